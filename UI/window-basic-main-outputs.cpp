@@ -870,6 +870,10 @@ bool SimpleOutput::ConfigureRecording(bool updateReplayBuffer)
 			"RecRBTime");
 	int rbSize = config_get_int(main->Config(), "SimpleOutput",
 			"RecRBSize");
+	bool rbUseDisk = config_get_bool(main->Config(), "SimpleOutput",
+			"RecRBUseDisk");
+	int rbSegment = config_get_int(main->Config(), "SimpleOutput",
+			"RecRBSegmentSec");
 
 	os_dir_t *dir = path ? os_opendir(path) : nullptr;
 
@@ -925,6 +929,8 @@ bool SimpleOutput::ConfigureRecording(bool updateReplayBuffer)
 		obs_data_set_int(settings, "max_time_sec", rbTime);
 		obs_data_set_int(settings, "max_size_mb",
 				usingRecordingPreset ? rbSize : 0);
+		obs_data_set_bool(settings, "use_disk_buffer", rbUseDisk);
+		obs_data_set_int(settings, "segment_sec", rbSegment);
 	} else {
 		obs_data_set_string(settings, ffmpegOutput ? "url" : "path",
 				strPath.c_str());
@@ -309,6 +309,8 @@ OBSBasicSettings::OBSBasicSettings(QWidget *parent)
 	HookWidget(ui->simpleReplayBuf,      CHECK_CHANGED,  OUTPUTS_CHANGED);
 	HookWidget(ui->simpleRBSecMax,       SCROLL_CHANGED, OUTPUTS_CHANGED);
 	HookWidget(ui->simpleRBMegsMax,      SCROLL_CHANGED, OUTPUTS_CHANGED);
+	HookWidget(ui->simpleRBUseDisk,      CHECK_CHANGED,  OUTPUTS_CHANGED);
+	HookWidget(ui->simpleRBSegmentSec,   SCROLL_CHANGED, OUTPUTS_CHANGED);
 	HookWidget(ui->advOutEncoder,        COMBO_CHANGED,  OUTPUTS_CHANGED);
 	HookWidget(ui->advOutUseRescale,     CHECK_CHANGED,  OUTPUTS_CHANGED);
 	HookWidget(ui->advOutRescale,        CBEDIT_CHANGED, OUTPUTS_CHANGED);
@@ -586,6 +588,8 @@ OBSBasicSettings::OBSBasicSettings(QWidget *parent)
 			this, SLOT(SimpleReplayBufferChanged()));
 	connect(ui->simpleRBSecMax, SIGNAL(valueChanged(int)),
 			this, SLOT(SimpleReplayBufferChanged()));
+	connect(ui->simpleRBUseDisk, SIGNAL(toggled(bool)),
+			this, SLOT(SimpleReplayBufferChanged()));
 	connect(ui->listWidget, SIGNAL(currentRowChanged(int)),
 			this, SLOT(SimpleRecordingEncoderChanged()));
 
@@ -1328,6 +1332,10 @@ void OBSBasicSettings::LoadSimpleOutputSettings()
 			"RecRBTime");
 	int rbSize = config_get_int(main->Config(), "SimpleOutput",
 			"RecRBSize");
+	bool rbUseDisk = config_get_bool(main->Config(), "SimpleOutput",
+			"RecRBUseDisk");
+	int rbSegment = config_get_int(main->Config(), "SimpleOutput",
+			"RecRBSegmentSec");
 
 	curPreset = preset;
 	curQSVPreset = qsvPreset;
@@ -1367,6 +1375,8 @@ void OBSBasicSettings::LoadSimpleOutputSettings()
 	ui->simpleReplayBuf->setChecked(replayBuf);
 	ui->simpleRBSecMax->setValue(rbTime);
 	ui->simpleRBMegsMax->setValue(rbSize);
+	ui->simpleRBUseDisk->setChecked(rbUseDisk);
+	ui->simpleRBSegmentSec->setValue(rbSegment);
 
 	SimpleStreamingEncoderChanged();
 }
@@ -2737,6 +2747,8 @@ void OBSBasicSettings::SaveOutputSettings()
 	SaveCheckBox(ui->simpleReplayBuf, "SimpleOutput", "RecRB");
 	SaveSpinBox(ui->simpleRBSecMax, "SimpleOutput", "RecRBTime");
 	SaveSpinBox(ui->simpleRBMegsMax, "SimpleOutput", "RecRBSize");
+	SaveCheckBox(ui->simpleRBUseDisk, "SimpleOutput", "RecRBUseDisk");
+	SaveSpinBox(ui->simpleRBSegmentSec, "SimpleOutput", "RecRBSegmentSec");
 
 	curAdvStreamEncoder = GetComboData(ui->advOutEncoder);
 
@@ -3695,8 +3707,12 @@ void OBSBasicSettings::SimpleReplayBufferChanged()
 	bool lossless = qual == "Lossless";
 	bool streamQuality = qual == "Stream";
 
+	bool useDisk = ui->simpleRBUseDisk->isChecked();
+
 	ui->simpleRBMegsMax->setVisible(!streamQuality);
 	ui->simpleRBMegsMaxLabel->setVisible(!streamQuality);
+	ui->simpleRBSegmentSec->setVisible(useDisk);
+	ui->simpleRBSegmentSecLabel->setVisible(useDisk);
 
 	int vbitrate = ui->simpleOutputVBitrate->value();
 	int abitrate = ui->simpleOutputABitrate->currentText().toInt();
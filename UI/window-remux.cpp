@@ -23,17 +23,18 @@
 #include <QFileDialog>
 #include <QFileInfo>
 #include <QMessageBox>
+#include <QThread>
 
 #include "qt-wrappers.hpp"
 
-#include <memory>
-#include <cmath>
+#include <algorithm>
 
 using namespace std;
 
+#define PROGRESS_INTERVAL_MS 100
+
 OBSRemux::OBSRemux(const char *path, QWidget *parent)
 	: QDialog (parent),
-	  worker  (new RemuxWorker),
 	  ui      (new Ui::OBSRemux),
 	  recPath (path)
 {
@@ -59,22 +60,19 @@ OBSRemux::OBSRemux(const char *path, QWidget *parent)
 	connect(ui->sourceFile, &QLineEdit::textChanged,
 			this, &OBSRemux::inputChanged);
 
-	worker->moveToThread(&remuxer);
-	remuxer.start();
+	/* remuxing is mostly bound by disk throughput, a couple of jobs at
+	 * a time is enough to keep it busy */
+	int jobs = min(max(QThread::idealThreadCount() / 2, 1), 4);
+	queue = media_remux_queue_create((size_t)jobs);
 
-	//gcc-4.8 can't use QPointer<RemuxWorker> below
-	RemuxWorker *worker_ = worker;
-	connect(worker_, &RemuxWorker::updateProgress,
+	progressTimer.setInterval(PROGRESS_INTERVAL_MS);
+	connect(&progressTimer, &QTimer::timeout,
 			this, &OBSRemux::updateProgress);
-	connect(&remuxer, &QThread::finished, worker_, &QObject::deleteLater);
-	connect(worker_, &RemuxWorker::remuxFinished,
-			this, &OBSRemux::remuxFinished);
-	connect(this, &OBSRemux::remux, worker_, &RemuxWorker::remux);
 }
 
 bool OBSRemux::Stop()
 {
-	if (!worker->job)
+	if (!running)
 		return true;
 
 	if (QMessageBox::critical(nullptr,
@@ -83,7 +81,11 @@ bool OBSRemux::Stop()
 				QMessageBox::Yes | QMessageBox::No,
 				QMessageBox::No) ==
 			QMessageBox::Yes) {
-		os_event_signal(worker->stop);
+		progressTimer.stop();
+		running = false;
+
+		media_remux_queue_cancel(queue);
+		media_remux_queue_wait(queue);
 		return true;
 	}
 
@@ -93,39 +95,62 @@ bool OBSRemux::Stop()
 OBSRemux::~OBSRemux()
 {
 	Stop();
-	remuxer.quit();
-	remuxer.wait();
+	media_remux_queue_destroy(queue);
 }
 
 #define RECORDING_PATTERN "(*.flv *.mp4 *.mov *.mkv *.ts *.m3u8)"
 
+static QString DefaultTarget(const QString &path)
+{
+	QFileInfo fi(path);
+	return fi.path() + "/" + fi.baseName() + ".mp4";
+}
+
 void OBSRemux::BrowseInput()
 {
 	QString path = ui->sourceFile->text();
-	if (path.isEmpty())
+	if (path.isEmpty() || inputFiles.size() > 1)
 		path = recPath;
 
-	path = QFileDialog::getOpenFileName(this,
+	QStringList paths = QFileDialog::getOpenFileNames(this,
 			QTStr("Remux.SelectRecording"), path,
 			QTStr("Remux.OBSRecording") + QString(" ") +
 			RECORDING_PATTERN);
 
-	inputChanged(path);
+	if (paths.size() <= 1) {
+		inputChanged(paths.value(0));
+		return;
+	}
+
+	/* several recordings are remuxed at once, each one next to its
+	 * source */
+	inputFiles = paths;
+
+	ui->sourceFile->blockSignals(true);
+	ui->sourceFile->setText(paths.join("; "));
+	ui->sourceFile->blockSignals(false);
+
+	ui->targetFile->setText(QTStr("Remux.TargetsNextToSources"));
+	ui->targetFile->setEnabled(false);
+	ui->browseTarget->setEnabled(false);
+	ui->remux->setEnabled(!running);
 }
 
 void OBSRemux::inputChanged(const QString &path)
 {
+	inputFiles.clear();
+
 	if (!QFileInfo::exists(path)) {
 		ui->remux->setEnabled(false);
 		return;
 	}
 
+	inputFiles << path;
+
 	ui->sourceFile->setText(path);
-	ui->remux->setEnabled(true);
+	ui->remux->setEnabled(!running);
 
-	QFileInfo fi(path);
-	QString mp4 = fi.path() + "/" + fi.baseName() + ".mp4";
-	ui->targetFile->setText(mp4);
+	ui->targetFile->setText(DefaultTarget(path));
 
 	ui->targetFile->setEnabled(true);
 	ui->browseTarget->setEnabled(true);
@@ -145,25 +170,43 @@ void OBSRemux::BrowseOutput()
 
 void OBSRemux::Remux()
 {
-	if (QFileInfo::exists(ui->targetFile->text()))
+	QStringList targets;
+	bool exists = false;
+
+	if (running || inputFiles.isEmpty())
+		return;
+
+	if (inputFiles.size() == 1) {
+		targets << ui->targetFile->text();
+	} else {
+		for (const QString &input : inputFiles)
+			targets << DefaultTarget(input);
+	}
+
+	for (const QString &target : targets)
+		exists = exists || QFileInfo::exists(target);
+
+	if (exists)
 		if (QMessageBox::question(this, QTStr("Remux.FileExistsTitle"),
 					QTStr("Remux.FileExists"),
 					QMessageBox::Yes | QMessageBox::No) !=
 				QMessageBox::Yes)
 			return;
 
-	media_remux_job_t mr_job = nullptr;
-	if (!media_remux_job_create(&mr_job, QT_TO_UTF8(ui->sourceFile->text()),
-				QT_TO_UTF8(ui->targetFile->text())))
-		return;
+	batchStart = media_remux_queue_count(queue);
+
+	for (int i = 0; i < inputFiles.size(); i++)
+		media_remux_queue_add(queue, QT_TO_UTF8(inputFiles[i]),
+				QT_TO_UTF8(targets[i]), nullptr, nullptr);
 
-	worker->job = job_t(mr_job, media_remux_job_destroy);
-	worker->lastProgress = 0.f;
+	batchEnd = media_remux_queue_count(queue);
+	running = true;
 
+	ui->progressBar->setValue(0);
 	ui->progressBar->setVisible(true);
 	ui->remux->setEnabled(false);
 
-	emit remux();
+	progressTimer.start();
 }
 
 void OBSRemux::closeEvent(QCloseEvent *event)
@@ -182,51 +225,66 @@ void OBSRemux::reject()
 	QDialog::reject();
 }
 
-void OBSRemux::updateProgress(float percent)
+/* jobs of a batch run concurrently, their progress is combined weighted by
+ * file size so that a short recording finishing first doesn't make the bar
+ * jump ahead */
+void OBSRemux::updateProgress()
 {
-	ui->progressBar->setValue(percent * 10);
-}
+	double total = 0.0;
+	double done = 0.0;
+	float percentSum = 0.0f;
+	bool finished = true;
+	bool success = true;
+	bool sized = true;
+
+	if (!running)
+		return;
 
-void OBSRemux::remuxFinished(bool success)
-{
-	QMessageBox::information(this, QTStr("Remux.FinishedTitle"),
-			success ?
-			QTStr("Remux.Finished") : QTStr("Remux.FinishedError"));
+	for (size_t idx = batchStart; idx < batchEnd; idx++) {
+		struct media_remux_progress progress = {};
 
-	worker->job.reset();
-	ui->progressBar->setVisible(false);
-	ui->remux->setEnabled(true);
-}
+		if (!media_remux_queue_get_progress(queue, idx, &progress))
+			continue;
 
-RemuxWorker::RemuxWorker()
-{
-	os_event_init(&stop, OS_EVENT_TYPE_MANUAL);
-}
+		if (!progress.finished)
+			finished = false;
+		else if (!progress.success)
+			success = false;
 
-RemuxWorker::~RemuxWorker()
-{
-	os_event_destroy(stop);
-}
+		float percent = progress.finished ? 100.0f : progress.percent;
+		percentSum += percent;
 
-void RemuxWorker::UpdateProgress(float percent)
-{
-	if (abs(lastProgress - percent) < 0.1f)
+		if (progress.total_bytes > 0) {
+			total += (double)progress.total_bytes;
+			done += (double)progress.total_bytes * percent / 100.0;
+		} else {
+			sized = false;
+		}
+	}
+
+	if (finished) {
+		remuxFinished(success);
 		return;
+	}
 
-	emit updateProgress(percent);
-	lastProgress = percent;
+	/* jobs that haven't been opened yet don't know their size */
+	double percent = sized && total > 0.0 ?
+		done * 100.0 / total :
+		percentSum / (float)(batchEnd - batchStart);
+	ui->progressBar->setValue((int)(percent * 10.0));
 }
 
-void RemuxWorker::remux()
+void OBSRemux::remuxFinished(bool success)
 {
-	auto callback = [](void *data, float percent)
-	{
-		auto rw = static_cast<RemuxWorker*>(data);
-		rw->UpdateProgress(percent);
-		return !!os_event_try(rw->stop);
-	};
+	progressTimer.stop();
+	running = false;
+
+	ui->progressBar->setValue(1000);
 
-	bool success = media_remux_job_process(job.get(), callback, this);
+	QMessageBox::information(this, QTStr("Remux.FinishedTitle"),
+			success ?
+			QTStr("Remux.Finished") : QTStr("Remux.FinishedError"));
 
-	emit remuxFinished(os_event_try(stop) && success);
+	ui->progressBar->setVisible(false);
+	ui->remux->setEnabled(!inputFiles.isEmpty());
 }
@@ -17,21 +17,25 @@
 
 #pragma once
 
-#include <QPointer>
-#include <QThread>
+#include <QStringList>
+#include <QTimer>
 #include <memory>
 #include "ui_OBSRemux.h"
 
 #include <media-io/media-remux.h>
-#include <util/threading.h>
-
-class RemuxWorker;
 
 class OBSRemux : public QDialog {
 	Q_OBJECT
 
-	QThread remuxer;
-	QPointer<RemuxWorker> worker;
+	media_remux_queue_t *queue = nullptr;
+	QTimer progressTimer;
+
+	/* jobs of the current batch are [batchStart, batchEnd) in the queue */
+	size_t batchStart = 0;
+	size_t batchEnd = 0;
+	bool running = false;
+
+	QStringList inputFiles;
 
 	std::unique_ptr<Ui::OBSRemux> ui;
 
@@ -50,37 +54,10 @@ public:
 	explicit OBSRemux(const char *recPath, QWidget *parent = nullptr);
 	virtual ~OBSRemux() override;
 
-	using job_t = std::shared_ptr<struct media_remux_job>;
-
 private slots:
 	void inputChanged(const QString &str);
 
 public slots:
-	void updateProgress(float percent);
-	void remuxFinished(bool success);
-
-signals:
-	void remux();
-};
-
-class RemuxWorker : public QObject {
-	Q_OBJECT
-
-	OBSRemux::job_t job;
-	os_event_t *stop;
-
-	float lastProgress;
-	void UpdateProgress(float percent);
-
-	explicit RemuxWorker();
-	virtual ~RemuxWorker();
-
-private slots:
-	void remux();
-
-signals:
-	void updateProgress(float percent);
+	void updateProgress();
 	void remuxFinished(bool success);
-
-	friend class OBSRemux;
 };
@@ -48,6 +48,8 @@ static void queue_wait(struct ff_circular_queue *cq)
 bool ff_circular_queue_init(struct ff_circular_queue *cq, int item_size,
 		int capacity)
 {
+	int i;
+
 	memset(cq, 0, sizeof(struct ff_circular_queue));
 
 	cq->item_size = item_size;
@@ -59,6 +61,13 @@ bool ff_circular_queue_init(struct ff_circular_queue *cq, int item_size,
 	if (cq->slots == NULL)
 		goto fail;
 
+	/* allocate every slot up front so the decode and refresh threads
+	 * never allocate while handing frames over */
+	for (i = 0; i < capacity; i++) {
+		if (queue_fetch_or_alloc(cq, i) == NULL)
+			goto fail1;
+	}
+
 	cq->size = 0;
 	cq->write_index = 0;
 	cq->read_index = 0;
@@ -74,6 +83,8 @@ bool ff_circular_queue_init(struct ff_circular_queue *cq, int item_size,
 fail2:
 	pthread_mutex_destroy(&cq->mutex);
 fail1:
+	for (i = 0; i < capacity; i++)
+		av_free(cq->slots[i]);
 	av_free(cq->slots);
 fail:
 	return false;
@@ -132,8 +143,9 @@ void ff_circular_queue_advance_read(struct ff_circular_queue *cq)
 {
 	cq->read_index = (cq->read_index + 1) % cq->capacity;
 	queue_lock(cq);
-	--cq->size;
-	queue_signal(cq);
+	/* the writer only waits while the queue is full */
+	if (cq->size-- == cq->capacity)
+		queue_signal(cq);
 	queue_unlock(cq);
 }
 
@@ -26,4 +26,5 @@ static inline int av_dup_packet_2(AVPacket *pkt)
 	return ret;
 }
 #define av_dup_packet av_dup_packet_2
+#define av_copy_packet av_packet_ref
 #endif
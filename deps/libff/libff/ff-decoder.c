@@ -122,7 +122,7 @@ void ff_decoder_free(struct ff_decoder *decoder)
 
 		if (frame != NULL) {
 			if (frame->frame != NULL)
-				av_frame_unref(frame->frame);
+				av_frame_free(&frame->frame);
 			if (frame->clock != NULL)
 				ff_clock_release(&frame->clock);
 			av_free(frame);
@@ -281,7 +281,7 @@ void ff_decoder_refresh(void *opaque)
 					(int)(delay_until_next_wake * 1000
 						+ 0.5L));
 
-			av_frame_free(&frame->frame);
+			av_frame_unref(frame->frame);
 
 			ff_circular_queue_advance_read(&decoder->frame_queue);
 		}
@@ -292,10 +292,24 @@ void ff_decoder_refresh(void *opaque)
 
 bool ff_decoder_full(struct ff_decoder *decoder)
 {
+	struct ff_packet_queue *q;
+	int64_t queued_ms;
+
 	if (decoder == NULL)
 		return false;
 
-	return (decoder->packet_queue.total_size > decoder->packet_queue_size);
+	q = &decoder->packet_queue;
+	if (q->total_size > decoder->packet_queue_size)
+		return true;
+
+	/* the byte limit alone lets low bitrate streams queue up far more
+	 * time than needed, so the queued duration is limited as well */
+	if (decoder->packet_queue_ms <= 0)
+		return false;
+
+	queued_ms = av_rescale_q(q->total_duration, decoder->stream->time_base,
+			(AVRational){1, 1000});
+	return queued_ms > decoder->packet_queue_ms;
 }
 
 bool ff_decoder_accept(struct ff_decoder *decoder, struct ff_packet *packet)
@@ -39,6 +39,7 @@ struct ff_decoder {
 	struct ff_packet_queue packet_queue;
 	struct ff_circular_queue frame_queue;
 	unsigned int packet_queue_size;
+	int packet_queue_ms;
 
 	double timer_next_wake;
 	double previous_pts;       // previous decoded frame's pts
@@ -17,6 +17,7 @@
 #include "ff-demuxer.h"
 
 #include <libavutil/avstring.h>
+#include <libavutil/imgutils.h>
 #include <libavutil/time.h>
 #include <libavdevice/avdevice.h>
 #include <libavfilter/avfilter.h>
@@ -32,6 +33,9 @@
 
 #define AUDIO_PACKET_QUEUE_SIZE (5 * 16 * 1024)
 #define VIDEO_PACKET_QUEUE_SIZE (5 * 256 * 1024)
+#define PACKET_QUEUE_MS 5000
+
+#define MAX_PREROLL_SIZE (32 * 1024 * 1024)
 
 static void *demux_thread(void *opaque_demuxer);
 
@@ -54,6 +58,11 @@ struct ff_demuxer *ff_demuxer_init()
 	demuxer->options.video_frame_queue_size = VIDEO_FRAME_QUEUE_SIZE;
 	demuxer->options.audio_packet_queue_size = AUDIO_PACKET_QUEUE_SIZE;
 	demuxer->options.video_packet_queue_size = VIDEO_PACKET_QUEUE_SIZE;
+	demuxer->options.packet_queue_ms = PACKET_QUEUE_MS;
+	demuxer->options.video_frame_queue_bytes = 0;
+	demuxer->options.video_thread_count = 0;
+	demuxer->options.is_frame_threading = true;
+	demuxer->options.is_slice_threading = true;
 	demuxer->options.is_hw_decoding = false;
 
 	return demuxer;
@@ -76,6 +85,7 @@ bool ff_demuxer_open(struct ff_demuxer *demuxer, char *input,
 void ff_demuxer_free(struct ff_demuxer *demuxer)
 {
 	void *demuxer_thread_result;
+	int i;
 
 	demuxer->abort = true;
 
@@ -96,9 +106,27 @@ void ff_demuxer_free(struct ff_demuxer *demuxer)
 	if (demuxer->format_context)
 		avformat_close_input(&demuxer->format_context);
 
+	for (i = 0; i < demuxer->preroll_count; i++)
+		av_free_packet(&demuxer->preroll_packets[i]);
+	av_free(demuxer->preroll_packets);
+	av_free(demuxer->preroll_end);
+	av_free(demuxer->preroll_caught_up);
+
 	av_free(demuxer);
 }
 
+void ff_demuxer_pause(struct ff_demuxer *demuxer)
+{
+	demuxer->paused = true;
+	ff_demuxer_flush(demuxer);
+}
+
+void ff_demuxer_restart(struct ff_demuxer *demuxer)
+{
+	demuxer->restart_request = true;
+	demuxer->paused = false;
+}
+
 void ff_demuxer_set_callbacks(struct ff_callbacks *callbacks,
 		ff_callback_frame frame,
 		ff_callback_format format,
@@ -186,6 +214,28 @@ enum AVPixelFormat get_hwaccel_format(struct AVCodecContext *s,
 	return AV_PIX_FMT_YUV420P;
 }
 
+/* limits the number of decoded frames buffered ahead to the byte budget */
+static int video_frame_queue_size(struct ff_demuxer *demuxer,
+		AVCodecContext *codec_context)
+{
+	int frames = demuxer->options.video_frame_queue_size;
+	int64_t budget = demuxer->options.video_frame_queue_bytes;
+	int frame_size;
+
+	if (budget <= 0)
+		return frames;
+
+	frame_size = av_image_get_buffer_size(codec_context->pix_fmt,
+			codec_context->width, codec_context->height, 1);
+	if (frame_size <= 0)
+		return frames;
+
+	if ((int64_t)frames > budget / frame_size)
+		frames = (int)(budget / frame_size);
+
+	return frames > 0 ? frames : 1;
+}
+
 static bool initialize_decoder(struct ff_demuxer *demuxer,
 		AVCodecContext *codec_context, AVStream *stream,
 		bool hwaccel_decoder)
@@ -198,6 +248,8 @@ static bool initialize_decoder(struct ff_demuxer *demuxer,
 				demuxer->options.audio_frame_queue_size);
 
 		demuxer->audio_decoder->hwaccel_decoder = hwaccel_decoder;
+		demuxer->audio_decoder->packet_queue_ms =
+				demuxer->options.packet_queue_ms;
 		demuxer->audio_decoder->frame_drop =
 				demuxer->options.frame_drop;
 		demuxer->audio_decoder->natural_sync_clock =
@@ -218,9 +270,11 @@ static bool initialize_decoder(struct ff_demuxer *demuxer,
 		demuxer->video_decoder = ff_decoder_init(
 				codec_context, stream,
 				demuxer->options.video_packet_queue_size,
-				demuxer->options.video_frame_queue_size);
+				video_frame_queue_size(demuxer, codec_context));
 
 		demuxer->video_decoder->hwaccel_decoder = hwaccel_decoder;
+		demuxer->video_decoder->packet_queue_ms =
+				demuxer->options.packet_queue_ms;
 		demuxer->video_decoder->frame_drop =
 				demuxer->options.frame_drop;
 		demuxer->video_decoder->natural_sync_clock =
@@ -257,6 +311,20 @@ static bool find_decoder(struct ff_demuxer *demuxer, AVStream *stream)
 	// > 1
 	codec_context->refcounted_frames = 1;
 
+	// the codec context defaults to a single thread, 0 lets libavcodec
+	// pick one thread per core.  audio decoders keep their defaults.
+	if (codec_context->codec_type == AVMEDIA_TYPE_VIDEO) {
+		codec_context->thread_count =
+			demuxer->options.video_thread_count;
+		codec_context->thread_type = 0;
+		if (demuxer->options.is_frame_threading)
+			codec_context->thread_type |= FF_THREAD_FRAME;
+		if (demuxer->options.is_slice_threading)
+			codec_context->thread_type |= FF_THREAD_SLICE;
+		if (!codec_context->thread_type)
+			codec_context->thread_count = 1;
+	}
+
 	// png/tiff decoders have serious issues with multiple threads
 	if (codec_context->codec_id == AV_CODEC_ID_PNG
 			|| codec_context->codec_id == AV_CODEC_ID_TIFF
@@ -493,6 +561,8 @@ static bool find_and_initialize_stream_decoders(struct ff_demuxer *demuxer)
 	return set_clock_sync_type(demuxer);
 }
 
+static void preroll_finish(struct ff_demuxer *demuxer);
+
 static bool handle_seek(struct ff_demuxer *demuxer)
 {
 	int ret;
@@ -527,10 +597,21 @@ static bool handle_seek(struct ff_demuxer *demuxer)
 		} else {
 			if (demuxer->seek_flush)
 				ff_demuxer_flush(demuxer);
-			ff_demuxer_reset(demuxer);
+			if (!demuxer->seek_keep_clock)
+				ff_demuxer_reset(demuxer);
+		}
+
+		/* the pre-roll only lines up with a restart from the
+		 * beginning, anything else ends caching and skipping */
+		if (!demuxer->seek_loop) {
+			if (!demuxer->preroll_complete)
+				preroll_finish(demuxer);
+			demuxer->preroll_skipping = 0;
 		}
 
 		demuxer->seek_request = false;
+		demuxer->seek_keep_clock = false;
+		demuxer->seek_loop = false;
 	}
 	return true;
 }
@@ -546,9 +627,221 @@ static void seek_beginning(struct ff_demuxer *demuxer)
 	}
 	demuxer->seek_request = true;
 	demuxer->seek_flush = false;
+	demuxer->seek_loop = true;
 	av_log(NULL, AV_LOG_VERBOSE, "looping media %s", demuxer->input);
 }
 
+/* ------------------------------------------------------------------------- */
+/* Loop pre-roll
+ *
+ * The packets at the start of the file are kept while it plays the first
+ * time.  When a looping file reaches the end, they are handed straight to
+ * the decoders and the file is seeked back to the start in the meantime.
+ * Packets that were already served from the cache are then skipped, so the
+ * decoders see one continuous stream and never wait on the seek. */
+
+static inline int64_t packet_time_ms(struct ff_demuxer *demuxer,
+		AVPacket *packet)
+{
+	AVStream *stream =
+		demuxer->format_context->streams[packet->stream_index];
+	int64_t ts = packet->dts != AV_NOPTS_VALUE ? packet->dts : packet->pts;
+	int64_t start = stream->start_time != AV_NOPTS_VALUE ?
+		stream->start_time : 0;
+
+	if (ts == AV_NOPTS_VALUE)
+		return 0;
+
+	return av_rescale_q(ts - start, stream->time_base,
+			(AVRational){1, 1000});
+}
+
+static inline int video_index(struct ff_demuxer *demuxer)
+{
+	return demuxer->video_decoder ?
+		demuxer->video_decoder->stream->index : -1;
+}
+
+static inline int audio_index(struct ff_demuxer *demuxer)
+{
+	return demuxer->audio_decoder ?
+		demuxer->audio_decoder->stream->index : -1;
+}
+
+static inline bool preroll_enabled(struct ff_demuxer *demuxer)
+{
+	return demuxer->options.is_looping && demuxer->options.preroll_ms > 0;
+}
+
+static void preroll_finish(struct ff_demuxer *demuxer)
+{
+	demuxer->preroll_complete = true;
+
+	if (demuxer->preroll_count)
+		av_log(NULL, AV_LOG_VERBOSE, "cached %d packets (%d bytes) "
+				"of pre-roll for %s",
+				demuxer->preroll_count, demuxer->preroll_size,
+				demuxer->input);
+}
+
+static void preroll_add(struct ff_demuxer *demuxer, AVPacket *packet)
+{
+	AVPacket *copy;
+
+	if (demuxer->preroll_complete || !preroll_enabled(demuxer))
+		return;
+
+	if (packet_time_ms(demuxer, packet) > demuxer->options.preroll_ms ||
+	    demuxer->preroll_size + packet->size > MAX_PREROLL_SIZE) {
+		preroll_finish(demuxer);
+		return;
+	}
+
+	if (!demuxer->preroll_end) {
+		unsigned int i, count = demuxer->format_context->nb_streams;
+
+		demuxer->preroll_end = av_malloc(count * sizeof(int64_t));
+		demuxer->preroll_caught_up = av_mallocz(count * sizeof(bool));
+		if (!demuxer->preroll_end || !demuxer->preroll_caught_up) {
+			av_freep(&demuxer->preroll_end);
+			av_freep(&demuxer->preroll_caught_up);
+			preroll_finish(demuxer);
+			return;
+		}
+		for (i = 0; i < count; i++)
+			demuxer->preroll_end[i] = AV_NOPTS_VALUE;
+	}
+
+	if (demuxer->preroll_count == demuxer->preroll_capacity) {
+		int capacity = demuxer->preroll_capacity ?
+			demuxer->preroll_capacity * 2 : 64;
+		AVPacket *packets = av_realloc(demuxer->preroll_packets,
+				capacity * sizeof(AVPacket));
+		if (!packets) {
+			preroll_finish(demuxer);
+			return;
+		}
+
+		demuxer->preroll_packets = packets;
+		demuxer->preroll_capacity = capacity;
+	}
+
+	copy = &demuxer->preroll_packets[demuxer->preroll_count];
+	av_init_packet(copy);
+	if (av_copy_packet(copy, packet) < 0) {
+		preroll_finish(demuxer);
+		return;
+	}
+
+	demuxer->preroll_count++;
+	demuxer->preroll_size += packet->size;
+	demuxer->preroll_end[packet->stream_index] =
+		packet->dts != AV_NOPTS_VALUE ? packet->dts : packet->pts;
+}
+
+/* hands the decoder all of its cached packets at once, so the whole pre-roll
+ * costs one lock and one wakeup rather than one per packet */
+static void preroll_queue(struct ff_demuxer *demuxer,
+		struct ff_decoder *decoder, struct ff_packet *batch)
+{
+	int count = 0;
+	int j;
+
+	if (decoder == NULL)
+		return;
+
+	for (j = 0; j < demuxer->preroll_count; j++) {
+		AVPacket *cached = &demuxer->preroll_packets[j];
+		struct ff_packet *packet = &batch[count];
+
+		if (cached->stream_index != decoder->stream->index)
+			continue;
+
+		memset(packet, 0, sizeof(*packet));
+		av_init_packet(&packet->base);
+		if (av_copy_packet(&packet->base, cached) < 0)
+			continue;
+
+		count++;
+	}
+
+	if (count && packet_queue_put_batch(&decoder->packet_queue, batch,
+				count) == FF_PACKET_FAIL) {
+		for (j = 0; j < count; j++)
+			av_free_packet(&batch[j].base);
+	}
+}
+
+static bool preroll_restart(struct ff_demuxer *demuxer)
+{
+	struct ff_packet *batch;
+	unsigned int i;
+
+	if (!demuxer->preroll_complete || !demuxer->preroll_count)
+		return false;
+
+	batch = av_malloc(demuxer->preroll_count * sizeof(struct ff_packet));
+	if (batch == NULL)
+		return false;
+
+	ff_demuxer_reset(demuxer);
+
+	preroll_queue(demuxer, demuxer->video_decoder, batch);
+	preroll_queue(demuxer, demuxer->audio_decoder, batch);
+	av_free(batch);
+
+	demuxer->preroll_skipping = 0;
+	for (i = 0; i < demuxer->format_context->nb_streams; i++) {
+		bool cached = demuxer->preroll_end[i] != AV_NOPTS_VALUE;
+
+		demuxer->preroll_caught_up[i] = !cached;
+		if (cached)
+			demuxer->preroll_skipping++;
+	}
+
+	/* the clock was already reset ahead of the cached packets */
+	seek_beginning(demuxer);
+	demuxer->seek_keep_clock = true;
+	return true;
+}
+
+/* drops the packets after the seek that were already served from cache */
+static bool preroll_skip(struct ff_demuxer *demuxer, AVPacket *packet)
+{
+	int idx = packet->stream_index;
+	int64_t ts;
+
+	if (!demuxer->preroll_skipping || demuxer->preroll_caught_up[idx])
+		return false;
+
+	ts = packet->dts != AV_NOPTS_VALUE ? packet->dts : packet->pts;
+	if (ts == AV_NOPTS_VALUE || ts <= demuxer->preroll_end[idx])
+		return true;
+
+	/* stream has caught up, stop checking it until the next loop */
+	demuxer->preroll_caught_up[idx] = true;
+	demuxer->preroll_skipping--;
+	return false;
+}
+
+/* restarts playback from the beginning, out of the pre-roll cache if there
+ * is one, dropping whatever is still queued from before */
+static void handle_restart(struct ff_demuxer *demuxer)
+{
+	demuxer->restart_request = false;
+
+	ff_demuxer_flush(demuxer);
+	if (preroll_restart(demuxer))
+		return;
+
+	/* a partial cache is still a valid start of the file, but it must
+	 * not be added to again once the file is read from the start */
+	if (!demuxer->preroll_complete)
+		preroll_finish(demuxer);
+
+	seek_beginning(demuxer);
+}
+
 static void *demux_thread(void *opaque)
 {
 	struct ff_demuxer *demuxer = (struct ff_demuxer *) opaque;
@@ -571,6 +864,16 @@ static void *demux_thread(void *opaque)
 		if (!handle_seek(demuxer))
 			break;
 
+		if (demuxer->restart_request) {
+			handle_restart(demuxer);
+			continue;
+		}
+
+		if (demuxer->paused) {
+			av_usleep(10 * 1000); // 10ms
+			continue;
+		}
+
 		if (ff_decoder_full(demuxer->audio_decoder) ||
 		    ff_decoder_full(demuxer->video_decoder)) {
 			av_usleep(10 * 1000); // 10ms
@@ -596,7 +899,10 @@ static void *demux_thread(void *opaque)
 
 			if (eof) {
 				if (demuxer->options.is_looping) {
-					seek_beginning(demuxer);
+					if (!demuxer->preroll_complete)
+						preroll_finish(demuxer);
+					if (!preroll_restart(demuxer))
+						seek_beginning(demuxer);
 				} else {
 					break;
 				}
@@ -609,6 +915,15 @@ static void *demux_thread(void *opaque)
 			}
 		}
 
+		if (preroll_skip(demuxer, &packet.base)) {
+			av_free_packet(&packet.base);
+			continue;
+		}
+
+		if (packet.base.stream_index == video_index(demuxer) ||
+		    packet.base.stream_index == audio_index(demuxer))
+			preroll_add(demuxer, &packet.base);
+
 		if (ff_decoder_accept(demuxer->video_decoder, &packet))
 			continue;
 		else if (ff_decoder_accept(demuxer->audio_decoder, &packet))
@@ -35,10 +35,16 @@ struct ff_demuxer_options
 {
 	int audio_packet_queue_size;
 	int video_packet_queue_size;
+	int packet_queue_ms;
 	int audio_frame_queue_size;
 	int video_frame_queue_size;
+	int64_t video_frame_queue_bytes;
+	int video_thread_count;
+	bool is_frame_threading;
+	bool is_slice_threading;
 	bool is_hw_decoding;
 	bool is_looping;
+	int preroll_ms;
 	enum AVDiscard frame_drop;
 	AVDictionary *custom_options;
 };
@@ -61,11 +67,24 @@ struct ff_demuxer {
 
 	pthread_t demuxer_thread;
 
+	AVPacket *preroll_packets;
+	int preroll_count;
+	int preroll_capacity;
+	int preroll_size;
+	bool preroll_complete;
+	int64_t *preroll_end;
+	bool *preroll_caught_up;
+	int preroll_skipping;
+
 	int64_t seek_pos;
 	bool seek_request;
 	int seek_flags;
 	bool seek_flush;
+	bool seek_keep_clock;
+	bool seek_loop;
 
+	bool restart_request;
+	bool paused;
 	bool abort;
 
 	char *input;
@@ -88,6 +107,11 @@ void ff_demuxer_set_callbacks(struct ff_callbacks *callbacks,
 
 void ff_demuxer_flush(struct ff_demuxer *demuxer);
 
+/* stops reading until ff_demuxer_restart, which plays the input again from
+ * the beginning, out of the loop pre-roll cache when there is one */
+void ff_demuxer_pause(struct ff_demuxer *demuxer);
+void ff_demuxer_restart(struct ff_demuxer *demuxer);
+
 #ifdef __cplusplus
 }
 #endif
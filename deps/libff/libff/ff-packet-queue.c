@@ -17,23 +17,36 @@
 #include "ff-packet-queue.h"
 #include "ff-compat.h"
 
+/* packets are kept in a ring that only grows, so once a stream has
+ * reached its working size no memory is allocated per packet */
+#define FF_PACKET_QUEUE_INITIAL_CAPACITY 256
+
 bool packet_queue_init(struct ff_packet_queue *q)
 {
 	memset(q, 0, sizeof(struct ff_packet_queue));
 
-	if (pthread_mutex_init(&q->mutex, NULL) != 0)
+	q->packets = av_malloc(FF_PACKET_QUEUE_INITIAL_CAPACITY *
+			sizeof(struct ff_packet));
+	if (q->packets == NULL)
 		goto fail;
 
-	if (pthread_cond_init(&q->cond, NULL) != 0)
+	q->capacity = FF_PACKET_QUEUE_INITIAL_CAPACITY;
+
+	if (pthread_mutex_init(&q->mutex, NULL) != 0)
 		goto fail1;
 
+	if (pthread_cond_init(&q->cond, NULL) != 0)
+		goto fail2;
+
 	av_init_packet(&q->flush_packet.base);
 	q->flush_packet.base.data = (uint8_t *)"FLUSH";
 
 	return true;
 
-fail1:
+fail2:
 	pthread_mutex_destroy(&q->mutex);
+fail1:
+	av_freep(&q->packets);
 fail:
 	return false;
 
@@ -54,66 +67,106 @@ void packet_queue_free(struct ff_packet_queue *q)
 	pthread_mutex_destroy(&q->mutex);
 	pthread_cond_destroy(&q->cond);
 
+	av_freep(&q->packets);
 	av_free_packet(&q->flush_packet.base);
 }
 
-int packet_queue_put(struct ff_packet_queue *q, struct ff_packet *packet)
+static bool packet_queue_grow(struct ff_packet_queue *q, int min_capacity)
 {
-	struct ff_packet_list *new_packet;
-
-	new_packet = av_malloc(sizeof(struct ff_packet_list));
+	int new_capacity = q->capacity * 2;
+	struct ff_packet *packets;
+	int tail;
+
+	while (new_capacity < min_capacity)
+		new_capacity *= 2;
+
+	packets = av_realloc(q->packets,
+			new_capacity * sizeof(struct ff_packet));
+	if (packets == NULL)
+		return false;
+
+	/* unwrap the packets that wrapped around to the start of the ring */
+	tail = q->read_index + q->count - q->capacity;
+	if (tail > 0)
+		memcpy(packets + q->capacity, packets,
+				tail * sizeof(struct ff_packet));
+
+	q->packets = packets;
+	q->capacity = new_capacity;
+	return true;
+}
 
-	if (new_packet == NULL)
-		return FF_PACKET_FAIL;
+static inline int64_t packet_duration(const struct ff_packet *packet)
+{
+	return packet->base.duration > 0 ? packet->base.duration : 0;
+}
 
-	new_packet->packet = *packet;
-	new_packet->next = NULL;
+int packet_queue_put_batch(struct ff_packet_queue *q,
+		struct ff_packet *packets, int count)
+{
+	bool was_empty;
 
 	pthread_mutex_lock(&q->mutex);
 
-	if (q->last_packet == NULL)
-		q->first_packet = new_packet;
-	else
-		q->last_packet->next = new_packet;
+	if (q->count + count > q->capacity &&
+	    !packet_queue_grow(q, q->count + count)) {
+		pthread_mutex_unlock(&q->mutex);
+		return FF_PACKET_FAIL;
+	}
 
-	q->last_packet = new_packet;
+	was_empty = q->count == 0;
 
-	q->count++;
-	q->total_size += new_packet->packet.base.size;
+	for (int i = 0; i < count; i++) {
+		int write_index = (q->read_index + q->count) % q->capacity;
+		q->packets[write_index] = packets[i];
 
-	pthread_cond_signal(&q->cond);
+		q->count++;
+		q->total_size += packets[i].base.size;
+		q->total_duration += packet_duration(&packets[i]);
+	}
+
+	/* the reader only ever waits on an empty queue */
+	if (was_empty && q->count > 0)
+		pthread_cond_signal(&q->cond);
 	pthread_mutex_unlock(&q->mutex);
 
 	return FF_PACKET_SUCCESS;
 }
 
+int packet_queue_put(struct ff_packet_queue *q, struct ff_packet *packet)
+{
+	return packet_queue_put_batch(q, packet, 1);
+}
+
 int packet_queue_put_flush_packet(struct ff_packet_queue *q)
 {
 	return packet_queue_put(q, &q->flush_packet);
 }
 
-int packet_queue_get(struct ff_packet_queue *q, struct ff_packet *packet,
-		bool block)
+/* returns the number of packets taken, FF_PACKET_EMPTY or FF_PACKET_FAIL */
+int packet_queue_get_batch(struct ff_packet_queue *q,
+		struct ff_packet *packets, int max_count, bool block)
 {
-	struct ff_packet_list *potential_packet;
 	int return_status;
 
 	pthread_mutex_lock(&q->mutex);
 
 	while (true) {
-		potential_packet = q->first_packet;
+		if (q->count > 0) {
+			int count = q->count < max_count ? q->count : max_count;
 
-		if (potential_packet != NULL) {
-			q->first_packet = potential_packet->next;
+			for (int i = 0; i < count; i++) {
+				packets[i] = q->packets[q->read_index];
+				q->read_index = (q->read_index + 1) %
+					q->capacity;
 
-			if (q->first_packet == NULL)
-				q->last_packet = NULL;
+				q->total_size -= packets[i].base.size;
+				q->total_duration -=
+					packet_duration(&packets[i]);
+			}
 
-			q->count--;
-			q->total_size -= potential_packet->packet.base.size;
-			*packet = potential_packet->packet;
-			av_free(potential_packet);
-			return_status = FF_PACKET_SUCCESS;
+			q->count -= count;
+			return_status = count;
 			break;
 
 		} else if (!block) {
@@ -134,24 +187,30 @@ int packet_queue_get(struct ff_packet_queue *q, struct ff_packet *packet,
 	return return_status;
 }
 
-void packet_queue_flush(struct ff_packet_queue *q)
+int packet_queue_get(struct ff_packet_queue *q, struct ff_packet *packet,
+		bool block)
 {
-	struct ff_packet_list *packet;
+	return packet_queue_get_batch(q, packet, 1, block);
+}
 
+void packet_queue_flush(struct ff_packet_queue *q)
+{
 	pthread_mutex_lock(&q->mutex);
 
-	for (packet = q->first_packet; packet != NULL;
-			packet = q->first_packet) {
-		q->first_packet = packet->next;
-		av_free_packet(&packet->packet.base);
-		if (packet->packet.clock != NULL)
-			ff_clock_release(&packet->packet.clock);
-		av_freep(&packet);
+	while (q->count > 0) {
+		struct ff_packet *packet = &q->packets[q->read_index];
+
+		av_free_packet(&packet->base);
+		if (packet->clock != NULL)
+			ff_clock_release(&packet->clock);
+
+		q->read_index = (q->read_index + 1) % q->capacity;
+		q->count--;
 	}
 
-	q->last_packet = q->first_packet = NULL;
-	q->count = 0;
+	q->read_index = 0;
 	q->total_size = 0;
+	q->total_duration = 0;
 
 	pthread_mutex_unlock(&q->mutex);
 }
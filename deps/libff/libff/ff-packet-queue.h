@@ -35,19 +35,16 @@ struct ff_packet {
 	ff_clock_t *clock;
 };
 
-struct ff_packet_list {
-    struct ff_packet packet;
-    struct ff_packet_list *next;
-};
-
 struct ff_packet_queue {
-	struct ff_packet_list *first_packet;
-	struct ff_packet_list *last_packet;
+	struct ff_packet *packets;
+	int capacity;
+	int read_index;
 	pthread_mutex_t mutex;
 	pthread_cond_t cond;
 	struct ff_packet flush_packet;
 	int count;
 	unsigned int total_size;
+	int64_t total_duration;
 	bool abort;
 };
 
@@ -57,9 +54,13 @@ bool packet_queue_init(struct ff_packet_queue *q);
 void packet_queue_abort(struct ff_packet_queue *q);
 void packet_queue_free(struct ff_packet_queue *q);
 int packet_queue_put(struct ff_packet_queue *q, struct ff_packet *packet);
+int packet_queue_put_batch(struct ff_packet_queue *q,
+		struct ff_packet *packets, int count);
 int packet_queue_put_flush_packet(struct ff_packet_queue *q);
 int packet_queue_get(struct ff_packet_queue *q, struct ff_packet *packet,
 		bool block);
+int packet_queue_get_batch(struct ff_packet_queue *q,
+		struct ff_packet *packets, int max_count, bool block);
 
 void packet_queue_flush(struct ff_packet_queue *q);
 
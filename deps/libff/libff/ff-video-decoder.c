@@ -51,13 +51,18 @@ static bool queue_frame(struct ff_decoder *decoder, AVFrame *frame,
 			|| queue_frame->frame->height != codec->height
 			|| queue_frame->frame->format != codec->pix_fmt);
 
-	if (queue_frame->frame != NULL) {
-		// This shouldn't happen any more, the frames are freed in
-		// ff_decoder_refresh.
-		av_frame_free(&queue_frame->frame);
-	}
+	// The slot keeps its AVFrame between uses, ff_decoder_refresh only
+	// drops the reference, so the decoded buffers are handed over by
+	// moving the reference without allocating or copying anything.
+	if (queue_frame->frame == NULL)
+		queue_frame->frame = av_frame_alloc();
+	else
+		av_frame_unref(queue_frame->frame);
+
+	if (queue_frame->frame == NULL)
+		return false;
 
-	queue_frame->frame = av_frame_clone(frame);
+	av_frame_move_ref(queue_frame->frame, frame);
 	queue_frame->clock = ff_clock_retain(decoder->clock);
 
 	if (call_initialize)
@@ -133,8 +138,8 @@ void *ff_video_decoder_thread(void *opaque_video_decoder)
 			double best_effort_pts =
 				ff_decoder_get_best_effort_pts(decoder, frame);
 
-			queue_frame(decoder, frame, best_effort_pts);
-			av_frame_unref(frame);
+			if (!queue_frame(decoder, frame, best_effort_pts))
+				av_frame_unref(frame);
 		}
 
 		av_free_packet(&packet.base);
@@ -226,6 +226,46 @@ failed:
 	blog(LOG_ERROR, "gs_texture_unmap (GL) failed");
 }
 
+bool gs_texture_set_image_rect(gs_texture_t *tex, uint32_t x, uint32_t y,
+		uint32_t width, uint32_t height, const uint8_t *data,
+		uint32_t linesize)
+{
+	struct gs_texture_2d *tex2d = (struct gs_texture_2d*)tex;
+	uint32_t pixel_size;
+	bool success = true;
+
+	if (!is_texture_2d(tex, "gs_texture_set_image_rect"))
+		return false;
+
+	if (gs_is_compressed_format(tex->format))
+		return false;
+
+	pixel_size = gs_get_format_bpp(tex->format) / 8;
+	if (!pixel_size || linesize % pixel_size != 0)
+		return false;
+
+	if (!gl_bind_texture(GL_TEXTURE_2D, tex2d->base.texture))
+		return false;
+
+	glPixelStorei(GL_UNPACK_ROW_LENGTH, linesize / pixel_size);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+	glTexSubImage2D(GL_TEXTURE_2D, 0, x, y, width, height,
+			tex->gl_format, tex->gl_type, data);
+	if (!gl_success("glTexSubImage2D"))
+		success = false;
+
+	glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+	if (!gl_bind_texture(GL_TEXTURE_2D, 0))
+		success = false;
+
+	if (!success)
+		blog(LOG_ERROR, "gs_texture_set_image_rect (GL) failed");
+	return success;
+}
+
 bool gs_texture_is_rect(const gs_texture_t *tex)
 {
 	const struct gs_texture_2d *tex2d = (const struct gs_texture_2d*)tex;
@@ -65,8 +65,10 @@ static inline const char *cd_serialize_string(uint8_t **pos)
 	return (size != 0) ? str : NULL;
 }
 
-static bool cd_getparam(const calldata_t *data, const char *name,
-		uint8_t **pos)
+/* the stored name sizes are compared first, so only names of the same
+ * length are ever compared */
+static bool cd_findparam(const calldata_t *data, const char *name,
+		size_t size, uint8_t **pos)
 {
 	size_t name_size;
 
@@ -81,7 +83,7 @@ static bool cd_getparam(const calldata_t *data, const char *name,
 		size_t param_size;
 
 		*pos += name_size;
-		if (strcmp(param_name, name) == 0)
+		if (name_size == size && memcmp(param_name, name, size) == 0)
 			return true;
 
 		param_size = cd_serialize_size(pos);
@@ -94,6 +96,12 @@ static bool cd_getparam(const calldata_t *data, const char *name,
 	return false;
 }
 
+static inline bool cd_getparam(const calldata_t *data, const char *name,
+		uint8_t **pos)
+{
+	return cd_findparam(data, name, strlen(name) + 1, pos);
+}
+
 static inline void cd_copy_string(uint8_t **pos, const char *str, size_t len)
 {
 	if (!len)
@@ -186,6 +194,23 @@ bool calldata_get_data(const calldata_t *data, const char *name, void *out,
 	return true;
 }
 
+const void *calldata_find(const calldata_t *data, const char *name,
+		size_t name_size, size_t size)
+{
+	uint8_t *pos;
+
+	if (!data || !name)
+		return NULL;
+
+	if (!cd_findparam(data, name, name_size, &pos))
+		return NULL;
+
+	if (cd_serialize_size(&pos) != size)
+		return NULL;
+
+	return pos;
+}
+
 void calldata_set_data(calldata_t *data, const char *name, const void *in,
 		size_t size)
 {
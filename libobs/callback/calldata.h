@@ -69,6 +69,20 @@ static inline void calldata_init_fixed(struct calldata *data, uint8_t *stack,
 	calldata_clear(data);
 }
 
+/* default size of calldata stored on the call stack, enough for a handful of
+ * pointer/number parameters */
+#define CALLDATA_FIXED_SIZE 128
+
+/*
+ *   Declares a calldata named 'name' backed by a buffer on the call stack,
+ * so setting parameters never allocates.  Parameters that don't fit are
+ * dropped (and logged), so use calldata_init for arbitrary strings.
+ */
+#define CALLDATA_FIXED_DECL(name, size) \
+	uint8_t name##_stack[size]; \
+	calldata_t name; \
+	calldata_init_fixed(&name, name##_stack, sizeof(name##_stack))
+
 static inline void calldata_free(struct calldata *data)
 {
 	if (!data->fixed)
@@ -119,6 +133,11 @@ static inline bool calldata_get_ptr   (const calldata_t *data, const char *name,
 EXPORT bool calldata_get_string(const calldata_t *data, const char *name,
 		const char **str);
 
+/* returns the data of a parameter if it exists and has the given size.
+ * 'name_size' includes the null terminator. */
+EXPORT const void *calldata_find(const calldata_t *data, const char *name,
+		size_t name_size, size_t size);
+
 /* ------------------------------------------------------------------------- */
 /* call if you know your data is valid */
 
@@ -158,6 +177,63 @@ static inline const char *calldata_string(const calldata_t *data,
 	return val;
 }
 
+/* ------------------------------------------------------------------------- */
+/* typed accessors for parameter names that are string literals.  the name
+ * size is known at compile time, and only parameters whose names have the
+ * same size are compared.  the "" concatenation makes anything other than a
+ * string literal fail to compile, sizeof a pointer would break the lookup. */
+
+#define CALLDATA_LITERAL_SIZE(name) sizeof("" name "")
+
+#define calldata_int_fast(data, name) \
+	calldata_int_sized(data, name, CALLDATA_LITERAL_SIZE(name))
+#define calldata_float_fast(data, name) \
+	calldata_float_sized(data, name, CALLDATA_LITERAL_SIZE(name))
+#define calldata_bool_fast(data, name) \
+	calldata_bool_sized(data, name, CALLDATA_LITERAL_SIZE(name))
+#define calldata_ptr_fast(data, name) \
+	calldata_ptr_sized(data, name, CALLDATA_LITERAL_SIZE(name))
+
+static inline long long calldata_int_sized(const calldata_t *data,
+		const char *name, size_t name_size)
+{
+	long long val = 0;
+	const void *p = calldata_find(data, name, name_size, sizeof(val));
+	if (p)
+		memcpy(&val, p, sizeof(val));
+	return val;
+}
+
+static inline double calldata_float_sized(const calldata_t *data,
+		const char *name, size_t name_size)
+{
+	double val = 0.0;
+	const void *p = calldata_find(data, name, name_size, sizeof(val));
+	if (p)
+		memcpy(&val, p, sizeof(val));
+	return val;
+}
+
+static inline bool calldata_bool_sized(const calldata_t *data,
+		const char *name, size_t name_size)
+{
+	bool val = false;
+	const void *p = calldata_find(data, name, name_size, sizeof(val));
+	if (p)
+		memcpy(&val, p, sizeof(val));
+	return val;
+}
+
+static inline void *calldata_ptr_sized(const calldata_t *data,
+		const char *name, size_t name_size)
+{
+	void *val = NULL;
+	const void *p = calldata_find(data, name, name_size, sizeof(val));
+	if (p)
+		memcpy(&val, p, sizeof(val));
+	return val;
+}
+
 /* ------------------------------------------------------------------------- */
 
 static inline void calldata_set_int   (calldata_t *data, const char *name,
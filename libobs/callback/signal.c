@@ -20,64 +20,147 @@
 #include "decl.h"
 #include "signal.h"
 
+/*
+ *   Signals are dispatched without taking any locks.  The callbacks of a
+ * signal are kept in an immutable array which is replaced as a whole when a
+ * callback is connected or disconnected.  Dispatching threads register
+ * themselves in one of two reader counters, selected by the current epoch, so
+ * that the writer can flip the epoch and wait for both counters to drain
+ * before it frees the array it replaced.
+ *
+ *   A callback that is disconnected is flagged as removed first, so a
+ * dispatch that is still walking the old array skips it.  Writers running
+ * inside a callback of the same signal can't wait for the readers (they are
+ * one of them), so they leave the old array to be freed by the next writer.
+ */
+
 struct signal_callback {
 	signal_callback_t callback;
 	void              *data;
-	bool              remove;
+	volatile bool     remove;
+};
+
+/* allocated in one block with the array following the struct */
+struct signal_callbacks {
+	size_t                 num;
+	struct signal_callback **array;
 };
 
 struct signal_info {
 	struct decl_info               func;
-	DARRAY(struct signal_callback) callbacks;
+	signal_id_t                    id;
+
+	struct signal_callbacks        *callbacks;
+	volatile long                  num_callbacks;
+	volatile long                  epoch;
+	volatile long                  readers[2];
+
+	/* serializes writers, never held while callbacks run */
 	pthread_mutex_t                mutex;
-	bool                           signalling;
+	pthread_mutex_t                sync_mutex;
+	DARRAY(void*)                  garbage;
+
+	/* signaled by the last reader leaving while a writer waits */
+	os_event_t                     *drained;
+	volatile bool                  synchronizing;
 
 	struct signal_info             *next;
 };
 
-static inline struct signal_info *signal_info_create(struct decl_info *info)
+/* signals the current thread is dispatching, innermost first */
+struct signal_frame {
+	struct signal_info  *sig;
+	struct signal_frame *prev;
+};
+
+#ifdef _MSC_VER
+static __declspec(thread) struct signal_frame *thread_frame = NULL;
+#else
+static __thread struct signal_frame *thread_frame = NULL;
+#endif
+
+static inline struct signal_callbacks *get_callbacks(struct signal_info *si)
 {
-	pthread_mutexattr_t attr;
-	struct signal_info *si;
+	return os_atomic_load_ptr((void *volatile *)&si->callbacks);
+}
 
-	if (pthread_mutexattr_init(&attr) != 0)
-		return NULL;
-	if (pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE) != 0)
-		return NULL;
+static inline struct signal_info *get_next(struct signal_info *const *p_sig)
+{
+	return os_atomic_load_ptr((void *volatile *)p_sig);
+}
 
-	si = bmalloc(sizeof(struct signal_info));
+static inline struct signal_info *signal_info_create(struct decl_info *info,
+		signal_id_t id)
+{
+	struct signal_info *si;
 
-	si->func       = *info;
-	si->next       = NULL;
-	si->signalling = false;
-	da_init(si->callbacks);
+	si = bzalloc(sizeof(struct signal_info));
 
-	if (pthread_mutex_init(&si->mutex, &attr) != 0) {
-		blog(LOG_ERROR, "Could not create signal");
+	si->func = *info;
+	si->id   = id;
 
-		decl_info_free(&si->func);
-		bfree(si);
-		return NULL;
+	pthread_mutex_init_value(&si->mutex);
+	pthread_mutex_init_value(&si->sync_mutex);
+
+	if (pthread_mutex_init(&si->mutex, NULL) != 0)
+		goto fail;
+	if (pthread_mutex_init(&si->sync_mutex, NULL) != 0) {
+		pthread_mutex_destroy(&si->mutex);
+		goto fail;
+	}
+	if (os_event_init(&si->drained, OS_EVENT_TYPE_AUTO) != 0) {
+		pthread_mutex_destroy(&si->sync_mutex);
+		pthread_mutex_destroy(&si->mutex);
+		goto fail;
 	}
 
 	return si;
+
+fail:
+	blog(LOG_ERROR, "Could not create signal");
+
+	decl_info_free(&si->func);
+	bfree(si);
+	return NULL;
+}
+
+static inline void free_garbage(void **garbage, size_t num)
+{
+	for (size_t i = 0; i < num; i++)
+		bfree(garbage[i]);
 }
 
 static inline void signal_info_destroy(struct signal_info *si)
 {
 	if (si) {
+		struct signal_callbacks *callbacks = si->callbacks;
+
+		if (callbacks) {
+			for (size_t i = 0; i < callbacks->num; i++)
+				bfree(callbacks->array[i]);
+			bfree(callbacks);
+		}
+
+		free_garbage(si->garbage.array, si->garbage.num);
+		da_free(si->garbage);
+
+		os_event_destroy(si->drained);
 		pthread_mutex_destroy(&si->mutex);
+		pthread_mutex_destroy(&si->sync_mutex);
 		decl_info_free(&si->func);
-		da_free(si->callbacks);
 		bfree(si);
 	}
 }
 
-static inline size_t signal_get_callback_idx(struct signal_info *si,
+static inline size_t signal_get_callback_idx(
+		const struct signal_callbacks *callbacks,
 		signal_callback_t callback, void *data)
 {
-	for (size_t i = 0; i < si->callbacks.num; i++) {
-		struct signal_callback *sc = si->callbacks.array+i;
+	if (!callbacks)
+		return DARRAY_INVALID;
+
+	for (size_t i = 0; i < callbacks->num; i++) {
+		struct signal_callback *sc = callbacks->array[i];
 
 		if (sc->callback == callback && sc->data == data)
 			return i;
@@ -86,32 +169,162 @@ static inline size_t signal_get_callback_idx(struct signal_info *si,
 	return DARRAY_INVALID;
 }
 
+static inline bool dispatching(struct signal_info *si)
+{
+	for (struct signal_frame *f = thread_frame; f; f = f->prev) {
+		if (f->sig == si)
+			return true;
+	}
+
+	return false;
+}
+
+/* the flag is set before the counter is checked, and readers check the flag
+ * after leaving, so either the writer sees the counter drained or the last
+ * reader sees the flag and wakes it.  a wakeup left over from an earlier
+ * wait only makes the counter get checked once more. */
+static inline void wait_for_readers(struct signal_info *si, long idx)
+{
+	while (os_atomic_load_long(&si->readers[idx]) != 0)
+		os_event_wait(si->drained);
+}
+
+/* waits until every dispatch that could still see a replaced callback array
+ * has finished.  readers that registered in the previous epoch but read the
+ * epoch before the last flip are drained first, then the epoch is flipped
+ * and the current one is drained. */
+static void signal_synchronize(struct signal_info *si)
+{
+	long epoch;
+
+	pthread_mutex_lock(&si->sync_mutex);
+	os_atomic_set_bool(&si->synchronizing, true);
+
+	epoch = os_atomic_load_long(&si->epoch);
+	wait_for_readers(si, (epoch + 1) & 1);
+	os_atomic_set_long(&si->epoch, epoch + 1);
+	wait_for_readers(si, epoch & 1);
+
+	os_atomic_set_bool(&si->synchronizing, false);
+	pthread_mutex_unlock(&si->sync_mutex);
+}
+
+/* publishes a new callback array.  the array it replaces (and a removed
+ * callback, if any) are freed once no dispatch can be using them anymore.
+ * must be called with the signal mutex held, which is released. */
+static void signal_replace_callbacks(struct signal_info *si,
+		struct signal_callbacks *callbacks,
+		struct signal_callback *removed)
+{
+	struct signal_callbacks *old;
+	DARRAY(void*) garbage;
+
+	old = os_atomic_set_ptr((void *volatile *)&si->callbacks, callbacks);
+	os_atomic_set_long(&si->num_callbacks,
+			callbacks ? (long)callbacks->num : 0);
+
+	if (old)
+		da_push_back(si->garbage, &old);
+	if (removed)
+		da_push_back(si->garbage, &removed);
+
+	if (dispatching(si)) {
+		pthread_mutex_unlock(&si->mutex);
+		return;
+	}
+
+	garbage.da = si->garbage.da;
+	da_init(si->garbage);
+	pthread_mutex_unlock(&si->mutex);
+
+	signal_synchronize(si);
+
+	free_garbage(garbage.array, garbage.num);
+	da_free(garbage);
+}
+
+static struct signal_callbacks *copy_callbacks(
+		const struct signal_callbacks *callbacks, size_t skip,
+		size_t extra)
+{
+	struct signal_callbacks *copy;
+	size_t num = callbacks ? callbacks->num : 0;
+	size_t new_num = 0;
+
+	if (skip != DARRAY_INVALID)
+		num--;
+	if (!num && !extra)
+		return NULL;
+
+	copy = bmalloc(sizeof(struct signal_callbacks) +
+			sizeof(struct signal_callback*) * (num + extra));
+	copy->array = (struct signal_callback**)(copy + 1);
+
+	for (size_t i = 0; callbacks && i < callbacks->num; i++) {
+		if (i != skip)
+			copy->array[new_num++] = callbacks->array[i];
+	}
+
+	copy->num = new_num;
+	return copy;
+}
+
 struct signal_handler {
 	struct signal_info *first;
 	pthread_mutex_t    mutex;
 };
 
+/* signals are only ever appended to the list (and only freed along with the
+ * handler), so the list can be walked without holding the handler mutex */
 static struct signal_info *getsignal(signal_handler_t *handler,
-		const char *name, struct signal_info **p_last)
+		signal_id_t id)
 {
-	struct signal_info *signal, *last= NULL;
+	struct signal_info *signal;
 
-	signal = handler->first;
+	signal = get_next(&handler->first);
 	while (signal != NULL) {
-		if (strcmp(signal->func.name, name) == 0)
+		if (signal->id == id)
 			break;
 
-		last = signal;
-		signal = signal->next;
+		signal = get_next(&signal->next);
 	}
 
-	if (p_last)
-		*p_last = last;
 	return signal;
 }
 
+static inline struct signal_info *getsignal_name(signal_handler_t *handler,
+		const char *name)
+{
+	struct signal_info *sig;
+
+	if (!handler || !name)
+		return NULL;
+
+	sig = getsignal(handler, signal_get_id(name));
+	if (sig && strcmp(sig->func.name, name) != 0)
+		return NULL;
+
+	return sig;
+}
+
 /* ------------------------------------------------------------------------- */
 
+signal_id_t signal_get_id(const char *name)
+{
+	/* 64-bit FNV-1a */
+	signal_id_t hash = 14695981039346656037ULL;
+
+	if (!name)
+		return 0;
+
+	while (*name) {
+		hash ^= (uint8_t)*(name++);
+		hash *= 1099511628211ULL;
+	}
+
+	return hash;
+}
+
 signal_handler_t *signal_handler_create(void)
 {
 	struct signal_handler *handler = bmalloc(sizeof(struct signal_handler));
@@ -144,7 +357,9 @@ void signal_handler_destroy(signal_handler_t *handler)
 bool signal_handler_add(signal_handler_t *handler, const char *signal_decl)
 {
 	struct decl_info func = {0};
-	struct signal_info *sig, *last;
+	struct signal_info *sig;
+	struct signal_info **p_next;
+	signal_id_t id;
 	bool success = true;
 
 	if (!parse_decl_string(&func, signal_decl)) {
@@ -152,19 +367,31 @@ bool signal_handler_add(signal_handler_t *handler, const char *signal_decl)
 		return false;
 	}
 
+	id = signal_get_id(func.name);
+
 	pthread_mutex_lock(&handler->mutex);
 
-	sig = getsignal(handler, func.name, &last);
+	sig = getsignal(handler, id);
 	if (sig) {
-		blog(LOG_WARNING, "Signal declaration '%s' exists", func.name);
+		if (strcmp(sig->func.name, func.name) == 0)
+			blog(LOG_WARNING, "Signal declaration '%s' exists",
+					func.name);
+		else
+			blog(LOG_ERROR, "Signal '%s' has the same id as '%s'",
+					func.name, sig->func.name);
 		decl_info_free(&func);
 		success = false;
 	} else {
-		sig = signal_info_create(&func);
-		if (!last)
-			handler->first = sig;
-		else
-			last->next = sig;
+		sig = signal_info_create(&func, id);
+		if (!sig) {
+			success = false;
+		} else {
+			p_next = &handler->first;
+			while (*p_next)
+				p_next = &(*p_next)->next;
+
+			os_atomic_set_ptr((void *volatile *)p_next, sig);
+		}
 	}
 
 	pthread_mutex_unlock(&handler->mutex);
@@ -175,17 +402,14 @@ bool signal_handler_add(signal_handler_t *handler, const char *signal_decl)
 void signal_handler_connect(signal_handler_t *handler, const char *signal,
 		signal_callback_t callback, void *data)
 {
-	struct signal_info *sig, *last;
-	struct signal_callback cb_data = {callback, data, false};
+	struct signal_info *sig = getsignal_name(handler, signal);
+	struct signal_callbacks *callbacks;
+	struct signal_callback *cb;
 	size_t idx;
 
 	if (!handler)
 		return;
 
-	pthread_mutex_lock(&handler->mutex);
-	sig = getsignal(handler, signal, &last);
-	pthread_mutex_unlock(&handler->mutex);
-
 	if (!sig) {
 		blog(LOG_WARNING, "signal_handler_connect: "
 		                  "signal '%s' not found", signal);
@@ -196,32 +420,28 @@ void signal_handler_connect(signal_handler_t *handler, const char *signal,
 
 	pthread_mutex_lock(&sig->mutex);
 
-	idx = signal_get_callback_idx(sig, callback, data);
-	if (idx == DARRAY_INVALID)
-		da_push_back(sig->callbacks, &cb_data);
-	
-	pthread_mutex_unlock(&sig->mutex);
-}
-
-static inline struct signal_info *getsignal_locked(signal_handler_t *handler,
-		const char *name)
-{
-	struct signal_info *sig;
+	idx = signal_get_callback_idx(sig->callbacks, callback, data);
+	if (idx != DARRAY_INVALID) {
+		pthread_mutex_unlock(&sig->mutex);
+		return;
+	}
 
-	if (!handler)
-		return NULL;
+	cb = bmalloc(sizeof(struct signal_callback));
+	cb->callback = callback;
+	cb->data     = data;
+	cb->remove   = false;
 
-	pthread_mutex_lock(&handler->mutex);
-	sig = getsignal(handler, name, NULL);
-	pthread_mutex_unlock(&handler->mutex);
+	callbacks = copy_callbacks(sig->callbacks, DARRAY_INVALID, 1);
+	callbacks->array[callbacks->num++] = cb;
 
-	return sig;
+	signal_replace_callbacks(sig, callbacks, NULL);
 }
 
 void signal_handler_disconnect(signal_handler_t *handler, const char *signal,
 		signal_callback_t callback, void *data)
 {
-	struct signal_info *sig = getsignal_locked(handler, signal);
+	struct signal_info *sig = getsignal_name(handler, signal);
+	struct signal_callback *cb;
 	size_t idx;
 
 	if (!sig)
@@ -229,40 +449,69 @@ void signal_handler_disconnect(signal_handler_t *handler, const char *signal,
 
 	pthread_mutex_lock(&sig->mutex);
 
-	idx = signal_get_callback_idx(sig, callback, data);
-	if (idx != DARRAY_INVALID) {
-		if (sig->signalling)
-			sig->callbacks.array[idx].remove = true;
-		else
-			da_erase(sig->callbacks, idx);
+	idx = signal_get_callback_idx(sig->callbacks, callback, data);
+	if (idx == DARRAY_INVALID) {
+		pthread_mutex_unlock(&sig->mutex);
+		return;
 	}
-	
-	pthread_mutex_unlock(&sig->mutex);
+
+	cb = sig->callbacks->array[idx];
+	os_atomic_set_bool(&cb->remove, true);
+
+	signal_replace_callbacks(sig,
+			copy_callbacks(sig->callbacks, idx, 0), cb);
 }
 
-void signal_handler_signal(signal_handler_t *handler, const char *signal,
-		calldata_t *params)
+static void signal_dispatch(struct signal_info *sig, calldata_t *params)
 {
-	struct signal_info *sig = getsignal_locked(handler, signal);
+	struct signal_callbacks *callbacks;
+	struct signal_frame frame;
+	long idx;
 
-	if (!sig)
+	if (!os_atomic_load_long(&sig->num_callbacks))
 		return;
 
-	pthread_mutex_lock(&sig->mutex);
-	sig->signalling = true;
+	frame.sig  = sig;
+	frame.prev = thread_frame;
+	thread_frame = &frame;
 
-	for (size_t i = 0; i < sig->callbacks.num; i++) {
-		struct signal_callback *cb = sig->callbacks.array+i;
-		if (!cb->remove)
+	idx = os_atomic_load_long(&sig->epoch) & 1;
+	os_atomic_inc_long(&sig->readers[idx]);
+
+	callbacks = get_callbacks(sig);
+	for (size_t i = 0; callbacks && i < callbacks->num; i++) {
+		struct signal_callback *cb = callbacks->array[i];
+		if (!os_atomic_load_bool(&cb->remove))
 			cb->callback(cb->data, params);
 	}
 
-	for (size_t i = sig->callbacks.num; i > 0; i--) {
-		struct signal_callback *cb = sig->callbacks.array+i-1;
-		if (cb->remove)
-			da_erase(sig->callbacks, i-1);
-	}
+	if (os_atomic_dec_long(&sig->readers[idx]) == 0 &&
+	    os_atomic_load_bool(&sig->synchronizing))
+		os_event_signal(sig->drained);
+	thread_frame = frame.prev;
+}
+
+void signal_handler_signal(signal_handler_t *handler, const char *signal,
+		calldata_t *params)
+{
+	struct signal_info *sig = getsignal_name(handler, signal);
+
+	if (sig)
+		signal_dispatch(sig, params);
+}
+
+void signal_handler_signal_id(signal_handler_t *handler, signal_id_t id,
+		calldata_t *params)
+{
+	struct signal_info *sig = handler ? getsignal(handler, id) : NULL;
+
+	if (sig)
+		signal_dispatch(sig, params);
+}
+
+bool signal_handler_has_callbacks(signal_handler_t *handler, signal_id_t id)
+{
+	struct signal_info *sig = handler ? getsignal(handler, id) : NULL;
 
-	sig->signalling = false;
-	pthread_mutex_unlock(&sig->mutex);
+	return sig && os_atomic_load_long(&sig->num_callbacks) != 0;
 }
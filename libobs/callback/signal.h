@@ -29,12 +29,26 @@ extern "C" {
  *
  *   This is used to create a signal handler which can broadcast events
  * to one or more callbacks connected to a signal.
+ *
+ *   Signals are dispatched without locking, so callbacks of the same signal
+ * may run concurrently on different threads.  Once signal_handler_disconnect
+ * returns, the callback will not be called again, except when it is called
+ * from within a callback of the same signal: then only the dispatch on the
+ * calling thread is guaranteed to skip it.
  */
 
 struct signal_handler;
 typedef struct signal_handler signal_handler_t;
 typedef void (*signal_callback_t)(void*, calldata_t*);
 
+/*
+ *   Signal ids are derived from the signal name only, so the id of a signal
+ * can be resolved once and used with any handler that declares it.
+ */
+typedef uint64_t signal_id_t;
+
+EXPORT signal_id_t signal_get_id(const char *name);
+
 EXPORT signal_handler_t *signal_handler_create(void);
 EXPORT void signal_handler_destroy(signal_handler_t *handler);
 
@@ -62,6 +76,12 @@ EXPORT void signal_handler_disconnect(signal_handler_t *handler,
 
 EXPORT void signal_handler_signal(signal_handler_t *handler, const char *signal,
 		calldata_t *params);
+EXPORT void signal_handler_signal_id(signal_handler_t *handler,
+		signal_id_t id, calldata_t *params);
+
+/* used to skip building the call data when nothing is connected */
+EXPORT bool signal_handler_has_callbacks(signal_handler_t *handler,
+		signal_id_t id);
 
 #ifdef __cplusplus
 }
@@ -2218,6 +2218,26 @@ void gs_texture_unmap(gs_texture_t *tex)
 	graphics->exports.gs_texture_unmap(tex);
 }
 
+bool gs_texture_set_image_rect(gs_texture_t *tex,
+		uint32_t x, uint32_t y, uint32_t width, uint32_t height,
+		const uint8_t *data, uint32_t linesize)
+{
+	graphics_t *graphics = thread_graphics;
+
+	if (!gs_valid_p2("gs_texture_set_image_rect", tex, data))
+		return false;
+	if (!graphics->exports.gs_texture_set_image_rect)
+		return false;
+
+	if (!width || !height ||
+	    x + width  > graphics->exports.gs_texture_get_width(tex) ||
+	    y + height > graphics->exports.gs_texture_get_height(tex))
+		return false;
+
+	return graphics->exports.gs_texture_set_image_rect(tex, x, y,
+			width, height, data, linesize);
+}
+
 bool gs_texture_is_rect(const gs_texture_t *tex)
 {
 	graphics_t *graphics = thread_graphics;
@@ -679,6 +679,12 @@ EXPORT enum gs_color_format gs_texture_get_color_format(
 EXPORT bool     gs_texture_map(gs_texture_t *tex, uint8_t **ptr,
 		uint32_t *linesize);
 EXPORT void     gs_texture_unmap(gs_texture_t *tex);
+/** updates part of a dynamic texture.  returns false if the rectangle is
+ * out of bounds or the graphics module doesn't support partial updates, in
+ * which case the whole texture has to be set instead */
+EXPORT bool     gs_texture_set_image_rect(gs_texture_t *tex,
+		uint32_t x, uint32_t y, uint32_t width, uint32_t height,
+		const uint8_t *data, uint32_t linesize);
 /** special-case function (GL only) - specifies whether the texture is a
  * GL_TEXTURE_RECTANGLE type, which doesn't use normalized texture
  * coordinates, doesn't support mipmapping, and requires address clamping */
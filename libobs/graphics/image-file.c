@@ -18,6 +18,7 @@
 #include "image-file.h"
 #include "../util/base.h"
 #include "../util/platform.h"
+#include "../util/threading.h"
 
 #define blog(level, format, ...) \
 	blog(level, "%s: " format, __FUNCTION__, __VA_ARGS__)
@@ -54,11 +55,292 @@ static void bi_def_bitmap_modified(void *bitmap)
 	UNUSED_PARAMETER(bitmap);
 }
 
-static inline int get_full_decoded_gif_size(gs_image_file_t *image)
+static inline uint64_t get_full_decoded_gif_size(gs_image_file_t *image)
 {
-	return image->gif.width * image->gif.height * 4 * image->gif.frame_count;
+	return (uint64_t)image->gif.width * (uint64_t)image->gif.height *
+		(uint64_t)image->gif.frame_count * 4LLU;
+}
+
+/* ------------------------------------------------------------------------- */
+
+/* animations larger than this when fully decoded keep a limited number of
+ * frames in a cache instead, decoded ahead of the playhead by a thread */
+#define GIF_FULL_DECODE_LIMIT (128ULL * 1024ULL * 1024ULL)
+#define GIF_FRAME_CACHE_SIZE  (64ULL * 1024ULL * 1024ULL)
+#define GIF_MIN_CACHED_FRAMES 3
+
+struct gif_frame_cache {
+	pthread_mutex_t mutex;
+	os_event_t      *event;
+	pthread_t       thread;
+	bool            thread_active;
+	volatile bool   stop;
+
+	size_t          frame_size;
+	size_t          num_slots;
+	uint8_t         *data;
+	int             *slot_frame;
+	uint64_t        *slot_used;
+	int             *frame_slot;
+	uint64_t        use_count;
+	int             playhead;
+
+	/* the gif decoder is shared by the decode thread and the graphics
+	 * thread, it must be sequentially fed frames to apply disposal */
+	pthread_mutex_t decode_mutex;
+	int             last_decoded_frame;
+};
+
+/* frames from the playhead up to the size of the cache (less one slot to
+ * decode other frames into) are never evicted */
+static inline bool frame_in_window(gs_image_file_t *image,
+		struct gif_frame_cache *cache, int frame)
+{
+	int count = (int)image->gif.frame_count;
+	int dist = (frame - cache->playhead + count) % count;
+	return dist < (int)cache->num_slots - 1;
+}
+
+static size_t find_free_slot(gs_image_file_t *image,
+		struct gif_frame_cache *cache)
+{
+	size_t oldest = cache->num_slots;
+	size_t fallback = cache->num_slots;
+
+	for (size_t i = 0; i < cache->num_slots; i++) {
+		int frame = cache->slot_frame[i];
+
+		if (frame < 0)
+			return i;
+		if (frame == cache->playhead)
+			continue;
+
+		if (fallback == cache->num_slots ||
+		    cache->slot_used[i] < cache->slot_used[fallback])
+			fallback = i;
+
+		if (frame_in_window(image, cache, frame))
+			continue;
+
+		if (oldest == cache->num_slots ||
+		    cache->slot_used[i] < cache->slot_used[oldest])
+			oldest = i;
+	}
+
+	return oldest != cache->num_slots ? oldest : fallback;
+}
+
+/* copies the frame currently held by the gif decoder into the cache.
+ * must be called with both mutexes held */
+static void store_frame(gs_image_file_t *image, struct gif_frame_cache *cache,
+		int frame)
+{
+	size_t slot;
+
+	if (cache->frame_slot[frame] >= 0)
+		return;
+
+	slot = find_free_slot(image, cache);
+	if (cache->slot_frame[slot] >= 0)
+		cache->frame_slot[cache->slot_frame[slot]] = -1;
+
+	memcpy(cache->data + slot * cache->frame_size, image->gif.frame_image,
+			cache->frame_size);
+
+	cache->slot_frame[slot] = frame;
+	cache->slot_used[slot] = ++cache->use_count;
+	cache->frame_slot[frame] = (int)slot;
+}
+
+static bool cache_decode_frame(gs_image_file_t *image,
+		struct gif_frame_cache *cache, int frame)
+{
+	bool success = true;
+
+	pthread_mutex_lock(&cache->decode_mutex);
+
+	if (frame != cache->last_decoded_frame) {
+		/* if looped, decode from frame 0 */
+		int first = (frame < cache->last_decoded_frame) ?
+			0 : cache->last_decoded_frame + 1;
+
+		/* decode missed frames */
+		for (int i = first; i < frame; i++)
+			gif_decode_frame(&image->gif, i);
+
+		success = gif_decode_frame(&image->gif, frame) == GIF_OK;
+		cache->last_decoded_frame = frame;
+	}
+
+	if (success) {
+		pthread_mutex_lock(&cache->mutex);
+		store_frame(image, cache, frame);
+		pthread_mutex_unlock(&cache->mutex);
+	}
+
+	pthread_mutex_unlock(&cache->decode_mutex);
+	return success;
+}
+
+static void *gif_decode_thread(void *data)
+{
+	gs_image_file_t *image = data;
+	struct gif_frame_cache *cache = image->frame_cache;
+	int count = (int)image->gif.frame_count;
+	int ahead = (int)cache->num_slots - 1;
+
+	os_set_thread_name("gif decoder");
+
+	if (ahead > count)
+		ahead = count;
+
+	while (os_event_wait(cache->event) == 0) {
+		for (int i = 0; i < ahead; i++) {
+			bool cached;
+			int frame;
+
+			if (os_atomic_load_bool(&cache->stop))
+				return NULL;
+
+			pthread_mutex_lock(&cache->mutex);
+			frame = (cache->playhead + i) % count;
+			cached = cache->frame_slot[frame] >= 0;
+			pthread_mutex_unlock(&cache->mutex);
+
+			if (!cached)
+				cache_decode_frame(image, cache, frame);
+		}
+
+		if (os_atomic_load_bool(&cache->stop))
+			break;
+	}
+
+	return NULL;
+}
+
+static void frame_cache_free(gs_image_file_t *image)
+{
+	struct gif_frame_cache *cache = image->frame_cache;
+
+	if (!cache)
+		return;
+
+	if (cache->thread_active) {
+		os_atomic_set_bool(&cache->stop, true);
+		os_event_signal(cache->event);
+		pthread_join(cache->thread, NULL);
+	}
+
+	os_event_destroy(cache->event);
+	pthread_mutex_destroy(&cache->mutex);
+	pthread_mutex_destroy(&cache->decode_mutex);
+	bfree(cache->data);
+	bfree(cache->slot_frame);
+	bfree(cache->slot_used);
+	bfree(cache->frame_slot);
+	bfree(cache);
+
+	image->frame_cache = NULL;
+}
+
+static bool frame_cache_init(gs_image_file_t *image)
+{
+	struct gif_frame_cache *cache = bzalloc(sizeof(*cache));
+	size_t count = image->gif.frame_count;
+
+	image->frame_cache = cache;
+
+	pthread_mutex_init_value(&cache->mutex);
+	pthread_mutex_init_value(&cache->decode_mutex);
+	if (pthread_mutex_init(&cache->mutex, NULL) != 0)
+		goto fail;
+	if (pthread_mutex_init(&cache->decode_mutex, NULL) != 0)
+		goto fail;
+	if (os_event_init(&cache->event, OS_EVENT_TYPE_AUTO) != 0)
+		goto fail;
+
+	cache->frame_size = (size_t)image->gif.width * image->gif.height * 4;
+	cache->num_slots = (size_t)(GIF_FRAME_CACHE_SIZE / cache->frame_size);
+	if (cache->num_slots < GIF_MIN_CACHED_FRAMES)
+		cache->num_slots = GIF_MIN_CACHED_FRAMES;
+	if (cache->num_slots > count)
+		cache->num_slots = count;
+
+	cache->data = bmalloc(cache->num_slots * cache->frame_size);
+	cache->slot_frame = bmalloc(cache->num_slots * sizeof(int));
+	cache->slot_used = bzalloc(cache->num_slots * sizeof(uint64_t));
+	cache->frame_slot = bmalloc(count * sizeof(int));
+
+	for (size_t i = 0; i < cache->num_slots; i++)
+		cache->slot_frame[i] = -1;
+	for (size_t i = 0; i < count; i++)
+		cache->frame_slot[i] = -1;
+
+	cache->last_decoded_frame = -1;
+	return cache_decode_frame(image, cache, 0);
+
+fail:
+	frame_cache_free(image);
+	return false;
 }
 
+/* the thread is started on the first tick rather than on init, after the
+ * image has reached its final location in memory */
+static void frame_cache_start(gs_image_file_t *image)
+{
+	struct gif_frame_cache *cache = image->frame_cache;
+
+	if (cache->thread_active || cache->stop)
+		return;
+
+	if (pthread_create(&cache->thread, NULL, gif_decode_thread,
+				image) == 0) {
+		cache->thread_active = true;
+		os_event_signal(cache->event);
+	} else {
+		cache->stop = true;
+	}
+}
+
+static void frame_cache_set_playhead(gs_image_file_t *image, int frame)
+{
+	struct gif_frame_cache *cache = image->frame_cache;
+
+	pthread_mutex_lock(&cache->mutex);
+	cache->playhead = frame;
+	pthread_mutex_unlock(&cache->mutex);
+
+	os_event_signal(cache->event);
+}
+
+/* calls the callback with the frame's data, decoding it on this thread if
+ * the decode thread hasn't reached it yet */
+static void frame_cache_use(gs_image_file_t *image, int frame,
+		void (*callback)(gs_image_file_t *image, const uint8_t *data))
+{
+	struct gif_frame_cache *cache = image->frame_cache;
+	int slot;
+
+	frame_cache_set_playhead(image, frame);
+
+	pthread_mutex_lock(&cache->mutex);
+	slot = cache->frame_slot[frame];
+	pthread_mutex_unlock(&cache->mutex);
+
+	if (slot < 0 && !cache_decode_frame(image, cache, frame))
+		return;
+
+	pthread_mutex_lock(&cache->mutex);
+	slot = cache->frame_slot[frame];
+	if (slot >= 0) {
+		cache->slot_used[slot] = ++cache->use_count;
+		callback(image, cache->data + slot * cache->frame_size);
+	}
+	pthread_mutex_unlock(&cache->mutex);
+}
+
+/* ------------------------------------------------------------------------- */
+
 static bool init_animated_gif(gs_image_file_t *image, const char *path)
 {
 	bool is_animated_gif = true;
@@ -104,23 +386,31 @@ static bool init_animated_gif(gs_image_file_t *image, const char *path)
 		goto fail;
 	}
 
-	max_size = (uint64_t)image->gif.width * (uint64_t)image->gif.height *
-		(uint64_t)image->gif.frame_count * 4LLU;
-
-	if ((uint64_t)get_full_decoded_gif_size(image) != max_size) {
-		blog(LOG_WARNING, "Gif '%s' overflowed maximum pointer size",
-				path);
-		goto fail;
-	}
+	max_size = get_full_decoded_gif_size(image);
 
 	image->is_animated_gif = (image->gif.frame_count > 1 && result >= 0);
-	if (image->is_animated_gif) {
+	if (image->is_animated_gif && max_size > GIF_FULL_DECODE_LIMIT) {
+		if (!frame_cache_init(image)) {
+			blog(LOG_WARNING, "Failed to decode '%s'", path);
+			goto fail;
+		}
+
+		image->cx = (uint32_t)image->gif.width;
+		image->cy = (uint32_t)image->gif.height;
+		image->format = GS_RGBA;
+
+	} else if (image->is_animated_gif) {
+		if ((uint64_t)(size_t)max_size != max_size) {
+			blog(LOG_WARNING, "Gif '%s' overflowed maximum "
+					"pointer size", path);
+			goto fail;
+		}
+
 		gif_decode_frame(&image->gif, 0);
 
 		image->animation_frame_cache = bzalloc(
 				image->gif.frame_count * sizeof(uint8_t*));
-		image->animation_frame_data = bzalloc(
-				get_full_decoded_gif_size(image));
+		image->animation_frame_data = bzalloc((size_t)max_size);
 
 		for (unsigned int i = 0; i < image->gif.frame_count; i++) {
 			if (gif_decode_frame(&image->gif, i) != GIF_OK)
@@ -187,6 +477,8 @@ void gs_image_file_free(gs_image_file_t *image)
 	if (!image)
 		return;
 
+	frame_cache_free(image);
+
 	if (image->loaded) {
 		if (image->is_animated_gif) {
 			gif_finalise(&image->gif);
@@ -202,12 +494,26 @@ void gs_image_file_free(gs_image_file_t *image)
 	memset(image, 0, sizeof(*image));
 }
 
+static void create_frame_texture(gs_image_file_t *image, const uint8_t *data)
+{
+	image->texture = gs_texture_create(image->cx, image->cy, image->format,
+			1, &data, GS_DYNAMIC);
+}
+
+static void update_frame_texture(gs_image_file_t *image, const uint8_t *data)
+{
+	gs_texture_set_image(image->texture, data, image->gif.width * 4, false);
+}
+
 void gs_image_file_init_texture(gs_image_file_t *image)
 {
 	if (!image->loaded)
 		return;
 
-	if (image->is_animated_gif) {
+	if (image->frame_cache) {
+		frame_cache_use(image, image->cur_frame, create_frame_texture);
+
+	} else if (image->is_animated_gif) {
 		image->texture = gs_texture_create(
 				image->cx, image->cy, image->format, 1,
 				(const uint8_t**)&image->gif.frame_image,
@@ -257,7 +563,10 @@ static inline int calculate_new_frame(gs_image_file_t *image,
 
 static void decode_new_frame(gs_image_file_t *image, int new_frame)
 {
-	if (!image->animation_frame_cache[new_frame]) {
+	if (image->frame_cache) {
+		frame_cache_set_playhead(image, new_frame);
+
+	} else if (!image->animation_frame_cache[new_frame]) {
 		int last_frame;
 
 		/* if looped, decode frame 0 */
@@ -296,6 +605,9 @@ bool gs_image_file_tick(gs_image_file_t *image, uint64_t elapsed_time_ns)
 	if (!image->is_animated_gif || !image->loaded)
 		return false;
 
+	if (image->frame_cache)
+		frame_cache_start(image);
+
 	loops = image->gif.loop_count;
 	if (loops >= 0xFFFF)
 		loops = 0;
@@ -318,6 +630,11 @@ void gs_image_file_update_texture(gs_image_file_t *image)
 	if (!image->is_animated_gif || !image->loaded)
 		return;
 
+	if (image->frame_cache) {
+		frame_cache_use(image, image->cur_frame, update_frame_texture);
+		return;
+	}
+
 	if (!image->animation_frame_cache[image->cur_frame])
 		decode_new_frame(image, image->cur_frame);
 
@@ -20,6 +20,8 @@
 #include "graphics.h"
 #include "libnsgif/libnsgif.h"
 
+struct gif_frame_cache;
+
 struct gs_image_file {
 	gs_texture_t *texture;
 	enum gs_color_format format;
@@ -40,6 +42,10 @@ struct gs_image_file {
 
 	uint8_t *texture_data;
 	gif_bitmap_callback_vt bitmap_callbacks;
+
+	/* set instead of animation_frame_cache for large animations, which
+	 * keep a bounded number of frames decoded ahead by a thread */
+	struct gif_frame_cache *frame_cache;
 };
 
 typedef struct gs_image_file gs_image_file_t;
@@ -19,16 +19,31 @@
 
 #include "../util/base.h"
 #include "../util/bmem.h"
+#include "../util/darray.h"
 #include "../util/platform.h"
+#include "../util/threading.h"
 
 #include <libavformat/avformat.h>
 
 #include <sys/types.h>
 #include <sys/stat.h>
 
+/* input is read in large blocks so that several concurrent jobs do not turn
+ * into lots of small interleaved reads on the same disk */
+#define READ_BUFFER_SIZE (4 * 1024 * 1024)
+
 struct media_remux_job {
 	int64_t in_size;
+	FILE *in_file;
+	AVIOContext *in_pb;
 	AVFormatContext *ifmt_ctx, *ofmt_ctx;
+
+	/* av_write_frame is used while the input stays interleaved */
+	bool interleave;
+	int64_t last_dts_usec;
+
+	pthread_mutex_t progress_mutex;
+	struct media_remux_progress progress;
 };
 
 static inline void init_size(media_remux_job_t job, const char *in_filename)
@@ -43,9 +58,66 @@ static inline void init_size(media_remux_job_t job, const char *in_filename)
 	job->in_size = st.st_size;
 }
 
+static int read_input(void *opaque, uint8_t *buf, int buf_size)
+{
+	media_remux_job_t job = opaque;
+	size_t size = fread(buf, 1, (size_t)buf_size, job->in_file);
+
+	if (!size)
+		return feof(job->in_file) ? AVERROR_EOF : AVERROR(EIO);
+	return (int)size;
+}
+
+static int64_t seek_input(void *opaque, int64_t offset, int whence)
+{
+	media_remux_job_t job = opaque;
+
+	if (whence & AVSEEK_SIZE)
+		return job->in_size;
+	if (os_fseeki64(job->in_file, offset, whence & ~AVSEEK_FORCE) != 0)
+		return -1;
+
+	return os_ftelli64(job->in_file);
+}
+
+static inline bool init_input_io(media_remux_job_t job, const char *in_filename)
+{
+	uint8_t *buffer;
+
+	job->in_file = os_fopen(in_filename, "rb");
+	if (!job->in_file)
+		return false;
+
+	/* the AVIO buffer already reads in large blocks */
+	setvbuf(job->in_file, NULL, _IONBF, 0);
+
+	buffer = av_malloc(READ_BUFFER_SIZE);
+	job->in_pb = avio_alloc_context(buffer, READ_BUFFER_SIZE, 0, job,
+			read_input, NULL, seek_input);
+	if (!job->in_pb) {
+		av_free(buffer);
+		return false;
+	}
+
+	job->ifmt_ctx = avformat_alloc_context();
+	if (!job->ifmt_ctx)
+		return false;
+
+	job->ifmt_ctx->pb = job->in_pb;
+	return true;
+}
+
 static inline bool init_input(media_remux_job_t job, const char *in_filename)
 {
-	int ret = avformat_open_input(&job->ifmt_ctx, in_filename, NULL, NULL);
+	int ret;
+
+	if (!init_input_io(job, in_filename)) {
+		blog(LOG_ERROR, "media_remux: Could not open input file '%s'",
+				in_filename);
+		return false;
+	}
+
+	ret = avformat_open_input(&job->ifmt_ctx, in_filename, NULL, NULL);
 	if (ret < 0) {
 		blog(LOG_ERROR, "media_remux: Could not open input file '%s'",
 				in_filename);
@@ -129,7 +201,16 @@ bool media_remux_job_create(media_remux_job_t *job, const char *in_filename,
 	if (!*job)
 		return false;
 
+	pthread_mutex_init_value(&(*job)->progress_mutex);
+	if (pthread_mutex_init(&(*job)->progress_mutex, NULL) != 0) {
+		bfree(*job);
+		*job = NULL;
+		return false;
+	}
+
 	init_size(*job, in_filename);
+	(*job)->progress.total_bytes = (*job)->in_size;
+	(*job)->last_dts_usec = AV_NOPTS_VALUE;
 
 	av_register_all();
 
@@ -143,6 +224,7 @@ bool media_remux_job_create(media_remux_job_t *job, const char *in_filename,
 
 fail:
 	media_remux_job_destroy(*job);
+	*job = NULL;
 	return false;
 }
 
@@ -161,6 +243,69 @@ static inline void process_packet(AVPacket *pkt,
 
 }
 
+static void update_progress(media_remux_job_t job, AVPacket *pkt,
+		AVStream *in_stream)
+{
+	AVFormatContext *ifmt_ctx = job->ifmt_ctx;
+	int64_t bytes = avio_tell(ifmt_ctx->pb);
+	int64_t time = -1;
+	int64_t duration = ifmt_ctx->duration;
+	float percent;
+
+	if (pkt->dts != AV_NOPTS_VALUE) {
+		int64_t start = in_stream->start_time != AV_NOPTS_VALUE ?
+			in_stream->start_time : 0;
+
+		time = av_rescale_q(pkt->dts - start, in_stream->time_base,
+				AV_TIME_BASE_Q);
+	}
+
+	/* container positions are not reliable for every format, so prefer
+	 * the timestamps whenever the duration is known */
+	if (duration > 0 && time >= 0)
+		percent = (float)time / (float)duration * 100.f;
+	else if (job->in_size > 0)
+		percent = (float)bytes / (float)job->in_size * 100.f;
+	else
+		percent = 0.f;
+
+	if (percent > 100.f)
+		percent = 100.f;
+
+	pthread_mutex_lock(&job->progress_mutex);
+	job->progress.bytes_read = bytes;
+	if (time >= 0)
+		job->progress.time_usec = time;
+	job->progress.duration_usec = duration > 0 ? duration : 0;
+	job->progress.percent = percent;
+	pthread_mutex_unlock(&job->progress_mutex);
+}
+
+static int write_packet(media_remux_job_t job, AVPacket *pkt,
+		AVStream *out_stream)
+{
+	if (!job->interleave && pkt->dts != AV_NOPTS_VALUE) {
+		int64_t dts_usec = av_rescale_q(pkt->dts,
+				out_stream->time_base, AV_TIME_BASE_Q);
+
+		if (job->last_dts_usec != AV_NOPTS_VALUE &&
+		    dts_usec < job->last_dts_usec) {
+			blog(LOG_INFO, "media_remux: Input is not interleaved, "
+					"interleaving packets");
+			job->interleave = true;
+		}
+
+		job->last_dts_usec = dts_usec;
+	}
+
+	/* recordings are already interleaved, so the interleaving queue can
+	 * be skipped and the packet written straight from the read buffer */
+	if (!job->interleave)
+		return av_write_frame(job->ofmt_ctx, pkt);
+
+	return av_interleaved_write_frame(job->ofmt_ctx, pkt);
+}
+
 static inline int process_packets(media_remux_job_t job,
 		media_remux_progress_callback callback, void *data)
 {
@@ -177,17 +322,23 @@ static inline int process_packets(media_remux_job_t job,
 			break;
 		}
 
-		if (callback != NULL && throttle++ > 10) {
-			float progress = pkt.pos / (float)job->in_size * 100.f;
-			if (!callback(data, progress))
+		AVStream *in_stream = job->ifmt_ctx->streams[pkt.stream_index];
+		AVStream *out_stream = job->ofmt_ctx->streams[pkt.stream_index];
+
+		if (throttle++ > 10) {
+			update_progress(job, &pkt, in_stream);
+
+			if (callback != NULL &&
+			    !callback(data, job->progress.percent)) {
+				av_free_packet(&pkt);
 				break;
+			}
 			throttle = 0;
 		}
 
-		process_packet(&pkt, job->ifmt_ctx->streams[pkt.stream_index],
-				job->ofmt_ctx->streams[pkt.stream_index]);
+		process_packet(&pkt, in_stream, out_stream);
 
-		ret = av_interleaved_write_frame(job->ofmt_ctx, &pkt);
+		ret = write_packet(job, &pkt, out_stream);
 		av_free_packet(&pkt);
 
 		if (ret < 0) {
@@ -229,12 +380,32 @@ bool media_remux_job_process(media_remux_job_t job,
 		success = false;
 	}
 
+	pthread_mutex_lock(&job->progress_mutex);
+	if (success) {
+		job->progress.bytes_read = job->in_size;
+		job->progress.percent = 100.f;
+	}
+	job->progress.finished = true;
+	job->progress.success = success;
+	pthread_mutex_unlock(&job->progress_mutex);
+
 	if (callback != NULL)
 		callback(data, 100.f);
 
 	return success;
 }
 
+void media_remux_job_get_progress(media_remux_job_t job,
+		struct media_remux_progress *progress)
+{
+	if (!job || !progress)
+		return;
+
+	pthread_mutex_lock(&job->progress_mutex);
+	*progress = job->progress;
+	pthread_mutex_unlock(&job->progress_mutex);
+}
+
 void media_remux_job_destroy(media_remux_job_t job)
 {
 	if (!job)
@@ -242,10 +413,272 @@ void media_remux_job_destroy(media_remux_job_t job)
 
 	avformat_close_input(&job->ifmt_ctx);
 
+	if (job->in_pb) {
+		av_freep(&job->in_pb->buffer);
+		av_freep(&job->in_pb);
+	}
+	if (job->in_file)
+		fclose(job->in_file);
+
 	if (job->ofmt_ctx && !(job->ofmt_ctx->oformat->flags & AVFMT_NOFILE))
 		avio_close(job->ofmt_ctx->pb);
 
 	avformat_free_context(job->ofmt_ctx);
 
+	pthread_mutex_destroy(&job->progress_mutex);
 	bfree(job);
 }
+
+/* ------------------------------------------------------------------------- */
+
+struct remux_queue_entry {
+	char                          *in_filename;
+	char                          *out_filename;
+	media_remux_finished_callback *callback;
+	void                          *data;
+
+	media_remux_job_t             job;
+	struct media_remux_progress   progress;
+	volatile bool                 cancel;
+};
+
+struct media_remux_queue {
+	pthread_mutex_t               mutex;
+	pthread_cond_t                cond;
+	DARRAY(pthread_t)             threads;
+	DARRAY(struct remux_queue_entry *) entries;
+	size_t                        next;
+	size_t                        finished;
+	bool                          stop;
+};
+
+static bool queue_job_progress(void *data, float percent)
+{
+	struct remux_queue_entry *entry = data;
+
+	UNUSED_PARAMETER(percent);
+	return !os_atomic_load_bool(&entry->cancel);
+}
+
+static void run_queue_entry(struct media_remux_queue *queue,
+		struct remux_queue_entry *entry)
+{
+	media_remux_job_t job = NULL;
+	bool success = false;
+
+	if (media_remux_job_create(&job, entry->in_filename,
+				entry->out_filename)) {
+		pthread_mutex_lock(&queue->mutex);
+		entry->job = job;
+		pthread_mutex_unlock(&queue->mutex);
+
+		success = media_remux_job_process(job, queue_job_progress,
+				entry);
+		success = success && !os_atomic_load_bool(&entry->cancel);
+	}
+
+	pthread_mutex_lock(&queue->mutex);
+	if (job)
+		media_remux_job_get_progress(job, &entry->progress);
+	entry->job = NULL;
+	entry->progress.finished = true;
+	entry->progress.success = success;
+	pthread_mutex_unlock(&queue->mutex);
+
+	media_remux_job_destroy(job);
+}
+
+static void *remux_queue_thread(void *data)
+{
+	struct media_remux_queue *queue = data;
+
+	os_set_thread_name("media_remux: queue thread");
+
+	pthread_mutex_lock(&queue->mutex);
+
+	for (;;) {
+		struct remux_queue_entry *entry;
+		size_t idx;
+
+		while (!queue->stop && queue->next == queue->entries.num)
+			pthread_cond_wait(&queue->cond, &queue->mutex);
+		if (queue->stop)
+			break;
+
+		idx = queue->next++;
+		entry = queue->entries.array[idx];
+
+		if (os_atomic_load_bool(&entry->cancel)) {
+			entry->progress.finished = true;
+			pthread_mutex_unlock(&queue->mutex);
+		} else {
+			pthread_mutex_unlock(&queue->mutex);
+			run_queue_entry(queue, entry);
+		}
+
+		if (entry->callback)
+			entry->callback(entry->data, idx,
+					entry->progress.success);
+
+		pthread_mutex_lock(&queue->mutex);
+		queue->finished++;
+		pthread_cond_broadcast(&queue->cond);
+	}
+
+	pthread_mutex_unlock(&queue->mutex);
+	return NULL;
+}
+
+media_remux_queue_t *media_remux_queue_create(size_t max_jobs)
+{
+	struct media_remux_queue *queue = bzalloc(sizeof(*queue));
+
+	if (!max_jobs)
+		max_jobs = 2;
+
+	pthread_mutex_init_value(&queue->mutex);
+	if (pthread_mutex_init(&queue->mutex, NULL) != 0) {
+		bfree(queue);
+		return NULL;
+	}
+	if (pthread_cond_init(&queue->cond, NULL) != 0) {
+		pthread_mutex_destroy(&queue->mutex);
+		bfree(queue);
+		return NULL;
+	}
+
+	av_register_all();
+
+	for (size_t i = 0; i < max_jobs; i++) {
+		pthread_t thread;
+
+		if (pthread_create(&thread, NULL, remux_queue_thread,
+					queue) != 0)
+			break;
+
+		da_push_back(queue->threads, &thread);
+	}
+
+	if (!queue->threads.num)
+		goto fail;
+
+	return queue;
+
+fail:
+	blog(LOG_ERROR, "media_remux: Failed to create remux queue");
+	media_remux_queue_destroy(queue);
+	return NULL;
+}
+
+void media_remux_queue_destroy(media_remux_queue_t *queue)
+{
+	if (!queue)
+		return;
+
+	media_remux_queue_cancel(queue);
+
+	pthread_mutex_lock(&queue->mutex);
+	queue->stop = true;
+	pthread_cond_broadcast(&queue->cond);
+	pthread_mutex_unlock(&queue->mutex);
+
+	for (size_t i = 0; i < queue->threads.num; i++)
+		pthread_join(queue->threads.array[i], NULL);
+
+	for (size_t i = 0; i < queue->entries.num; i++) {
+		struct remux_queue_entry *entry = queue->entries.array[i];
+		bfree(entry->in_filename);
+		bfree(entry->out_filename);
+		bfree(entry);
+	}
+
+	da_free(queue->threads);
+	da_free(queue->entries);
+	pthread_cond_destroy(&queue->cond);
+	pthread_mutex_destroy(&queue->mutex);
+	bfree(queue);
+}
+
+size_t media_remux_queue_add(media_remux_queue_t *queue,
+		const char *in_filename, const char *out_filename,
+		media_remux_finished_callback callback, void *data)
+{
+	struct remux_queue_entry *entry;
+	size_t idx;
+
+	if (!queue)
+		return DARRAY_INVALID;
+
+	entry = bzalloc(sizeof(*entry));
+	entry->in_filename = bstrdup(in_filename);
+	entry->out_filename = bstrdup(out_filename);
+	entry->callback = callback;
+	entry->data = data;
+
+	pthread_mutex_lock(&queue->mutex);
+	idx = da_push_back(queue->entries, &entry);
+	pthread_cond_broadcast(&queue->cond);
+	pthread_mutex_unlock(&queue->mutex);
+
+	return idx;
+}
+
+size_t media_remux_queue_count(media_remux_queue_t *queue)
+{
+	size_t count;
+
+	if (!queue)
+		return 0;
+
+	pthread_mutex_lock(&queue->mutex);
+	count = queue->entries.num;
+	pthread_mutex_unlock(&queue->mutex);
+	return count;
+}
+
+bool media_remux_queue_get_progress(media_remux_queue_t *queue, size_t idx,
+		struct media_remux_progress *progress)
+{
+	bool success = false;
+
+	if (!queue || !progress)
+		return false;
+
+	pthread_mutex_lock(&queue->mutex);
+
+	if (idx < queue->entries.num) {
+		struct remux_queue_entry *entry = queue->entries.array[idx];
+
+		if (entry->job)
+			media_remux_job_get_progress(entry->job, progress);
+		else
+			*progress = entry->progress;
+		success = true;
+	}
+
+	pthread_mutex_unlock(&queue->mutex);
+	return success;
+}
+
+/* only the jobs added so far are cancelled, jobs added afterwards run */
+void media_remux_queue_cancel(media_remux_queue_t *queue)
+{
+	if (!queue)
+		return;
+
+	pthread_mutex_lock(&queue->mutex);
+	for (size_t i = 0; i < queue->entries.num; i++)
+		os_atomic_set_bool(&queue->entries.array[i]->cancel, true);
+	pthread_mutex_unlock(&queue->mutex);
+}
+
+void media_remux_queue_wait(media_remux_queue_t *queue)
+{
+	if (!queue)
+		return;
+
+	pthread_mutex_lock(&queue->mutex);
+	while (queue->finished < queue->entries.num)
+		pthread_cond_wait(&queue->cond, &queue->mutex);
+	pthread_mutex_unlock(&queue->mutex);
+}
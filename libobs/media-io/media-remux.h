@@ -22,7 +22,22 @@
 struct media_remux_job;
 typedef struct media_remux_job *media_remux_job_t;
 
+struct media_remux_queue;
+typedef struct media_remux_queue media_remux_queue_t;
+
 typedef bool (media_remux_progress_callback)(void *data, float percent);
+typedef void (media_remux_finished_callback)(void *data, size_t idx,
+		bool success);
+
+struct media_remux_progress {
+	int64_t bytes_read;
+	int64_t total_bytes;
+	int64_t time_usec;
+	int64_t duration_usec;
+	float   percent;
+	bool    finished;
+	bool    success;
+};
 
 #ifdef __cplusplus
 extern "C" {
@@ -32,8 +47,36 @@ EXPORT bool media_remux_job_create(media_remux_job_t *job,
 		const char *in_filename, const char *out_filename);
 EXPORT bool media_remux_job_process(media_remux_job_t job,
 		media_remux_progress_callback callback, void *data);
+EXPORT void media_remux_job_get_progress(media_remux_job_t job,
+		struct media_remux_progress *progress);
 EXPORT void media_remux_job_destroy(media_remux_job_t job);
 
+/* ------------------------------------------------------------------------- */
+/* Remux queue
+ *
+ *   Runs up to 'max_jobs' remux jobs concurrently, each on its own thread.
+ * Jobs are started in the order they are added.  The finished callback is
+ * called from the worker thread.
+ */
+
+EXPORT media_remux_queue_t *media_remux_queue_create(size_t max_jobs);
+EXPORT void media_remux_queue_destroy(media_remux_queue_t *queue);
+
+/** Adds a job to the queue and returns its index */
+EXPORT size_t media_remux_queue_add(media_remux_queue_t *queue,
+		const char *in_filename, const char *out_filename,
+		media_remux_finished_callback callback, void *data);
+
+EXPORT size_t media_remux_queue_count(media_remux_queue_t *queue);
+EXPORT bool media_remux_queue_get_progress(media_remux_queue_t *queue,
+		size_t idx, struct media_remux_progress *progress);
+
+/** Cancels all pending and running jobs, jobs added later still run */
+EXPORT void media_remux_queue_cancel(media_remux_queue_t *queue);
+
+/** Waits until every job added so far has finished */
+EXPORT void media_remux_queue_wait(media_remux_queue_t *queue);
+
 #ifdef __cplusplus
 }
 #endif
@@ -37,21 +37,42 @@ struct cached_frame_info {
 	int count;
 };
 
-struct video_input {
+/* Inputs that want the same conversion share a scale group, so several
+ * encoders at one resolution only scale each frame once.  Inputs connected
+ * with video_output_connect_cascade can also be chained: a cascading group
+ * that only needs to downscale is fed from the smallest larger cascading
+ * group of the same format and scale type rather than from the full size
+ * frame, giving a cascade such as 1080p -> 720p -> 480p. */
+struct video_scale_group {
 	struct video_scale_info   conversion;
+	enum video_scale_type     scale_type;
+	bool                      cascade;
+	struct video_scale_group  *source;
 	video_scaler_t            *scaler;
 	struct video_frame        frame[MAX_CONVERT_BUFFERS];
 	int                       cur_frame;
+	long                      refs;
+
+	struct video_data         output;
+	bool                      scaled;
+};
+
+struct video_input {
+	struct video_scale_info   conversion;
+	enum video_scale_type     scale_type;
+	bool                      cascade;
+	struct video_scale_group  *group;
 
 	void (*callback)(void *param, struct video_data *frame);
 	void *param;
 };
 
-static inline void video_input_free(struct video_input *input)
+static void video_scale_group_free(struct video_scale_group *group)
 {
 	for (size_t i = 0; i < MAX_CONVERT_BUFFERS; i++)
-		video_frame_free(&input->frame[i]);
-	video_scaler_destroy(input->scaler);
+		video_frame_free(&group->frame[i]);
+	video_scaler_destroy(group->scaler);
+	bfree(group);
 }
 
 struct video_output {
@@ -70,6 +91,7 @@ struct video_output {
 
 	pthread_mutex_t            input_mutex;
 	DARRAY(struct video_input) inputs;
+	DARRAY(struct video_scale_group*) groups;
 
 	size_t                     available_frames;
 	size_t                     first_added;
@@ -79,35 +101,39 @@ struct video_output {
 
 /* ------------------------------------------------------------------------- */
 
-static inline bool scale_video_output(struct video_input *input,
-		struct video_data *data)
+static void scale_group_output(struct video_scale_group *group,
+		const struct video_data *input)
 {
-	bool success = true;
+	struct video_frame *frame;
+	const struct video_data *src = input;
 
-	if (input->scaler) {
-		struct video_frame *frame;
+	if (!group->scaler || (group->source && !group->source->scaled)) {
+		group->scaled = false;
+		return;
+	}
 
-		if (++input->cur_frame == MAX_CONVERT_BUFFERS)
-			input->cur_frame = 0;
+	if (group->source)
+		src = &group->source->output;
 
-		frame = &input->frame[input->cur_frame];
+	if (++group->cur_frame == MAX_CONVERT_BUFFERS)
+		group->cur_frame = 0;
 
-		success = video_scaler_scale(input->scaler,
-				frame->data, frame->linesize,
-				(const uint8_t * const*)data->data,
-				data->linesize);
+	frame = &group->frame[group->cur_frame];
 
-		if (success) {
-			for (size_t i = 0; i < MAX_AV_PLANES; i++) {
-				data->data[i]     = frame->data[i];
-				data->linesize[i] = frame->linesize[i];
-			}
-		} else {
-			blog(LOG_WARNING, "video-io: Could not scale frame!");
+	group->scaled = video_scaler_scale(group->scaler,
+			frame->data, frame->linesize,
+			(const uint8_t * const*)src->data,
+			src->linesize);
+
+	if (group->scaled) {
+		for (size_t i = 0; i < MAX_AV_PLANES; i++) {
+			group->output.data[i]     = frame->data[i];
+			group->output.linesize[i] = frame->linesize[i];
 		}
+		group->output.timestamp = input->timestamp;
+	} else {
+		blog(LOG_WARNING, "video-io: Could not scale frame!");
 	}
-
-	return success;
 }
 
 static inline bool video_output_cur_frame(struct video_output *video)
@@ -127,12 +153,22 @@ static inline bool video_output_cur_frame(struct video_output *video)
 
 	pthread_mutex_lock(&video->input_mutex);
 
+	/* groups are kept largest first, so sources are scaled before the
+	 * groups fed from them */
+	for (size_t i = 0; i < video->groups.num; i++)
+		scale_group_output(video->groups.array[i], &frame_info->frame);
+
 	for (size_t i = 0; i < video->inputs.num; i++) {
 		struct video_input *input = video->inputs.array+i;
 		struct video_data frame = frame_info->frame;
 
-		if (scale_video_output(input, &frame))
-			input->callback(input->param, &frame);
+		if (input->group) {
+			if (!input->group->scaled)
+				continue;
+			frame = input->group->output;
+		}
+
+		input->callback(input->param, &frame);
 	}
 
 	pthread_mutex_unlock(&video->input_mutex);
@@ -259,8 +295,9 @@ void video_output_close(video_t *video)
 
 	video_output_stop(video);
 
-	for (size_t i = 0; i < video->inputs.num; i++)
-		video_input_free(&video->inputs.array[i]);
+	for (size_t i = 0; i < video->groups.num; i++)
+		video_scale_group_free(video->groups.array[i]);
+	da_free(video->groups);
 	da_free(video->inputs);
 
 	for (size_t i = 0; i < video->info.cache_size; i++)
@@ -285,44 +322,190 @@ static size_t video_get_input_idx(const video_t *video,
 	return DARRAY_INVALID;
 }
 
+static inline bool scale_info_equal(const struct video_scale_info *a,
+		const struct video_scale_info *b)
+{
+	return a->format     == b->format &&
+	       a->width      == b->width &&
+	       a->height     == b->height &&
+	       a->range      == b->range &&
+	       a->colorspace == b->colorspace;
+}
+
+static inline uint64_t scale_info_area(const struct video_scale_info *info)
+{
+	return (uint64_t)info->width * (uint64_t)info->height;
+}
+
+static inline bool scale_group_matches(const struct video_scale_group *group,
+		const struct video_input *input)
+{
+	return group->scale_type == input->scale_type &&
+	       group->cascade    == input->cascade &&
+	       scale_info_equal(&group->conversion, &input->conversion);
+}
+
+/* a group can be fed from another if both opted into the cascade, use the
+ * same scaler, and it is a pure downscale of the other */
+static inline bool can_scale_from(const struct video_scale_group *to,
+		const struct video_scale_group *from)
+{
+	return to->cascade && from->cascade &&
+	       to->scale_type            == from->scale_type &&
+	       to->conversion.format     == from->conversion.format &&
+	       to->conversion.range      == from->conversion.range &&
+	       to->conversion.colorspace == from->conversion.colorspace &&
+	       to->conversion.width      <= from->conversion.width &&
+	       to->conversion.height     <= from->conversion.height;
+}
+
+static bool scale_group_set_source(struct video_output *video,
+		struct video_scale_group *group,
+		struct video_scale_group *source)
+{
+	struct video_scale_info from = {
+		.format = video->info.format,
+		.width  = video->info.width,
+		.height = video->info.height,
+	};
+	video_scaler_t *scaler = NULL;
+	int ret;
+
+	if (group->scaler && group->source == source)
+		return true;
+
+	if (source)
+		from = source->conversion;
+
+	ret = video_scaler_create(&scaler, &group->conversion, &from,
+			group->scale_type);
+	if (ret != VIDEO_SCALER_SUCCESS) {
+		if (ret == VIDEO_SCALER_BAD_CONVERSION)
+			blog(LOG_ERROR, "video_input_init: Bad "
+			                "scale conversion type");
+		else
+			blog(LOG_ERROR, "video_input_init: Failed to "
+			                "create scaler");
+
+		return false;
+	}
+
+	video_scaler_destroy(group->scaler);
+	group->scaler = scaler;
+	group->source = source;
+	group->scaled = false;
+	return true;
+}
+
+/* sorts the groups largest first and picks the smallest suitable larger
+ * group as the source of each one */
+static bool video_output_update_groups(struct video_output *video)
+{
+	struct video_scale_group **groups = video->groups.array;
+	size_t num = video->groups.num;
+	bool success = true;
+
+	for (size_t i = 1; i < num; i++) {
+		struct video_scale_group *group = groups[i];
+		uint64_t area = scale_info_area(&group->conversion);
+		size_t j = i;
+
+		while (j > 0 && scale_info_area(&groups[j - 1]->conversion)
+				< area) {
+			groups[j] = groups[j - 1];
+			j--;
+		}
+		groups[j] = group;
+	}
+
+	for (size_t i = 0; i < num; i++) {
+		struct video_scale_group *group = groups[i];
+		struct video_scale_group *source = NULL;
+
+		for (size_t j = i; j > 0; j--) {
+			struct video_scale_group *prev = groups[j - 1];
+
+			if (can_scale_from(group, prev)) {
+				source = prev;
+				break;
+			}
+		}
+
+		if (!scale_group_set_source(video, group, source))
+			success = false;
+	}
+
+	return success;
+}
+
+static void video_output_release_group(struct video_output *video,
+		struct video_scale_group *group)
+{
+	if (!group || --group->refs > 0)
+		return;
+
+	da_erase_item(video->groups, &group);
+
+	for (size_t i = 0; i < video->groups.num; i++) {
+		struct video_scale_group *other = video->groups.array[i];
+
+		if (other->source == group) {
+			video_scaler_destroy(other->scaler);
+			other->scaler = NULL;
+			other->source = NULL;
+		}
+	}
+
+	video_scale_group_free(group);
+	video_output_update_groups(video);
+}
+
 static inline bool video_input_init(struct video_input *input,
 		struct video_output *video)
 {
-	if (input->conversion.width  != video->info.width ||
-	    input->conversion.height != video->info.height ||
-	    input->conversion.format != video->info.format) {
-		struct video_scale_info from = {
-			.format = video->info.format,
-			.width  = video->info.width,
-			.height = video->info.height,
-		};
-
-		int ret = video_scaler_create(&input->scaler,
-				&input->conversion, &from,
-				VIDEO_SCALE_FAST_BILINEAR);
-		if (ret != VIDEO_SCALER_SUCCESS) {
-			if (ret == VIDEO_SCALER_BAD_CONVERSION)
-				blog(LOG_ERROR, "video_input_init: Bad "
-				                "scale conversion type");
-			else
-				blog(LOG_ERROR, "video_input_init: Failed to "
-				                "create scaler");
-
-			return false;
+	struct video_scale_group *group;
+
+	if (input->conversion.width  == video->info.width &&
+	    input->conversion.height == video->info.height &&
+	    input->conversion.format == video->info.format)
+		return true;
+
+	for (size_t i = 0; i < video->groups.num; i++) {
+		group = video->groups.array[i];
+
+		if (scale_group_matches(group, input)) {
+			group->refs++;
+			input->group = group;
+			return true;
 		}
+	}
+
+	group = bzalloc(sizeof(struct video_scale_group));
+	group->conversion = input->conversion;
+	group->scale_type = input->scale_type;
+	group->cascade = input->cascade;
+	group->refs = 1;
+
+	for (size_t i = 0; i < MAX_CONVERT_BUFFERS; i++)
+		video_frame_init(&group->frame[i],
+				group->conversion.format,
+				group->conversion.width,
+				group->conversion.height);
+
+	da_push_back(video->groups, &group);
 
-		for (size_t i = 0; i < MAX_CONVERT_BUFFERS; i++)
-			video_frame_init(&input->frame[i],
-					input->conversion.format,
-					input->conversion.width,
-					input->conversion.height);
+	if (!video_output_update_groups(video)) {
+		video_output_release_group(video, group);
+		return false;
 	}
 
+	input->group = group;
 	return true;
 }
 
-bool video_output_connect(video_t *video,
+static bool connect_input(video_t *video,
 		const struct video_scale_info *conversion,
+		enum video_scale_type scale_type, bool cascade,
 		void (*callback)(void *param, struct video_data *frame),
 		void *param)
 {
@@ -337,8 +520,10 @@ bool video_output_connect(video_t *video,
 		struct video_input input;
 		memset(&input, 0, sizeof(input));
 
-		input.callback = callback;
-		input.param    = param;
+		input.callback   = callback;
+		input.param      = param;
+		input.scale_type = scale_type;
+		input.cascade    = cascade;
 
 		if (conversion) {
 			input.conversion = *conversion;
@@ -363,6 +548,25 @@ bool video_output_connect(video_t *video,
 	return success;
 }
 
+bool video_output_connect(video_t *video,
+		const struct video_scale_info *conversion,
+		void (*callback)(void *param, struct video_data *frame),
+		void *param)
+{
+	return connect_input(video, conversion, VIDEO_SCALE_FAST_BILINEAR,
+			false, callback, param);
+}
+
+bool video_output_connect_cascade(video_t *video,
+		const struct video_scale_info *conversion,
+		enum video_scale_type scale_type,
+		void (*callback)(void *param, struct video_data *frame),
+		void *param)
+{
+	return connect_input(video, conversion, scale_type, true, callback,
+			param);
+}
+
 void video_output_disconnect(video_t *video,
 		void (*callback)(void *param, struct video_data *frame),
 		void *param)
@@ -374,7 +578,8 @@ void video_output_disconnect(video_t *video,
 
 	size_t idx = video_get_input_idx(video, callback, param);
 	if (idx != DARRAY_INVALID) {
-		video_input_free(video->inputs.array+idx);
+		video_output_release_group(video,
+				video->inputs.array[idx].group);
 		da_erase(video->inputs, idx);
 	}
 
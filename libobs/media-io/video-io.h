@@ -157,6 +157,20 @@ EXPORT bool video_output_connect(video_t *video,
 		const struct video_scale_info *conversion,
 		void (*callback)(void *param, struct video_data *frame),
 		void *param);
+
+/**
+ * Connects like video_output_connect, but lets the input share a downscale
+ * cascade with other cascading inputs: if a larger cascading input with the
+ * same format and scale type exists, frames are scaled from its output rather
+ * than from the full size frame.  Each step of the cascade scales an already
+ * scaled frame, so this trades some quality for speed and is only used when
+ * asked for.
+ */
+EXPORT bool video_output_connect_cascade(video_t *video,
+		const struct video_scale_info *conversion,
+		enum video_scale_type scale_type,
+		void (*callback)(void *param, struct video_data *frame),
+		void *param);
 EXPORT void video_output_disconnect(video_t *video,
 		void (*callback)(void *param, struct video_data *frame),
 		void *param);
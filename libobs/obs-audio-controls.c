@@ -228,7 +228,7 @@ static void fader_source_volume_changed(void *vptr, calldata_t *calldata)
 		return;
 	}
 
-	const float mul      = (float)calldata_float(calldata, "volume");
+	const float mul      = (float)calldata_float_fast(calldata, "volume");
 	const float db       = mul_to_db(mul);
 	fader->cur_db        = db;
 
@@ -243,7 +243,7 @@ static void volmeter_source_volume_changed(void *vptr, calldata_t *calldata)
 
 	pthread_mutex_lock(&volmeter->mutex);
 
-	float mul = (float) calldata_float(calldata, "volume");
+	float mul = (float) calldata_float_fast(calldata, "volume");
 	volmeter->cur_db = mul_to_db(mul);
 
 	pthread_mutex_unlock(&volmeter->mutex);
@@ -189,8 +189,13 @@ static void add_connection(struct obs_encoder *encoder)
 		struct video_scale_info info = {0};
 		get_video_info(encoder, &info);
 
-		video_output_connect(encoder->media, &info, receive_video,
-			encoder);
+		if (encoder->scale_cascade)
+			video_output_connect_cascade(encoder->media, &info,
+					encoder->scale_type, receive_video,
+					encoder);
+		else
+			video_output_connect(encoder->media, &info,
+					receive_video, encoder);
 	}
 
 	set_encoder_active(encoder, true);
@@ -580,6 +585,28 @@ void obs_encoder_set_scaled_size(obs_encoder_t *encoder, uint32_t width,
 	encoder->scaled_height = height;
 }
 
+void obs_encoder_set_scale_cascade(obs_encoder_t *encoder, bool enable,
+		enum video_scale_type scale_type)
+{
+	if (!obs_encoder_valid(encoder, "obs_encoder_set_scale_cascade"))
+		return;
+	if (encoder->info.type != OBS_ENCODER_VIDEO) {
+		blog(LOG_WARNING, "obs_encoder_set_scale_cascade: "
+				"encoder '%s' is not a video encoder",
+				obs_encoder_get_name(encoder));
+		return;
+	}
+	if (encoder_active(encoder)) {
+		blog(LOG_WARNING, "encoder '%s': Cannot change scaling "
+		                  "while the encoder is active",
+		                  obs_encoder_get_name(encoder));
+		return;
+	}
+
+	encoder->scale_cascade = enable;
+	encoder->scale_type    = scale_type;
+}
+
 uint32_t obs_encoder_get_width(const obs_encoder_t *encoder)
 {
 	if (!obs_encoder_valid(encoder, "obs_encoder_get_width"))
@@ -770,6 +797,13 @@ static void full_stop(struct obs_encoder *encoder)
 	}
 }
 
+static inline int64_t get_delay_usec(struct obs_encoder *encoder,
+		struct encoder_packet *packet)
+{
+	int64_t delay = encoder->info.get_delay(encoder->context.data);
+	return delay * MICROSECOND_DEN / packet->timebase_den;
+}
+
 static const char *do_encode_name = "do_encode";
 static inline void do_encode(struct obs_encoder *encoder,
 		struct encoder_frame *frame)
@@ -802,6 +836,9 @@ static inline void do_encode(struct obs_encoder *encoder,
 	if (received) {
 		if (!encoder->first_received) {
 			encoder->offset_usec = packet_dts_usec(&pkt);
+			if (encoder->info.get_delay)
+				encoder->offset_usec += get_delay_usec(encoder,
+						&pkt);
 			encoder->first_received = true;
 		}
 
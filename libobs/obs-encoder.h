@@ -234,6 +234,17 @@ struct obs_encoder_info {
 	void (*free_type_data)(void *type_data);
 
 	uint32_t caps;
+
+	/**
+	 * Returns the algorithmic delay of the encoder, in the timebase of
+	 * its packets.  Used to place the first packet before the start of
+	 * the input it was encoded from so that outputs interleave it with
+	 * the correct timing.
+	 *
+	 * @param  data  Data associated with this encoder context
+	 * @return       Encoder delay, in packet timebase units
+	 */
+	int64_t (*get_delay)(void *data);
 };
 
 EXPORT void obs_register_encoder_s(const struct obs_encoder_info *info,
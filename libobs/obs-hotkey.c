@@ -81,13 +81,10 @@ obs_hotkey_t *obs_hotkey_binding_get_hotkey(obs_hotkey_binding_t *binding)
 
 static void hotkey_signal(const char *signal, obs_hotkey_t *hotkey)
 {
-	calldata_t data;
-	calldata_init(&data);
+	CALLDATA_FIXED_DECL(data, CALLDATA_FIXED_SIZE);
 	calldata_set_ptr(&data, "key", hotkey);
 
 	signal_handler_signal(obs->hotkeys.signals, signal, &data);
-
-	calldata_free(&data);
 }
 
 static inline void fixup_pointers(void);
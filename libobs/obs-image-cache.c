@@ -0,0 +1,346 @@
+/******************************************************************************
+    Copyright (C) 2017 by OBS Studio contributors
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#include <sys/stat.h>
+
+#include "graphics/image-file.h"
+#include "obs.h"
+#include "obs-internal.h"
+
+#define DEFAULT_IMAGE_CACHE_LIMIT (256ULL * 1024ULL * 1024ULL)
+
+struct obs_cached_image {
+	long            refs;
+	char            *path;
+	time_t          mtime;
+	int64_t         size;
+	uint64_t        bytes;
+
+	/* false for animated images and images removed from the cache while
+	 * still referenced, which are freed on their last release */
+	bool            shared;
+
+	gs_image_file_t image;
+};
+
+typedef DARRAY(struct obs_cached_image*) image_array_t;
+
+static void free_image(struct obs_cached_image *image)
+{
+	obs_enter_graphics();
+	gs_image_file_free(&image->image);
+	obs_leave_graphics();
+
+	bfree(image->path);
+	bfree(image);
+}
+
+static void free_images(image_array_t *images)
+{
+	for (size_t i = 0; i < images->num; i++)
+		free_image(images->array[i]);
+	da_free((*images));
+}
+
+/* unreferenced images are evicted oldest first.  the images are only
+ * collected here because freeing them requires the graphics context, which
+ * must not be entered with the cache mutex held */
+static void evict_images(struct obs_core_image_cache *cache,
+		image_array_t *victims)
+{
+	size_t i = 0;
+
+	while (cache->bytes > cache->limit && i < cache->images.num) {
+		struct obs_cached_image *image = cache->images.array[i];
+
+		if (image->refs) {
+			i++;
+			continue;
+		}
+
+		cache->bytes -= image->bytes;
+		cache->evictions++;
+		da_erase(cache->images, i);
+		da_push_back((*victims), &image);
+	}
+}
+
+static void remove_image(struct obs_core_image_cache *cache, size_t idx,
+		image_array_t *victims)
+{
+	struct obs_cached_image *image = cache->images.array[idx];
+
+	cache->bytes -= image->bytes;
+	da_erase(cache->images, idx);
+
+	if (image->refs)
+		image->shared = false;
+	else
+		da_push_back((*victims), &image);
+}
+
+/* finds an image by path, discarding outdated entries for the same path.
+ * must be called with the mutex held */
+static struct obs_cached_image *find_image(struct obs_core_image_cache *cache,
+		const char *path, time_t mtime, int64_t size,
+		image_array_t *victims)
+{
+	for (size_t i = 0; i < cache->images.num; i++) {
+		struct obs_cached_image *image = cache->images.array[i];
+
+		if (strcmp(image->path, path) != 0)
+			continue;
+
+		if (image->mtime != mtime || image->size != size) {
+			remove_image(cache, i, victims);
+			return NULL;
+		}
+
+		/* move to the back of the LRU order */
+		da_erase(cache->images, i);
+		da_push_back(cache->images, &image);
+		image->refs++;
+		return image;
+	}
+
+	return NULL;
+}
+
+static struct obs_cached_image *load_image(const char *path, time_t mtime,
+		int64_t size)
+{
+	struct obs_cached_image *image = bzalloc(sizeof(*image));
+
+	gs_image_file_init(&image->image, path);
+	if (!image->image.loaded) {
+		bfree(image);
+		return NULL;
+	}
+
+	image->refs = 1;
+	image->path = bstrdup(path);
+	image->mtime = mtime;
+	image->size = size;
+	image->bytes = (uint64_t)image->image.cx * image->image.cy * 4;
+	image->shared = !image->image.is_animated_gif;
+	return image;
+}
+
+obs_cached_image_t *obs_image_cache_get(const char *path)
+{
+	struct obs_core_image_cache *cache;
+	struct obs_cached_image *image;
+	struct obs_cached_image *existing;
+	image_array_t victims;
+	struct stat stats;
+
+	if (!obs || !path || !*path)
+		return NULL;
+	if (os_stat(path, &stats) != 0)
+		return NULL;
+
+	cache = &obs->image_cache;
+	da_init(victims);
+
+	pthread_mutex_lock(&cache->mutex);
+	image = cache->active ? find_image(cache, path, stats.st_mtime,
+			(int64_t)stats.st_size, &victims) : NULL;
+	if (image)
+		cache->hits++;
+	else
+		cache->misses++;
+	pthread_mutex_unlock(&cache->mutex);
+
+	free_images(&victims);
+	if (image)
+		return image;
+
+	/* decode without holding the lock; if another thread cached the same
+	 * file in the meantime its image is used instead */
+	image = load_image(path, stats.st_mtime, (int64_t)stats.st_size);
+	if (!image || !image->shared)
+		return image;
+
+	pthread_mutex_lock(&cache->mutex);
+	existing = cache->active ? find_image(cache, path, stats.st_mtime,
+			(int64_t)stats.st_size, &victims) : NULL;
+
+	if (existing) {
+		da_push_back(victims, &image);
+		image = existing;
+
+	} else if (cache->active) {
+		da_push_back(cache->images, &image);
+		cache->bytes += image->bytes;
+		evict_images(cache, &victims);
+
+	} else {
+		image->shared = false;
+	}
+	pthread_mutex_unlock(&cache->mutex);
+
+	free_images(&victims);
+	return image;
+}
+
+void obs_image_cache_release(obs_cached_image_t *image)
+{
+	struct obs_core_image_cache *cache;
+	image_array_t victims;
+	bool free_now;
+
+	if (!image)
+		return;
+	if (!obs) {
+		free_image(image);
+		return;
+	}
+
+	cache = &obs->image_cache;
+	da_init(victims);
+
+	pthread_mutex_lock(&cache->mutex);
+	free_now = --image->refs == 0 && !image->shared;
+	if (!image->refs && image->shared)
+		evict_images(cache, &victims);
+	pthread_mutex_unlock(&cache->mutex);
+
+	if (free_now)
+		free_image(image);
+	free_images(&victims);
+}
+
+gs_image_file_t *obs_cached_image_get_file(obs_cached_image_t *image)
+{
+	return image ? &image->image : NULL;
+}
+
+bool obs_cached_image_shared(const obs_cached_image_t *image)
+{
+	return image ? image->shared : false;
+}
+
+gs_texture_t *obs_cached_image_get_texture(obs_cached_image_t *image)
+{
+	gs_texture_t *texture;
+
+	if (!image || !obs)
+		return NULL;
+
+	pthread_mutex_lock(&obs->image_cache.mutex);
+	if (!image->image.texture)
+		gs_image_file_init_texture(&image->image);
+	texture = image->image.texture;
+	pthread_mutex_unlock(&obs->image_cache.mutex);
+
+	return texture;
+}
+
+void obs_image_cache_set_limit(uint64_t bytes)
+{
+	struct obs_core_image_cache *cache;
+	image_array_t victims;
+
+	if (!obs)
+		return;
+
+	cache = &obs->image_cache;
+	da_init(victims);
+
+	pthread_mutex_lock(&cache->mutex);
+	cache->limit = bytes;
+	evict_images(cache, &victims);
+	pthread_mutex_unlock(&cache->mutex);
+
+	free_images(&victims);
+}
+
+void obs_image_cache_get_stats(struct obs_image_cache_stats *stats)
+{
+	struct obs_core_image_cache *cache;
+
+	if (!stats)
+		return;
+
+	memset(stats, 0, sizeof(*stats));
+	if (!obs)
+		return;
+
+	cache = &obs->image_cache;
+
+	pthread_mutex_lock(&cache->mutex);
+	stats->hits = cache->hits;
+	stats->misses = cache->misses;
+	stats->evictions = cache->evictions;
+	stats->images = cache->images.num;
+	stats->bytes = cache->bytes;
+	stats->limit = cache->limit;
+	pthread_mutex_unlock(&cache->mutex);
+}
+
+bool obs_init_image_cache(void)
+{
+	struct obs_core_image_cache *cache = &obs->image_cache;
+
+	pthread_mutex_init_value(&cache->mutex);
+	if (pthread_mutex_init(&cache->mutex, NULL) != 0)
+		return false;
+
+	cache->limit = DEFAULT_IMAGE_CACHE_LIMIT;
+	cache->initialized = true;
+	cache->active = true;
+	return true;
+}
+
+/* called while the graphics subsystem still exists.  images that are still
+ * referenced (by modules that haven't been unloaded yet) are detached from
+ * the cache and freed on their last release */
+void obs_free_image_cache(void)
+{
+	struct obs_core_image_cache *cache = &obs->image_cache;
+	image_array_t victims;
+
+	if (!cache->initialized)
+		return;
+
+	da_init(victims);
+
+	pthread_mutex_lock(&cache->mutex);
+	blog(LOG_INFO, "Image cache: %llu hits, %llu misses, %llu evictions",
+			(unsigned long long)cache->hits,
+			(unsigned long long)cache->misses,
+			(unsigned long long)cache->evictions);
+
+	while (cache->images.num)
+		remove_image(cache, cache->images.num - 1, &victims);
+	da_free(cache->images);
+	cache->active = false;
+	pthread_mutex_unlock(&cache->mutex);
+
+	free_images(&victims);
+}
+
+void obs_destroy_image_cache(void)
+{
+	struct obs_core_image_cache *cache = &obs->image_cache;
+
+	if (!cache->initialized)
+		return;
+
+	pthread_mutex_destroy(&cache->mutex);
+	cache->initialized = false;
+}
@@ -318,9 +318,32 @@ struct obs_core_data {
 
 	long long                       unnamed_index;
 
+	/* ids of signals emitted on hot paths, resolved once at startup */
+	signal_id_t                     item_transform_id;
+	signal_id_t                     update_properties_id;
+
 	volatile bool                   valid;
 };
 
+/* decoded images shared between sources, see obs-image-cache.c */
+struct obs_core_image_cache {
+	pthread_mutex_t                 mutex;
+	DARRAY(struct obs_cached_image*) images;
+	uint64_t                        bytes;
+	uint64_t                        limit;
+
+	uint64_t                        hits;
+	uint64_t                        misses;
+	uint64_t                        evictions;
+
+	bool                            initialized;
+	bool                            active;
+};
+
+extern bool obs_init_image_cache(void);
+extern void obs_free_image_cache(void);
+extern void obs_destroy_image_cache(void);
+
 /* user hotkeys */
 struct obs_core_hotkeys {
 	pthread_mutex_t                 mutex;
@@ -384,6 +407,7 @@ struct obs_core {
 	struct obs_core_audio           audio;
 	struct obs_core_data            data;
 	struct obs_core_hotkeys         hotkeys;
+	struct obs_core_image_cache     image_cache;
 };
 
 extern struct obs_core *obs;
@@ -703,10 +727,7 @@ enum view_type {
 static inline void obs_source_dosignal(struct obs_source *source,
 		const char *signal_obs, const char *signal_source)
 {
-	struct calldata data;
-	uint8_t stack[128];
-
-	calldata_init_fixed(&data, stack, sizeof(stack));
+	CALLDATA_FIXED_DECL(data, CALLDATA_FIXED_SIZE);
 	calldata_set_ptr(&data, "source", source);
 	if (signal_obs && !source->context.private)
 		signal_handler_signal(obs->signals, signal_obs, &data);
@@ -870,10 +891,9 @@ struct obs_output {
 static inline void do_output_signal(struct obs_output *output,
 		const char *signal)
 {
-	struct calldata params = {0};
+	CALLDATA_FIXED_DECL(params, CALLDATA_FIXED_SIZE);
 	calldata_set_ptr(&params, "output", output);
 	signal_handler_signal(output->context.signals, signal, &params);
-	calldata_free(&params);
 }
 
 extern void process_delay(void *data, struct encoder_packet *packet);
@@ -926,6 +946,8 @@ struct obs_encoder {
 	uint32_t                        scaled_width;
 	uint32_t                        scaled_height;
 	enum video_format               preferred_format;
+	bool                            scale_cascade;
+	enum video_scale_type           scale_type;
 
 	volatile bool                   active;
 	bool                            initialized;
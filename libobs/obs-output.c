@@ -1552,10 +1552,7 @@ static inline void signal_start(struct obs_output *output)
 
 static inline void signal_reconnect(struct obs_output *output)
 {
-	struct calldata params;
-	uint8_t stack[128];
-
-	calldata_init_fixed(&params, stack, sizeof(stack));
+	CALLDATA_FIXED_DECL(params, CALLDATA_FIXED_SIZE);
 	calldata_set_int(&params, "timeout_sec",
 			output->reconnect_retry_cur_sec);
 	calldata_set_ptr(&params, "output", output);
@@ -1569,10 +1566,7 @@ static inline void signal_reconnect_success(struct obs_output *output)
 
 static inline void signal_stop(struct obs_output *output)
 {
-	struct calldata params;
-	uint8_t stack[128];
-
-	calldata_init_fixed(&params, stack, sizeof(stack));
+	CALLDATA_FIXED_DECL(params, CALLDATA_FIXED_SIZE);
 	calldata_set_int(&params, "code", output->stop_code);
 	calldata_set_ptr(&params, "output", output);
 	signal_handler_signal(output->context.signals, "stop", &params);
@@ -44,10 +44,7 @@ static const char *obs_scene_signals[] = {
 
 static inline void signal_item_remove(struct obs_scene_item *item)
 {
-	struct calldata params;
-	uint8_t stack[128];
-
-	calldata_init_fixed(&params, stack, sizeof(stack));
+	CALLDATA_FIXED_DECL(params, CALLDATA_FIXED_SIZE);
 	calldata_set_ptr(&params, "scene", item->parent);
 	calldata_set_ptr(&params, "item", item);
 
@@ -318,8 +315,7 @@ static void update_item_transform(struct obs_scene_item *item)
 	struct vec2     base_origin;
 	struct vec2     origin;
 	struct vec2     scale         = item->scale;
-	struct calldata params;
-	uint8_t         stack[128];
+	signal_handler_t *signals;
 
 	if (os_atomic_load_long(&item->defer_update) > 0)
 		return;
@@ -379,11 +375,15 @@ static void update_item_transform(struct obs_scene_item *item)
 	item->last_width  = width;
 	item->last_height = height;
 
-	calldata_init_fixed(&params, stack, sizeof(stack));
+	signals = item->parent->source->context.signals;
+	if (!signal_handler_has_callbacks(signals, obs->data.item_transform_id))
+		return;
+
+	CALLDATA_FIXED_DECL(params, CALLDATA_FIXED_SIZE);
 	calldata_set_ptr(&params, "scene", item->parent);
 	calldata_set_ptr(&params, "item", item);
-	signal_handler_signal(item->parent->source->context.signals,
-			"item_transform", &params);
+	signal_handler_signal_id(signals, obs->data.item_transform_id,
+			&params);
 }
 
 static inline bool source_size_changed(struct obs_scene_item *item)
@@ -1276,8 +1276,6 @@ obs_sceneitem_t *obs_scene_add(obs_scene_t *scene, obs_source_t *source)
 {
 	struct obs_scene_item *last;
 	struct obs_scene_item *item;
-	struct calldata params;
-	uint8_t stack[128];
 	pthread_mutex_t mutex;
 
 	struct item_action action = {
@@ -1350,7 +1348,7 @@ obs_sceneitem_t *obs_scene_add(obs_scene_t *scene, obs_source_t *source)
 	if (!scene->source->context.private)
 		init_hotkeys(scene, item, obs_source_get_name(source));
 
-	calldata_init_fixed(&params, stack, sizeof(stack));
+	CALLDATA_FIXED_DECL(params, CALLDATA_FIXED_SIZE);
 	calldata_set_ptr(&params, "scene", scene);
 	calldata_set_ptr(&params, "item", item);
 	signal_handler_signal(scene->source->context.signals, "item_add",
@@ -1435,8 +1433,6 @@ obs_source_t *obs_sceneitem_get_source(const obs_sceneitem_t *item)
 
 void obs_sceneitem_select(obs_sceneitem_t *item, bool select)
 {
-	struct calldata params;
-	uint8_t stack[128];
 	const char *command = select ? "item_select" : "item_deselect";
 
 	if (!item || item->selected == select || !item->parent)
@@ -1444,7 +1440,7 @@ void obs_sceneitem_select(obs_sceneitem_t *item, bool select)
 
 	item->selected = select;
 
-	calldata_init_fixed(&params, stack, sizeof(stack));
+	CALLDATA_FIXED_DECL(params, CALLDATA_FIXED_SIZE);
 	calldata_set_ptr(&params, "scene", item->parent);
 	calldata_set_ptr(&params, "item",  item);
 	signal_handler_signal(item->parent->source->context.signals,
@@ -1491,12 +1487,10 @@ void obs_sceneitem_set_alignment(obs_sceneitem_t *item, uint32_t alignment)
 static inline void signal_reorder(struct obs_scene_item *item)
 {
 	const char *command = NULL;
-	struct calldata params;
-	uint8_t stack[128];
 
 	command = "reorder";
 
-	calldata_init_fixed(&params, stack, sizeof(stack));
+	CALLDATA_FIXED_DECL(params, CALLDATA_FIXED_SIZE);
 	calldata_set_ptr(&params, "scene", item->parent);
 
 	signal_handler_signal(item->parent->source->context.signals,
@@ -1692,8 +1686,6 @@ bool obs_sceneitem_visible(const obs_sceneitem_t *item)
 
 bool obs_sceneitem_set_visible(obs_sceneitem_t *item, bool visible)
 {
-	struct calldata cd;
-	uint8_t stack[256];
 	struct item_action action = {
 		.visible = visible,
 		.timestamp = os_gettime_ns()
@@ -1720,7 +1712,7 @@ bool obs_sceneitem_set_visible(obs_sceneitem_t *item, bool visible)
 
 	item->user_visible = visible;
 
-	calldata_init_fixed(&cd, stack, sizeof(stack));
+	CALLDATA_FIXED_DECL(cd, 256);
 	calldata_set_ptr(&cd, "scene", item->parent);
 	calldata_set_ptr(&cd, "item", item);
 	calldata_set_bool(&cd, "visible", visible);
@@ -456,10 +456,20 @@ void obs_source_frame_init(struct obs_source_frame *frame,
 	}
 }
 
+/* frames output with obs_source_output_video_ref are handed back to their
+ * owner instead of being freed */
+static inline void async_frame_destroy(struct obs_source_frame *frame)
+{
+	if (frame->release)
+		frame->release(frame->release_param, frame);
+	else
+		obs_source_frame_destroy(frame);
+}
+
 static inline void obs_source_frame_decref(struct obs_source_frame *frame)
 {
 	if (os_atomic_dec_long(&frame->refs) == 0)
-		obs_source_frame_destroy(frame);
+		async_frame_destroy(frame);
 }
 
 static bool obs_source_filter_remove_refless(obs_source_t *source,
@@ -753,7 +763,14 @@ void obs_source_update_properties(obs_source_t *source)
 	if (!obs_source_valid(source, "obs_source_update_properties"))
 		return;
 
-	obs_source_dosignal(source, NULL, "update_properties");
+	if (!signal_handler_has_callbacks(source->context.signals,
+				obs->data.update_properties_id))
+		return;
+
+	CALLDATA_FIXED_DECL(data, CALLDATA_FIXED_SIZE);
+	calldata_set_ptr(&data, "source", source);
+	signal_handler_signal_id(source->context.signals,
+			obs->data.update_properties_id, &data);
 }
 
 void obs_source_send_mouse_click(obs_source_t *source,
@@ -1851,9 +1868,6 @@ obs_source_t *obs_filter_get_target(const obs_source_t *filter)
 
 void obs_source_filter_add(obs_source_t *source, obs_source_t *filter)
 {
-	struct calldata cd;
-	uint8_t stack[128];
-
 	if (!obs_source_valid(source, "obs_source_filter_add"))
 		return;
 	if (!obs_ptr_valid(filter, "obs_source_filter_add"))
@@ -1878,7 +1892,7 @@ void obs_source_filter_add(obs_source_t *source, obs_source_t *filter)
 
 	pthread_mutex_unlock(&source->filter_mutex);
 
-	calldata_init_fixed(&cd, stack, sizeof(stack));
+	CALLDATA_FIXED_DECL(cd, CALLDATA_FIXED_SIZE);
 	calldata_set_ptr(&cd, "source", source);
 	calldata_set_ptr(&cd, "filter", filter);
 
@@ -1892,8 +1906,6 @@ void obs_source_filter_add(obs_source_t *source, obs_source_t *filter)
 static bool obs_source_filter_remove_refless(obs_source_t *source,
 		obs_source_t *filter)
 {
-	struct calldata cd;
-	uint8_t stack[128];
 	size_t idx;
 
 	pthread_mutex_lock(&source->filter_mutex);
@@ -1913,7 +1925,7 @@ static bool obs_source_filter_remove_refless(obs_source_t *source,
 
 	pthread_mutex_unlock(&source->filter_mutex);
 
-	calldata_init_fixed(&cd, stack, sizeof(stack));
+	CALLDATA_FIXED_DECL(cd, CALLDATA_FIXED_SIZE);
 	calldata_set_ptr(&cd, "source", source);
 	calldata_set_ptr(&cd, "filter", filter);
 
@@ -2289,6 +2301,125 @@ static inline struct obs_source_frame *cache_video(struct obs_source *source,
 	return new_frame;
 }
 
+/* planar frames are uploaded straight from data[0] as one texture of
+ * width * height * 3 / 2 bytes, so they can only be used without copying if
+ * all of their planes are inside of that area */
+static inline bool chroma_plane_uploaded(const struct obs_source_frame *frame,
+		size_t plane, size_t plane_size)
+{
+	size_t luma_size = (size_t)frame->width * frame->height;
+	size_t offset;
+
+	if (frame->data[plane] < frame->data[0])
+		return false;
+
+	offset = (size_t)(frame->data[plane] - frame->data[0]);
+	return offset >= luma_size &&
+	       offset + plane_size <= luma_size + luma_size / 2;
+}
+
+static bool frame_data_packed(const struct obs_source_frame *frame)
+{
+	size_t luma_size = (size_t)frame->width * frame->height;
+
+	switch (frame->format) {
+	case VIDEO_FORMAT_I420:
+		return frame->linesize[0] == frame->width &&
+		       frame->linesize[1] == frame->width / 2 &&
+		       frame->linesize[2] == frame->width / 2 &&
+		       frame->data[1] != frame->data[2] &&
+		       chroma_plane_uploaded(frame, 1, luma_size / 4) &&
+		       chroma_plane_uploaded(frame, 2, luma_size / 4);
+
+	case VIDEO_FORMAT_NV12:
+		return frame->linesize[0] == frame->width &&
+		       frame->linesize[1] == frame->width &&
+		       chroma_plane_uploaded(frame, 1, luma_size / 2);
+
+	case VIDEO_FORMAT_YVYU:
+	case VIDEO_FORMAT_YUY2:
+	case VIDEO_FORMAT_UYVY:
+	case VIDEO_FORMAT_RGBA:
+	case VIDEO_FORMAT_BGRA:
+	case VIDEO_FORMAT_BGRX:
+		return true;
+
+	case VIDEO_FORMAT_Y800:
+	case VIDEO_FORMAT_I444:
+	case VIDEO_FORMAT_NONE:
+		return false;
+	}
+
+	return false;
+}
+
+void obs_source_output_video_ref(obs_source_t *source,
+		struct obs_source_frame *frame,
+		obs_source_frame_release_t release, void *param)
+{
+	struct async_frame af;
+
+	if (!frame)
+		return;
+
+	if (!obs_source_valid(source, "obs_source_output_video_ref")) {
+		release(param, frame);
+		return;
+	}
+
+	if (!frame_data_packed(frame)) {
+		obs_source_output_video(source, frame);
+		release(param, frame);
+		return;
+	}
+
+	frame->refs          = 1;
+	frame->prev_frame    = false;
+	frame->release       = release;
+	frame->release_param = param;
+
+	pthread_mutex_lock(&source->async_mutex);
+
+	if (source->async_frames.num >= MAX_ASYNC_FRAMES) {
+		free_async_cache(source);
+		source->last_frame_ts = 0;
+		pthread_mutex_unlock(&source->async_mutex);
+
+		release(param, frame);
+		return;
+	}
+
+	if (async_texture_changed(source, frame)) {
+		free_async_cache(source);
+		source->async_cache_width  = frame->width;
+		source->async_cache_height = frame->height;
+		source->async_cache_format = frame->format;
+	}
+
+	/* the cache holds the reference until the frame has been used, see
+	 * remove_async_frame */
+	af.frame        = frame;
+	af.unused_count = 0;
+	af.used         = true;
+	da_push_back(source->async_cache, &af);
+	da_push_back(source->async_frames, &frame);
+
+	pthread_mutex_unlock(&source->async_mutex);
+
+	source->async_active = true;
+}
+
+void obs_source_flush_async_video(obs_source_t *source)
+{
+	if (!obs_source_valid(source, "obs_source_flush_async_video"))
+		return;
+
+	pthread_mutex_lock(&source->async_mutex);
+	free_async_cache(source);
+	source->last_frame_ts = 0;
+	pthread_mutex_unlock(&source->async_mutex);
+}
+
 void obs_source_output_video(obs_source_t *source,
 		const struct obs_source_frame *frame)
 {
@@ -2493,7 +2624,13 @@ void remove_async_frame(obs_source_t *source, struct obs_source_frame *frame)
 		struct async_frame *f = &source->async_cache.array[i];
 
 		if (f->frame == frame) {
-			f->used = false;
+			/* frames that aren't ours can't be reused */
+			if (frame->release) {
+				da_erase(source->async_cache, i);
+				obs_source_frame_decref(frame);
+			} else {
+				f->used = false;
+			}
 			break;
 		}
 	}
@@ -2643,12 +2780,12 @@ void obs_source_release_frame(obs_source_t *source,
 		return;
 
 	if (!source) {
-		obs_source_frame_destroy(frame);
+		async_frame_destroy(frame);
 	} else {
 		pthread_mutex_lock(&source->async_mutex);
 
 		if (os_atomic_dec_long(&frame->refs) == 0)
-			obs_source_frame_destroy(frame);
+			async_frame_destroy(frame);
 		else
 			remove_async_frame(source, frame);
 
@@ -2916,10 +3053,7 @@ void obs_source_set_volume(obs_source_t *source, float volume)
 			.vol       = volume
 		};
 
-		struct calldata data;
-		uint8_t stack[128];
-
-		calldata_init_fixed(&data, stack, sizeof(stack));
+		CALLDATA_FIXED_DECL(data, CALLDATA_FIXED_SIZE);
 		calldata_set_ptr(&data, "source", source);
 		calldata_set_float(&data, "volume", volume);
 
@@ -2928,7 +3062,7 @@ void obs_source_set_volume(obs_source_t *source, float volume)
 			signal_handler_signal(obs->signals, "source_volume",
 					&data);
 
-		volume = (float)calldata_float(&data, "volume");
+		volume = (float)calldata_float_fast(&data, "volume");
 
 		pthread_mutex_lock(&source->audio_actions_mutex);
 		da_push_back(source->audio_actions, &action);
@@ -2947,17 +3081,14 @@ float obs_source_get_volume(const obs_source_t *source)
 void obs_source_set_sync_offset(obs_source_t *source, int64_t offset)
 {
 	if (obs_source_valid(source, "obs_source_set_sync_offset")) {
-		struct calldata data;
-		uint8_t stack[128];
-
-		calldata_init_fixed(&data, stack, sizeof(stack));
+		CALLDATA_FIXED_DECL(data, CALLDATA_FIXED_SIZE);
 		calldata_set_ptr(&data, "source", source);
 		calldata_set_int(&data, "offset", offset);
 
 		signal_handler_signal(source->context.signals, "audio_sync",
 				&data);
 
-		source->sync_offset = calldata_int(&data, "offset");
+		source->sync_offset = calldata_int_fast(&data, "offset");
 	}
 }
 
@@ -3187,10 +3318,7 @@ bool obs_source_showing(const obs_source_t *source)
 
 static inline void signal_flags_updated(obs_source_t *source)
 {
-	struct calldata data;
-	uint8_t stack[128];
-
-	calldata_init_fixed(&data, stack, sizeof(stack));
+	CALLDATA_FIXED_DECL(data, CALLDATA_FIXED_SIZE);
 	calldata_set_ptr(&data, "source", source);
 	calldata_set_int(&data, "flags", source->flags);
 
@@ -3224,9 +3352,6 @@ uint32_t obs_source_get_flags(const obs_source_t *source)
 
 void obs_source_set_audio_mixers(obs_source_t *source, uint32_t mixers)
 {
-	struct calldata data;
-	uint8_t stack[128];
-
 	if (!obs_source_valid(source, "obs_source_set_audio_mixers"))
 		return;
 	if ((source->info.output_flags & OBS_SOURCE_AUDIO) == 0)
@@ -3235,13 +3360,13 @@ void obs_source_set_audio_mixers(obs_source_t *source, uint32_t mixers)
 	if (source->audio_mixers == mixers)
 		return;
 
-	calldata_init_fixed(&data, stack, sizeof(stack));
+	CALLDATA_FIXED_DECL(data, CALLDATA_FIXED_SIZE);
 	calldata_set_ptr(&data, "source", source);
 	calldata_set_int(&data, "mixers", mixers);
 
 	signal_handler_signal(source->context.signals, "audio_mixers", &data);
 
-	mixers = (uint32_t)calldata_int(&data, "mixers");
+	mixers = (uint32_t)calldata_int_fast(&data, "mixers");
 
 	source->audio_mixers = mixers;
 }
@@ -3387,15 +3512,12 @@ bool obs_source_enabled(const obs_source_t *source)
 
 void obs_source_set_enabled(obs_source_t *source, bool enabled)
 {
-	struct calldata data;
-	uint8_t stack[128];
-
 	if (!obs_source_valid(source, "obs_source_set_enabled"))
 		return;
 
 	source->enabled = enabled;
 
-	calldata_init_fixed(&data, stack, sizeof(stack));
+	CALLDATA_FIXED_DECL(data, CALLDATA_FIXED_SIZE);
 	calldata_set_ptr(&data, "source", source);
 	calldata_set_bool(&data, "enabled", enabled);
 
@@ -3410,8 +3532,6 @@ bool obs_source_muted(const obs_source_t *source)
 
 void obs_source_set_muted(obs_source_t *source, bool muted)
 {
-	struct calldata data;
-	uint8_t stack[128];
 	struct audio_action action = {
 		.timestamp = os_gettime_ns(),
 		.type      = AUDIO_ACTION_MUTE,
@@ -3423,7 +3543,7 @@ void obs_source_set_muted(obs_source_t *source, bool muted)
 
 	source->user_muted = muted;
 
-	calldata_init_fixed(&data, stack, sizeof(stack));
+	CALLDATA_FIXED_DECL(data, CALLDATA_FIXED_SIZE);
 	calldata_set_ptr(&data, "source", source);
 	calldata_set_bool(&data, "muted", muted);
 
@@ -3437,10 +3557,7 @@ void obs_source_set_muted(obs_source_t *source, bool muted)
 static void source_signal_push_to_changed(obs_source_t *source,
 		const char *signal, bool enabled)
 {
-	struct calldata data;
-	uint8_t stack[128];
-
-	calldata_init_fixed(&data, stack, sizeof(stack));
+	CALLDATA_FIXED_DECL(data, CALLDATA_FIXED_SIZE);
 	calldata_set_ptr (&data, "source",  source);
 	calldata_set_bool(&data, "enabled", enabled);
 
@@ -3450,10 +3567,7 @@ static void source_signal_push_to_changed(obs_source_t *source,
 static void source_signal_push_to_delay(obs_source_t *source,
 		const char *signal, uint64_t delay)
 {
-	struct calldata data;
-	uint8_t stack[128];
-
-	calldata_init_fixed(&data, stack, sizeof(stack));
+	CALLDATA_FIXED_DECL(data, CALLDATA_FIXED_SIZE);
 	calldata_set_ptr (&data, "source", source);
 	calldata_set_bool(&data, "delay",  delay);
 
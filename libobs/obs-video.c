@@ -575,6 +575,12 @@ void *obs_video_thread(void *param)
 	uint64_t interval = video_output_get_frame_time(obs->video.video);
 	uint64_t fps_total_ns = 0;
 	uint32_t fps_total_frames = 0;
+#if COUNT_ALLOCATIONS
+	uint64_t total_frames = 0;
+	uint64_t total_allocs = 0;
+	long last_allocs;
+	long allocs;
+#endif
 
 	obs->video.video_time = os_gettime_ns();
 
@@ -585,6 +591,10 @@ void *obs_video_thread(void *param)
 			"obs_video_thread(%g"NBSP"ms)", interval / 1000000.);
 	profile_register_root(video_thread_name, interval);
 
+#if COUNT_ALLOCATIONS
+	last_allocs = btotal_allocs();
+#endif
+
 	while (!video_output_stopped(obs->video.video)) {
 		profile_start(video_thread_name);
 
@@ -606,6 +616,15 @@ void *obs_video_thread(void *param)
 
 		video_sleep(&obs->video, &obs->video.video_time, interval);
 
+#if COUNT_ALLOCATIONS
+		/* the counter is process-wide, so this is the heap churn of all
+		 * threads during one frame interval, not of the video thread */
+		allocs = btotal_allocs();
+		total_allocs += (unsigned long)allocs - (unsigned long)last_allocs;
+		last_allocs = allocs;
+		total_frames++;
+#endif
+
 		fps_total_ns += (obs->video.video_time - last_time);
 		fps_total_frames++;
 
@@ -617,6 +636,13 @@ void *obs_video_thread(void *param)
 		}
 	}
 
+#if COUNT_ALLOCATIONS
+	if (total_frames)
+		blog(LOG_INFO, "Heap allocations (all threads) per frame "
+				"interval: %.2f",
+				(double)total_allocs / (double)total_frames);
+#endif
+
 	UNUSED_PARAMETER(param);
 	return NULL;
 }
@@ -561,6 +561,8 @@ static bool obs_init_data(void)
 	if (!obs_view_init(&data->main_view))
 		goto fail;
 
+	data->item_transform_id = signal_get_id("item_transform");
+	data->update_properties_id = signal_get_id("update_properties");
 	data->valid = true;
 
 fail:
@@ -755,6 +757,8 @@ static bool obs_init(const char *locale, const char *module_config_path,
 
 	if (!obs_init_data())
 		return false;
+	if (!obs_init_image_cache())
+		return false;
 	if (!obs_init_handlers())
 		return false;
 	if (!obs_init_hotkeys())
@@ -834,6 +838,7 @@ void obs_shutdown(void)
 
 	obs_free_audio();
 	obs_free_data();
+	obs_free_image_cache();
 	obs_free_video();
 	obs_free_hotkeys();
 	obs_free_graphics();
@@ -857,6 +862,8 @@ void obs_shutdown(void)
 	if (obs->name_store_owned)
 		profiler_name_store_free(obs->name_store);
 
+	obs_destroy_image_cache();
+
 	bfree(obs->module_config_path);
 	bfree(obs->locale);
 	bfree(obs);
@@ -1214,7 +1221,7 @@ void obs_set_output_source(uint32_t channel, obs_source_t *source)
 
 	struct obs_source *prev_source;
 	struct obs_view *view = &obs->data.main_view;
-	struct calldata params = {0};
+	CALLDATA_FIXED_DECL(params, CALLDATA_FIXED_SIZE);
 
 	pthread_mutex_lock(&view->channels_mutex);
 
@@ -1227,7 +1234,6 @@ void obs_set_output_source(uint32_t channel, obs_source_t *source)
 	calldata_set_ptr(&params, "source", source);
 	signal_handler_signal(obs->signals, "channel_change", &params);
 	calldata_get_ptr(&params, "source", &source);
-	calldata_free(&params);
 
 	view->channels[channel] = source;
 
@@ -1437,14 +1443,13 @@ void obs_render_main_view(void)
 
 void obs_set_master_volume(float volume)
 {
-	struct calldata data = {0};
+	CALLDATA_FIXED_DECL(data, CALLDATA_FIXED_SIZE);
 
 	if (!obs) return;
 
 	calldata_set_float(&data, "volume", volume);
 	signal_handler_signal(obs->signals, "master_volume", &data);
-	volume = (float)calldata_float(&data, "volume");
-	calldata_free(&data);
+	volume = (float)calldata_float_fast(&data, "volume");
 
 	obs->audio.user_volume = volume;
 }
@@ -62,6 +62,7 @@ typedef struct obs_output     obs_output_t;
 typedef struct obs_encoder    obs_encoder_t;
 typedef struct obs_service    obs_service_t;
 typedef struct obs_module     obs_module_t;
+typedef struct obs_cached_image obs_cached_image_t;
 typedef struct obs_fader      obs_fader_t;
 typedef struct obs_volmeter   obs_volmeter_t;
 
@@ -237,6 +238,9 @@ struct obs_source_frame {
 	/* used internally by libobs */
 	volatile long       refs;
 	bool                prev_frame;
+	void                (*release)(void *param,
+	                            struct obs_source_frame *frame);
+	void                *release_param;
 };
 
 /* ------------------------------------------------------------------------- */
@@ -594,6 +598,60 @@ EXPORT bool obs_set_audio_monitoring_device(const char *name, const char *id);
 EXPORT void obs_get_audio_monitoring_device(const char **name, const char **id);
 
 
+/* ------------------------------------------------------------------------- */
+/* Image cache */
+
+struct gs_image_file;
+
+struct obs_image_cache_stats {
+	uint64_t hits;
+	uint64_t misses;
+	uint64_t evictions;
+	size_t   images;
+	uint64_t bytes;
+	uint64_t limit;
+};
+
+/**
+ * Gets a decoded image from the shared image cache, loading it if it isn't
+ * cached yet.  Images are identified by path, modification time and file size,
+ * so a changed file is loaded again.  Can be called from any thread; the
+ * file is decoded on the calling thread.  Returns NULL if the file could not
+ * be loaded.  Release with obs_image_cache_release.
+ *
+ *   Animated GIFs have their own playback state and are never shared, each
+ * call returns a new image.
+ */
+EXPORT obs_cached_image_t *obs_image_cache_get(const char *path);
+
+/**
+ * Releases a cached image.  Unreferenced images stay cached until the cache
+ * exceeds its memory limit, least recently used first.
+ */
+EXPORT void obs_image_cache_release(obs_cached_image_t *image);
+
+/**
+ * Returns the decoded image.  Shared images must not be modified, see
+ * obs_cached_image_shared.
+ */
+EXPORT struct gs_image_file *obs_cached_image_get_file(
+		obs_cached_image_t *image);
+
+/** Returns whether the image may be in use by other callers */
+EXPORT bool obs_cached_image_shared(const obs_cached_image_t *image);
+
+/**
+ * Returns the image's texture, creating it on first use.  Must be called
+ * within the graphics context.
+ */
+EXPORT gs_texture_t *obs_cached_image_get_texture(obs_cached_image_t *image);
+
+/** Sets the memory limit of the image cache in bytes */
+EXPORT void obs_image_cache_set_limit(uint64_t bytes);
+
+EXPORT void obs_image_cache_get_stats(struct obs_image_cache_stats *stats);
+
+
 /* ------------------------------------------------------------------------- */
 /* View context */
 
@@ -976,6 +1034,31 @@ EXPORT void obs_source_draw(gs_texture_t *image, int x, int y,
 EXPORT void obs_source_output_video(obs_source_t *source,
 		const struct obs_source_frame *frame);
 
+typedef void (*obs_source_frame_release_t)(void *param,
+		struct obs_source_frame *frame);
+
+/**
+ * Outputs asynchronous video data without copying it.
+ *
+ *   The frame structure and its data must stay valid until the release
+ * callback is called, which happens once libobs (and anything that got the
+ * frame through obs_source_get_frame) no longer uses it.  The callback may
+ * be called from any thread, including the video thread with the source's
+ * frame lock held, so it should only hand the frame back to its owner.
+ * Frames that libobs can't upload directly (such as Y800 frames, or planar
+ * frames with padded or scattered planes) are copied and released right
+ * away.
+ */
+EXPORT void obs_source_output_video_ref(obs_source_t *source,
+		struct obs_source_frame *frame,
+		obs_source_frame_release_t release, void *param);
+
+/**
+ * Drops all asynchronous video frames that are queued or being displayed,
+ * which releases frames output with obs_source_output_video_ref.
+ */
+EXPORT void obs_source_flush_async_video(obs_source_t *source);
+
 /** Outputs audio data (always asynchronous) */
 EXPORT void obs_source_output_audio(obs_source_t *source,
 		const struct obs_source_audio *audio);
@@ -1605,6 +1688,17 @@ EXPORT enum obs_encoder_type obs_encoder_get_type(const obs_encoder_t *encoder);
 EXPORT void obs_encoder_set_scaled_size(obs_encoder_t *encoder, uint32_t width,
 		uint32_t height);
 
+/**
+ * For video encoders, lets the encoder's scaled frames come from the output of
+ * another cascading encoder on the same video output (for example 1080p ->
+ * 720p -> 480p) instead of from the full size frame.  Only encoders that
+ * enabled this with the same scale type are chained.  Disabled by default.
+ * If the encoder is active, this function will trigger a warning, and do
+ * nothing.
+ */
+EXPORT void obs_encoder_set_scale_cascade(obs_encoder_t *encoder, bool enable,
+		enum video_scale_type scale_type);
+
 /** For video encoders, returns the width of the encoded image */
 EXPORT uint32_t obs_encoder_get_width(const obs_encoder_t *encoder);
 
@@ -89,6 +89,9 @@ static void a_free(void *ptr)
 
 static struct base_allocator alloc = {a_malloc, a_realloc, a_free};
 static long num_allocs = 0;
+#if COUNT_ALLOCATIONS
+static long total_allocs = 0;
+#endif
 
 void base_set_allocator(struct base_allocator *defs)
 {
@@ -107,6 +110,9 @@ void *bmalloc(size_t size)
 	}
 
 	os_atomic_inc_long(&num_allocs);
+#if COUNT_ALLOCATIONS
+	os_atomic_inc_long(&total_allocs);
+#endif
 	return ptr;
 }
 
@@ -114,6 +120,9 @@ void *brealloc(void *ptr, size_t size)
 {
 	if (!ptr)
 		os_atomic_inc_long(&num_allocs);
+#if COUNT_ALLOCATIONS
+	os_atomic_inc_long(&total_allocs);
+#endif
 
 	ptr = alloc.realloc(ptr, size);
 	if (!ptr && !size)
@@ -139,6 +148,15 @@ long bnum_allocs(void)
 	return num_allocs;
 }
 
+long btotal_allocs(void)
+{
+#if COUNT_ALLOCATIONS
+	return os_atomic_load_long(&total_allocs);
+#else
+	return 0;
+#endif
+}
+
 int base_get_alignment(void)
 {
 	return ALIGNMENT;
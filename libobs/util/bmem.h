@@ -41,6 +41,10 @@ EXPORT int base_get_alignment(void);
 
 EXPORT long bnum_allocs(void);
 
+/* number of bmalloc/brealloc calls so far, wraps around.  only counted when
+ * libobs is built with LIBOBS_COUNT_ALLOCATIONS, 0 otherwise */
+EXPORT long btotal_allocs(void);
+
 EXPORT void *bmemdup(const void *ptr, size_t size);
 
 static inline void *bzalloc(size_t size)
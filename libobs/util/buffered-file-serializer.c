@@ -0,0 +1,326 @@
+/*
+ * Copyright (c) 2017 OBS Studio contributors
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+
+#include "buffered-file-serializer.h"
+#include "circlebuf.h"
+#include "threading.h"
+#include "platform.h"
+#include "bmem.h"
+#include "base.h"
+
+#define DEFAULT_BUF_SIZE   (64 * 1024 * 1024)
+#define DEFAULT_CHUNK_SIZE (1024 * 1024)
+#define EXTENT_SIZE        (64LL * 1024 * 1024)
+
+struct buffered_file_data {
+	FILE                       *file;
+	uint8_t                    *chunk;
+	size_t                     chunk_size;
+	size_t                     max_bufsize;
+
+	pthread_t                  thread;
+	pthread_mutex_t            mutex;
+	pthread_cond_t             data_cond;
+	pthread_cond_t             space_cond;
+	struct circlebuf           buf;
+	bool                       busy;
+	bool                       flush;
+	bool                       stop;
+
+	int64_t                    pos;
+	int64_t                    file_pos;
+	int64_t                    file_size;
+	int64_t                    allocated;
+	bool                       prealloc_failed;
+
+	struct buffered_file_stats stats;
+};
+
+static inline bool chunk_ready(struct buffered_file_data *out)
+{
+	return out->buf.size >= out->chunk_size ||
+		(out->buf.size && (out->flush || out->stop));
+}
+
+static void preallocate(struct buffered_file_data *out, size_t size)
+{
+	if (out->prealloc_failed)
+		return;
+	if (out->file_pos + (int64_t)size <= out->allocated)
+		return;
+
+	int64_t new_size = out->file_pos + (int64_t)size + EXTENT_SIZE;
+
+	if (os_fpreallocate(out->file, new_size) == 0) {
+		out->allocated = new_size;
+	} else {
+		blog(LOG_DEBUG, "buffered_file_serializer: file preallocation "
+				"not supported, writing without it");
+		out->prealloc_failed = true;
+	}
+}
+
+static void *buffered_file_thread(void *opaque)
+{
+	struct buffered_file_data *out = opaque;
+
+	os_set_thread_name("buffered file writer");
+
+	pthread_mutex_lock(&out->mutex);
+
+	for (;;) {
+		size_t size;
+		size_t written;
+		uint64_t start;
+		uint64_t elapsed;
+
+		while (!chunk_ready(out) && !out->stop)
+			pthread_cond_wait(&out->data_cond, &out->mutex);
+		if (!out->buf.size && out->stop)
+			break;
+
+		/* keep writes aligned to the chunk size in the file */
+		size = out->chunk_size -
+			(size_t)(out->file_pos % (int64_t)out->chunk_size);
+		if (size > out->buf.size)
+			size = out->buf.size;
+
+		circlebuf_pop_front(&out->buf, out->chunk, size);
+		out->busy = true;
+		pthread_cond_signal(&out->space_cond);
+		pthread_mutex_unlock(&out->mutex);
+
+		preallocate(out, size);
+
+		start = os_gettime_ns();
+		written = fwrite(out->chunk, 1, size, out->file);
+		elapsed = os_gettime_ns() - start;
+
+		pthread_mutex_lock(&out->mutex);
+		out->busy = false;
+		out->file_pos += (int64_t)written;
+		if (out->file_pos > out->file_size)
+			out->file_size = out->file_pos;
+
+		out->stats.bytes_written += written;
+		if (elapsed > out->stats.max_write_time_ns)
+			out->stats.max_write_time_ns = elapsed;
+
+		if (written != size) {
+			blog(LOG_ERROR, "buffered_file_serializer: write failed");
+			out->stats.write_error = true;
+			circlebuf_pop_front(&out->buf, NULL, out->buf.size);
+		}
+
+		pthread_cond_broadcast(&out->space_cond);
+	}
+
+	pthread_mutex_unlock(&out->mutex);
+	return NULL;
+}
+
+/* waits until everything queued has been written, call with mutex held */
+static void flush_locked(struct buffered_file_data *out)
+{
+	out->flush = true;
+	pthread_cond_signal(&out->data_cond);
+
+	while ((out->buf.size || out->busy) && !out->stats.write_error)
+		pthread_cond_wait(&out->space_cond, &out->mutex);
+
+	out->flush = false;
+}
+
+static size_t buffered_file_write(void *opaque, const void *data, size_t size)
+{
+	struct buffered_file_data *out = opaque;
+	const uint8_t *ptr = data;
+	size_t total = size;
+
+	pthread_mutex_lock(&out->mutex);
+
+	while (size && !out->stats.write_error) {
+		size_t avail = out->max_bufsize - out->buf.size;
+
+		if (!avail) {
+			uint64_t start = os_gettime_ns();
+
+			out->stats.stalls++;
+			while (out->buf.size == out->max_bufsize &&
+			       !out->stats.write_error)
+				pthread_cond_wait(&out->space_cond,
+						&out->mutex);
+
+			out->stats.stall_time_ns += os_gettime_ns() - start;
+			continue;
+		}
+
+		if (avail > size)
+			avail = size;
+
+		circlebuf_push_back(&out->buf, ptr, avail);
+		ptr += avail;
+		size -= avail;
+		out->pos += (int64_t)avail;
+
+		if (out->buf.size > out->stats.max_queue_size)
+			out->stats.max_queue_size = out->buf.size;
+		if (chunk_ready(out))
+			pthread_cond_signal(&out->data_cond);
+	}
+
+	if (out->stats.write_error)
+		total -= size;
+
+	pthread_mutex_unlock(&out->mutex);
+	return total;
+}
+
+static int64_t buffered_file_seek(void *opaque, int64_t offset,
+		enum serialize_seek_type seek_type)
+{
+	struct buffered_file_data *out = opaque;
+	int64_t pos = -1;
+
+	pthread_mutex_lock(&out->mutex);
+	flush_locked(out);
+
+	switch (seek_type) {
+	case SERIALIZE_SEEK_START:   pos = offset; break;
+	case SERIALIZE_SEEK_CURRENT: pos = out->pos + offset; break;
+	case SERIALIZE_SEEK_END:     pos = out->file_size + offset; break;
+	}
+
+	if (pos < 0 || os_fseeki64(out->file, pos, SEEK_SET) != 0) {
+		pos = -1;
+	} else {
+		out->pos = pos;
+		out->file_pos = pos;
+	}
+
+	pthread_mutex_unlock(&out->mutex);
+	return pos;
+}
+
+static int64_t buffered_file_get_pos(void *opaque)
+{
+	struct buffered_file_data *out = opaque;
+	int64_t pos;
+
+	pthread_mutex_lock(&out->mutex);
+	pos = out->pos;
+	pthread_mutex_unlock(&out->mutex);
+	return pos;
+}
+
+static void buffered_file_data_free(struct buffered_file_data *out)
+{
+	if (out->file)
+		fclose(out->file);
+
+	pthread_cond_destroy(&out->space_cond);
+	pthread_cond_destroy(&out->data_cond);
+	pthread_mutex_destroy(&out->mutex);
+	circlebuf_free(&out->buf);
+	bfree(out->chunk);
+	bfree(out);
+}
+
+bool buffered_file_serializer_init(struct serializer *s, const char *path,
+		size_t max_bufsize, size_t chunk_size)
+{
+	struct buffered_file_data *out;
+
+	if (!chunk_size)
+		chunk_size = DEFAULT_CHUNK_SIZE;
+	if (!max_bufsize)
+		max_bufsize = DEFAULT_BUF_SIZE;
+	if (max_bufsize < chunk_size)
+		max_bufsize = chunk_size;
+
+	out = bzalloc(sizeof(*out));
+	out->chunk_size = chunk_size;
+	out->max_bufsize = max_bufsize;
+	out->chunk = bmalloc(chunk_size);
+
+	pthread_mutex_init_value(&out->mutex);
+	if (pthread_mutex_init(&out->mutex, NULL) != 0)
+		goto fail;
+	if (pthread_cond_init(&out->data_cond, NULL) != 0)
+		goto fail;
+	if (pthread_cond_init(&out->space_cond, NULL) != 0)
+		goto fail;
+
+	out->file = os_fopen(path, "wb");
+	if (!out->file)
+		goto fail;
+
+	/* all buffering is done here in chunk sized writes */
+	setvbuf(out->file, NULL, _IONBF, 0);
+
+	if (pthread_create(&out->thread, NULL, buffered_file_thread, out) != 0)
+		goto fail;
+
+	s->data = out;
+	s->read = NULL;
+	s->write = buffered_file_write;
+	s->seek = buffered_file_seek;
+	s->get_pos = buffered_file_get_pos;
+	return true;
+
+fail:
+	buffered_file_data_free(out);
+	return false;
+}
+
+void buffered_file_serializer_free(struct serializer *s)
+{
+	struct buffered_file_data *out = s->data;
+
+	if (!out)
+		return;
+
+	pthread_mutex_lock(&out->mutex);
+	out->stop = true;
+	pthread_cond_signal(&out->data_cond);
+	pthread_mutex_unlock(&out->mutex);
+
+	pthread_join(out->thread, NULL);
+
+	/* release any space preallocated past the end of the file */
+	if (out->allocated > out->file_size)
+		os_ftruncate(out->file, out->file_size);
+
+	buffered_file_data_free(out);
+	s->data = NULL;
+}
+
+void buffered_file_serializer_get_stats(struct serializer *s,
+		struct buffered_file_stats *stats)
+{
+	struct buffered_file_data *out = s->data;
+
+	if (!out) {
+		memset(stats, 0, sizeof(*stats));
+		return;
+	}
+
+	pthread_mutex_lock(&out->mutex);
+	*stats = out->stats;
+	stats->queue_size = out->buf.size;
+	pthread_mutex_unlock(&out->mutex);
+}
@@ -0,0 +1,60 @@
+/*
+ * Copyright (c) 2017 OBS Studio contributors
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+
+#pragma once
+
+#include "serializer.h"
+
+/*
+ * Write-behind file output serializer
+ *
+ *   Data written through the serializer is queued in memory and written to
+ * disk in large chunks by a separate thread, so that a slow or stalling disk
+ * does not block the caller until the queue is full.  The file is
+ * preallocated ahead of the write position in large extents where the
+ * platform supports it.  Seeking waits for the queue to be written first.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct buffered_file_stats {
+	uint64_t bytes_written;
+	size_t   queue_size;
+	size_t   max_queue_size;
+	uint64_t stalls;
+	uint64_t stall_time_ns;
+	uint64_t max_write_time_ns;
+	bool     write_error;
+};
+
+/**
+ * Opens a file for write-behind output.  'max_bufsize' is the maximum amount
+ * of queued data before writes block, 'chunk_size' is the size of each
+ * aligned write.  Either can be 0 to use the default.
+ */
+EXPORT bool buffered_file_serializer_init(struct serializer *s,
+		const char *path, size_t max_bufsize, size_t chunk_size);
+EXPORT void buffered_file_serializer_free(struct serializer *s);
+
+EXPORT void buffered_file_serializer_get_stats(struct serializer *s,
+		struct buffered_file_stats *stats);
+
+#ifdef __cplusplus
+}
+#endif
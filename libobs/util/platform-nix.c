@@ -14,6 +14,10 @@
  * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
  */
 
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE /* fallocate */
+#endif
+
 #include <stdio.h>
 #include <errno.h>
 #include <sys/types.h>
@@ -27,6 +31,11 @@
 #include <glob.h>
 #include <time.h>
 #include <signal.h>
+#include <fcntl.h>
+
+#if defined(__linux__)
+#include <linux/falloc.h>
+#endif
 
 #include "obsconfig.h"
 
@@ -364,6 +373,51 @@ int64_t os_get_free_space(const char *path)
 	return ret;
 }
 
+int os_fpreallocate(FILE *file, int64_t size)
+{
+	struct stat st;
+	int fd;
+
+	if (!file || size < 0)
+		return -1;
+
+	fflush(file);
+	fd = fileno(file);
+
+	if (fstat(fd, &st) != 0)
+		return -1;
+	if (size <= (int64_t)st.st_size)
+		return 0;
+
+#if defined(__APPLE__)
+	fstore_t store = {
+		.fst_flags    = F_ALLOCATECONTIG,
+		.fst_posmode  = F_PEOFPOSMODE,
+		.fst_offset   = 0,
+		.fst_length   = (off_t)(size - (int64_t)st.st_size)
+	};
+
+	if (fcntl(fd, F_PREALLOCATE, &store) == 0)
+		return 0;
+
+	store.fst_flags = F_ALLOCATEALL;
+	return fcntl(fd, F_PREALLOCATE, &store) == 0 ? 0 : -1;
+#elif defined(__linux__)
+	return fallocate(fd, FALLOC_FL_KEEP_SIZE, 0, (off_t)size) == 0 ? 0 : -1;
+#else
+	return -1;
+#endif
+}
+
+int os_ftruncate(FILE *file, int64_t size)
+{
+	if (!file || size < 0)
+		return -1;
+
+	fflush(file);
+	return ftruncate(fileno(file), (off_t)size) == 0 ? 0 : -1;
+}
+
 struct posix_glob_info {
 	struct os_glob_info base;
 	glob_t gl;
@@ -19,6 +19,7 @@
 #include <shellapi.h>
 #include <shlobj.h>
 #include <intrin.h>
+#include <io.h>
 
 #include "base.h"
 #include "platform.h"
@@ -418,6 +419,31 @@ int64_t os_get_free_space(const char *path)
 	return -1;
 }
 
+int os_fpreallocate(FILE *file, int64_t size)
+{
+	FILE_ALLOCATION_INFO info;
+	HANDLE handle;
+
+	if (!file || size < 0)
+		return -1;
+
+	fflush(file);
+	handle = (HANDLE)_get_osfhandle(_fileno(file));
+
+	info.AllocationSize.QuadPart = size;
+	return SetFileInformationByHandle(handle, FileAllocationInfo, &info,
+			sizeof(info)) ? 0 : -1;
+}
+
+int os_ftruncate(FILE *file, int64_t size)
+{
+	if (!file || size < 0)
+		return -1;
+
+	fflush(file);
+	return _chsize_s(_fileno(file), size) == 0 ? 0 : -1;
+}
+
 static void make_globent(struct os_globent *ent, WIN32_FIND_DATA *wfd,
 		const char *pattern)
 {
@@ -43,6 +43,15 @@ EXPORT int os_stat(const char *file, struct stat *st);
 EXPORT int os_fseeki64(FILE *file, int64_t offset, int origin);
 EXPORT int64_t os_ftelli64(FILE *file);
 
+/**
+ * Reserves disk space for the first 'size' bytes of a file without changing
+ * its size, so that later writes within that range do not have to allocate.
+ * Space reserved past the end of the file may stay allocated until the file
+ * is truncated.  Returns 0 on success, -1 if unsupported or on failure.
+ */
+EXPORT int os_fpreallocate(FILE *file, int64_t size);
+EXPORT int os_ftruncate(FILE *file, int64_t size);
+
 EXPORT size_t os_fread_mbs(FILE *file, char **pstr);
 EXPORT size_t os_fread_utf8(FILE *file, char **pstr);
 
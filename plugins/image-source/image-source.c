@@ -1,6 +1,8 @@
 #include <obs-module.h>
 #include <graphics/image-file.h>
+#include <util/threading.h>
 #include <util/platform.h>
+#include <util/darray.h>
 #include <util/dstr.h>
 #include <sys/stat.h>
 
@@ -15,6 +17,24 @@
 #define warn(format, ...) \
 	blog(LOG_WARNING, format, ##__VA_ARGS__)
 
+#define LOADER_THREADS 2
+
+/* A decode request handed to the loader threads.  The image is fetched from
+ * the shared image cache (decoding it if needed) off the graphics thread, and
+ * the source picks it up in its tick once 'finished' is set. */
+struct image_load_job {
+	volatile long   refs;
+	volatile bool   cancelled;
+	volatile bool   finished;
+
+	char            *file;
+	bool            check_only;
+	bool            changed;
+	time_t          timestamp;
+
+	obs_cached_image_t *image;
+};
+
 struct image_source {
 	obs_source_t *source;
 
@@ -25,9 +45,26 @@ struct image_source {
 	uint64_t     last_time;
 	bool         active;
 
-	gs_image_file_t image;
+	pthread_mutex_t       job_mutex;
+	struct image_load_job *job;
+
+	/* the image may be released while get_width/get_height run on
+	 * another thread, so its size is copied when the image is swapped */
+	obs_cached_image_t *image;
+	uint32_t           cx;
+	uint32_t           cy;
 };
 
+static struct {
+	pthread_mutex_t mutex;
+	os_sem_t        *sem;
+	pthread_t       threads[LOADER_THREADS];
+	size_t          num_threads;
+	bool            stop;
+
+	DARRAY(struct image_load_job*) jobs;
+} loader;
+
 
 static time_t get_modified_timestamp(const char *filename)
 {
@@ -37,40 +74,255 @@ static time_t get_modified_timestamp(const char *filename)
 	return stats.st_mtime;
 }
 
+/* ------------------------------------------------------------------------- */
+
+static void image_load_job_release(struct image_load_job *job)
+{
+	if (!job || os_atomic_dec_long(&job->refs) != 0)
+		return;
+
+	obs_image_cache_release(job->image);
+	bfree(job->file);
+	bfree(job);
+}
+
+static void image_load_job_process(struct image_load_job *job)
+{
+	const char *file = job->file;
+	time_t timestamp = get_modified_timestamp(file);
+
+	if (job->check_only && timestamp == job->timestamp) {
+		job->changed = false;
+		return;
+	}
+
+	job->changed = true;
+	job->timestamp = timestamp;
+
+	if (!os_atomic_load_bool(&job->cancelled))
+		job->image = obs_image_cache_get(file);
+}
+
+static void *loader_thread(void *unused)
+{
+	os_set_thread_name("image-source: loader");
+
+	while (os_sem_wait(loader.sem) == 0) {
+		struct image_load_job *job = NULL;
+		bool stop;
+
+		pthread_mutex_lock(&loader.mutex);
+		if (loader.jobs.num) {
+			job = loader.jobs.array[0];
+			da_erase(loader.jobs, 0);
+		}
+		stop = loader.stop;
+		pthread_mutex_unlock(&loader.mutex);
+
+		if (job) {
+			if (!os_atomic_load_bool(&job->cancelled))
+				image_load_job_process(job);
+
+			os_atomic_set_bool(&job->finished, true);
+			image_load_job_release(job);
+
+		} else if (stop) {
+			break;
+		}
+	}
+
+	UNUSED_PARAMETER(unused);
+	return NULL;
+}
+
+static bool loader_init(void)
+{
+	pthread_mutex_init_value(&loader.mutex);
+	if (pthread_mutex_init(&loader.mutex, NULL) != 0)
+		return false;
+	if (os_sem_init(&loader.sem, 0) != 0) {
+		pthread_mutex_destroy(&loader.mutex);
+		return false;
+	}
+
+	/* if no thread can be created, loader_push decodes synchronously */
+	for (size_t i = 0; i < LOADER_THREADS; i++) {
+		if (pthread_create(&loader.threads[loader.num_threads], NULL,
+					loader_thread, NULL) == 0)
+			loader.num_threads++;
+	}
+
+	return true;
+}
+
+static void loader_free(void)
+{
+	if (!loader.sem)
+		return;
+
+	pthread_mutex_lock(&loader.mutex);
+	loader.stop = true;
+	pthread_mutex_unlock(&loader.mutex);
+
+	for (size_t i = 0; i < loader.num_threads; i++)
+		os_sem_post(loader.sem);
+	for (size_t i = 0; i < loader.num_threads; i++)
+		pthread_join(loader.threads[i], NULL);
+
+	for (size_t i = 0; i < loader.jobs.num; i++)
+		image_load_job_release(loader.jobs.array[i]);
+	da_free(loader.jobs);
+
+	os_sem_destroy(loader.sem);
+	pthread_mutex_destroy(&loader.mutex);
+	memset(&loader, 0, sizeof(loader));
+}
+
+static struct image_load_job *loader_push(const char *file, bool check_only,
+		time_t timestamp)
+{
+	struct image_load_job *job = bzalloc(sizeof(*job));
+	job->refs = 2;
+	job->file = bstrdup(file);
+	job->check_only = check_only;
+	job->timestamp = timestamp;
+
+	if (!loader.num_threads) {
+		image_load_job_process(job);
+		job->finished = true;
+		job->refs = 1;
+		return job;
+	}
+
+	pthread_mutex_lock(&loader.mutex);
+	da_push_back(loader.jobs, &job);
+	pthread_mutex_unlock(&loader.mutex);
+
+	os_sem_post(loader.sem);
+	return job;
+}
+
+/* ------------------------------------------------------------------------- */
+
+static void image_source_set_job(struct image_source *context,
+		struct image_load_job *job)
+{
+	struct image_load_job *old_job;
+
+	pthread_mutex_lock(&context->job_mutex);
+	old_job = context->job;
+	context->job = job;
+	pthread_mutex_unlock(&context->job_mutex);
+
+	if (old_job) {
+		os_atomic_set_bool(&old_job->cancelled, true);
+		image_load_job_release(old_job);
+	}
+}
+
+static struct image_load_job *image_source_take_finished_job(
+		struct image_source *context)
+{
+	struct image_load_job *job = NULL;
+
+	pthread_mutex_lock(&context->job_mutex);
+	if (context->job && os_atomic_load_bool(&context->job->finished)) {
+		job = context->job;
+		context->job = NULL;
+	}
+	pthread_mutex_unlock(&context->job_mutex);
+
+	return job;
+}
+
+static bool image_source_job_pending(struct image_source *context)
+{
+	bool pending;
+
+	pthread_mutex_lock(&context->job_mutex);
+	pending = context->job != NULL;
+	pthread_mutex_unlock(&context->job_mutex);
+
+	return pending;
+}
+
+/* called from the graphics thread once the loader has decoded the image */
+static void image_source_apply_job(struct image_source *context,
+		struct image_load_job *job)
+{
+	context->file_timestamp = job->timestamp;
+
+	if (!job->changed)
+		return;
+
+	obs_cached_image_t *old_image = context->image;
+	gs_image_file_t *file = obs_cached_image_get_file(job->image);
+
+	obs_enter_graphics();
+	obs_cached_image_get_texture(job->image);
+	context->image = job->image;
+	context->cx = file ? file->cx : 0;
+	context->cy = file ? file->cy : 0;
+	obs_leave_graphics();
+
+	job->image = NULL;
+	obs_image_cache_release(old_image);
+
+	context->last_time = 0;
+
+	if (!context->image)
+		warn("failed to load texture '%s'", job->file);
+}
+
+static void image_source_free_image(struct image_source *context)
+{
+	obs_cached_image_t *old_image;
+
+	obs_enter_graphics();
+	old_image = context->image;
+	context->image = NULL;
+	context->cx = 0;
+	context->cy = 0;
+	obs_leave_graphics();
+
+	obs_image_cache_release(old_image);
+}
+
+/* animated images are never shared, so their playback state can be updated
+ * by the source */
+static inline gs_image_file_t *get_animated_image(
+		struct image_source *context)
+{
+	gs_image_file_t *image = obs_cached_image_get_file(context->image);
+	return image && image->is_animated_gif ? image : NULL;
+}
+
 static const char *image_source_get_name(void *unused)
 {
 	UNUSED_PARAMETER(unused);
 	return obs_module_text("ImageInput");
 }
 
+/* The current image keeps rendering until the replacement has been decoded
+ * by the loader and picked up in image_source_tick. */
 static void image_source_load(struct image_source *context)
 {
 	char *file = context->file;
 
-	obs_enter_graphics();
-	gs_image_file_free(&context->image);
-	obs_leave_graphics();
-
 	if (file && *file) {
 		debug("loading texture '%s'", file);
-		context->file_timestamp = get_modified_timestamp(file);
-		gs_image_file_init(&context->image, file);
 		context->update_time_elapsed = 0;
-
-		obs_enter_graphics();
-		gs_image_file_init_texture(&context->image);
-		obs_leave_graphics();
-
-		if (!context->image.loaded)
-			warn("failed to load texture '%s'", file);
+		image_source_set_job(context, loader_push(file, false, 0));
+	} else {
+		image_source_set_job(context, NULL);
+		image_source_free_image(context);
 	}
 }
 
 static void image_source_unload(struct image_source *context)
 {
-	obs_enter_graphics();
-	gs_image_file_free(&context->image);
-	obs_leave_graphics();
+	image_source_set_job(context, NULL);
+	image_source_free_image(context);
 }
 
 static void image_source_update(void *data, obs_data_t *settings)
@@ -117,6 +369,12 @@ static void *image_source_create(obs_data_t *settings, obs_source_t *source)
 	struct image_source *context = bzalloc(sizeof(struct image_source));
 	context->source = source;
 
+	pthread_mutex_init_value(&context->job_mutex);
+	if (pthread_mutex_init(&context->job_mutex, NULL) != 0) {
+		bfree(context);
+		return NULL;
+	}
+
 	image_source_update(context, settings);
 	return context;
 }
@@ -129,55 +387,66 @@ static void image_source_destroy(void *data)
 
 	if (context->file)
 		bfree(context->file);
+	pthread_mutex_destroy(&context->job_mutex);
 	bfree(context);
 }
 
 static uint32_t image_source_getwidth(void *data)
 {
 	struct image_source *context = data;
-	return context->image.cx;
+	return context->cx;
 }
 
 static uint32_t image_source_getheight(void *data)
 {
 	struct image_source *context = data;
-	return context->image.cy;
+	return context->cy;
 }
 
 static void image_source_render(void *data, gs_effect_t *effect)
 {
 	struct image_source *context = data;
+	gs_image_file_t *image = obs_cached_image_get_file(context->image);
 
-	if (!context->image.texture)
+	if (!image || !image->texture)
 		return;
 
 	gs_effect_set_texture(gs_effect_get_param_by_name(effect, "image"),
-			context->image.texture);
-	gs_draw_sprite(context->image.texture, 0,
-			context->image.cx, context->image.cy);
+			image->texture);
+	gs_draw_sprite(image->texture, 0, image->cx, image->cy);
 }
 
 static void image_source_tick(void *data, float seconds)
 {
 	struct image_source *context = data;
 	uint64_t frame_time = obs_get_video_frame_time();
+	struct image_load_job *job;
+	gs_image_file_t *gif;
+
+	job = image_source_take_finished_job(context);
+	if (job) {
+		image_source_apply_job(context, job);
+		image_load_job_release(job);
+	}
+
+	gif = get_animated_image(context);
 
 	if (obs_source_active(context->source)) {
 		if (!context->active) {
-			if (context->image.is_animated_gif)
+			if (gif)
 				context->last_time = frame_time;
 			context->active = true;
 		}
 
 	} else {
 		if (context->active) {
-			if (context->image.is_animated_gif) {
-				context->image.cur_frame = 0;
-				context->image.cur_loop = 0;
-				context->image.cur_time = 0;
+			if (gif) {
+				gif->cur_frame = 0;
+				gif->cur_loop = 0;
+				gif->cur_time = 0;
 
 				obs_enter_graphics();
-				gs_image_file_update_texture(&context->image);
+				gs_image_file_update_texture(gif);
 				obs_leave_graphics();
 			}
 
@@ -187,13 +456,13 @@ static void image_source_tick(void *data, float seconds)
 		return;
 	}
 
-	if (context->last_time && context->image.is_animated_gif) {
+	if (context->last_time && gif) {
 		uint64_t elapsed = frame_time - context->last_time;
-		bool updated = gs_image_file_tick(&context->image, elapsed);
+		bool updated = gs_image_file_tick(gif, elapsed);
 
 		if (updated) {
 			obs_enter_graphics();
-			gs_image_file_update_texture(&context->image);
+			gs_image_file_update_texture(gif);
 			obs_leave_graphics();
 		}
 	}
@@ -202,13 +471,16 @@ static void image_source_tick(void *data, float seconds)
 
 	context->update_time_elapsed += seconds;
 
+	/* the timestamp is checked (and the image reloaded if it changed)
+	 * on the loader threads rather than stat'ing here every second */
 	if (context->update_time_elapsed >= 1.0f) {
-		time_t t = get_modified_timestamp(context->file);
 		context->update_time_elapsed = 0.0f;
 
-		if (context->file_timestamp != t) {
-			image_source_load(context);
-		}
+		if (context->file && *context->file &&
+		    !image_source_job_pending(context))
+			image_source_set_job(context, loader_push(
+					context->file, true,
+					context->file_timestamp));
 	}
 }
 
@@ -274,8 +546,16 @@ extern struct obs_source_info color_source_info;
 
 bool obs_module_load(void)
 {
+	if (!loader_init())
+		return false;
+
 	obs_register_source(&image_source_info);
 	obs_register_source(&color_source_info);
 	obs_register_source(&slideshow_info);
 	return true;
 }
+
+void obs_module_unload(void)
+{
+	loader_free();
+}
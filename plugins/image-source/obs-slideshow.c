@@ -52,6 +52,7 @@ struct slideshow {
 
 	float elapsed;
 	size_t cur_item;
+	size_t next_item;
 
 	uint32_t cx;
 	uint32_t cy;
@@ -84,7 +85,8 @@ static obs_source_t *get_source(struct darray *array, const char *path)
 
 		if (strcmp(path, cur_path) == 0) {
 			source = files.array[i].source;
-			obs_source_addref(source);
+			if (source)
+				obs_source_addref(source);
 			break;
 		}
 	}
@@ -123,6 +125,100 @@ static inline size_t random_file(struct slideshow *ss)
 	return (size_t)rand() % ss->files.num;
 }
 
+static size_t next_file(struct slideshow *ss, size_t cur)
+{
+	size_t next = cur;
+
+	if (ss->randomize) {
+		if (ss->files.num > 1) {
+			while (next == cur)
+				next = random_file(ss);
+		}
+
+	} else if (++next >= ss->files.num) {
+		next = 0;
+	}
+
+	return next;
+}
+
+/* sources are created on demand; the image source decodes in the background
+ * so this doesn't block on the file */
+static obs_source_t *file_source(struct slideshow *ss, size_t idx)
+{
+	struct image_file_data *file = &ss->files.array[idx];
+
+	if (!file->source)
+		file->source = create_source_from_file(file->path);
+	return file->source;
+}
+
+/* makes sure the current and next images are loading and releases the
+ * others.  released images stay in the libobs image cache while it has room,
+ * so looping back to them doesn't necessarily decode them again.
+ * must be called with the mutex held */
+static void cache_files(struct slideshow *ss)
+{
+	if (!ss->files.num)
+		return;
+
+	file_source(ss, ss->cur_item);
+	file_source(ss, ss->next_item);
+
+	for (size_t i = 0; i < ss->files.num; i++) {
+		struct image_file_data *file = &ss->files.array[i];
+
+		if (i == ss->cur_item || i == ss->next_item || !file->source)
+			continue;
+
+		obs_source_release(file->source);
+		file->source = NULL;
+	}
+}
+
+/* images report their size once decoded, so the slideshow grows to the
+ * largest image that has been loaded so far */
+static void update_size(struct slideshow *ss)
+{
+	uint32_t cx = ss->cx;
+	uint32_t cy = ss->cy;
+
+	pthread_mutex_lock(&ss->mutex);
+	for (size_t i = 0; i < ss->files.num; i++) {
+		obs_source_t *source = ss->files.array[i].source;
+		uint32_t new_cx, new_cy;
+
+		if (!source)
+			continue;
+
+		new_cx = obs_source_get_width(source);
+		new_cy = obs_source_get_height(source);
+		if (new_cx > cx) cx = new_cx;
+		if (new_cy > cy) cy = new_cy;
+	}
+	pthread_mutex_unlock(&ss->mutex);
+
+	if (cx != ss->cx || cy != ss->cy) {
+		ss->cx = cx;
+		ss->cy = cy;
+		obs_transition_set_size(ss->transition, cx, cy);
+	}
+}
+
+static obs_source_t *get_current_source(struct slideshow *ss)
+{
+	obs_source_t *source = NULL;
+
+	pthread_mutex_lock(&ss->mutex);
+	if (ss->files.num) {
+		source = ss->files.array[ss->cur_item].source;
+		obs_source_addref(source);
+	}
+	pthread_mutex_unlock(&ss->mutex);
+
+	return source;
+}
+
 /* ------------------------------------------------------------------------- */
 
 static const char *ss_getname(void *unused)
@@ -132,7 +228,7 @@ static const char *ss_getname(void *unused)
 }
 
 static void add_file(struct slideshow *ss, struct darray *array,
-		const char *path, uint32_t *cx, uint32_t *cy)
+		const char *path)
 {
 	DARRAY(struct image_file_data) new_files;
 	struct image_file_data data;
@@ -146,20 +242,11 @@ static void add_file(struct slideshow *ss, struct darray *array,
 
 	if (!new_source)
 		new_source = get_source(&new_files.da, path);
-	if (!new_source)
-		new_source = create_source_from_file(path);
-
-	if (new_source) {
-		uint32_t new_cx = obs_source_get_width(new_source);
-		uint32_t new_cy = obs_source_get_height(new_source);
-
-		data.path = bstrdup(path);
-		data.source = new_source;
-		da_push_back(new_files, &data);
 
-		if (new_cx > *cx) *cx = new_cx;
-		if (new_cy > *cy) *cy = new_cy;
-	}
+	/* new files are only loaded once they're about to be shown */
+	data.path = bstrdup(path);
+	data.source = new_source;
+	da_push_back(new_files, &data);
 
 	*array = new_files.da;
 }
@@ -182,13 +269,12 @@ static void ss_update(void *data, obs_data_t *settings)
 	DARRAY(struct image_file_data) old_files;
 	obs_source_t *new_tr = NULL;
 	obs_source_t *old_tr = NULL;
+	obs_source_t *cur_source;
 	struct slideshow *ss = data;
 	obs_data_array_t *array;
 	const char *tr_name;
 	uint32_t new_duration;
 	uint32_t new_speed;
-	uint32_t cx = 0;
-	uint32_t cy = 0;
 	size_t count;
 
 	/* ------------------------------------- */
@@ -245,14 +331,13 @@ static void ss_update(void *data, obs_data_t *settings)
 				dstr_copy(&dir_path, path);
 				dstr_cat_ch(&dir_path, '/');
 				dstr_cat(&dir_path, ent->d_name);
-				add_file(ss, &new_files.da, dir_path.array,
-						&cx, &cy);
+				add_file(ss, &new_files.da, dir_path.array);
 			}
 
 			dstr_free(&dir_path);
 			os_closedir(dir);
 		} else {
-			add_file(ss, &new_files.da, path, &cx, &cy);
+			add_file(ss, &new_files.da, path);
 		}
 
 		obs_data_release(item);
@@ -279,6 +364,14 @@ static void ss_update(void *data, obs_data_t *settings)
 	ss->tr_name = tr_name;
 	ss->slide_time = (float)new_duration / 1000.0f;
 
+	ss->cur_item = 0;
+	ss->elapsed = 0.0f;
+	if (ss->randomize && ss->files.num)
+		ss->cur_item = random_file(ss);
+	if (ss->files.num)
+		ss->next_item = next_file(ss, ss->cur_item);
+	cache_files(ss);
+
 	pthread_mutex_unlock(&ss->mutex);
 
 	/* ------------------------------------- */
@@ -288,23 +381,23 @@ static void ss_update(void *data, obs_data_t *settings)
 		obs_source_release(old_tr);
 	free_files(&old_files.da);
 
-	ss->cx = cx;
-	ss->cy = cy;
-	ss->cur_item = 0;
-	ss->elapsed = 0.0f;
-	obs_transition_set_size(ss->transition, cx, cy);
+	ss->cx = 0;
+	ss->cy = 0;
+	update_size(ss);
+	obs_transition_set_size(ss->transition, ss->cx, ss->cy);
 	obs_transition_set_alignment(ss->transition, OBS_ALIGN_CENTER);
 	obs_transition_set_scale_type(ss->transition,
 			OBS_TRANSITION_SCALE_ASPECT);
 
-	if (ss->randomize && ss->files.num)
-		ss->cur_item = random_file(ss);
 	if (new_tr)
 		obs_source_add_active_child(ss->source, new_tr);
-	if (ss->files.num)
+
+	cur_source = get_current_source(ss);
+	if (cur_source) {
 		obs_transition_start(ss->transition, OBS_TRANSITION_MODE_AUTO,
-				ss->tr_speed,
-				ss->files.array[ss->cur_item].source);
+				ss->tr_speed, cur_source);
+		obs_source_release(cur_source);
+	}
 
 	obs_data_array_release(array);
 }
@@ -354,30 +447,32 @@ static void ss_video_render(void *data, gs_effect_t *effect)
 static void ss_video_tick(void *data, float seconds)
 {
 	struct slideshow *ss = data;
+	obs_source_t *cur_source;
 
 	if (!ss->transition || !ss->slide_time)
 		return;
 
+	update_size(ss);
+
 	ss->elapsed += seconds;
 	if (ss->elapsed > ss->slide_time) {
 		ss->elapsed -= ss->slide_time;
 
-		if (ss->randomize) {
-			size_t next = ss->cur_item;
-			if (ss->files.num > 1) {
-				while (next == ss->cur_item)
-					next = random_file(ss);
-			}
-			ss->cur_item = next;
-
-		} else if (++ss->cur_item >= ss->files.num) {
-			ss->cur_item = 0;
+		pthread_mutex_lock(&ss->mutex);
+		if (ss->files.num) {
+			ss->cur_item = ss->next_item;
+			ss->next_item = next_file(ss, ss->cur_item);
+			cache_files(ss);
 		}
+		pthread_mutex_unlock(&ss->mutex);
 
-		if (ss->files.num)
+		cur_source = get_current_source(ss);
+		if (cur_source) {
 			obs_transition_start(ss->transition,
 					OBS_TRANSITION_MODE_AUTO, ss->tr_speed,
-					ss->files.array[ss->cur_item].source);
+					cur_source);
+			obs_source_release(cur_source);
+		}
 	}
 }
 
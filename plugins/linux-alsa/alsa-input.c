@@ -31,6 +31,7 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
 #define NSEC_PER_SEC  1000000000LL
 #define NSEC_PER_MSEC 1000000L
+#define USEC_PER_MSEC 1000U
 #define STARTUP_TIMEOUT_NS (500 * NSEC_PER_MSEC)
 #define REOPEN_TIMEOUT 1000UL
 #define SHUTDOWN_ON_DEACTIVATE false
@@ -43,6 +44,9 @@ struct alsa_data {
 
 	/* user settings */
 	char *device;
+	bool use_mmap;
+	unsigned int period_time;
+	unsigned int buffer_time;
 
 	/* pthread */
 	pthread_t listen_thread;
@@ -55,6 +59,8 @@ struct alsa_data {
 	snd_pcm_t *handle;
 	snd_pcm_format_t format;
 	snd_pcm_uframes_t period_size;
+	bool mmap;
+	bool monotonic_tstamp;
 
 	unsigned int channels;
 	unsigned int rate;
@@ -94,9 +100,11 @@ static bool _alsa_try_open(struct alsa_data *);
 static bool _alsa_open(struct alsa_data *);
 static void _alsa_close(struct alsa_data *);
 static bool _alsa_configure(struct alsa_data *);
+static bool _alsa_configure_sw(struct alsa_data *);
 static void _alsa_start_reopen(struct alsa_data *);
 static void _alsa_stop_reopen(struct alsa_data *);
 static void * _alsa_listen(void *);
+static void * _alsa_listen_mmap(void *);
 static void * _alsa_reopen(void *);
 
 static enum audio_format _alsa_to_obs_audio_format(snd_pcm_format_t);
@@ -128,6 +136,9 @@ void * alsa_create(obs_data_t *settings, obs_source_t *source)
 
 	data->device = bstrdup(device);
 	data->rate = obs_data_get_int(settings, "rate");
+	data->use_mmap = obs_data_get_bool(settings, "mmap");
+	data->period_time = obs_data_get_int(settings, "period_time");
+	data->buffer_time = obs_data_get_int(settings, "buffer_time");
 
 	if (os_event_init(&data->abort_event, OS_EVENT_TYPE_MANUAL) != 0) {
 		blog(LOG_ERROR, "Abort event creation failed!");
@@ -183,6 +194,9 @@ void alsa_update(void *vptr, obs_data_t *settings)
 	struct alsa_data *data = vptr;
 	const char *device;
 	unsigned int rate;
+	unsigned int period_time;
+	unsigned int buffer_time;
+	bool use_mmap;
 	bool reset = false;
 
 	device = obs_data_get_string(settings, "device_id");
@@ -202,6 +216,18 @@ void alsa_update(void *vptr, obs_data_t *settings)
 		reset = true;
 	}
 
+	use_mmap = obs_data_get_bool(settings, "mmap");
+	period_time = obs_data_get_int(settings, "period_time");
+	buffer_time = obs_data_get_int(settings, "buffer_time");
+	if (data->use_mmap != use_mmap ||
+	    data->period_time != period_time ||
+	    data->buffer_time != buffer_time) {
+		data->use_mmap = use_mmap;
+		data->period_time = period_time;
+		data->buffer_time = buffer_time;
+		reset = true;
+	}
+
 #if SHUTDOWN_ON_DEACTIVATE
 	if (reset && data->handle)
 		_alsa_close(data);
@@ -228,6 +254,9 @@ void alsa_get_defaults(obs_data_t *settings)
 	obs_data_set_default_string(settings, "device_id", "default");
 	obs_data_set_default_string(settings, "custom_pcm", "default");
 	obs_data_set_default_int(settings, "rate", 44100);
+	obs_data_set_default_bool(settings, "mmap", false);
+	obs_data_set_default_int(settings, "period_time", 0);
+	obs_data_set_default_int(settings, "buffer_time", 0);
 }
 
 static bool alsa_devices_changed(obs_properties_t *props,
@@ -283,6 +312,12 @@ obs_properties_t * alsa_get_properties(void *unused)
 	obs_property_list_add_int(rate, "44100 Hz", 44100);
 	obs_property_list_add_int(rate, "48000 Hz", 48000);
 
+	obs_properties_add_bool(props, "mmap", obs_module_text("UseMmap"));
+	obs_properties_add_int(props, "period_time",
+	    obs_module_text("PeriodTime"), 0, 1000, 1);
+	obs_properties_add_int(props, "buffer_time",
+	    obs_module_text("BufferTime"), 0, 5000, 1);
+
 	if (snd_device_name_hint(-1, "pcm", &hints) < 0)
 		return props;
 
@@ -381,7 +416,8 @@ bool _alsa_open(struct alsa_data *data)
 	pthread_attr_init(&attr);
 	pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_JOINABLE);
 
-	err = pthread_create(&data->listen_thread, &attr, _alsa_listen, data);
+	err = pthread_create(&data->listen_thread, &attr,
+		data->mmap ? _alsa_listen_mmap : _alsa_listen, data);
 	if (err) {
 		pthread_attr_destroy(&attr);
 		blog(LOG_ERROR,
@@ -418,6 +454,7 @@ void _alsa_close(struct alsa_data *data)
 bool _alsa_configure(struct alsa_data *data)
 {
 	snd_pcm_hw_params_t *hwparams;
+	snd_pcm_uframes_t buffer_size;
 	int err;
 	int dir;
 
@@ -431,8 +468,21 @@ bool _alsa_configure(struct alsa_data *data)
 		return false;
 	}
 
-	err = snd_pcm_hw_params_set_access(data->handle, hwparams,
-		SND_PCM_ACCESS_RW_INTERLEAVED);
+	data->mmap = false;
+	if (data->use_mmap) {
+		err = snd_pcm_hw_params_set_access(data->handle, hwparams,
+			SND_PCM_ACCESS_MMAP_INTERLEAVED);
+		if (err < 0)
+			blog(LOG_WARNING, "PCM '%s' does not support mmap "
+				"access, using read access: %s",
+				data->device, snd_strerror(err));
+		else
+			data->mmap = true;
+	}
+
+	if (!data->mmap)
+		err = snd_pcm_hw_params_set_access(data->handle, hwparams,
+			SND_PCM_ACCESS_RW_INTERLEAVED);
 	if (err < 0) {
 		blog(LOG_ERROR,
 			"snd_pcm_hw_params_set_access failed: %s",
@@ -475,6 +525,28 @@ bool _alsa_configure(struct alsa_data *data)
 	blog(LOG_INFO, "PCM '%s' channels set to %d",
 		data->device, data->channels);
 
+	/* the buffer has to be set before the period so the period can be
+	 * fitted into it */
+	if (data->buffer_time) {
+		unsigned int usec = data->buffer_time * USEC_PER_MSEC;
+		err = snd_pcm_hw_params_set_buffer_time_near(data->handle,
+			hwparams, &usec, 0);
+		if (err < 0)
+			blog(LOG_WARNING,
+				"snd_pcm_hw_params_set_buffer_time_near "
+				"failed: %s", snd_strerror(err));
+	}
+
+	if (data->period_time) {
+		unsigned int usec = data->period_time * USEC_PER_MSEC;
+		err = snd_pcm_hw_params_set_period_time_near(data->handle,
+			hwparams, &usec, 0);
+		if (err < 0)
+			blog(LOG_WARNING,
+				"snd_pcm_hw_params_set_period_time_near "
+				"failed: %s", snd_strerror(err));
+	}
+
 	err = snd_pcm_hw_params(data->handle, hwparams);
 	if (err < 0) {
 		blog(LOG_ERROR, "snd_pcm_hw_params failed: %s",
@@ -491,12 +563,74 @@ bool _alsa_configure(struct alsa_data *data)
 		return false;
 	}
 
+	if (snd_pcm_hw_params_get_buffer_size(hwparams, &buffer_size) == 0)
+		blog(LOG_INFO, "PCM '%s' period %lu frames, buffer %lu frames"
+			"%s", data->device, (unsigned long)data->period_size,
+			(unsigned long)buffer_size,
+			data->mmap ? ", mmap access" : "");
+
 	data->sample_size = (data->channels
 		* snd_pcm_format_physical_width(data->format)) / 8;
 
-	if (data->buffer)
+	if (data->buffer) {
 		bfree(data->buffer);
-	data->buffer = bzalloc(data->period_size * data->sample_size);
+		data->buffer = NULL;
+	}
+
+	/* mmap capture outputs straight from the ring of the device */
+	if (!data->mmap)
+		data->buffer = bzalloc(data->period_size * data->sample_size);
+
+	return _alsa_configure_sw(data);
+}
+
+bool _alsa_configure_sw(struct alsa_data *data)
+{
+	snd_pcm_sw_params_t *swparams;
+	int err;
+
+	data->monotonic_tstamp = false;
+
+	snd_pcm_sw_params_alloca(&swparams);
+
+	err = snd_pcm_sw_params_current(data->handle, swparams);
+	if (err < 0) {
+		blog(LOG_ERROR,
+			"snd_pcm_sw_params_current failed: %s",
+			snd_strerror(err));
+		return false;
+	}
+
+	err = snd_pcm_sw_params_set_avail_min(data->handle, swparams,
+		data->period_size);
+	if (err < 0) {
+		blog(LOG_ERROR,
+			"snd_pcm_sw_params_set_avail_min failed: %s",
+			snd_strerror(err));
+		return false;
+	}
+
+	/* timestamps for snd_pcm_htimestamp, on the same clock as
+	 * os_gettime_ns */
+	if (data->mmap) {
+		err = snd_pcm_sw_params_set_tstamp_mode(data->handle,
+			swparams, SND_PCM_TSTAMP_ENABLE);
+#if SND_LIB_VERSION >= 0x01001d
+		if (err >= 0)
+			err = snd_pcm_sw_params_set_tstamp_type(data->handle,
+				swparams, SND_PCM_TSTAMP_TYPE_MONOTONIC);
+#else
+		err = -ENOSYS;
+#endif
+		data->monotonic_tstamp = err >= 0;
+	}
+
+	err = snd_pcm_sw_params(data->handle, swparams);
+	if (err < 0) {
+		blog(LOG_ERROR, "snd_pcm_sw_params failed: %s",
+			snd_strerror(err));
+		return false;
+	}
 
 	return true;
 }
@@ -581,6 +715,119 @@ void * _alsa_listen(void *attr)
 	return NULL;
 }
 
+/**
+ * Get the capture time of the next frame to be read
+ *
+ * snd_pcm_htimestamp returns the number of frames that were available at the
+ * time of the last hardware pointer update, so this isn't off by the time
+ * it took to wake up the thread.
+ */
+static uint64_t _alsa_capture_time(struct alsa_data *data,
+	snd_pcm_uframes_t avail)
+{
+	snd_htimestamp_t tstamp;
+	snd_pcm_uframes_t tstamp_avail;
+	uint64_t ts;
+
+	if (data->monotonic_tstamp &&
+	    snd_pcm_htimestamp(data->handle, &tstamp_avail, &tstamp) == 0 &&
+	    (tstamp.tv_sec || tstamp.tv_nsec)) {
+		ts = (uint64_t)tstamp.tv_sec * NSEC_PER_SEC + tstamp.tv_nsec;
+		avail = tstamp_avail;
+	} else {
+		ts = os_gettime_ns();
+	}
+
+	return ts - (avail * NSEC_PER_SEC) / data->rate;
+}
+
+/**
+ * Recover from an xrun or suspend in mmap mode
+ *
+ * Unlike snd_pcm_readi, the mmap functions don't start a prepared capture
+ * stream on their own.
+ */
+static void _alsa_recover_mmap(struct alsa_data *data, int err)
+{
+	err = snd_pcm_recover(data->handle, err, 0);
+	if (err >= 0)
+		err = snd_pcm_start(data->handle);
+
+	if (err < 0) {
+		blog(LOG_WARNING, "Failed to recover '%s': %s",
+			data->device, snd_strerror(err));
+		os_sleep_ms(10);
+	}
+}
+
+void * _alsa_listen_mmap(void *attr)
+{
+	struct alsa_data *data = attr;
+	struct obs_source_audio out;
+	const snd_pcm_channel_area_t *areas;
+	snd_pcm_uframes_t offset;
+	snd_pcm_uframes_t frames;
+	snd_pcm_sframes_t avail;
+	snd_pcm_sframes_t committed;
+	int err;
+
+	blog(LOG_DEBUG, "Capture thread started (mmap).");
+
+	out.format   = _alsa_to_obs_audio_format(data->format);
+	out.speakers = _alsa_channels_to_obs_speakers(data->channels);
+	out.samples_per_sec = data->rate;
+
+	os_atomic_set_bool(&data->listen, true);
+
+	do {
+		avail = snd_pcm_avail_update(data->handle);
+		if (avail < 0) {
+			_alsa_recover_mmap(data, (int)avail);
+			continue;
+		}
+
+		if ((snd_pcm_uframes_t)avail < data->period_size) {
+			err = snd_pcm_wait(data->handle, 100);
+			if (err < 0)
+				_alsa_recover_mmap(data, err);
+			continue;
+		}
+
+		out.timestamp = _alsa_capture_time(data, avail);
+
+		/* the area may wrap around at the end of the ring, in which
+		 * case the rest is picked up in the next iteration */
+		frames = data->period_size;
+		err = snd_pcm_mmap_begin(data->handle, &areas, &offset,
+			&frames);
+		if (err < 0) {
+			_alsa_recover_mmap(data, err);
+			continue;
+		}
+
+		/* interleaved, so all channels are in the first area */
+		out.data[0] = (uint8_t *)areas[0].addr +
+			(areas[0].first + offset * areas[0].step) / 8;
+		out.frames  = frames;
+
+		if (!data->first_ts)
+			data->first_ts = out.timestamp + STARTUP_TIMEOUT_NS;
+
+		if (out.timestamp > data->first_ts)
+			obs_source_output_audio(data->source, &out);
+
+		committed = snd_pcm_mmap_commit(data->handle, offset, frames);
+		if (committed < 0 || (snd_pcm_uframes_t)committed != frames)
+			_alsa_recover_mmap(data,
+				committed < 0 ? (int)committed : -EPIPE);
+	} while (os_atomic_load_bool(&data->listen));
+
+	blog(LOG_DEBUG, "Capture thread is about to exit.");
+
+	pthread_exit(NULL);
+	return NULL;
+}
+
 void * _alsa_reopen(void *attr)
 {
 	struct alsa_data *data = attr;
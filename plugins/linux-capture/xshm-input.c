@@ -22,6 +22,10 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include <xcb/xfixes.h>
 #include <xcb/xinerama.h>
 
+#if HAVE_XCB_DAMAGE
+#include <xcb/damage.h>
+#endif
+
 #include <obs-module.h>
 #include <util/dstr.h>
 #include "xcursor-xcb.h"
@@ -31,6 +35,9 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
 #define blog(level, msg, ...) blog(level, "xshm-input: " msg, ##__VA_ARGS__)
 
+/* with more damaged rectangles than this their bounding box is captured */
+#define XSHM_MAX_DAMAGE_RECTS 32
+
 struct xshm_data {
 	obs_source_t     *source;
 
@@ -48,6 +55,13 @@ struct xshm_data {
 
 	gs_texture_t     *texture;
 
+#if HAVE_XCB_DAMAGE
+	xcb_damage_damage_t damage;
+	xcb_xfixes_region_t damage_region;
+	bool             use_damage;
+#endif
+	bool             full_update;
+
 	bool             show_cursor;
 	bool             use_xinerama;
 	bool             advanced;
@@ -86,6 +100,72 @@ static bool xshm_check_extensions(xcb_connection_t *xcb)
 	return ok;
 }
 
+#if HAVE_XCB_DAMAGE
+/**
+ * Start tracking the changed areas of the root window
+ *
+ * @return true if damage tracking is available
+ */
+static bool xshm_init_damage(struct xshm_data *data)
+{
+	xcb_xfixes_query_version_reply_t *fix_r;
+	xcb_damage_query_version_reply_t *dmg_r;
+	xcb_generic_error_t *err;
+	bool ok;
+
+	if (!xcb_get_extension_data(data->xcb, &xcb_damage_id)->present ||
+	    !xcb_get_extension_data(data->xcb, &xcb_xfixes_id)->present) {
+		blog(LOG_INFO, "Missing Damage extension, capturing full "
+				"frames");
+		return false;
+	}
+
+	/* the versions need to be negotiated before using the extensions,
+	 * regions were added in xfixes 2 */
+	fix_r = xcb_xfixes_query_version_reply(data->xcb,
+			xcb_xfixes_query_version(data->xcb, 2, 0), NULL);
+	dmg_r = xcb_damage_query_version_reply(data->xcb,
+			xcb_damage_query_version(data->xcb, 1, 1), NULL);
+
+	ok = fix_r && fix_r->major_version >= 2 && dmg_r;
+	free(fix_r);
+	free(dmg_r);
+	if (!ok)
+		return false;
+
+	data->damage = xcb_generate_id(data->xcb);
+	err = xcb_request_check(data->xcb, xcb_damage_create_checked(
+			data->xcb, data->damage, data->xcb_screen->root,
+			XCB_DAMAGE_REPORT_LEVEL_NON_EMPTY));
+	if (err) {
+		free(err);
+		data->damage = 0;
+		return false;
+	}
+
+	data->damage_region = xcb_generate_id(data->xcb);
+	xcb_xfixes_create_region(data->xcb, data->damage_region, 0, NULL);
+
+	data->full_update = true;
+	return true;
+}
+
+/**
+ * Stop tracking the changed areas of the root window
+ */
+static void xshm_free_damage(struct xshm_data *data)
+{
+	if (!data->use_damage)
+		return;
+
+	xcb_damage_destroy(data->xcb, data->damage);
+	xcb_xfixes_destroy_region(data->xcb, data->damage_region);
+	data->damage        = 0;
+	data->damage_region = 0;
+	data->use_damage    = false;
+}
+#endif
+
 /**
  * Update the capture
  *
@@ -161,6 +241,11 @@ static void xshm_capture_stop(struct xshm_data *data)
 		data->xshm = NULL;
 	}
 
+#if HAVE_XCB_DAMAGE
+	if (data->xcb)
+		xshm_free_damage(data);
+#endif
+
 	if (data->xcb) {
 		xcb_disconnect(data->xcb);
 		data->xcb = NULL;
@@ -205,6 +290,10 @@ static void xshm_capture_start(struct xshm_data *data)
 	data->cursor = xcb_xcursor_init(data->xcb);
 	xcb_xcursor_offset(data->cursor, data->x_org, data->y_org);
 
+#if HAVE_XCB_DAMAGE
+	data->use_damage = xshm_init_damage(data);
+#endif
+
 	obs_enter_graphics();
 
 	xshm_resize_texture(data);
@@ -383,8 +472,169 @@ static void *xshm_create(obs_data_t *settings, obs_source_t *source)
 	return data;
 }
 
+#if HAVE_XCB_DAMAGE
+/**
+ * Clip a damaged rectangle of the root window to the captured area
+ *
+ * @return false if the rectangle is outside of the captured area
+ */
+static bool xshm_clip_rect(struct xshm_data *data, const xcb_rectangle_t *in,
+		xcb_rectangle_t *out)
+{
+	int_fast32_t x1 = in->x - data->x_org;
+	int_fast32_t y1 = in->y - data->y_org;
+	int_fast32_t x2 = x1 + in->width;
+	int_fast32_t y2 = y1 + in->height;
+
+	if (x1 < 0)
+		x1 = 0;
+	if (y1 < 0)
+		y1 = 0;
+	if (x2 > data->width)
+		x2 = data->width;
+	if (y2 > data->height)
+		y2 = data->height;
+
+	if (x1 >= x2 || y1 >= y2)
+		return false;
+
+	out->x      = (int16_t)x1;
+	out->y      = (int16_t)y1;
+	out->width  = (uint16_t)(x2 - x1);
+	out->height = (uint16_t)(y2 - y1);
+	return true;
+}
+
+/**
+ * Get the damaged rectangles, relative to the captured area
+ *
+ * The damage notify events are not needed since the region is fetched every
+ * frame, they are only drained so they don't pile up.
+ *
+ * @return number of rectangles
+ */
+static size_t xshm_get_damage(struct xshm_data *data, xcb_rectangle_t *rects)
+{
+	xcb_xfixes_fetch_region_reply_t *reg_r;
+	xcb_generic_event_t *event;
+	xcb_rectangle_t *damaged;
+	size_t count = 0;
+	int num;
+
+	while ((event = xcb_poll_for_event(data->xcb)) != NULL)
+		free(event);
+
+	xcb_damage_subtract(data->xcb, data->damage, XCB_NONE,
+			data->damage_region);
+	reg_r = xcb_xfixes_fetch_region_reply(data->xcb,
+			xcb_xfixes_fetch_region(data->xcb,
+				data->damage_region), NULL);
+	if (!reg_r) {
+		data->full_update = true;
+		return 0;
+	}
+
+	damaged = xcb_xfixes_fetch_region_rectangles(reg_r);
+	num     = xcb_xfixes_fetch_region_rectangles_length(reg_r);
+
+	if (num > XSHM_MAX_DAMAGE_RECTS) {
+		if (xshm_clip_rect(data, &reg_r->extents, &rects[0]))
+			count = 1;
+	} else {
+		for (int i = 0; i < num; ++i) {
+			if (xshm_clip_rect(data, &damaged[i], &rects[count]))
+				count++;
+		}
+	}
+
+	free(reg_r);
+	return count;
+}
+#endif
+
+/**
+ * Capture the whole screen
+ *
+ * @note requires to be called within the obs graphics context
+ */
+static void xshm_capture_full(struct xshm_data *data)
+{
+	xcb_shm_get_image_cookie_t img_c;
+	xcb_shm_get_image_reply_t  *img_r;
+
+	img_c = xcb_shm_get_image_unchecked(data->xcb, data->xcb_screen->root,
+			data->x_org, data->y_org, data->width, data->height,
+			~0, XCB_IMAGE_FORMAT_Z_PIXMAP, data->xshm->seg, 0);
+	img_r = xcb_shm_get_image_reply(data->xcb, img_c, NULL);
+
+	if (img_r) {
+		gs_texture_set_image(data->texture, (void *) data->xshm->data,
+			data->width * 4, false);
+		data->full_update = false;
+	}
+
+	free(img_r);
+}
+
+#if HAVE_XCB_DAMAGE
+/**
+ * Capture only the damaged rectangles
+ *
+ * The rectangles don't overlap, so they are all requested at once and
+ * stored next to each other in the shared memory segment.
+ *
+ * @note requires to be called within the obs graphics context
+ */
+static void xshm_capture_rects(struct xshm_data *data,
+		const xcb_rectangle_t *rects, size_t count)
+{
+	xcb_shm_get_image_cookie_t img_c[XSHM_MAX_DAMAGE_RECTS];
+	xcb_shm_get_image_reply_t  *img_r;
+	uint32_t offsets[XSHM_MAX_DAMAGE_RECTS];
+	uint32_t offset = 0;
+
+	for (size_t i = 0; i < count; ++i) {
+		offsets[i] = offset;
+		img_c[i] = xcb_shm_get_image_unchecked(data->xcb,
+				data->xcb_screen->root,
+				data->x_org + rects[i].x,
+				data->y_org + rects[i].y,
+				rects[i].width, rects[i].height,
+				~0, XCB_IMAGE_FORMAT_Z_PIXMAP,
+				data->xshm->seg, offset);
+		offset += (uint32_t)rects[i].width * rects[i].height * 4;
+	}
+
+	for (size_t i = 0; i < count; ++i) {
+		img_r = xcb_shm_get_image_reply(data->xcb, img_c[i], NULL);
+		if (!img_r) {
+			data->full_update = true;
+			continue;
+		}
+		free(img_r);
+
+		if (data->full_update)
+			continue;
+
+		if (!gs_texture_set_image_rect(data->texture,
+				rects[i].x, rects[i].y,
+				rects[i].width, rects[i].height,
+				data->xshm->data + offsets[i],
+				rects[i].width * 4)) {
+			blog(LOG_INFO, "Partial texture updates not supported, "
+					"capturing full frames");
+			xshm_free_damage(data);
+			data->full_update = true;
+		}
+	}
+}
+#endif
+
 /**
  * Prepare the capture data
+ *
+ * With damage tracking only the parts of the screen that changed since the
+ * last frame are captured, and nothing at all while the screen is idle.
  */
 static void xshm_video_tick(void *vptr, float seconds)
 {
@@ -396,32 +646,36 @@ static void xshm_video_tick(void *vptr, float seconds)
 	if (!obs_source_showing(data->source))
 		return;
 
-	xcb_shm_get_image_cookie_t           img_c;
-	xcb_shm_get_image_reply_t            *img_r;
+#if HAVE_XCB_DAMAGE
+	xcb_rectangle_t                      rects[XSHM_MAX_DAMAGE_RECTS];
+	size_t                               count = 0;
+#endif
 	xcb_xfixes_get_cursor_image_cookie_t cur_c;
 	xcb_xfixes_get_cursor_image_reply_t  *cur_r;
 
-	img_c = xcb_shm_get_image_unchecked(data->xcb, data->xcb_screen->root,
-			data->x_org, data->y_org, data->width, data->height,
-			~0, XCB_IMAGE_FORMAT_Z_PIXMAP, data->xshm->seg, 0);
-	cur_c = xcb_xfixes_get_cursor_image_unchecked(data->xcb);
-
-	img_r = xcb_shm_get_image_reply(data->xcb, img_c, NULL);
-	cur_r = xcb_xfixes_get_cursor_image_reply(data->xcb, cur_c, NULL);
+#if HAVE_XCB_DAMAGE
+	if (data->use_damage)
+		count = xshm_get_damage(data, rects);
+#endif
 
-	if (!img_r)
-		goto exit;
+	cur_c = xcb_xfixes_get_cursor_image_unchecked(data->xcb);
 
 	obs_enter_graphics();
 
-	gs_texture_set_image(data->texture, (void *) data->xshm->data,
-		data->width * 4, false);
+#if HAVE_XCB_DAMAGE
+	if (!data->use_damage || data->full_update)
+		xshm_capture_full(data);
+	else if (count)
+		xshm_capture_rects(data, rects, count);
+#else
+	xshm_capture_full(data);
+#endif
+
+	cur_r = xcb_xfixes_get_cursor_image_reply(data->xcb, cur_c, NULL);
 	xcb_xcursor_update(data->cursor, cur_r);
 
 	obs_leave_graphics();
 
-exit:
-	free(img_r);
 	free(cur_r);
 }
 
@@ -18,6 +18,7 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include "jack-wrapper.h"
 
 #include <obs-module.h>
+#include <util/threading.h>
 
 /**
  * Returns the name of the plugin
@@ -91,6 +92,19 @@ static void jack_update(void *vptr, obs_data_t *settings)
 	}
 }
 
+/**
+ * Get the number of xruns and of cycles that were dropped because the audio
+ * couldn't be handed off fast enough
+ */
+static void jack_get_stats_proc(void *vptr, calldata_t *cd)
+{
+	struct jack_data* data = (struct jack_data*)vptr;
+
+	calldata_set_int(cd, "xruns", os_atomic_load_long(&data->xruns));
+	calldata_set_int(cd, "dropped_cycles",
+			os_atomic_load_long(&data->overflows));
+}
+
 /**
  * Create the plugin object
  */
@@ -108,6 +122,11 @@ static void *jack_create(obs_data_t *settings, obs_source_t *source)
 		jack_destroy(data);
 		return NULL;
 	}
+
+	proc_handler_t *ph = obs_source_get_proc_handler(source);
+	proc_handler_add(ph, "void get_stats(out int xruns, "
+			"out int dropped_cycles)", jack_get_stats_proc, data);
+
 	return data;
 }
 
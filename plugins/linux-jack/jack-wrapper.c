@@ -21,9 +21,23 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include <stdio.h>
 
 #include <util/platform.h>
+#include <util/bmem.h>
 
 #define blog(level, msg, ...) blog(level, "jack-input: " msg, ##__VA_ARGS__)
 
+/* amount of audio the ring can hold before the callback has to drop */
+#define RING_BUFFER_MS 500
+
+/**
+ * Header of a block of audio in the ring, followed by the samples of every
+ * channel one after another
+ */
+struct jack_packet {
+	/* jack time at the start of the cycle, in microseconds */
+	jack_time_t   time;
+	jack_nframes_t frames;
+};
+
 /**
  * Get obs speaker layout from number of channels
  *
@@ -51,36 +65,177 @@ static enum speaker_layout jack_channels_to_obs_speakers(uint_fast32_t channels)
 	return SPEAKERS_UNKNOWN;
 }
 
+/**
+ * Copy the audio of one cycle into the ring
+ *
+ * This runs in the realtime thread of jack, so it must not lock, allocate or
+ * call into libobs. If the drain thread falls behind the cycle is dropped.
+ */
 int jack_process_callback(jack_nframes_t nframes, void* arg)
 {
 	struct jack_data* data = (struct jack_data*)arg;
 	if (data == 0)
 		return 0;
 
-	pthread_mutex_lock(&data->jack_mutex);
+	struct jack_packet packet;
+	size_t plane_size = nframes * sizeof(jack_default_audio_sample_t);
 
-	struct obs_source_audio out;
-	out.speakers        = jack_channels_to_obs_speakers(data->channels);
-	out.samples_per_sec = jack_get_sample_rate (data->jack_client);
-	/* format is always 32 bit float for jack */
-	out.format          = AUDIO_FORMAT_FLOAT_PLANAR;
+	if (jack_ringbuffer_write_space(data->ring) <
+			sizeof(packet) + plane_size * data->channels) {
+		os_atomic_inc_long(&data->overflows);
+		return 0;
+	}
+
+	packet.time   = jack_frames_to_time(data->jack_client,
+			jack_last_frame_time(data->jack_client));
+	packet.frames = nframes;
+	jack_ringbuffer_write(data->ring, (const char *)&packet,
+			sizeof(packet));
 
 	for (unsigned int i = 0; i < data->channels; ++i) {
 		jack_default_audio_sample_t *jack_buffer =
 			(jack_default_audio_sample_t *)jack_port_get_buffer(
 				data->jack_ports[i], nframes);
-		out.data[i] = (uint8_t *)jack_buffer;
+		jack_ringbuffer_write(data->ring, (const char *)jack_buffer,
+				plane_size);
 	}
 
-	out.frames    = nframes;
-	out.timestamp = os_gettime_ns() -
-				jack_frames_to_time(data->jack_client, nframes);
+	os_sem_post(data->ring_sem);
+	return 0;
+}
 
-	obs_source_output_audio(data->source, &out);
-	pthread_mutex_unlock(&data->jack_mutex);
+static int jack_xrun_callback(void *arg)
+{
+	struct jack_data* data = (struct jack_data*)arg;
+	os_atomic_inc_long(&data->xruns);
 	return 0;
 }
 
+/**
+ * Output one block of audio from the ring
+ *
+ * @return false if there is no complete block in the ring
+ */
+static bool jack_output_packet(struct jack_data* data)
+{
+	struct jack_packet packet;
+	struct obs_source_audio out;
+	size_t plane_size;
+	size_t size;
+	jack_time_t now;
+
+	if (jack_ringbuffer_read_space(data->ring) < sizeof(packet))
+		return false;
+
+	jack_ringbuffer_peek(data->ring, (char *)&packet, sizeof(packet));
+	plane_size = packet.frames * sizeof(jack_default_audio_sample_t);
+	size       = plane_size * data->channels;
+
+	if (jack_ringbuffer_read_space(data->ring) < sizeof(packet) + size)
+		return false;
+
+	if (data->drain_buffer_size < size) {
+		data->drain_buffer = brealloc(data->drain_buffer, size);
+		data->drain_buffer_size = size;
+	}
+
+	jack_ringbuffer_read_advance(data->ring, sizeof(packet));
+	jack_ringbuffer_read(data->ring, (char *)data->drain_buffer, size);
+
+	memset(&out, 0, sizeof(out));
+	out.speakers        = jack_channels_to_obs_speakers(data->channels);
+	out.samples_per_sec = jack_get_sample_rate(data->jack_client);
+	/* format is always 32 bit float for jack */
+	out.format          = AUDIO_FORMAT_FLOAT_PLANAR;
+	out.frames          = packet.frames;
+
+	for (unsigned int i = 0; i < data->channels; ++i)
+		out.data[i] = data->drain_buffer + plane_size * i;
+
+	/* map the start of the cycle from jack time to obs time */
+	now = jack_get_time();
+	out.timestamp = os_gettime_ns();
+	if (now > packet.time)
+		out.timestamp -= (now - packet.time) * 1000;
+
+	obs_source_output_audio(data->source, &out);
+	return true;
+}
+
+static void *jack_drain_thread(void *arg)
+{
+	struct jack_data* data = (struct jack_data*)arg;
+
+	os_set_thread_name("jack-input: drain");
+
+	while (os_sem_wait(data->ring_sem) == 0) {
+		if (os_atomic_load_bool(&data->stopping))
+			break;
+
+		while (jack_output_packet(data))
+			;
+	}
+
+	return NULL;
+}
+
+static bool jack_start_drain_thread(struct jack_data* data)
+{
+	size_t size = (size_t)jack_get_sample_rate(data->jack_client) *
+		RING_BUFFER_MS / 1000 * data->channels *
+		sizeof(jack_default_audio_sample_t);
+
+	/* room for a few cycles at least, and their headers */
+	size += (jack_get_buffer_size(data->jack_client) * data->channels *
+		sizeof(jack_default_audio_sample_t) +
+		sizeof(struct jack_packet)) * 4;
+
+	data->ring = jack_ringbuffer_create(size);
+	if (!data->ring)
+		return false;
+
+	/* keep the realtime thread from page faulting */
+	jack_ringbuffer_mlock(data->ring);
+
+	if (os_sem_init(&data->ring_sem, 0) != 0)
+		return false;
+
+	data->stopping = false;
+	if (pthread_create(&data->drain_thread, NULL, jack_drain_thread,
+			data) != 0)
+		return false;
+
+	data->drain_thread_active = true;
+	return true;
+}
+
+/**
+ * Stop the drain thread, must be called after the client was deactivated
+ */
+static void jack_stop_drain_thread(struct jack_data* data)
+{
+	if (data->drain_thread_active) {
+		os_atomic_set_bool(&data->stopping, true);
+		os_sem_post(data->ring_sem);
+		pthread_join(data->drain_thread, NULL);
+		data->drain_thread_active = false;
+	}
+
+	if (data->ring_sem) {
+		os_sem_destroy(data->ring_sem);
+		data->ring_sem = NULL;
+	}
+
+	if (data->ring) {
+		jack_ringbuffer_free(data->ring);
+		data->ring = NULL;
+	}
+
+	bfree(data->drain_buffer);
+	data->drain_buffer = NULL;
+	data->drain_buffer_size = 0;
+}
+
 int_fast32_t jack_init(struct jack_data* data)
 {
 	pthread_mutex_lock(&data->jack_mutex);
@@ -117,12 +272,21 @@ int_fast32_t jack_init(struct jack_data* data)
 		}
 	}
 
+	if (!jack_start_drain_thread(data)) {
+		blog(LOG_ERROR, "Could not start the drain thread");
+		goto error;
+	}
+
 	if (jack_set_process_callback(data->jack_client,
 			jack_process_callback, data) != 0) {
 		blog(LOG_ERROR, "jack_set_process_callback Error");
 		goto error;
 	}
 
+	if (jack_set_xrun_callback(data->jack_client,
+			jack_xrun_callback, data) != 0)
+		blog(LOG_WARNING, "jack_set_xrun_callback Error");
+
 	if (jack_activate(data->jack_client) != 0) {
 		blog(LOG_ERROR,
 			"jack_activate Error:"
@@ -144,6 +308,14 @@ void deactivate_jack(struct jack_data* data)
 	pthread_mutex_lock(&data->jack_mutex);
 
 	if (data->jack_client) {
+		/* makes sure the process callback is no longer running */
+		jack_deactivate(data->jack_client);
+		jack_stop_drain_thread(data);
+
+		blog(LOG_INFO, "%ld xruns, %ld cycles dropped",
+				os_atomic_load_long(&data->xruns),
+				os_atomic_load_long(&data->overflows));
+
 		if (data->jack_ports != NULL) {
 			for (int i = 0; i < data->channels; ++i) {
 				if (data->jack_ports[i] != NULL)
@@ -18,6 +18,7 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #pragma once
 
 #include <jack/jack.h>
+#include <jack/ringbuffer.h>
 #include <obs.h>
 #include <util/threading.h>
 
@@ -37,6 +38,20 @@ struct jack_data {
 	jack_client_t *jack_client;
 	jack_port_t **jack_ports;
 
+	/* the process callback runs in the realtime thread of jack and only
+	 * copies the audio into the ring, which is drained by our thread */
+	jack_ringbuffer_t *ring;
+	os_sem_t *ring_sem;
+	pthread_t drain_thread;
+	bool drain_thread_active;
+	volatile bool stopping;
+	uint8_t *drain_buffer;
+	size_t drain_buffer_size;
+
+	/* statistics */
+	volatile long xruns;
+	volatile long overflows;
+
 	pthread_mutex_t jack_mutex;
 };
 
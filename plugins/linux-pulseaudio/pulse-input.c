@@ -15,14 +15,27 @@ You should have received a copy of the GNU General Public License
 along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 
+#include <stdlib.h>
 #include <util/platform.h>
 #include <util/bmem.h>
+#include <util/dstr.h>
 #include <obs-module.h>
 
 #include "pulse-wrapper.h"
 
 #define NSEC_PER_SEC  1000000000LL
 #define NSEC_PER_MSEC 1000000L
+#define NSEC_PER_USEC 1000LL
+
+/* requested size of the chunks delivered by the server */
+#define PULSE_FRAGMENT_USEC 10000
+/* audio the server buffers for us before it starts dropping */
+#define PULSE_MAX_BUFFER_USEC 500000
+
+/* timestamps follow the measured capture time by this fraction */
+#define TS_CORRECTION_DIV 16
+/* larger differences (holes, overruns) resync the timestamps */
+#define TS_MAX_ERROR_NS (50 * NSEC_PER_MSEC)
 
 #define PULSE_DATA(voidptr) struct pulse_data *data = voidptr;
 #define blog(level, msg, ...) blog(level, "pulse-input: " msg, ##__VA_ARGS__)
@@ -42,9 +55,18 @@ struct pulse_data {
 	uint_fast8_t channels;
 	uint64_t first_ts;
 
-	/* statistics */
+	/* timestamps are derived from the sample count since the last sync,
+	 * corrected towards the capture time measured by pulse */
+	uint64_t sync_ts;
+	uint64_t sync_frames;
+	uint64_t measure_start_ts;
+	uint64_t measure_frames;
+
+	/* statistics, protected by the pulse lock */
 	uint_fast32_t packets;
 	uint_fast64_t frames;
+	pa_usec_t latency;
+	double drift_ppm;
 };
 
 static void pulse_stop_recording(struct pulse_data *data);
@@ -97,11 +119,93 @@ static inline uint64_t samples_to_ns(size_t frames, uint_fast32_t rate)
 	return frames * NSEC_PER_SEC / rate;
 }
 
+/* same as samples_to_ns, for sample counts that would overflow */
+static inline uint64_t frames_to_ns(uint64_t frames, uint_fast32_t rate)
+{
+	return frames / rate * NSEC_PER_SEC +
+		(frames % rate) * NSEC_PER_SEC / rate;
+}
+
 static inline uint64_t get_sample_time(size_t frames, uint_fast32_t rate)
 {
 	return os_gettime_ns() - samples_to_ns(frames, rate);
 }
 
+/**
+ * Get the time the first frame of the current chunk was captured
+ *
+ * Uses the latency reported by pulse, which covers the source latency and
+ * everything queued in the stream. The timing info is updated automatically
+ * and interpolated, so this does not need a round trip to the server.
+ */
+static uint64_t pulse_capture_time(struct pulse_data *data, size_t frames)
+{
+	pa_usec_t latency;
+	int negative;
+
+	if (pa_stream_get_latency(data->stream, &latency, &negative) < 0)
+		return get_sample_time(frames, data->samples_per_sec);
+
+	if (negative)
+		latency = 0;
+
+	data->latency = latency;
+	return os_gettime_ns() - latency * NSEC_PER_USEC;
+}
+
+/**
+ * Get the timestamp for the current chunk
+ *
+ * The sample clock of the device and the system clock drift apart, and the
+ * measured capture time jitters with the scheduling of the server. So the
+ * timestamps are counted from the samples and only slowly pulled towards the
+ * measured time, which also gives an estimate of the drift.
+ */
+static uint64_t pulse_get_timestamp(struct pulse_data *data, size_t frames)
+{
+	uint64_t measured = pulse_capture_time(data, frames);
+	uint64_t ts;
+	int64_t error;
+
+	if (!data->measure_start_ts) {
+		data->measure_start_ts = measured;
+		data->measure_frames   = 0;
+	} else if (data->measure_frames >= data->samples_per_sec * 10) {
+		int64_t elapsed  = (int64_t)(measured -
+				data->measure_start_ts);
+		int64_t expected = (int64_t)frames_to_ns(data->measure_frames,
+				data->samples_per_sec);
+
+		data->drift_ppm = (double)(elapsed - expected) * 1000000.0 /
+			(double)expected;
+	}
+	data->measure_frames += frames;
+
+	ts = data->sync_ts + frames_to_ns(data->sync_frames,
+			data->samples_per_sec);
+	error = (int64_t)(measured - ts);
+
+	if (!data->sync_ts || llabs(error) > TS_MAX_ERROR_NS) {
+		if (data->sync_ts)
+			blog(LOG_DEBUG, "Resyncing timestamps, off by %"PRId64
+					" ns", error);
+
+		data->sync_ts     = measured;
+		data->sync_frames = 0;
+		ts = measured;
+
+		/* the hole or overrun would show up as drift */
+		data->measure_start_ts = measured;
+		data->measure_frames   = frames;
+	} else {
+		data->sync_ts += error / TS_CORRECTION_DIV;
+		ts            += error / TS_CORRECTION_DIV;
+	}
+
+	data->sync_frames += frames;
+	return ts;
+}
+
 #define STARTUP_TIMEOUT_NS (500 * NSEC_PER_MSEC)
 
 /**
@@ -140,8 +244,7 @@ static void pulse_stream_read(pa_stream *p, size_t nbytes, void *userdata)
 	out.format          = pulse_to_obs_audio_format(data->format);
 	out.data[0]         = (uint8_t *) frames;
 	out.frames          = bytes / data->bytes_per_frame;
-	out.timestamp       = get_sample_time(out.frames,
-	                                      out.samples_per_sec);
+	out.timestamp       = pulse_get_timestamp(data, out.frames);
 
 	if (!data->first_ts)
 		data->first_ts = out.timestamp + STARTUP_TIMEOUT_NS;
@@ -232,9 +335,10 @@ skip:
  * We request the default format used by pulse here because the data will be
  * converted and possibly re-sampled by obs anyway.
  *
- * For now we request a buffer length of 25ms although pulse seems to ignore
- * this setting for monitor streams. For "real" input streams this should work
- * fine though.
+ * The fragment size is requested explicitly and ADJUST_LATENCY makes the
+ * server configure the source latency to match it, so the capture latency
+ * does not depend on the server defaults. Monitor streams may still use a
+ * larger latency, which is compensated in the timestamps.
  */
 static int_fast32_t pulse_start_recording(struct pulse_data *data)
 {
@@ -279,13 +383,15 @@ static int_fast32_t pulse_start_recording(struct pulse_data *data)
 	pulse_unlock();
 
 	pa_buffer_attr attr;
-	attr.fragsize  = pa_usec_to_bytes(25000, &spec);
-	attr.maxlength = (uint32_t) -1;
+	attr.fragsize  = pa_usec_to_bytes(PULSE_FRAGMENT_USEC, &spec);
+	attr.maxlength = pa_usec_to_bytes(PULSE_MAX_BUFFER_USEC, &spec);
 	attr.minreq    = (uint32_t) -1;
 	attr.prebuf    = (uint32_t) -1;
 	attr.tlength   = (uint32_t) -1;
 
-	pa_stream_flags_t flags = PA_STREAM_ADJUST_LATENCY;
+	pa_stream_flags_t flags = PA_STREAM_ADJUST_LATENCY |
+		PA_STREAM_AUTO_TIMING_UPDATE |
+		PA_STREAM_INTERPOLATE_TIMING;
 
 	pulse_lock();
 	int_fast32_t ret = pa_stream_connect_record(data->stream, data->device,
@@ -317,10 +423,46 @@ static void pulse_stop_recording(struct pulse_data *data)
 	blog(LOG_INFO, "Stopped recording from '%s'", data->device);
 	blog(LOG_INFO, "Got %"PRIuFAST32" packets with %"PRIuFAST64" frames",
 		data->packets, data->frames);
+	blog(LOG_INFO, "Latency %.1f ms, clock drift %+.1f ppm",
+		(double)data->latency / 1000.0, data->drift_ppm);
 
+	pulse_lock();
 	data->first_ts = 0;
 	data->packets = 0;
 	data->frames = 0;
+	data->sync_ts = 0;
+	data->sync_frames = 0;
+	data->measure_start_ts = 0;
+	data->measure_frames = 0;
+	data->latency = 0;
+	data->drift_ppm = 0.0;
+	pulse_unlock();
+}
+
+/**
+ * Get the measured latency and clock drift of the stream
+ */
+static void pulse_get_stats(struct pulse_data *data, pa_usec_t *latency,
+		double *drift_ppm, bool *recording)
+{
+	pulse_lock();
+	*latency   = data->latency;
+	*drift_ppm = data->drift_ppm;
+	*recording = data->stream != NULL && data->packets > 0;
+	pulse_unlock();
+}
+
+static void pulse_get_stats_proc(void *vptr, calldata_t *cd)
+{
+	PULSE_DATA(vptr);
+	pa_usec_t latency;
+	double drift_ppm;
+	bool recording;
+
+	pulse_get_stats(data, &latency, &drift_ppm, &recording);
+
+	calldata_set_int(cd, "latency_us", (long long)latency);
+	calldata_set_float(cd, "drift_ppm", drift_ppm);
 }
 
 /**
@@ -357,10 +499,43 @@ skip:
 	pulse_signal(0);
 }
 
+/**
+ * Show the measured latency in a read only property
+ *
+ * The measurement is the only entry of a disabled list, selected by the empty
+ * default value, so it is never saved with the settings.
+ */
+static void pulse_latency_property(struct pulse_data *data,
+		obs_properties_t *props)
+{
+	obs_property_t *p = obs_properties_add_list(props, "latency",
+		obs_module_text("MeasuredLatency"), OBS_COMBO_TYPE_LIST,
+		OBS_COMBO_FORMAT_STRING);
+	obs_property_set_enabled(p, false);
+
+	pa_usec_t latency;
+	double drift_ppm;
+	bool recording;
+	struct dstr info;
+
+	dstr_init(&info);
+	pulse_get_stats(data, &latency, &drift_ppm, &recording);
+
+	if (recording)
+		dstr_printf(&info, "%.1f ms (%s %+.1f ppm)",
+			(double)latency / 1000.0,
+			obs_module_text("ClockDrift"), drift_ppm);
+	else
+		dstr_copy(&info, obs_module_text("NotRecording"));
+
+	obs_property_list_add_string(p, info.array, "");
+	dstr_free(&info);
+}
+
 /**
  * Get plugin properties
  */
-static obs_properties_t *pulse_properties(bool input)
+static obs_properties_t *pulse_properties(struct pulse_data *data, bool input)
 {
 	obs_properties_t *props = obs_properties_create();
 	obs_property_t *devices = obs_properties_add_list(props, "device_id",
@@ -372,21 +547,20 @@ static obs_properties_t *pulse_properties(bool input)
 	pulse_get_source_info_list(cb, (void *) devices);
 	pulse_unref();
 
+	if (data)
+		pulse_latency_property(data, props);
+
 	return props;
 }
 
-static obs_properties_t *pulse_input_properties(void *unused)
+static obs_properties_t *pulse_input_properties(void *vptr)
 {
-	UNUSED_PARAMETER(unused);
-
-	return pulse_properties(true);
+	return pulse_properties(vptr, true);
 }
 
-static obs_properties_t *pulse_output_properties(void *unused)
+static obs_properties_t *pulse_output_properties(void *vptr)
 {
-	UNUSED_PARAMETER(unused);
-
-	return pulse_properties(false);
+	return pulse_properties(vptr, false);
 }
 
 /**
@@ -427,6 +601,8 @@ static void pulse_output_device(pa_context *c, const pa_server_info *i,
  */
 static void pulse_defaults(obs_data_t *settings, bool input)
 {
+	obs_data_set_default_string(settings, "latency", "");
+
 	pulse_init();
 
 	pa_server_info_cb_t cb = (input)
@@ -517,6 +693,10 @@ static void *pulse_create(obs_data_t *settings, obs_source_t *source)
 	pulse_init();
 	pulse_update(data, settings);
 
+	proc_handler_t *ph = obs_source_get_proc_handler(source);
+	proc_handler_add(ph, "void get_stats(out int latency_us, "
+			"out float drift_ppm)", pulse_get_stats_proc, data);
+
 	return data;
 }
 
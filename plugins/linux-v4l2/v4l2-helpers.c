@@ -81,8 +81,10 @@ int_fast32_t v4l2_create_mmap(int_fast32_t dev, struct v4l2_buffer_data *buf)
 		return -1;
 	}
 
-	buf->count = req.count;
-	buf->info  = bzalloc(req.count * sizeof(struct v4l2_mmap_info));
+	buf->count    = req.count;
+	buf->capacity = (req.count > V4L2_MAX_BUFFERS)
+			? req.count : V4L2_MAX_BUFFERS;
+	buf->info     = bzalloc(buf->capacity * sizeof(struct v4l2_mmap_info));
 
 	memset(&map, 0, sizeof(map));
 	map.type   = req.type;
@@ -108,6 +110,67 @@ int_fast32_t v4l2_create_mmap(int_fast32_t dev, struct v4l2_buffer_data *buf)
 	return 0;
 }
 
+int_fast32_t v4l2_grow_mmap(int_fast32_t dev, struct v4l2_buffer_data *buf)
+{
+#ifndef VIDIOC_CREATE_BUFS
+	UNUSED_PARAMETER(dev);
+	UNUSED_PARAMETER(buf);
+	return -1;
+#else
+	struct v4l2_create_buffers create;
+	struct v4l2_buffer map;
+	struct v4l2_mmap_info *info;
+
+	if (buf->count >= buf->capacity)
+		return -1;
+
+	memset(&create, 0, sizeof(create));
+	create.count       = 1;
+	create.memory      = V4L2_MEMORY_MMAP;
+	create.format.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+
+	if (v4l2_ioctl(dev, VIDIOC_G_FMT, &create.format) < 0)
+		return -1;
+	if (v4l2_ioctl(dev, VIDIOC_CREATE_BUFS, &create) < 0)
+		return -1;
+
+	/* buffers are tracked by their index */
+	if (create.count != 1 || create.index != buf->count) {
+		blog(LOG_ERROR, "Unexpected buffer index %u", create.index);
+		return -1;
+	}
+
+	memset(&map, 0, sizeof(map));
+	map.type   = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+	map.memory = V4L2_MEMORY_MMAP;
+	map.index  = create.index;
+
+	if (v4l2_ioctl(dev, VIDIOC_QUERYBUF, &map) < 0) {
+		blog(LOG_ERROR, "Failed to query buffer details");
+		return -1;
+	}
+
+	info         = &buf->info[map.index];
+	info->length = map.length;
+	info->start  = v4l2_mmap(NULL, map.length, PROT_READ | PROT_WRITE,
+			MAP_SHARED, dev, map.m.offset);
+
+	if (info->start == MAP_FAILED) {
+		blog(LOG_ERROR, "mmap for buffer failed");
+		return -1;
+	}
+
+	buf->count++;
+
+	if (v4l2_ioctl(dev, VIDIOC_QBUF, &map) < 0) {
+		blog(LOG_ERROR, "unable to queue buffer");
+		return -1;
+	}
+
+	return 0;
+#endif
+}
+
 int_fast32_t v4l2_destroy_mmap(struct v4l2_buffer_data *buf)
 {
 	for(uint_fast32_t i = 0; i < buf->count; ++i) {
@@ -115,9 +178,11 @@ int_fast32_t v4l2_destroy_mmap(struct v4l2_buffer_data *buf)
 			v4l2_munmap(buf->info[i].start, buf->info[i].length);
 	}
 
-	if (buf->count) {
+	if (buf->info) {
 		bfree(buf->info);
-		buf->count = 0;
+		buf->info     = NULL;
+		buf->count    = 0;
+		buf->capacity = 0;
 	}
 
 	return 0;
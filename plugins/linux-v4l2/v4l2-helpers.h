@@ -27,6 +27,12 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 extern "C" {
 #endif
 
+/**
+ * Number of buffers that can be mapped at most, including the buffers that
+ * are added while capturing
+ */
+#define V4L2_MAX_BUFFERS 16
+
 /**
  * Data structure for mapped buffers
  */
@@ -43,6 +49,8 @@ struct v4l2_mmap_info {
 struct v4l2_buffer_data {
 	/** number of mapped buffers */
 	uint_fast32_t count;
+	/** number of buffers the info array has room for */
+	uint_fast32_t capacity;
 	/** memory info for mapped buffers */
 	struct v4l2_mmap_info *info;
 };
@@ -73,6 +81,34 @@ static inline enum video_format v4l2_to_obs_video_format(uint_fast32_t format)
 	}
 }
 
+/**
+ * Check if the v4l2 pixel format is a (motion) jpeg format
+ *
+ * @param format v4l2 format id
+ *
+ * @return true if the frames need to be decoded
+ */
+static inline bool v4l2_is_mjpeg(uint_fast32_t format)
+{
+	return format == V4L2_PIX_FMT_MJPEG || format == V4L2_PIX_FMT_JPEG;
+}
+
+/**
+ * Check if frames in the v4l2 pixel format can be captured
+ *
+ * @param format v4l2 format id
+ *
+ * @return true if the format is supported
+ */
+static inline bool v4l2_format_supported(uint_fast32_t format)
+{
+#if HAVE_AVCODEC
+	if (v4l2_is_mjpeg(format))
+		return true;
+#endif
+	return v4l2_to_obs_video_format(format) != VIDEO_FORMAT_NONE;
+}
+
 /**
  * Fixed framesizes for devices that don't support enumerating discrete values.
  *
@@ -203,6 +239,20 @@ int_fast32_t v4l2_stop_capture(int_fast32_t dev);
  */
 int_fast32_t v4l2_create_mmap(int_fast32_t dev, struct v4l2_buffer_data *buf);
 
+/**
+ * Add a buffer while the capture is running
+ *
+ * Uses VIDIOC_CREATE_BUFS to allocate one more buffer, maps it and queues it
+ * on the device. This fails if the driver does not support adding buffers
+ * or V4L2_MAX_BUFFERS buffers are already mapped.
+ *
+ * @param dev handle for the v4l2 device
+ * @param buf buffer data
+ *
+ * @return negative on failure
+ */
+int_fast32_t v4l2_grow_mmap(int_fast32_t dev, struct v4l2_buffer_data *buf);
+
 /**
  * Destroy the memory mapping for buffers
  *
@@ -37,6 +37,10 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
 #include "v4l2-helpers.h"
 
+#if HAVE_AVCODEC
+#include "v4l2-mjpeg.h"
+#endif
+
 #if HAVE_UDEV
 #include "v4l2-udev.h"
 #endif
@@ -63,6 +67,28 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
 #define blog(level, msg, ...) blog(level, "v4l2-input: " msg, ##__VA_ARGS__)
 
+/**
+ * Mapped buffers of a capture
+ *
+ * Captured frames are output without copying them, so the buffers are only
+ * queued on the device again once libobs is done with them. The pool owns
+ * the device handle and the buffers, and is freed when the capture stopped
+ * and all frames have been released.
+ */
+struct v4l2_frame_pool {
+	volatile long refs;
+	pthread_mutex_t mutex;
+
+	int_fast32_t dev;
+	bool streaming;
+	bool grow_failed;
+	/* number of buffers queued on the device */
+	uint_fast32_t queued;
+
+	struct v4l2_buffer_data buffers;
+	struct obs_source_frame *frames;
+};
+
 /**
  * Data structure for the v4l2 source
  */
@@ -85,7 +111,10 @@ struct v4l2_data {
 	int width;
 	int height;
 	int linesize;
-	struct v4l2_buffer_data buffers;
+	struct v4l2_frame_pool *pool;
+#if HAVE_AVCODEC
+	v4l2_mjpeg_t *mjpeg;
+#endif
 };
 
 /* forward declarations */
@@ -142,23 +171,129 @@ static void v4l2_prep_obs_frame(struct v4l2_data *data,
 	}
 }
 
+/**
+ * Map the buffers for the device and create the pool
+ *
+ * @return the pool or NULL on failure, the device is not closed then
+ */
+static struct v4l2_frame_pool *v4l2_pool_create(int_fast32_t dev)
+{
+	struct v4l2_frame_pool *pool = bzalloc(sizeof(struct v4l2_frame_pool));
+
+	if (v4l2_create_mmap(dev, &pool->buffers) < 0) {
+		bfree(pool);
+		return NULL;
+	}
+
+	pthread_mutex_init(&pool->mutex, NULL);
+	pool->refs   = 1;
+	pool->dev    = dev;
+	pool->frames = bzalloc(pool->buffers.capacity *
+			sizeof(struct obs_source_frame));
+	return pool;
+}
+
+static void v4l2_pool_release(struct v4l2_frame_pool *pool)
+{
+	if (os_atomic_dec_long(&pool->refs) != 0)
+		return;
+
+	v4l2_destroy_mmap(&pool->buffers);
+	v4l2_close(pool->dev);
+
+	pthread_mutex_destroy(&pool->mutex);
+	bfree(pool->frames);
+	bfree(pool);
+}
+
+/**
+ * Hand a buffer back to the device
+ */
+static void v4l2_pool_requeue(void *vptr, uint32_t index)
+{
+	struct v4l2_frame_pool *pool = vptr;
+	struct v4l2_buffer buf;
+
+	pthread_mutex_lock(&pool->mutex);
+
+	if (pool->streaming) {
+		memset(&buf, 0, sizeof(buf));
+		buf.type   = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+		buf.memory = V4L2_MEMORY_MMAP;
+		buf.index  = index;
+
+		if (v4l2_ioctl(pool->dev, VIDIOC_QBUF, &buf) < 0)
+			blog(LOG_DEBUG, "failed to enqueue buffer");
+		else
+			pool->queued++;
+	}
+
+	pthread_mutex_unlock(&pool->mutex);
+}
+
+/**
+ * Add a buffer if the device is about to run out of queued buffers
+ *
+ * This happens when libobs holds on to a few frames, for example when the
+ * source is buffered.
+ */
+static void v4l2_pool_grow(struct v4l2_frame_pool *pool)
+{
+	pthread_mutex_lock(&pool->mutex);
+
+	if (pool->queued < 2 && !pool->grow_failed) {
+		if (v4l2_grow_mmap(pool->dev, &pool->buffers) < 0) {
+			blog(LOG_INFO, "Unable to add buffers, using %u",
+					(unsigned)pool->buffers.count);
+			pool->grow_failed = true;
+		} else {
+			blog(LOG_DEBUG, "Added buffer, using %u",
+					(unsigned)pool->buffers.count);
+			pool->queued++;
+		}
+	}
+
+	pthread_mutex_unlock(&pool->mutex);
+}
+
+/*
+ * Called by libobs once a frame is no longer used, possibly with the frame
+ * lock of the source held
+ */
+static void v4l2_frame_release(void *vptr, struct obs_source_frame *frame)
+{
+	struct v4l2_frame_pool *pool = vptr;
+
+	v4l2_pool_requeue(pool, (uint32_t)(frame - pool->frames));
+	v4l2_pool_release(pool);
+}
+
 /*
  * Worker thread to get video data
  */
 static void *v4l2_thread(void *vptr)
 {
 	V4L2_DATA(vptr);
+	struct v4l2_frame_pool *pool = data->pool;
 	int r;
 	fd_set fds;
 	uint8_t *start;
 	uint64_t frames;
 	uint64_t first_ts;
+	uint64_t timestamp;
 	struct timeval tv;
 	struct v4l2_buffer buf;
 	struct obs_source_frame out;
+	struct obs_source_frame *frame;
 	size_t plane_offsets[MAX_AV_PLANES];
 
-	if (v4l2_start_capture(data->dev, &data->buffers) < 0)
+	pthread_mutex_lock(&pool->mutex);
+	r = v4l2_start_capture(data->dev, &pool->buffers);
+	pool->streaming = r == 0;
+	pool->queued    = pool->buffers.count;
+	pthread_mutex_unlock(&pool->mutex);
+
+	if (r < 0)
 		goto exit;
 
 	frames   = 0;
@@ -182,38 +317,62 @@ static void *v4l2_thread(void *vptr)
 			continue;
 		}
 
+		memset(&buf, 0, sizeof(buf));
 		buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
 		buf.memory = V4L2_MEMORY_MMAP;
 
-		if (v4l2_ioctl(data->dev, VIDIOC_DQBUF, &buf) < 0) {
+		pthread_mutex_lock(&pool->mutex);
+		r = v4l2_ioctl(data->dev, VIDIOC_DQBUF, &buf);
+		if (r == 0)
+			pool->queued--;
+		pthread_mutex_unlock(&pool->mutex);
+
+		if (r < 0) {
 			if (errno == EAGAIN)
 				continue;
 			blog(LOG_DEBUG, "failed to dequeue buffer");
 			break;
 		}
 
-		out.timestamp = timeval2ns(buf.timestamp);
+		timestamp = timeval2ns(buf.timestamp);
 		if (!frames)
-			first_ts = out.timestamp;
-		out.timestamp -= first_ts;
-
-		start = (uint8_t *) data->buffers.info[buf.index].start;
-		for (uint_fast32_t i = 0; i < MAX_AV_PLANES; ++i)
-			out.data[i] = start + plane_offsets[i];
-		obs_source_output_video(data->source, &out);
-
-		if (v4l2_ioctl(data->dev, VIDIOC_QBUF, &buf) < 0) {
-			blog(LOG_DEBUG, "failed to enqueue buffer");
-			break;
+			first_ts = timestamp;
+		timestamp -= first_ts;
+
+		start = (uint8_t *) pool->buffers.info[buf.index].start;
+
+#if HAVE_AVCODEC
+		if (data->mjpeg) {
+			if (!v4l2_mjpeg_decode(data->mjpeg, buf.index, start,
+					buf.bytesused,
+					pool->buffers.info[buf.index].length,
+					timestamp))
+				v4l2_pool_requeue(pool, buf.index);
+		} else
+#endif
+		{
+			frame = &pool->frames[buf.index];
+			*frame = out;
+			frame->timestamp = timestamp;
+			for (uint_fast32_t i = 0; i < MAX_AV_PLANES; ++i)
+				frame->data[i] = start + plane_offsets[i];
+
+			os_atomic_inc_long(&pool->refs);
+			obs_source_output_video_ref(data->source, frame,
+					v4l2_frame_release, pool);
 		}
 
+		v4l2_pool_grow(pool);
 		frames++;
 	}
 
 	blog(LOG_INFO, "Stopped capture after %"PRIu64" frames", frames);
 
 exit:
+	pthread_mutex_lock(&pool->mutex);
+	pool->streaming = false;
 	v4l2_stop_capture(data->dev);
+	pthread_mutex_unlock(&pool->mutex);
 	return NULL;
 }
 
@@ -388,8 +547,7 @@ static void v4l2_format_list(int dev, obs_property_t *prop)
 		if (fmt.flags & V4L2_FMT_FLAG_EMULATED)
 			dstr_cat(&buffer, " (Emulated)");
 
-		if (v4l2_to_obs_video_format(fmt.pixelformat)
-				!= VIDEO_FORMAT_NONE) {
+		if (v4l2_format_supported(fmt.pixelformat)) {
 			obs_property_list_add_int(prop, buffer.array,
 					fmt.pixelformat);
 			blog(LOG_INFO, "Pixelformat: %s (available)",
@@ -784,12 +942,23 @@ static void v4l2_terminate(struct v4l2_data *data)
 		data->thread = 0;
 	}
 
-	v4l2_destroy_mmap(&data->buffers);
+#if HAVE_AVCODEC
+	if (data->mjpeg) {
+		v4l2_mjpeg_destroy(data->mjpeg);
+		data->mjpeg = NULL;
+	}
+#endif
 
-	if (data->dev != -1) {
+	if (data->pool) {
+		/* the pool closes the device once the frames still in use
+		 * have been released */
+		obs_source_flush_async_video(data->source);
+		v4l2_pool_release(data->pool);
+		data->pool = NULL;
+	} else if (data->dev != -1) {
 		v4l2_close(data->dev);
-		data->dev = -1;
 	}
+	data->dev = -1;
 }
 
 static void v4l2_destroy(void *vptr)
@@ -874,7 +1043,7 @@ static void v4l2_init(struct v4l2_data *data)
 		blog(LOG_ERROR, "Unable to set format");
 		goto fail;
 	}
-	if (v4l2_to_obs_video_format(data->pixfmt) == VIDEO_FORMAT_NONE) {
+	if (!v4l2_format_supported(data->pixfmt)) {
 		blog(LOG_ERROR, "Selected video format not supported");
 		goto fail;
 	}
@@ -892,11 +1061,21 @@ static void v4l2_init(struct v4l2_data *data)
 	blog(LOG_INFO, "Framerate: %.2f fps", (float) fps_denom / fps_num);
 
 	/* map buffers */
-	if (v4l2_create_mmap(data->dev, &data->buffers) < 0) {
+	data->pool = v4l2_pool_create(data->dev);
+	if (!data->pool) {
 		blog(LOG_ERROR, "Failed to map buffers");
 		goto fail;
 	}
 
+#if HAVE_AVCODEC
+	if (v4l2_is_mjpeg(data->pixfmt)) {
+		data->mjpeg = v4l2_mjpeg_create(data->source,
+				v4l2_pool_requeue, data->pool);
+		if (!data->mjpeg)
+			goto fail;
+	}
+#endif
+
 	/* start the capture thread */
 	if (os_event_init(&data->event, OS_EVENT_TYPE_MANUAL) != 0)
 		goto fail;
@@ -0,0 +1,525 @@
+/*
+Copyright (C) 2017 by OBS Studio contributors
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include <string.h>
+#include <unistd.h>
+
+#include <libavcodec/avcodec.h>
+#include <libavutil/pixdesc.h>
+
+#include <util/threading.h>
+#include <util/circlebuf.h>
+#include <util/darray.h>
+#include <util/platform.h>
+#include <util/bmem.h>
+
+#include "v4l2-mjpeg.h"
+
+#define blog(level, msg, ...) blog(level, "v4l2-input: " msg, ##__VA_ARGS__)
+
+#ifndef AV_INPUT_BUFFER_PADDING_SIZE
+#define AV_INPUT_BUFFER_PADDING_SIZE FF_INPUT_BUFFER_PADDING_SIZE
+#endif
+
+#define MJPEG_MAX_WORKERS 4
+
+/**
+ * Compressed frame waiting for a worker
+ */
+struct mjpeg_job {
+	uint64_t seq;
+	uint32_t index;
+	uint8_t *data;
+	size_t size;
+	size_t buffer_size;
+	uint64_t timestamp;
+};
+
+/**
+ * Decoder thread with its own codec context
+ */
+struct mjpeg_worker {
+	struct v4l2_mjpeg *mjpeg;
+	pthread_t thread;
+	bool thread_created;
+
+	AVCodecContext *context;
+	AVFrame *frame;
+	uint8_t *packet_buffer;
+	size_t packet_size;
+};
+
+struct v4l2_mjpeg {
+	/* one reference for the owner and one for each output frame */
+	volatile long refs;
+
+	obs_source_t *source;
+	v4l2_mjpeg_requeue_t requeue;
+	void *param;
+
+	pthread_mutex_t mutex;
+	pthread_cond_t job_cond;
+	pthread_cond_t space_cond;
+	pthread_cond_t output_cond;
+	struct circlebuf jobs;
+	uint64_t next_seq;
+	uint64_t next_output;
+	bool stopping;
+
+	/* output frames that libobs handed back */
+	pthread_mutex_t frame_mutex;
+	DARRAY(struct obs_source_frame *) free_frames;
+
+	size_t num_workers;
+	struct mjpeg_worker workers[MJPEG_MAX_WORKERS];
+};
+
+static void mjpeg_free_frame(struct obs_source_frame *frame)
+{
+	bfree(frame->data[0]);
+	bfree(frame);
+}
+
+static void mjpeg_release(struct v4l2_mjpeg *mjpeg)
+{
+	if (os_atomic_dec_long(&mjpeg->refs) != 0)
+		return;
+
+	for (size_t i = 0; i < mjpeg->free_frames.num; ++i)
+		mjpeg_free_frame(mjpeg->free_frames.array[i]);
+	da_free(mjpeg->free_frames);
+
+	circlebuf_free(&mjpeg->jobs);
+	pthread_cond_destroy(&mjpeg->output_cond);
+	pthread_cond_destroy(&mjpeg->space_cond);
+	pthread_cond_destroy(&mjpeg->job_cond);
+	pthread_mutex_destroy(&mjpeg->frame_mutex);
+	pthread_mutex_destroy(&mjpeg->mutex);
+	bfree(mjpeg);
+}
+
+/*
+ * Called by libobs once an output frame is no longer used, possibly with the
+ * frame lock of the source held
+ */
+static void mjpeg_frame_release(void *vptr, struct obs_source_frame *frame)
+{
+	struct v4l2_mjpeg *mjpeg = vptr;
+
+	pthread_mutex_lock(&mjpeg->frame_mutex);
+	da_push_back(mjpeg->free_frames, &frame);
+	pthread_mutex_unlock(&mjpeg->frame_mutex);
+
+	mjpeg_release(mjpeg);
+}
+
+/**
+ * Get an I420 frame with packed planes, so libobs can upload it directly
+ */
+static struct obs_source_frame *mjpeg_get_frame(struct v4l2_mjpeg *mjpeg,
+		uint32_t width, uint32_t height)
+{
+	struct obs_source_frame *frame = NULL;
+	size_t luma_size = (size_t)width * height;
+
+	pthread_mutex_lock(&mjpeg->frame_mutex);
+	while (mjpeg->free_frames.num && !frame) {
+		frame = mjpeg->free_frames.array[mjpeg->free_frames.num - 1];
+		da_pop_back(mjpeg->free_frames);
+
+		if (frame->width != width || frame->height != height) {
+			mjpeg_free_frame(frame);
+			frame = NULL;
+		}
+	}
+	pthread_mutex_unlock(&mjpeg->frame_mutex);
+
+	if (frame)
+		return frame;
+
+	frame = bzalloc(sizeof(struct obs_source_frame));
+	frame->format      = VIDEO_FORMAT_I420;
+	frame->width       = width;
+	frame->height      = height;
+	frame->data[0]     = bmalloc(luma_size + luma_size / 2);
+	frame->data[1]     = frame->data[0] + luma_size;
+	frame->data[2]     = frame->data[1] + luma_size / 4;
+	frame->linesize[0] = width;
+	frame->linesize[1] = width / 2;
+	frame->linesize[2] = width / 2;
+	return frame;
+}
+
+/**
+ * Subsample a decoded chroma plane to 4:2:0
+ *
+ * Most webcams send 4:2:2 jpegs, in which case this simply skips every
+ * other chroma row.
+ */
+static void mjpeg_copy_chroma(uint8_t *dst, uint32_t dst_linesize,
+		const uint8_t *src, int src_linesize, uint32_t width,
+		uint32_t height, int shift_x, int shift_y)
+{
+	for (uint32_t y = 0; y < height; ++y) {
+		const uint8_t *row = src +
+			(size_t)((y << 1) >> shift_y) * src_linesize;
+
+		if (shift_x == 1) {
+			memcpy(dst, row, width);
+		} else {
+			for (uint32_t x = 0; x < width; ++x)
+				dst[x] = row[(x << 1) >> shift_x];
+		}
+
+		dst += dst_linesize;
+	}
+}
+
+/**
+ * Convert the decoded image to an output frame
+ *
+ * @return the frame or NULL if the pixel format is not supported
+ */
+static struct obs_source_frame *mjpeg_convert(struct v4l2_mjpeg *mjpeg,
+		const AVFrame *av_frame)
+{
+	struct obs_source_frame *frame;
+	enum AVPixelFormat pix_fmt = av_frame->format;
+	uint32_t width  = (uint32_t)av_frame->width & ~1;
+	uint32_t height = (uint32_t)av_frame->height & ~1;
+	bool full_range;
+	bool gray;
+	int shift_x = 0, shift_y = 0;
+
+	switch (pix_fmt) {
+	case AV_PIX_FMT_YUVJ420P:
+	case AV_PIX_FMT_YUVJ422P:
+	case AV_PIX_FMT_YUVJ440P:
+	case AV_PIX_FMT_YUVJ444P:
+	case AV_PIX_FMT_YUVJ411P:
+		full_range = true;
+		gray = false;
+		break;
+	case AV_PIX_FMT_YUV420P:
+	case AV_PIX_FMT_YUV422P:
+	case AV_PIX_FMT_YUV440P:
+	case AV_PIX_FMT_YUV444P:
+	case AV_PIX_FMT_YUV411P:
+		full_range = av_frame->color_range == AVCOL_RANGE_JPEG;
+		gray = false;
+		break;
+	case AV_PIX_FMT_GRAY8:
+		full_range = av_frame->color_range != AVCOL_RANGE_MPEG;
+		gray = true;
+		break;
+	default:
+		return NULL;
+	}
+
+	if (!width || !height)
+		return NULL;
+
+	if (!gray && av_pix_fmt_get_chroma_sub_sample(pix_fmt,
+			&shift_x, &shift_y) < 0)
+		return NULL;
+
+	frame = mjpeg_get_frame(mjpeg, width, height);
+
+	for (uint32_t y = 0; y < height; ++y)
+		memcpy(frame->data[0] + (size_t)y * frame->linesize[0],
+				av_frame->data[0] + (size_t)y *
+				av_frame->linesize[0], width);
+
+	if (gray) {
+		memset(frame->data[1], 128, (size_t)width * height / 2);
+	} else {
+		for (size_t i = 1; i < 3; ++i)
+			mjpeg_copy_chroma(frame->data[i], frame->linesize[i],
+					av_frame->data[i],
+					av_frame->linesize[i], width / 2,
+					height / 2, shift_x, shift_y);
+	}
+
+	frame->full_range = full_range;
+	video_format_get_parameters(VIDEO_CS_601, full_range
+			? VIDEO_RANGE_FULL : VIDEO_RANGE_PARTIAL,
+			frame->color_matrix, frame->color_range_min,
+			frame->color_range_max);
+
+	return frame;
+}
+
+/**
+ * Decode a job and hand the capture buffer back
+ */
+static struct obs_source_frame *mjpeg_decode_job(struct mjpeg_worker *worker,
+		const struct mjpeg_job *job)
+{
+	struct v4l2_mjpeg *mjpeg = worker->mjpeg;
+	struct obs_source_frame *frame = NULL;
+	AVPacket packet;
+	int got_frame = 0;
+	int ret;
+
+	av_init_packet(&packet);
+	packet.size = (int)job->size;
+
+	/* the decoder may read past the end of the data, so the padding has
+	 * to be zeroed. this is done in place if the capture buffer has room
+	 * for it */
+	if (job->size + AV_INPUT_BUFFER_PADDING_SIZE <= job->buffer_size) {
+		memset(job->data + job->size, 0,
+				AV_INPUT_BUFFER_PADDING_SIZE);
+		packet.data = job->data;
+	} else {
+		size_t new_size = job->size + AV_INPUT_BUFFER_PADDING_SIZE;
+
+		if (worker->packet_size < new_size) {
+			worker->packet_buffer = brealloc(worker->packet_buffer,
+					new_size);
+			worker->packet_size = new_size;
+		}
+
+		memcpy(worker->packet_buffer, job->data, job->size);
+		memset(worker->packet_buffer + job->size, 0,
+				AV_INPUT_BUFFER_PADDING_SIZE);
+		packet.data = worker->packet_buffer;
+	}
+
+	ret = avcodec_decode_video2(worker->context, worker->frame,
+			&got_frame, &packet);
+
+	/* the decoded image does not reference the packet */
+	mjpeg->requeue(mjpeg->param, job->index);
+
+	if (ret < 0 || !got_frame) {
+		blog(LOG_DEBUG, "failed to decode frame");
+		return NULL;
+	}
+
+	frame = mjpeg_convert(mjpeg, worker->frame);
+	if (!frame) {
+		blog(LOG_DEBUG, "unsupported pixel format %s",
+				av_get_pix_fmt_name(worker->frame->format));
+		return NULL;
+	}
+
+	frame->timestamp = job->timestamp;
+	return frame;
+}
+
+static void *mjpeg_worker_thread(void *vptr)
+{
+	struct mjpeg_worker *worker = vptr;
+	struct v4l2_mjpeg *mjpeg = worker->mjpeg;
+	struct obs_source_frame *frame;
+	struct mjpeg_job job;
+	bool drop;
+
+	os_set_thread_name("v4l2: mjpeg decode");
+
+	for (;;) {
+		pthread_mutex_lock(&mjpeg->mutex);
+		while (!mjpeg->stopping && !mjpeg->jobs.size)
+			pthread_cond_wait(&mjpeg->job_cond, &mjpeg->mutex);
+
+		if (!mjpeg->jobs.size) {
+			pthread_mutex_unlock(&mjpeg->mutex);
+			break;
+		}
+
+		circlebuf_pop_front(&mjpeg->jobs, &job, sizeof(job));
+		drop = mjpeg->stopping;
+		pthread_cond_signal(&mjpeg->space_cond);
+		pthread_mutex_unlock(&mjpeg->mutex);
+
+		if (drop) {
+			mjpeg->requeue(mjpeg->param, job.index);
+			frame = NULL;
+		} else {
+			frame = mjpeg_decode_job(worker, &job);
+		}
+
+		/* frames are output in the order they were captured */
+		pthread_mutex_lock(&mjpeg->mutex);
+		while (mjpeg->next_output != job.seq)
+			pthread_cond_wait(&mjpeg->output_cond, &mjpeg->mutex);
+		pthread_mutex_unlock(&mjpeg->mutex);
+
+		if (frame) {
+			os_atomic_inc_long(&mjpeg->refs);
+			obs_source_output_video_ref(mjpeg->source, frame,
+					mjpeg_frame_release, mjpeg);
+		}
+
+		pthread_mutex_lock(&mjpeg->mutex);
+		mjpeg->next_output++;
+		pthread_cond_broadcast(&mjpeg->output_cond);
+		pthread_mutex_unlock(&mjpeg->mutex);
+	}
+
+	return NULL;
+}
+
+static bool mjpeg_worker_init(struct v4l2_mjpeg *mjpeg,
+		struct mjpeg_worker *worker, AVCodec *codec)
+{
+	worker->mjpeg = mjpeg;
+
+	worker->context = avcodec_alloc_context3(codec);
+	if (!worker->context)
+		return false;
+
+	/* frames are already decoded in parallel by the workers */
+	worker->context->thread_count = 1;
+
+	if (avcodec_open2(worker->context, codec, NULL) < 0) {
+		blog(LOG_ERROR, "failed to open mjpeg decoder");
+		return false;
+	}
+
+	worker->frame = av_frame_alloc();
+	if (!worker->frame)
+		return false;
+
+	if (pthread_create(&worker->thread, NULL, mjpeg_worker_thread,
+			worker) != 0)
+		return false;
+
+	worker->thread_created = true;
+	return true;
+}
+
+static void mjpeg_worker_free(struct mjpeg_worker *worker)
+{
+	if (worker->context) {
+		avcodec_close(worker->context);
+		av_free(worker->context);
+	}
+
+	if (worker->frame)
+		av_frame_free(&worker->frame);
+
+	bfree(worker->packet_buffer);
+	memset(worker, 0, sizeof(*worker));
+}
+
+static size_t mjpeg_worker_count(void)
+{
+	long cores = sysconf(_SC_NPROCESSORS_ONLN);
+
+	/* leave a core for the rest of the program */
+	if (cores <= 2)
+		return 1;
+	if (cores > MJPEG_MAX_WORKERS + 1)
+		return MJPEG_MAX_WORKERS;
+	return (size_t)cores - 1;
+}
+
+v4l2_mjpeg_t *v4l2_mjpeg_create(obs_source_t *source,
+		v4l2_mjpeg_requeue_t requeue, void *param)
+{
+	struct v4l2_mjpeg *mjpeg;
+	AVCodec *codec;
+
+	avcodec_register_all();
+
+	codec = avcodec_find_decoder(AV_CODEC_ID_MJPEG);
+	if (!codec) {
+		blog(LOG_ERROR, "mjpeg decoder not found");
+		return NULL;
+	}
+
+	mjpeg = bzalloc(sizeof(struct v4l2_mjpeg));
+	mjpeg->refs    = 1;
+	mjpeg->source  = source;
+	mjpeg->requeue = requeue;
+	mjpeg->param   = param;
+
+	pthread_mutex_init(&mjpeg->mutex, NULL);
+	pthread_mutex_init(&mjpeg->frame_mutex, NULL);
+	pthread_cond_init(&mjpeg->job_cond, NULL);
+	pthread_cond_init(&mjpeg->space_cond, NULL);
+	pthread_cond_init(&mjpeg->output_cond, NULL);
+
+	mjpeg->num_workers = mjpeg_worker_count();
+	for (size_t i = 0; i < mjpeg->num_workers; ++i) {
+		if (!mjpeg_worker_init(mjpeg, &mjpeg->workers[i], codec)) {
+			mjpeg->num_workers = i + 1;
+			v4l2_mjpeg_destroy(mjpeg);
+			return NULL;
+		}
+	}
+
+	blog(LOG_INFO, "Decoding mjpeg with %d threads",
+			(int)mjpeg->num_workers);
+	return mjpeg;
+}
+
+void v4l2_mjpeg_destroy(v4l2_mjpeg_t *mjpeg)
+{
+	if (!mjpeg)
+		return;
+
+	pthread_mutex_lock(&mjpeg->mutex);
+	mjpeg->stopping = true;
+	pthread_cond_broadcast(&mjpeg->job_cond);
+	pthread_cond_broadcast(&mjpeg->space_cond);
+	pthread_mutex_unlock(&mjpeg->mutex);
+
+	for (size_t i = 0; i < mjpeg->num_workers; ++i) {
+		struct mjpeg_worker *worker = &mjpeg->workers[i];
+
+		if (worker->thread_created)
+			pthread_join(worker->thread, NULL);
+		mjpeg_worker_free(worker);
+	}
+
+	/* output frames still used by libobs keep the rest alive */
+	mjpeg_release(mjpeg);
+}
+
+bool v4l2_mjpeg_decode(v4l2_mjpeg_t *mjpeg, uint32_t index, uint8_t *data,
+		size_t size, size_t buffer_size, uint64_t timestamp)
+{
+	struct mjpeg_job job;
+
+	if (!size)
+		return false;
+
+	pthread_mutex_lock(&mjpeg->mutex);
+
+	while (!mjpeg->stopping &&
+	       mjpeg->jobs.size >= mjpeg->num_workers * sizeof(job))
+		pthread_cond_wait(&mjpeg->space_cond, &mjpeg->mutex);
+
+	if (mjpeg->stopping) {
+		pthread_mutex_unlock(&mjpeg->mutex);
+		return false;
+	}
+
+	job.seq         = mjpeg->next_seq++;
+	job.index       = index;
+	job.data        = data;
+	job.size        = size;
+	job.buffer_size = buffer_size;
+	job.timestamp   = timestamp;
+	circlebuf_push_back(&mjpeg->jobs, &job, sizeof(job));
+
+	pthread_cond_signal(&mjpeg->job_cond);
+	pthread_mutex_unlock(&mjpeg->mutex);
+	return true;
+}
@@ -0,0 +1,89 @@
+/*
+Copyright (C) 2017 by OBS Studio contributors
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <inttypes.h>
+#include <stdbool.h>
+
+#include <obs-module.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Called when a worker is done with a capture buffer
+ *
+ * @param param user data passed to v4l2_mjpeg_create
+ * @param index index of the buffer that can be queued again
+ */
+typedef void (*v4l2_mjpeg_requeue_t)(void *param, uint32_t index);
+
+/**
+ * Motion jpeg decoder
+ *
+ * Frames are decoded by a small pool of worker threads so a single slow
+ * decode does not hold up the capture thread. The workers convert the
+ * decoded images to packed I420 frames, which libobs uses without copying
+ * them again, and output them in the order they were captured.
+ */
+typedef struct v4l2_mjpeg v4l2_mjpeg_t;
+
+/**
+ * Create the decoder and start the worker threads
+ *
+ * @param source the source to output decoded frames to
+ * @param requeue called when a capture buffer is no longer needed
+ * @param param user data for the callback
+ *
+ * @return the decoder or NULL on failure
+ */
+v4l2_mjpeg_t *v4l2_mjpeg_create(obs_source_t *source,
+		v4l2_mjpeg_requeue_t requeue, void *param);
+
+/**
+ * Stop the worker threads and destroy the decoder
+ *
+ * Frames that have not been decoded yet are dropped and their buffers are
+ * handed back through the requeue callback.
+ *
+ * @param mjpeg the decoder
+ */
+void v4l2_mjpeg_destroy(v4l2_mjpeg_t *mjpeg);
+
+/**
+ * Queue a captured frame for decoding
+ *
+ * Blocks while all workers are busy. The buffer must stay valid until it is
+ * handed back through the requeue callback.
+ *
+ * @param mjpeg the decoder
+ * @param index index of the capture buffer
+ * @param data start of the compressed frame
+ * @param size size of the compressed frame
+ * @param buffer_size size of the capture buffer
+ * @param timestamp timestamp of the frame
+ *
+ * @return false if the frame was not queued, the buffer is not used then
+ */
+bool v4l2_mjpeg_decode(v4l2_mjpeg_t *mjpeg, uint32_t index, uint8_t *data,
+		size_t size, size_t buffer_size, uint64_t timestamp);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,388 @@
+/*
+ * Copyright (c) 2017 OBS Studio contributors
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE /* fallocate */
+#endif
+
+#ifdef _WIN32
+#include <io.h>
+#include <windows.h>
+#define inline __inline
+#else
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "ffmpeg-mux-writer.h"
+
+#include <libavutil/time.h>
+
+#define CHUNK_SIZE  (1024 * 1024)
+#define EXTENT_SIZE (64LL * 1024 * 1024)
+
+struct mux_writer {
+	FILE                    *file;
+	uint8_t                 *buf;
+	size_t                  capacity;
+	size_t                  head;
+	size_t                  size;
+
+	pthread_t               thread;
+	pthread_mutex_t         mutex;
+	pthread_cond_t          data_cond;
+	pthread_cond_t          space_cond;
+	bool                    busy;
+	bool                    stop;
+	bool                    error;
+
+	/* pos is where the next queued byte goes, file_pos where the writer
+	 * thread writes next; they only differ while data is queued */
+	int64_t                 pos;
+	int64_t                 file_pos;
+	int64_t                 file_size;
+	int64_t                 allocated;
+	bool                    prealloc_failed;
+
+	struct mux_writer_stats stats;
+};
+
+/* ------------------------------------------------------------------------- */
+
+#ifdef _WIN32
+static FILE *open_file(const char *path)
+{
+	wchar_t *wpath;
+	FILE *file;
+	int len;
+
+	len = MultiByteToWideChar(CP_UTF8, 0, path, -1, NULL, 0);
+	if (!len)
+		return NULL;
+
+	wpath = malloc(len * sizeof(wchar_t));
+	MultiByteToWideChar(CP_UTF8, 0, path, -1, wpath, len);
+	file = _wfopen(wpath, L"wb");
+	free(wpath);
+	return file;
+}
+
+static inline int seek_file(FILE *file, int64_t offset)
+{
+	return _fseeki64(file, offset, SEEK_SET);
+}
+
+static int preallocate_file(FILE *file, int64_t size)
+{
+	FILE_ALLOCATION_INFO info;
+	HANDLE handle = (HANDLE)_get_osfhandle(_fileno(file));
+
+	info.AllocationSize.QuadPart = size;
+	return SetFileInformationByHandle(handle, FileAllocationInfo, &info,
+			sizeof(info)) ? 0 : -1;
+}
+
+#else
+static inline FILE *open_file(const char *path)
+{
+	return fopen(path, "wb");
+}
+
+static inline int seek_file(FILE *file, int64_t offset)
+{
+	return fseeko(file, (off_t)offset, SEEK_SET);
+}
+
+/* like fallocate with FALLOC_FL_KEEP_SIZE, the reported file size stays at
+ * the end of the written data, so nothing needs to be truncated on close */
+static int preallocate_file(FILE *file, int64_t size)
+{
+	int fd = fileno(file);
+
+#if defined(__APPLE__)
+	struct stat st;
+
+	if (fstat(fd, &st) != 0)
+		return -1;
+	if (size <= (int64_t)st.st_size)
+		return 0;
+
+	fstore_t store = {
+		.fst_flags    = F_ALLOCATECONTIG,
+		.fst_posmode  = F_PEOFPOSMODE,
+		.fst_offset   = 0,
+		.fst_length   = (off_t)(size - (int64_t)st.st_size)
+	};
+
+	if (fcntl(fd, F_PREALLOCATE, &store) == 0)
+		return 0;
+
+	store.fst_flags = F_ALLOCATEALL;
+	return fcntl(fd, F_PREALLOCATE, &store) == 0 ? 0 : -1;
+#elif defined(__linux__)
+	return fallocate(fd, FALLOC_FL_KEEP_SIZE, 0, (off_t)size) == 0 ? 0 : -1;
+#else
+	(void)fd;
+	(void)size;
+	return -1;
+#endif
+}
+#endif
+
+/* ------------------------------------------------------------------------- */
+
+static void preallocate(struct mux_writer *w, size_t size)
+{
+	int64_t new_size;
+
+	if (w->prealloc_failed)
+		return;
+	if (w->file_pos + (int64_t)size <= w->allocated)
+		return;
+
+	new_size = w->file_pos + (int64_t)size + EXTENT_SIZE;
+
+	if (preallocate_file(w->file, new_size) == 0) {
+		w->allocated = new_size;
+	} else {
+		fprintf(stderr, "ffmpeg-mux: file preallocation not supported, "
+				"writing without it\n");
+		w->prealloc_failed = true;
+	}
+}
+
+static void *writer_thread(void *data)
+{
+	struct mux_writer *w = data;
+
+	pthread_mutex_lock(&w->mutex);
+
+	for (;;) {
+		int64_t start, elapsed;
+		size_t chunk;
+		bool ok;
+
+		while (!w->size && !w->stop)
+			pthread_cond_wait(&w->data_cond, &w->mutex);
+		if (!w->size)
+			break;
+
+		/* the queued range is only written to by this thread, so it
+		 * can be written to the file without holding the lock */
+		chunk = w->capacity - w->head;
+		if (chunk > w->size)
+			chunk = w->size;
+		if (chunk > CHUNK_SIZE)
+			chunk = CHUNK_SIZE;
+
+		w->busy = true;
+		pthread_mutex_unlock(&w->mutex);
+
+		start = av_gettime_relative();
+		preallocate(w, chunk);
+		ok = fwrite(w->buf + w->head, 1, chunk, w->file) == chunk;
+		elapsed = av_gettime_relative() - start;
+
+		pthread_mutex_lock(&w->mutex);
+		w->busy = false;
+
+		if (ok) {
+			w->head = (w->head + chunk) % w->capacity;
+			w->size -= chunk;
+			w->file_pos += (int64_t)chunk;
+			if (w->file_pos > w->file_size)
+				w->file_size = w->file_pos;
+
+			w->stats.bytes_written += (int64_t)chunk;
+			w->stats.writes++;
+			if (elapsed > w->stats.max_write_time_us)
+				w->stats.max_write_time_us = elapsed;
+		} else {
+			fprintf(stderr, "ffmpeg-mux: failed to write to the "
+					"output file\n");
+			w->error = true;
+			w->size = 0;
+		}
+
+		pthread_cond_broadcast(&w->space_cond);
+	}
+
+	pthread_mutex_unlock(&w->mutex);
+	return NULL;
+}
+
+/* waits until all queued data has been written, with the mutex held */
+static void wait_idle(struct mux_writer *w)
+{
+	while ((w->size || w->busy) && !w->error)
+		pthread_cond_wait(&w->space_cond, &w->mutex);
+}
+
+/* ------------------------------------------------------------------------- */
+
+struct mux_writer *mux_writer_open(const char *path, size_t buffer_size)
+{
+	struct mux_writer *w = calloc(1, sizeof(*w));
+
+	w->capacity = buffer_size;
+	w->buf = malloc(buffer_size);
+	w->file = open_file(path);
+	if (!w->buf || !w->file)
+		goto fail;
+
+	if (pthread_mutex_init(&w->mutex, NULL) != 0)
+		goto fail;
+	if (pthread_cond_init(&w->data_cond, NULL) != 0)
+		goto fail_data_cond;
+	if (pthread_cond_init(&w->space_cond, NULL) != 0)
+		goto fail_space_cond;
+	if (pthread_create(&w->thread, NULL, writer_thread, w) != 0)
+		goto fail_thread;
+
+	return w;
+
+fail_thread:
+	pthread_cond_destroy(&w->space_cond);
+fail_space_cond:
+	pthread_cond_destroy(&w->data_cond);
+fail_data_cond:
+	pthread_mutex_destroy(&w->mutex);
+fail:
+	if (w->file)
+		fclose(w->file);
+	free(w->buf);
+	free(w);
+	return NULL;
+}
+
+bool mux_writer_close(struct mux_writer *w, struct mux_writer_stats *stats)
+{
+	bool success;
+
+	if (!w)
+		return false;
+
+	pthread_mutex_lock(&w->mutex);
+	w->stop = true;
+	pthread_cond_signal(&w->data_cond);
+	pthread_mutex_unlock(&w->mutex);
+
+	pthread_join(w->thread, NULL);
+
+	success = !w->error && fflush(w->file) == 0;
+	if (fclose(w->file) != 0)
+		success = false;
+
+	if (stats)
+		*stats = w->stats;
+
+	pthread_cond_destroy(&w->space_cond);
+	pthread_cond_destroy(&w->data_cond);
+	pthread_mutex_destroy(&w->mutex);
+	free(w->buf);
+	free(w);
+	return success;
+}
+
+bool mux_writer_write(struct mux_writer *w, const uint8_t *data, size_t size)
+{
+	bool stalled = false;
+	int64_t stall_start = 0;
+	bool success;
+
+	pthread_mutex_lock(&w->mutex);
+
+	while (size && !w->error) {
+		size_t tail, space, n;
+
+		if (w->size == w->capacity) {
+			if (!stalled) {
+				stall_start = av_gettime_relative();
+				stalled = true;
+			}
+
+			pthread_cond_wait(&w->space_cond, &w->mutex);
+			continue;
+		}
+
+		tail = (w->head + w->size) % w->capacity;
+		space = w->capacity - w->size;
+		if (space > w->capacity - tail)
+			space = w->capacity - tail;
+
+		n = size < space ? size : space;
+		memcpy(w->buf + tail, data, n);
+
+		w->size += n;
+		w->pos += (int64_t)n;
+		data += n;
+		size -= n;
+
+		if ((int64_t)w->size > w->stats.peak_queued)
+			w->stats.peak_queued = (int64_t)w->size;
+
+		pthread_cond_signal(&w->data_cond);
+	}
+
+	if (stalled) {
+		w->stats.stalls++;
+		w->stats.stall_time_us += av_gettime_relative() - stall_start;
+	}
+
+	success = !w->error;
+	pthread_mutex_unlock(&w->mutex);
+	return success;
+}
+
+int64_t mux_writer_seek(struct mux_writer *w, int64_t offset, int origin)
+{
+	int64_t target;
+
+	pthread_mutex_lock(&w->mutex);
+	wait_idle(w);
+
+	if (origin == SEEK_CUR)
+		target = w->pos + offset;
+	else if (origin == SEEK_END)
+		target = w->file_size + offset;
+	else
+		target = offset;
+
+	if (w->error || target < 0 || seek_file(w->file, target) != 0) {
+		pthread_mutex_unlock(&w->mutex);
+		return -1;
+	}
+
+	w->pos = target;
+	w->file_pos = target;
+	pthread_mutex_unlock(&w->mutex);
+	return target;
+}
+
+int64_t mux_writer_size(struct mux_writer *w)
+{
+	int64_t size;
+
+	pthread_mutex_lock(&w->mutex);
+	size = w->pos > w->file_size ? w->pos : w->file_size;
+	pthread_mutex_unlock(&w->mutex);
+	return size;
+}
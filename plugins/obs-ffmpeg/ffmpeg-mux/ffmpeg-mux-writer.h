@@ -0,0 +1,53 @@
+/*
+ * Copyright (c) 2017 OBS Studio contributors
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Write-behind file writer for the muxer process.
+ *
+ * Writes are copied into a ring buffer and written to the file by a separate
+ * thread, which preallocates the file in large extents ahead of the data.
+ * The muxer only blocks when the ring buffer is full, or when it seeks, which
+ * waits for the queued data to be written first.
+ *
+ * This deliberately does not use libobs, the muxer runs as its own process.
+ */
+
+struct mux_writer;
+
+struct mux_writer_stats {
+	int64_t bytes_written;
+	int64_t writes;
+	int64_t max_write_time_us;
+	int64_t peak_queued;
+	int64_t stalls;
+	int64_t stall_time_us;
+};
+
+struct mux_writer *mux_writer_open(const char *path, size_t buffer_size);
+bool mux_writer_close(struct mux_writer *writer,
+		struct mux_writer_stats *stats);
+
+bool mux_writer_write(struct mux_writer *writer, const uint8_t *data,
+		size_t size);
+int64_t mux_writer_seek(struct mux_writer *writer, int64_t offset,
+		int origin);
+int64_t mux_writer_size(struct mux_writer *writer);
@@ -26,9 +26,13 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include "ffmpeg-mux.h"
+#include "ffmpeg-mux-writer.h"
 
 #include <libavformat/avformat.h>
 
+#define IO_BUFFER_SIZE     (1024 * 1024)
+#define WRITER_BUFFER_SIZE (64 * 1024 * 1024)
+
 /* ------------------------------------------------------------------------- */
 
 struct resize_buf {
@@ -99,6 +103,7 @@ struct ffmpeg_mux {
 	struct header          *audio_header;
 	int                    num_audio_streams;
 	bool                   initialized;
+	struct mux_writer      *writer;
 	char error[4096];
 };
 
@@ -107,11 +112,39 @@ static void header_free(struct header *header)
 	free(header->data);
 }
 
+static void close_output_io(struct ffmpeg_mux *ffm)
+{
+	struct mux_writer_stats stats = {0};
+	AVIOContext *pb = ffm->output->pb;
+
+	if (!pb)
+		return;
+
+	avio_flush(pb);
+	av_freep(&pb->buffer);
+	av_freep(&ffm->output->pb);
+
+	if (!mux_writer_close(ffm->writer, &stats))
+		fprintf(stderr, "ffmpeg-mux: failed to finish writing '%s'\n",
+				ffm->params.file);
+	ffm->writer = NULL;
+
+	fprintf(stderr, "ffmpeg-mux: wrote %lld bytes in %lld writes, "
+			"slowest write %lld ms, write queue peaked at %lld KB, "
+			"muxer stalled %lld times for %lld ms\n",
+			(long long)stats.bytes_written,
+			(long long)stats.writes,
+			(long long)stats.max_write_time_us / 1000,
+			(long long)stats.peak_queued / 1024,
+			(long long)stats.stalls,
+			(long long)stats.stall_time_us / 1000);
+}
+
 static void free_avformat(struct ffmpeg_mux *ffm)
 {
 	if (ffm->output) {
 		if ((ffm->output->oformat->flags & AVFMT_NOFILE) == 0)
-			avio_close(ffm->output->pb);
+			close_output_io(ffm);
 
 		avformat_free_context(ffm->output);
 		ffm->output = NULL;
@@ -448,19 +481,62 @@ static inline bool ffmpeg_mux_get_extra_data(struct ffmpeg_mux *ffm)
 #pragma warning(disable : 4996)
 #endif
 
+static int write_io(void *opaque, uint8_t *buf, int buf_size)
+{
+	struct mux_writer *writer = opaque;
+
+	if (!mux_writer_write(writer, buf, (size_t)buf_size))
+		return AVERROR(EIO);
+
+	return buf_size;
+}
+
+static int64_t seek_io(void *opaque, int64_t offset, int whence)
+{
+	struct mux_writer *writer = opaque;
+	int64_t ret;
+
+	if (whence & AVSEEK_SIZE)
+		return mux_writer_size(writer);
+
+	ret = mux_writer_seek(writer, offset, whence & ~AVSEEK_FORCE);
+	return ret < 0 ? AVERROR(EIO) : ret;
+}
+
+static inline int open_output_io(struct ffmpeg_mux *ffm)
+{
+	uint8_t *buffer;
+
+	ffm->writer = mux_writer_open(ffm->params.file, WRITER_BUFFER_SIZE);
+	if (!ffm->writer) {
+		printf("Couldn't open '%s'", ffm->params.file);
+		return FFM_ERROR;
+	}
+
+	buffer = av_malloc(IO_BUFFER_SIZE);
+	ffm->output->pb = avio_alloc_context(buffer, IO_BUFFER_SIZE, 1,
+			ffm->writer, NULL, write_io, seek_io);
+	if (!ffm->output->pb) {
+		printf("Couldn't create IO context for '%s'",
+				ffm->params.file);
+		av_free(buffer);
+		mux_writer_close(ffm->writer, NULL);
+		ffm->writer = NULL;
+		return FFM_ERROR;
+	}
+
+	return FFM_SUCCESS;
+}
+
 static inline int open_output_file(struct ffmpeg_mux *ffm)
 {
 	AVOutputFormat *format = ffm->output->oformat;
 	int ret;
 
 	if ((format->flags & AVFMT_NOFILE) == 0) {
-		ret = avio_open(&ffm->output->pb, ffm->params.file,
-				AVIO_FLAG_WRITE);
-		if (ret < 0) {
-			printf("Couldn't open '%s', %s",
-					ffm->params.file, av_err2str(ret));
-			return FFM_ERROR;
-		}
+		ret = open_output_io(ffm);
+		if (ret != FFM_SUCCESS)
+			return ret;
 	}
 
 	strncpy(ffm->output->filename, ffm->params.file,
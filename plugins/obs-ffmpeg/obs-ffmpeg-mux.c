@@ -25,6 +25,7 @@
 #include <util/circlebuf.h>
 #include <util/threading.h>
 #include "ffmpeg-mux/ffmpeg-mux.h"
+#include "obs-ffmpeg-split.h"
 
 #include <libavformat/avformat.h>
 
@@ -35,6 +36,26 @@
 #define warn(format, ...)  do_log(LOG_WARNING, format, ##__VA_ARGS__)
 #define info(format, ...)  do_log(LOG_INFO,    format, ##__VA_ARGS__)
 
+struct replay_gop {
+	uint64_t          packet_idx;
+	int64_t           byte_offset;
+	int64_t           start_ts;
+};
+
+struct replay_segment {
+	int64_t           offset;
+	int64_t           size;
+	int64_t           start_ts;
+	int64_t           end_ts;
+};
+
+struct replay_offsets {
+	bool              found_video;
+	bool              found_audio[MAX_AUDIO_MIXES];
+	int64_t           video;
+	int64_t           audio[MAX_AUDIO_MIXES];
+};
+
 struct ffmpeg_muxer {
 	obs_output_t      *output;
 	os_process_pipe_t *pipe;
@@ -45,16 +66,45 @@ struct ffmpeg_muxer {
 	volatile bool     stopping;
 	volatile bool     capturing;
 
+	/* split file */
+	os_process_pipe_t *next_pipe;
+	os_process_pipe_t *closing_pipe;
+	pthread_t         close_thread;
+	bool              close_thread_joinable;
+	struct dstr       base_path;
+	struct dstr       next_path;
+	volatile bool     split_requested;
+	int               split_count;
+	int64_t           file_size;
+	int64_t           file_start_ts;
+	struct split_offsets file_offsets;
+
 	/* replay buffer */
 	struct circlebuf  packets;
-	int64_t           cur_size;
-	int64_t           cur_time;
+	struct circlebuf  gops;
+	uint64_t          packets_pushed;
+	uint64_t          packets_popped;
+	int64_t           bytes_pushed;
 	int64_t           max_size;
 	int64_t           max_time;
 	int64_t           save_ts;
-	int               keyframes;
+	int64_t           save_duration;
+	bool              has_video;
 	obs_hotkey_id     hotkey;
 
+	/* disk-backed replay buffer */
+	bool              use_disk;
+	bool              wait_keyframe;
+	FILE              *disk_file;
+	struct dstr       disk_path;
+	struct circlebuf  segments;
+	int64_t           segment_time;
+	int64_t           disk_capacity;
+	int64_t           disk_pos;
+	int64_t           disk_used;
+	int64_t           save_offset;
+	int64_t           save_size;
+
 	DARRAY(struct encoder_packet) mux_packets;
 	pthread_t                     mux_thread;
 	bool                          mux_thread_joinable;
@@ -67,8 +117,32 @@ static const char *ffmpeg_mux_getname(void *type)
 	return obs_module_text("FFmpegMuxer");
 }
 
+static void replay_disk_free(struct ffmpeg_muxer *stream)
+{
+	if (stream->mux_thread_joinable) {
+		pthread_join(stream->mux_thread, NULL);
+		stream->mux_thread_joinable = false;
+	}
+
+	if (stream->disk_file) {
+		fclose(stream->disk_file);
+		stream->disk_file = NULL;
+		os_unlink(stream->disk_path.array);
+	}
+
+	circlebuf_free(&stream->segments);
+	dstr_free(&stream->disk_path);
+	stream->disk_capacity = 0;
+	stream->disk_pos = 0;
+	stream->disk_used = 0;
+	stream->use_disk = false;
+}
+
 static inline void replay_buffer_clear(struct ffmpeg_muxer *stream)
 {
+	if (stream->use_disk)
+		replay_disk_free(stream);
+
 	while (stream->packets.size > 0) {
 		struct encoder_packet pkt;
 		circlebuf_pop_front(&stream->packets, &pkt, sizeof(pkt));
@@ -76,12 +150,14 @@ static inline void replay_buffer_clear(struct ffmpeg_muxer *stream)
 	}
 
 	circlebuf_free(&stream->packets);
-	stream->cur_size = 0;
-	stream->cur_time = 0;
+	circlebuf_free(&stream->gops);
+	stream->packets_pushed = 0;
+	stream->packets_popped = 0;
+	stream->bytes_pushed = 0;
 	stream->max_size = 0;
 	stream->max_time = 0;
 	stream->save_ts = 0;
-	stream->keyframes = 0;
+	stream->save_duration = 0;
 }
 
 static void ffmpeg_mux_destroy(void *data)
@@ -93,16 +169,35 @@ static void ffmpeg_mux_destroy(void *data)
 		pthread_join(stream->mux_thread, NULL);
 	da_free(stream->mux_packets);
 
+	if (stream->close_thread_joinable)
+		pthread_join(stream->close_thread, NULL);
+
 	os_process_pipe_destroy(stream->pipe);
+	os_process_pipe_destroy(stream->next_pipe);
 	dstr_free(&stream->path);
+	dstr_free(&stream->base_path);
+	dstr_free(&stream->next_path);
 	bfree(stream);
 }
 
+static void split_file_proc(void *data, calldata_t *cd)
+{
+	struct ffmpeg_muxer *stream = data;
+	os_atomic_set_bool(&stream->split_requested, true);
+	UNUSED_PARAMETER(cd);
+}
+
 static void *ffmpeg_mux_create(obs_data_t *settings, obs_output_t *output)
 {
 	struct ffmpeg_muxer *stream = bzalloc(sizeof(*stream));
 	stream->output = output;
 
+	proc_handler_t *ph = obs_output_get_proc_handler(output);
+	proc_handler_add(ph, "void split_file()", split_file_proc, stream);
+
+	signal_handler_t *sh = obs_output_get_signal_handler(output);
+	signal_handler_add(sh, "void file_changed(ptr output, string path)");
+
 	UNUSED_PARAMETER(settings);
 	return stream;
 }
@@ -202,12 +297,50 @@ static void log_muxer_params(struct ffmpeg_muxer *stream, const char *settings)
 	av_dict_free(&dict);
 }
 
-static void add_muxer_params(struct dstr *cmd, struct ffmpeg_muxer *stream)
+static bool is_mp4_path(const char *path)
+{
+	const char *ext = path ? strrchr(path, '.') : NULL;
+
+	return ext && (astrcmpi(ext, ".mp4") == 0 ||
+	               astrcmpi(ext, ".mov") == 0 ||
+	               astrcmpi(ext, ".m4v") == 0);
+}
+
+/* Fragmented MP4 writes an empty moov up front and then self-contained
+ * moof/mdat pairs, so the file stays playable up to the last complete
+ * fragment if the muxer dies, and needs no trailer rewrite when it stops.
+ * A clean stop still writes the mfra index so players can seek quickly. */
+static void add_fragment_params(struct dstr *mux, obs_data_t *settings,
+		const char *path)
+{
+	int64_t frag_ms;
+
+	if (!obs_data_get_bool(settings, "fragmented") || !is_mp4_path(path))
+		return;
+
+	/* leave explicit user muxer flags alone */
+	if (mux->array && strstr(mux->array, "movflags"))
+		return;
+
+	frag_ms = obs_data_get_int(settings, "fragment_ms");
+	if (frag_ms <= 0)
+		frag_ms = 1000;
+
+	if (!dstr_is_empty(mux))
+		dstr_cat_ch(mux, ' ');
+
+	dstr_catf(mux, "movflags=frag_keyframe+empty_moov+default_base_moof "
+			"min_frag_duration=%lld", (long long)frag_ms * 1000);
+}
+
+static void add_muxer_params(struct dstr *cmd, struct ffmpeg_muxer *stream,
+		const char *path)
 {
 	obs_data_t *settings = obs_output_get_settings(stream->output);
 	struct dstr mux = {0};
 
 	dstr_copy(&mux, obs_data_get_string(settings, "muxer_settings"));
+	add_fragment_params(&mux, settings, path);
 
 	log_muxer_params(stream, mux.array);
 
@@ -236,13 +369,16 @@ static void build_command_line(struct ffmpeg_muxer *stream, struct dstr *cmd,
 		num_tracks++;
 	}
 
+	struct dstr quoted_path = {0};
+
 	dstr_init_move_array(cmd, obs_module_file(FFMPEG_MUX));
 	dstr_insert_ch(cmd, 0, '\"');
 	dstr_cat(cmd, "\" \"");
 
-	dstr_copy(&stream->path, path);
-	dstr_replace(&stream->path, "\"", "\"\"");
-	dstr_cat_dstr(cmd, &stream->path);
+	dstr_copy(&quoted_path, path);
+	dstr_replace(&quoted_path, "\"", "\"\"");
+	dstr_cat_dstr(cmd, &quoted_path);
+	dstr_free(&quoted_path);
 
 	dstr_catf(cmd, "\" %d %d ", vencoder ? 1 : 0, num_tracks);
 
@@ -257,15 +393,65 @@ static void build_command_line(struct ffmpeg_muxer *stream, struct dstr *cmd,
 		}
 	}
 
-	add_muxer_params(cmd, stream);
+	add_muxer_params(cmd, stream, path);
 }
 
-static inline void start_pipe(struct ffmpeg_muxer *stream, const char *path)
+static inline os_process_pipe_t *create_pipe(struct ffmpeg_muxer *stream,
+		const char *path)
 {
+	os_process_pipe_t *pipe;
 	struct dstr cmd;
+
 	build_command_line(stream, &cmd, path);
-	stream->pipe = os_process_pipe_create(cmd.array, "w");
+	pipe = os_process_pipe_create(cmd.array, "w");
 	dstr_free(&cmd);
+	return pipe;
+}
+
+static inline void start_pipe(struct ffmpeg_muxer *stream, const char *path)
+{
+	dstr_copy(&stream->path, path);
+	stream->pipe = create_pipe(stream, path);
+}
+
+static inline bool split_enabled(struct ffmpeg_muxer *stream)
+{
+	return stream->max_time > 0 || stream->max_size > 0;
+}
+
+/* "name.ext" becomes "name (2).ext", "name (3).ext", ... */
+static void get_split_path(struct ffmpeg_muxer *stream, struct dstr *dst,
+		int idx)
+{
+	const char *ext = os_get_path_extension(stream->base_path.array);
+	size_t len = ext ? (size_t)(ext - stream->base_path.array) :
+		stream->base_path.len;
+
+	dstr_ncopy(dst, stream->base_path.array, len);
+	dstr_catf(dst, " (%d)", idx + 1);
+	if (ext)
+		dstr_cat(dst, ext);
+}
+
+/* spawns the muxer process for the next file ahead of time so that the
+ * switch at the next keyframe is just a matter of swapping pipes */
+static void prepare_next_file(struct ffmpeg_muxer *stream)
+{
+	if (stream->next_pipe)
+		return;
+
+	get_split_path(stream, &stream->next_path, stream->split_count + 1);
+	stream->next_pipe = create_pipe(stream, stream->next_path.array);
+	if (!stream->next_pipe)
+		warn("Failed to create process pipe for '%s'",
+				stream->next_path.array);
+}
+
+static void reset_file_offsets(struct ffmpeg_muxer *stream, bool rebase,
+		int64_t start_usec)
+{
+	split_offsets_reset(&stream->file_offsets, rebase, start_usec);
+	stream->file_size = 0;
 }
 
 static bool ffmpeg_mux_start(void *data)
@@ -281,6 +467,15 @@ static bool ffmpeg_mux_start(void *data)
 
 	settings = obs_output_get_settings(stream->output);
 	path = obs_data_get_string(settings, "path");
+	stream->max_time = obs_data_get_int(settings, "max_time_sec") *
+		1000000LL;
+	stream->max_size = obs_data_get_int(settings, "max_size_mb") *
+		(1024 * 1024);
+	stream->has_video = !!obs_output_get_video_encoder(stream->output);
+	stream->split_count = 0;
+	stream->file_start_ts = -1;
+	os_atomic_set_bool(&stream->split_requested, false);
+	dstr_copy(&stream->base_path, path);
 	start_pipe(stream, path);
 	obs_data_release(settings);
 
@@ -289,6 +484,12 @@ static bool ffmpeg_mux_start(void *data)
 		return false;
 	}
 
+	/* the first file keeps the original timestamps */
+	reset_file_offsets(stream, false, 0);
+
+	if (split_enabled(stream))
+		prepare_next_file(stream);
+
 	/* write headers and start capture */
 	os_atomic_set_bool(&stream->active, true);
 	os_atomic_set_bool(&stream->capturing, true);
@@ -306,6 +507,16 @@ static int deactivate(struct ffmpeg_muxer *stream)
 		ret = os_process_pipe_destroy(stream->pipe);
 		stream->pipe = NULL;
 
+		/* the prepared process exits without creating a file when its
+		 * input ends before the headers are sent */
+		os_process_pipe_destroy(stream->next_pipe);
+		stream->next_pipe = NULL;
+
+		if (stream->close_thread_joinable) {
+			pthread_join(stream->close_thread, NULL);
+			stream->close_thread_joinable = false;
+		}
+
 		os_atomic_set_bool(&stream->active, false);
 		os_atomic_set_bool(&stream->sent_headers, false);
 
@@ -344,32 +555,47 @@ static void signal_failure(struct ffmpeg_muxer *stream)
 	os_atomic_set_bool(&stream->capturing, false);
 }
 
-static bool write_packet(struct ffmpeg_muxer *stream,
+static inline void get_packet_info(struct ffm_packet_info *info,
 		struct encoder_packet *packet)
 {
 	bool is_video = packet->type == OBS_ENCODER_VIDEO;
-	size_t ret;
 
-	struct ffm_packet_info info = {
-		.pts = packet->pts,
-		.dts = packet->dts,
-		.size = (uint32_t)packet->size,
-		.index = (int)packet->track_idx,
-		.type = is_video ? FFM_PACKET_VIDEO : FFM_PACKET_AUDIO,
-		.keyframe = packet->keyframe
-	};
+	info->pts = packet->pts;
+	info->dts = packet->dts;
+	info->size = (uint32_t)packet->size;
+	info->index = (int)packet->track_idx;
+	info->type = is_video ? FFM_PACKET_VIDEO : FFM_PACKET_AUDIO;
+	info->keyframe = packet->keyframe;
+}
+
+static bool write_packet_data(struct ffmpeg_muxer *stream,
+		const struct ffm_packet_info *info, const uint8_t *data)
+{
+	size_t ret;
 
-	ret = os_process_pipe_write(stream->pipe, (const uint8_t*)&info,
-			sizeof(info));
-	if (ret != sizeof(info)) {
+	ret = os_process_pipe_write(stream->pipe, (const uint8_t*)info,
+			sizeof(*info));
+	if (ret != sizeof(*info)) {
 		warn("os_process_pipe_write for info structure failed");
-		signal_failure(stream);
 		return false;
 	}
 
-	ret = os_process_pipe_write(stream->pipe, packet->data, packet->size);
-	if (ret != packet->size) {
+	ret = os_process_pipe_write(stream->pipe, data, info->size);
+	if (ret != info->size) {
 		warn("os_process_pipe_write for packet data failed");
+		return false;
+	}
+
+	return true;
+}
+
+static bool write_packet(struct ffmpeg_muxer *stream,
+		struct encoder_packet *packet)
+{
+	struct ffm_packet_info info = {0};
+	get_packet_info(&info, packet);
+
+	if (!write_packet_data(stream, &info, packet->data)) {
 		signal_failure(stream);
 		return false;
 	}
@@ -424,9 +650,93 @@ static bool send_headers(struct ffmpeg_muxer *stream)
 	return true;
 }
 
+static void *close_pipe_thread(void *data)
+{
+	struct ffmpeg_muxer *stream = data;
+
+	os_process_pipe_destroy(stream->closing_pipe);
+	stream->closing_pipe = NULL;
+	return NULL;
+}
+
+static inline bool should_split(struct ffmpeg_muxer *stream,
+		struct encoder_packet *packet)
+{
+	bool keyframe = !stream->has_video ||
+		(packet->type == OBS_ENCODER_VIDEO && packet->keyframe);
+
+	if (!keyframe)
+		return false;
+	if (os_atomic_load_bool(&stream->split_requested))
+		return true;
+	if (stream->max_time > 0 && stream->file_start_ts >= 0 &&
+	    (packet->dts_usec - stream->file_start_ts) >= stream->max_time)
+		return true;
+	if (stream->max_size > 0 && stream->file_size >= stream->max_size)
+		return true;
+
+	return false;
+}
+
+static void signal_file_changed(struct ffmpeg_muxer *stream)
+{
+	signal_handler_t *sh = obs_output_get_signal_handler(stream->output);
+	calldata_t cd;
+
+	calldata_init(&cd);
+	calldata_set_ptr(&cd, "output", stream->output);
+	calldata_set_string(&cd, "path", stream->path.array);
+	signal_handler_signal(sh, "file_changed", &cd);
+	calldata_free(&cd);
+}
+
+static bool split_file(struct ffmpeg_muxer *stream,
+		struct encoder_packet *packet)
+{
+	if (!stream->next_pipe)
+		prepare_next_file(stream);
+	if (!stream->next_pipe)
+		return false;
+
+	/* a previous file still being finalized should be long done */
+	if (stream->close_thread_joinable) {
+		pthread_join(stream->close_thread, NULL);
+		stream->close_thread_joinable = false;
+	}
+
+	stream->closing_pipe = stream->pipe;
+	stream->pipe = stream->next_pipe;
+	stream->next_pipe = NULL;
+
+	/* writing the trailer of the old file can take a while, so do not
+	 * wait for it on the encoder thread */
+	stream->close_thread_joinable = pthread_create(&stream->close_thread,
+			NULL, close_pipe_thread, stream) == 0;
+	if (!stream->close_thread_joinable)
+		close_pipe_thread(stream);
+
+	info("Output of file '%s' stopped, continuing in '%s'",
+			stream->path.array, stream->next_path.array);
+
+	dstr_copy_dstr(&stream->path, &stream->next_path);
+	stream->split_count++;
+	os_atomic_set_bool(&stream->split_requested, false);
+	reset_file_offsets(stream, true, packet->dts_usec);
+
+	if (!send_headers(stream))
+		return false;
+
+	signal_file_changed(stream);
+
+	if (split_enabled(stream))
+		prepare_next_file(stream);
+	return true;
+}
+
 static void ffmpeg_mux_data(void *data, struct encoder_packet *packet)
 {
 	struct ffmpeg_muxer *stream = data;
+	struct encoder_packet pkt;
 
 	if (!active(stream))
 		return;
@@ -445,7 +755,23 @@ static void ffmpeg_mux_data(void *data, struct encoder_packet *packet)
 		}
 	}
 
-	write_packet(stream, packet);
+	if (os_atomic_load_bool(&stream->split_requested))
+		prepare_next_file(stream);
+
+	if (should_split(stream, packet) && !split_file(stream, packet)) {
+		if (!active(stream))
+			return;
+
+		os_atomic_set_bool(&stream->split_requested, false);
+	}
+
+	if (stream->file_start_ts < 0 || stream->file_size == 0)
+		stream->file_start_ts = packet->dts_usec;
+	stream->file_size += (int64_t)packet->size;
+
+	pkt = *packet;
+	split_offsets_apply(&stream->file_offsets, &pkt);
+	write_packet(stream, &pkt);
 }
 
 static obs_properties_t *ffmpeg_mux_properties(void *unused)
@@ -457,9 +783,24 @@ static obs_properties_t *ffmpeg_mux_properties(void *unused)
 	obs_properties_add_text(props, "path",
 			obs_module_text("FilePath"),
 			OBS_TEXT_DEFAULT);
+	obs_properties_add_int(props, "max_time_sec",
+			obs_module_text("SplitFile.Time"), 0, 86400, 1);
+	obs_properties_add_int(props, "max_size_mb",
+			obs_module_text("SplitFile.Size"), 0, 1024 * 1024, 1);
+	obs_properties_add_bool(props, "fragmented",
+			obs_module_text("FragmentedMP4"));
+	obs_properties_add_int(props, "fragment_ms",
+			obs_module_text("FragmentedMP4.Duration"),
+			100, 60000, 100);
 	return props;
 }
 
+static void ffmpeg_mux_defaults(obs_data_t *s)
+{
+	obs_data_set_default_bool(s, "fragmented", false);
+	obs_data_set_default_int(s, "fragment_ms", 1000);
+}
+
 struct obs_output_info ffmpeg_muxer = {
 	.id             = "ffmpeg_muxer",
 	.flags          = OBS_OUTPUT_AV |
@@ -471,7 +812,8 @@ struct obs_output_info ffmpeg_muxer = {
 	.start          = ffmpeg_mux_start,
 	.stop           = ffmpeg_mux_stop,
 	.encoded_packet = ffmpeg_mux_data,
-	.get_properties = ffmpeg_mux_properties
+	.get_properties = ffmpeg_mux_properties,
+	.get_defaults   = ffmpeg_mux_defaults
 };
 
 /* ------------------------------------------------------------------------ */
@@ -490,8 +832,10 @@ static bool replay_buffer_hotkey(void *data, obs_hotkey_id id,
 	UNUSED_PARAMETER(pressed);
 
 	struct ffmpeg_muxer *stream = data;
-	if (os_atomic_load_bool(&stream->active))
+	if (os_atomic_load_bool(&stream->active)) {
+		stream->save_duration = 0;
 		stream->save_ts = os_gettime_ns() / 1000LL;
+	}
 	return true;
 }
 
@@ -501,6 +845,17 @@ static void save_replay_proc(void *data, calldata_t *cd)
 	UNUSED_PARAMETER(cd);
 }
 
+static void save_replay_seconds_proc(void *data, calldata_t *cd)
+{
+	struct ffmpeg_muxer *stream = data;
+	long long seconds = calldata_int(cd, "seconds");
+
+	if (os_atomic_load_bool(&stream->active)) {
+		stream->save_duration = seconds > 0 ? seconds * 1000000LL : 0;
+		stream->save_ts = os_gettime_ns() / 1000LL;
+	}
+}
+
 static void *replay_buffer_create(obs_data_t *settings, obs_output_t *output)
 {
 	struct ffmpeg_muxer *stream = bzalloc(sizeof(*stream));
@@ -513,6 +868,8 @@ static void *replay_buffer_create(obs_data_t *settings, obs_output_t *output)
 
 	proc_handler_t *ph = obs_output_get_proc_handler(output);
 	proc_handler_add(ph, "void save()", save_replay_proc, stream);
+	proc_handler_add(ph, "void save_seconds(int seconds)",
+			save_replay_seconds_proc, stream);
 
 	UNUSED_PARAMETER(settings);
 	return stream;
@@ -526,6 +883,88 @@ static void replay_buffer_destroy(void *data)
 	ffmpeg_mux_destroy(data);
 }
 
+static int64_t estimate_replay_size(struct ffmpeg_muxer *stream)
+{
+	obs_encoder_t *vencoder = obs_output_get_video_encoder(stream->output);
+	int64_t kbps = 0;
+	size_t idx = 0;
+
+	if (vencoder) {
+		obs_data_t *settings = obs_encoder_get_settings(vencoder);
+		kbps += obs_data_get_int(settings, "bitrate");
+		obs_data_release(settings);
+	}
+
+	for (;;) {
+		obs_encoder_t *aencoder = obs_output_get_audio_encoder(
+				stream->output, idx++);
+		if (!aencoder)
+			break;
+
+		obs_data_t *settings = obs_encoder_get_settings(aencoder);
+		kbps += obs_data_get_int(settings, "bitrate");
+		obs_data_release(settings);
+	}
+
+	/* allow for rate control overshoot */
+	return (stream->max_time / 1000000LL) * kbps * 1000 / 8 * 3 / 2;
+}
+
+static bool replay_disk_init(struct ffmpeg_muxer *stream, obs_data_t *settings)
+{
+	const char *dir = obs_data_get_string(settings, "disk_buffer_dir");
+	int64_t size = stream->max_size;
+	char *filename;
+
+	if (!dir || !*dir)
+		dir = obs_data_get_string(settings, "directory");
+	if (!size)
+		size = estimate_replay_size(stream);
+	if (!size) {
+		warn("Could not determine the size of the replay buffer file");
+		return false;
+	}
+
+	filename = os_generate_formatted_filename("tmp", false,
+			"replay-buffer-%CCYY%MM%DD-%hh%mm%ss");
+
+	dstr_copy(&stream->disk_path, dir);
+	dstr_replace(&stream->disk_path, "\\", "/");
+	if (dstr_end(&stream->disk_path) != '/')
+		dstr_cat_ch(&stream->disk_path, '/');
+	dstr_cat(&stream->disk_path, filename);
+	bfree(filename);
+
+	/* the space past the size limit is only used while a save is reading
+	 * the oldest segments, so that new packets need not be dropped */
+	stream->disk_capacity = size + size / 4;
+	stream->disk_pos = 0;
+	stream->disk_used = 0;
+	stream->wait_keyframe = true;
+	stream->segment_time = obs_data_get_int(settings, "segment_sec") *
+		1000000LL;
+
+	stream->disk_file = os_fopen(stream->disk_path.array, "w+b");
+	if (!stream->disk_file) {
+		warn("Failed to create replay buffer file '%s'",
+				stream->disk_path.array);
+		dstr_free(&stream->disk_path);
+		return false;
+	}
+
+	if (os_fpreallocate(stream->disk_file, stream->disk_capacity) != 0)
+		info("Could not preallocate replay buffer file, the file "
+		     "will grow as it is written");
+
+	setvbuf(stream->disk_file, NULL, _IOFBF, 1024 * 1024);
+	stream->use_disk = true;
+
+	info("Buffering replay to '%s' (%"PRId64" MB)",
+			stream->disk_path.array,
+			stream->disk_capacity / (1024 * 1024));
+	return true;
+}
+
 static bool replay_buffer_start(void *data)
 {
 	struct ffmpeg_muxer *stream = data;
@@ -535,9 +974,20 @@ static bool replay_buffer_start(void *data)
 	if (!obs_output_initialize_encoders(stream->output, 0))
 		return false;
 
+	if (stream->use_disk)
+		replay_disk_free(stream);
+
 	obs_data_t *s = obs_output_get_settings(stream->output);
 	stream->max_time = obs_data_get_int(s, "max_time_sec") * 1000000LL;
 	stream->max_size = obs_data_get_int(s, "max_size_mb") * (1024 * 1024);
+	stream->has_video = !!obs_output_get_video_encoder(stream->output);
+
+	if (obs_data_get_bool(s, "use_disk_buffer") &&
+	    !replay_disk_init(stream, s)) {
+		obs_data_release(s);
+		return false;
+	}
+
 	obs_data_release(s);
 
 	os_atomic_set_bool(&stream->active, true);
@@ -547,101 +997,399 @@ static bool replay_buffer_start(void *data)
 	return true;
 }
 
-static bool purge_front(struct ffmpeg_muxer *stream)
+/*
+ * The replay buffer keeps an index of its GOPs, storing the absolute packet
+ * index, byte offset and timestamp of each keyframe.  The buffered size and
+ * duration can then be derived from the first GOP, and trimming removes a
+ * whole GOP at once instead of scanning packets for the next keyframe.
+ */
+
+static inline bool is_keyframe(struct ffmpeg_muxer *stream,
+		struct encoder_packet *packet)
+{
+	/* every audio packet is a sync point for audio-only buffers */
+	if (!stream->has_video)
+		return true;
+
+	return packet->type == OBS_ENCODER_VIDEO && packet->keyframe;
+}
+
+static inline size_t num_gops(struct ffmpeg_muxer *stream)
+{
+	return stream->gops.size / sizeof(struct replay_gop);
+}
+
+static inline struct replay_gop *get_gop(struct ffmpeg_muxer *stream,
+		size_t idx)
+{
+	return circlebuf_data(&stream->gops, idx * sizeof(struct replay_gop));
+}
+
+static inline int64_t replay_buffer_size(struct ffmpeg_muxer *stream)
+{
+	return stream->bytes_pushed - get_gop(stream, 0)->byte_offset;
+}
+
+static void replay_buffer_pop_gop(struct ffmpeg_muxer *stream)
 {
+	const size_t size = sizeof(struct encoder_packet);
+	uint64_t end;
+	size_t count;
+
+	circlebuf_pop_front(&stream->gops, NULL, sizeof(struct replay_gop));
+
+	end = stream->gops.size ?
+		get_gop(stream, 0)->packet_idx : stream->packets_pushed;
+	count = (size_t)(end - stream->packets_popped);
+
+	for (size_t i = 0; i < count; i++) {
+		struct encoder_packet *pkt;
+		pkt = circlebuf_data(&stream->packets, i * size);
+		obs_encoder_packet_release(pkt);
+	}
+
+	circlebuf_pop_front(&stream->packets, NULL, count * size);
+	stream->packets_popped = end;
+}
+
+static inline void replay_buffer_purge(struct ffmpeg_muxer *stream,
+		struct encoder_packet *pkt)
+{
+	if (stream->max_size) {
+		while (num_gops(stream) > 2 &&
+		       (replay_buffer_size(stream) + (int64_t)pkt->size) >
+		       stream->max_size)
+			replay_buffer_pop_gop(stream);
+	}
+
+	while (num_gops(stream) > 2 &&
+	       (pkt->dts_usec - get_gop(stream, 1)->start_ts) >=
+	       stream->max_time)
+		replay_buffer_pop_gop(stream);
+}
+
+static void replay_buffer_push(struct ffmpeg_muxer *stream,
+		struct encoder_packet *packet)
+{
+	bool keyframe = is_keyframe(stream, packet);
 	struct encoder_packet pkt;
-	bool keyframe;
 
-	circlebuf_pop_front(&stream->packets, &pkt, sizeof(pkt));
+	/* packets before the first keyframe cannot be decoded */
+	if (!keyframe && !stream->gops.size)
+		return;
 
-	keyframe = pkt.type == OBS_ENCODER_VIDEO && pkt.keyframe;
+	replay_buffer_purge(stream, packet);
 
-	if (keyframe)
-		stream->keyframes--;
+	if (keyframe) {
+		struct replay_gop gop = {
+			.packet_idx  = stream->packets_pushed,
+			.byte_offset = stream->bytes_pushed,
+			.start_ts    = packet->dts_usec
+		};
 
-	if (!stream->packets.size) {
-		stream->cur_size = 0;
-		stream->cur_time = 0;
-	} else {
-		struct encoder_packet first;
-		circlebuf_peek_front(&stream->packets, &first, sizeof(first));
-		stream->cur_time = first.dts_usec;
-		stream->cur_size -= (int64_t)pkt.size;
+		circlebuf_push_back(&stream->gops, &gop, sizeof(gop));
 	}
 
-	obs_encoder_packet_release(&pkt);
-	return keyframe;
+	obs_encoder_packet_ref(&pkt, packet);
+	circlebuf_push_back(&stream->packets, &pkt, sizeof(pkt));
+
+	stream->packets_pushed++;
+	stream->bytes_pushed += (int64_t)pkt.size;
 }
 
-static inline void purge(struct ffmpeg_muxer *stream)
+/* returns the index of the first packet of the latest GOP that still covers
+ * the requested duration, or of the first packet if it cannot be covered */
+static size_t replay_buffer_find_start(struct ffmpeg_muxer *stream,
+		int64_t duration)
 {
-	if (purge_front(stream)) {
-		struct encoder_packet pkt;
+	const size_t size = sizeof(struct encoder_packet);
+	struct encoder_packet *last;
+	int64_t target;
+	size_t idx;
 
-		for (;;) {
-			circlebuf_peek_front(&stream->packets, &pkt,
-					sizeof(pkt));
-			if (pkt.type == OBS_ENCODER_VIDEO && pkt.keyframe)
-				return;
+	if (!duration || !stream->packets.size)
+		return 0;
 
-			purge_front(stream);
+	last = circlebuf_data(&stream->packets, stream->packets.size - size);
+	target = last->dts_usec - duration;
+
+	for (idx = num_gops(stream); idx > 1; idx--) {
+		if (get_gop(stream, idx - 1)->start_ts <= target)
+			break;
+	}
+
+	return (size_t)(get_gop(stream, idx - 1)->packet_idx -
+			stream->packets_popped);
+}
+
+/* ------------------------------------------------------------------------ */
+/* disk-backed replay buffer                                                */
+
+/*
+ * Packets are written to a preallocated ring file as ffm_packet_info headers
+ * followed by the packet data, in the same format that is sent to the
+ * ffmpeg-mux process.  The file is split into keyframe-aligned segments and
+ * only the segment index is kept in memory, so trimming drops whole segments
+ * and saving streams the covered range of the file straight to the muxer.
+ */
+
+static inline size_t num_segments(struct ffmpeg_muxer *stream)
+{
+	return stream->segments.size / sizeof(struct replay_segment);
+}
+
+static inline struct replay_segment *get_segment(struct ffmpeg_muxer *stream,
+		size_t idx)
+{
+	return circlebuf_data(&stream->segments,
+			idx * sizeof(struct replay_segment));
+}
+
+static void replay_disk_pop_segment(struct ffmpeg_muxer *stream)
+{
+	struct replay_segment seg;
+
+	circlebuf_pop_front(&stream->segments, &seg, sizeof(seg));
+	stream->disk_used -= seg.size;
+}
+
+static void replay_disk_reset(struct ffmpeg_muxer *stream)
+{
+	while (stream->segments.size)
+		replay_disk_pop_segment(stream);
+
+	stream->disk_used = 0;
+	stream->wait_keyframe = true;
+}
+
+/* returns false if there is no physical room left for 'size' more bytes */
+static bool replay_disk_trim(struct ffmpeg_muxer *stream, int64_t size,
+		int64_t ts)
+{
+	/* never reclaim segments while a save is still reading them */
+	if (!os_atomic_load_bool(&stream->muxing)) {
+		while (num_segments(stream) > 2 &&
+		       (ts - get_segment(stream, 1)->start_ts) >=
+		       stream->max_time)
+			replay_disk_pop_segment(stream);
+
+		if (stream->max_size) {
+			while (num_segments(stream) > 1 &&
+			       (stream->disk_used + size) > stream->max_size)
+				replay_disk_pop_segment(stream);
 		}
 	}
+
+	return (stream->disk_used + size) <= stream->disk_capacity;
 }
 
-static inline void replay_buffer_purge(struct ffmpeg_muxer *stream,
-		struct encoder_packet *pkt)
+static bool replay_disk_write(struct ffmpeg_muxer *stream, const void *data,
+		size_t size)
 {
-	if (stream->max_size) {
-		if (!stream->packets.size || stream->keyframes <= 2)
+	const uint8_t *ptr = data;
+
+	while (size) {
+		int64_t tail = stream->disk_capacity - stream->disk_pos;
+		size_t chunk = (int64_t)size > tail ? (size_t)tail : size;
+
+		if (stream->disk_pos == 0 &&
+		    os_fseeki64(stream->disk_file, 0, SEEK_SET) != 0)
+			return false;
+		if (fwrite(ptr, 1, chunk, stream->disk_file) != chunk)
+			return false;
+
+		stream->disk_pos += (int64_t)chunk;
+		if (stream->disk_pos == stream->disk_capacity)
+			stream->disk_pos = 0;
+
+		ptr += chunk;
+		size -= chunk;
+	}
+
+	return true;
+}
+
+static bool replay_disk_read(FILE *file, int64_t capacity, int64_t *pos,
+		void *data, size_t size)
+{
+	uint8_t *ptr = data;
+
+	while (size) {
+		int64_t tail = capacity - *pos;
+		size_t chunk = (int64_t)size > tail ? (size_t)tail : size;
+
+		if (*pos == 0 && os_fseeki64(file, 0, SEEK_SET) != 0)
+			return false;
+		if (fread(ptr, 1, chunk, file) != chunk)
+			return false;
+
+		*pos += (int64_t)chunk;
+		if (*pos == capacity)
+			*pos = 0;
+
+		ptr += chunk;
+		size -= chunk;
+	}
+
+	return true;
+}
+
+static void replay_disk_data(struct ffmpeg_muxer *stream,
+		struct encoder_packet *packet)
+{
+	struct ffm_packet_info info = {0};
+	struct replay_segment *seg;
+	int64_t size = (int64_t)(sizeof(info) + packet->size);
+	bool keyframe = is_keyframe(stream, packet);
+	bool new_segment = false;
+
+	if (stream->wait_keyframe) {
+		if (!keyframe)
 			return;
 
-		while ((stream->cur_size + (int64_t)pkt->size) >
-				stream->max_size)
-			purge(stream);
+		stream->wait_keyframe = false;
+		new_segment = true;
+
+	} else if (keyframe) {
+		seg = get_segment(stream, num_segments(stream) - 1);
+		new_segment = (packet->dts_usec - seg->start_ts) >=
+			stream->segment_time;
+	}
+
+	if (!replay_disk_trim(stream, size, packet->dts_usec)) {
+		if (os_atomic_load_bool(&stream->muxing)) {
+			warn("Replay buffer file is full while saving, "
+			     "dropping packets until the next keyframe");
+			stream->wait_keyframe = true;
+		} else {
+			warn("Replay buffer segment does not fit in the "
+			     "replay buffer file, discarding buffer");
+			replay_disk_reset(stream);
+		}
+		return;
+	}
+
+	if (new_segment) {
+		struct replay_segment new_seg = {
+			.offset   = stream->disk_pos,
+			.start_ts = packet->dts_usec,
+			.end_ts   = packet->dts_usec
+		};
+
+		circlebuf_push_back(&stream->segments, &new_seg,
+				sizeof(new_seg));
 	}
 
-	if (!stream->packets.size || stream->keyframes <= 2)
+	get_packet_info(&info, packet);
+
+	if (!replay_disk_write(stream, &info, sizeof(info)) ||
+	    !replay_disk_write(stream, packet->data, packet->size)) {
+		warn("Failed to write to replay buffer file '%s'",
+				stream->disk_path.array);
+		os_atomic_set_bool(&stream->active, false);
+		obs_output_signal_stop(stream->output, OBS_OUTPUT_ERROR);
 		return;
+	}
+
+	seg = get_segment(stream, num_segments(stream) - 1);
+	seg->size += size;
+	if (packet->dts_usec > seg->end_ts)
+		seg->end_ts = packet->dts_usec;
 
-	while ((pkt->dts_usec - stream->cur_time) > stream->max_time)
-		purge(stream);
+	stream->disk_used += size;
 }
 
-static void insert_packet(struct darray *array, struct encoder_packet *packet,
-		int64_t video_offset, int64_t *audio_offsets,
-		int64_t video_dts_offset, int64_t *audio_dts_offsets)
+/* Both save paths rebase each track on the dts of its first saved packet, so
+ * a replay gets the same timestamps whether it was buffered in memory or on
+ * disk. */
+static void offset_replay_packet(struct replay_offsets *offsets,
+		struct ffm_packet_info *info)
 {
-	struct encoder_packet pkt;
-	DARRAY(struct encoder_packet) packets;
-	packets.da = *array;
-	size_t idx;
+	int64_t offset;
 
-	obs_encoder_packet_ref(&pkt, packet);
+	if (info->type == FFM_PACKET_VIDEO) {
+		if (!offsets->found_video) {
+			offsets->video = info->dts;
+			offsets->found_video = true;
+		}
+
+		offset = offsets->video;
+
+	} else if (info->index < MAX_AUDIO_MIXES) {
+		if (!offsets->found_audio[info->index]) {
+			offsets->audio[info->index] = info->dts;
+			offsets->found_audio[info->index] = true;
+		}
+
+		offset = offsets->audio[info->index];
 
-	if (pkt.type == OBS_ENCODER_VIDEO) {
-		pkt.dts_usec -= video_offset;
-		pkt.dts -= video_dts_offset;
-		pkt.pts -= video_dts_offset;
 	} else {
-		pkt.dts_usec -= audio_offsets[pkt.track_idx];
-		pkt.dts -= audio_dts_offsets[pkt.track_idx];
-		pkt.pts -= audio_dts_offsets[pkt.track_idx];
+		return;
 	}
 
-	for (idx = packets.num; idx > 0; idx--) {
-		struct encoder_packet *p = packets.array + (idx - 1);
-		if (p->dts_usec < pkt.dts_usec)
-			break;
+	info->pts -= offset;
+	info->dts -= offset;
+}
+
+static bool write_disk_packets(struct ffmpeg_muxer *stream,
+		struct replay_offsets *offsets)
+{
+	int64_t pos = stream->save_offset;
+	int64_t remaining = stream->save_size;
+	DARRAY(uint8_t) buf = {0};
+	bool success = false;
+	FILE *file;
+
+	file = os_fopen(stream->disk_path.array, "rb");
+	if (!file) {
+		warn("Failed to open replay buffer file '%s'",
+				stream->disk_path.array);
+		return false;
+	}
+
+	setvbuf(file, NULL, _IOFBF, 1024 * 1024);
+
+	if (os_fseeki64(file, pos, SEEK_SET) != 0)
+		goto fail;
+
+	while (remaining > 0) {
+		struct ffm_packet_info info;
+
+		if (!replay_disk_read(file, stream->disk_capacity, &pos,
+					&info, sizeof(info)))
+			goto fail;
+
+		da_resize(buf, info.size);
+
+		if (!replay_disk_read(file, stream->disk_capacity, &pos,
+					buf.array, info.size))
+			goto fail;
+
+		remaining -= (int64_t)(sizeof(info) + info.size);
+		offset_replay_packet(offsets, &info);
+
+		if (!write_packet_data(stream, &info, buf.array))
+			goto fail;
 	}
 
-	da_insert(packets, idx, &pkt);
-	*array = packets.da;
+	success = true;
+
+fail:
+	if (!success)
+		warn("Failed to read replay buffer file '%s'",
+				stream->disk_path.array);
+	da_free(buf);
+	fclose(file);
+	return success;
 }
 
+/* ------------------------------------------------------------------------ */
+
 static void *replay_buffer_mux_thread(void *data)
 {
 	struct ffmpeg_muxer *stream = data;
+	struct replay_offsets offsets = {0};
+	bool success = true;
 
 	start_pipe(stream, stream->path.array);
 
@@ -656,65 +1404,39 @@ static void *replay_buffer_mux_thread(void *data)
 		goto error;
 	}
 
+	if (stream->use_disk) {
+		if (!write_disk_packets(stream, &offsets))
+			goto error;
+	}
+
 	for (size_t i = 0; i < stream->mux_packets.num; i++) {
 		struct encoder_packet *pkt = &stream->mux_packets.array[i];
-		write_packet(stream, pkt);
-		obs_encoder_packet_release(pkt);
+		struct ffm_packet_info info = {0};
+
+		get_packet_info(&info, pkt);
+		offset_replay_packet(&offsets, &info);
+
+		if (success && !write_packet_data(stream, &info, pkt->data)) {
+			signal_failure(stream);
+			success = false;
+		}
 	}
 
-	info("Wrote replay buffer to '%s'", stream->path.array);
+	if (success)
+		info("Wrote replay buffer to '%s'", stream->path.array);
 
 error:
 	os_process_pipe_destroy(stream->pipe);
 	stream->pipe = NULL;
+	for (size_t i = 0; i < stream->mux_packets.num; i++)
+		obs_encoder_packet_release(&stream->mux_packets.array[i]);
 	da_free(stream->mux_packets);
 	os_atomic_set_bool(&stream->muxing, false);
 	return NULL;
 }
 
-static void replay_buffer_save(struct ffmpeg_muxer *stream)
+static void generate_replay_filename(struct ffmpeg_muxer *stream)
 {
-	const size_t size = sizeof(struct encoder_packet);
-	size_t num_packets = stream->packets.size / size;
-
-	da_reserve(stream->mux_packets, num_packets);
-
-	/* ---------------------------- */
-	/* reorder packets */
-
-	bool found_video = false;
-	bool found_audio[MAX_AUDIO_MIXES] = {0};
-	int64_t video_offset = 0;
-	int64_t video_dts_offset = 0;
-	int64_t audio_offsets[MAX_AUDIO_MIXES] = {0};
-	int64_t audio_dts_offsets[MAX_AUDIO_MIXES] = {0};
-
-	for (size_t i = 0; i < num_packets; i++) {
-		struct encoder_packet *pkt;
-		pkt = circlebuf_data(&stream->packets, i * size);
-
-		if (pkt->type == OBS_ENCODER_VIDEO) {
-			if (!found_video) {
-				video_offset = pkt->dts_usec;
-				video_dts_offset = pkt->dts;
-				found_video = true;
-			}
-		} else {
-			if (!found_audio[pkt->track_idx]) {
-				found_audio[pkt->track_idx] = true;
-				audio_offsets[pkt->track_idx] = pkt->dts_usec;
-				audio_dts_offsets[pkt->track_idx] = pkt->dts;
-			}
-		}
-
-		insert_packet(&stream->mux_packets.da, pkt,
-				video_offset, audio_offsets,
-				video_dts_offset, audio_dts_offsets);
-	}
-
-	/* ---------------------------- */
-	/* generate filename */
-
 	obs_data_t *settings = obs_output_get_settings(stream->output);
 	const char *dir = obs_data_get_string(settings, "directory");
 	const char *fmt = obs_data_get_string(settings, "format");
@@ -731,6 +1453,32 @@ static void replay_buffer_save(struct ffmpeg_muxer *stream)
 
 	bfree(filename);
 	obs_data_release(settings);
+}
+
+static void replay_buffer_save(struct ffmpeg_muxer *stream)
+{
+	const size_t size = sizeof(struct encoder_packet);
+	size_t num_packets = stream->packets.size / size;
+	size_t start = replay_buffer_find_start(stream, stream->save_duration);
+
+	da_reserve(stream->mux_packets, num_packets - start);
+
+	/* ---------------------------- */
+	/* the packets are kept in the order they were received, like the disk
+	 * buffer, and offset by the mux thread */
+
+	for (size_t i = start; i < num_packets; i++) {
+		struct encoder_packet *pkt;
+		struct encoder_packet ref;
+
+		pkt = circlebuf_data(&stream->packets, i * size);
+		obs_encoder_packet_ref(&ref, pkt);
+		da_push_back(stream->mux_packets, &ref);
+	}
+
+	/* ---------------------------- */
+
+	generate_replay_filename(stream);
 
 	/* ---------------------------- */
 
@@ -739,6 +1487,45 @@ static void replay_buffer_save(struct ffmpeg_muxer *stream)
 			replay_buffer_mux_thread, stream) == 0;
 }
 
+static void replay_disk_save(struct ffmpeg_muxer *stream)
+{
+	size_t count = num_segments(stream);
+	size_t idx = count;
+
+	if (!count)
+		return;
+
+	if (fflush(stream->disk_file) != 0) {
+		warn("Failed to flush replay buffer file '%s'",
+				stream->disk_path.array);
+		return;
+	}
+
+	if (stream->save_duration) {
+		struct replay_segment *last = get_segment(stream, count - 1);
+		int64_t target = last->end_ts - stream->save_duration;
+
+		for (; idx > 1; idx--) {
+			if (get_segment(stream, idx - 1)->start_ts <= target)
+				break;
+		}
+	} else {
+		idx = 1;
+	}
+
+	stream->save_offset = get_segment(stream, idx - 1)->offset;
+	stream->save_size = stream->disk_used;
+
+	for (size_t i = 0; i < idx - 1; i++)
+		stream->save_size -= get_segment(stream, i)->size;
+
+	generate_replay_filename(stream);
+
+	os_atomic_set_bool(&stream->muxing, true);
+	stream->mux_thread_joinable = pthread_create(&stream->mux_thread, NULL,
+			replay_buffer_mux_thread, stream) == 0;
+}
+
 static void deactivate_replay_buffer(struct ffmpeg_muxer *stream)
 {
 	if (stopping(stream))
@@ -753,7 +1540,6 @@ static void deactivate_replay_buffer(struct ffmpeg_muxer *stream)
 static void replay_buffer_data(void *data, struct encoder_packet *packet)
 {
 	struct ffmpeg_muxer *stream = data;
-	struct encoder_packet pkt;
 
 	if (!active(stream))
 		return;
@@ -765,17 +1551,13 @@ static void replay_buffer_data(void *data, struct encoder_packet *packet)
 		}
 	}
 
-	obs_encoder_packet_ref(&pkt, packet);
-	replay_buffer_purge(stream, &pkt);
-
-	if (!stream->packets.size)
-		stream->cur_time = pkt.dts_usec;
-	stream->cur_size += pkt.size;
-
-	circlebuf_push_back(&stream->packets, packet, sizeof(*packet));
-
-	if (packet->type == OBS_ENCODER_VIDEO && packet->keyframe)
-		stream->keyframes++;
+	if (stream->use_disk) {
+		replay_disk_data(stream, packet);
+		if (!active(stream))
+			return;
+	} else {
+		replay_buffer_push(stream, packet);
+	}
 
 	if (stream->save_ts && packet->sys_dts_usec >= stream->save_ts) {
 		if (os_atomic_load_bool(&stream->muxing))
@@ -787,10 +1569,36 @@ static void replay_buffer_data(void *data, struct encoder_packet *packet)
 		}
 
 		stream->save_ts = 0;
-		replay_buffer_save(stream);
+
+		if (stream->use_disk)
+			replay_disk_save(stream);
+		else
+			replay_buffer_save(stream);
 	}
 }
 
+static obs_properties_t *replay_buffer_properties(void *unused)
+{
+	UNUSED_PARAMETER(unused);
+
+	obs_properties_t *props = obs_properties_create();
+
+	obs_properties_add_int(props, "max_time_sec",
+			obs_module_text("ReplayBuffer.MaxTime"), 5, 21600, 1);
+	obs_properties_add_int(props, "max_size_mb",
+			obs_module_text("ReplayBuffer.MaxSize"),
+			0, 1024 * 1024, 1);
+	obs_properties_add_bool(props, "use_disk_buffer",
+			obs_module_text("ReplayBuffer.UseDisk"));
+	obs_properties_add_int(props, "segment_sec",
+			obs_module_text("ReplayBuffer.SegmentDuration"),
+			1, 60, 1);
+	obs_properties_add_path(props, "disk_buffer_dir",
+			obs_module_text("ReplayBuffer.DiskDirectory"),
+			OBS_PATH_DIRECTORY, NULL, NULL);
+	return props;
+}
+
 static void replay_buffer_defaults(obs_data_t *s)
 {
 	obs_data_set_default_int(s, "max_time_sec", 15);
@@ -798,6 +1606,8 @@ static void replay_buffer_defaults(obs_data_t *s)
 	obs_data_set_default_string(s, "format", "%CCYY-%MM-%DD %hh-%mm-%ss");
 	obs_data_set_default_string(s, "extension", "mp4");
 	obs_data_set_default_bool(s, "allow_spaces", true);
+	obs_data_set_default_bool(s, "use_disk_buffer", false);
+	obs_data_set_default_int(s, "segment_sec", 2);
 }
 
 struct obs_output_info replay_buffer = {
@@ -811,5 +1621,6 @@ struct obs_output_info replay_buffer = {
 	.start          = replay_buffer_start,
 	.stop           = ffmpeg_mux_stop,
 	.encoded_packet = replay_buffer_data,
+	.get_properties = replay_buffer_properties,
 	.get_defaults   = replay_buffer_defaults
 };
@@ -50,6 +50,8 @@ struct opus_encoder {
 
 	int              frame_size; /* pretty much always 1024 for opus */
 	int              frame_size_bytes;
+
+	int64_t          delay;
 };
 
 static const char *opus_getname(void *unused)
@@ -73,8 +75,39 @@ static void opus_destroy(void *data)
 	bfree(enc);
 }
 
-static bool initialize_codec(struct opus_encoder *enc)
+static bool is_libopus(struct opus_encoder *enc)
+{
+	return strcmp(enc->opus->name, "libopus") == 0;
+}
+
+static void get_libopus_options(struct opus_encoder *enc,
+		obs_data_t *settings, AVDictionary **opts)
 {
+	const char *application = obs_data_get_string(settings, "application");
+	const char *duration = obs_data_get_string(settings, "frame_duration");
+	bool fec = obs_data_get_bool(settings, "fec");
+	int packet_loss = (int)obs_data_get_int(settings, "packet_loss");
+
+	if (!is_libopus(enc))
+		return;
+
+	if (application && *application)
+		av_dict_set(opts, "application", application, 0);
+	if (duration && *duration)
+		av_dict_set(opts, "frame_duration", duration, 0);
+	if (fec)
+		av_dict_set(opts, "fec", "1", 0);
+	av_dict_set_int(opts, "packet_loss", packet_loss, 0);
+
+	info("application: %s, frame duration: %s ms, fec: %s, "
+			"packet loss: %d%%",
+			application, duration, fec ? "on" : "off",
+			packet_loss);
+}
+
+static bool initialize_codec(struct opus_encoder *enc, AVDictionary **opts)
+{
+	AVDictionaryEntry *entry = NULL;
 	int ret;
 
 	enc->aframe  = av_frame_alloc();
@@ -83,12 +116,25 @@ static bool initialize_codec(struct opus_encoder *enc)
 		return false;
 	}
 
-	ret = avcodec_open2(enc->context, enc->opus, NULL);
+	ret = avcodec_open2(enc->context, enc->opus, opts);
 	if (ret < 0) {
 		warn("Failed to open opus codec: %s", av_err2str(ret));
 		return false;
 	}
 
+	while ((entry = av_dict_get(*opts, "", entry, AV_DICT_IGNORE_SUFFIX)))
+		warn("Option '%s' is not supported by this version of %s",
+				entry->key, enc->opus->name);
+
+	/* samples of priming the decoder skips (pre-skip), which is the
+	 * algorithmic delay of the encoder */
+	enc->delay = enc->context->initial_padding;
+	if (enc->delay)
+		info("encoder delay: %lld samples (%.1f ms)",
+				(long long)enc->delay,
+				(double)enc->delay * 1000.0 /
+				(double)enc->context->sample_rate);
+
 	enc->frame_size = enc->context->frame_size;
 	if (!enc->frame_size)
 		enc->frame_size = 1024;
@@ -126,6 +172,7 @@ static void *opus_create(obs_data_t *settings, obs_encoder_t *encoder)
 	struct opus_encoder *enc;
 	int                bitrate = (int)obs_data_get_int(settings, "bitrate");
 	audio_t            *audio   = obs_encoder_audio(encoder);
+	AVDictionary       *opts    = NULL;
 
 	avcodec_register_all();
 
@@ -180,10 +227,15 @@ static void *opus_create(obs_data_t *settings, obs_encoder_t *encoder)
 
 	enc->context->flags = CODEC_FLAG_GLOBAL_HEADER;
 
-	if (initialize_codec(enc))
+	get_libopus_options(enc, settings, &opts);
+
+	if (initialize_codec(enc, &opts)) {
+		av_dict_free(&opts);
 		return enc;
+	}
 
 fail:
+	av_dict_free(&opts);
 	opus_destroy(enc);
 	return NULL;
 }
@@ -250,6 +302,10 @@ static bool opus_encode(void *data, struct encoder_frame *frame,
 static void opus_defaults(obs_data_t *settings)
 {
 	obs_data_set_default_int(settings, "bitrate", 160);
+	obs_data_set_default_string(settings, "application", "audio");
+	obs_data_set_default_string(settings, "frame_duration", "20");
+	obs_data_set_default_bool(settings, "fec", false);
+	obs_data_set_default_int(settings, "packet_loss", 0);
 }
 
 static obs_properties_t *opus_properties(void *unused)
@@ -257,9 +313,33 @@ static obs_properties_t *opus_properties(void *unused)
 	UNUSED_PARAMETER(unused);
 
 	obs_properties_t *props = obs_properties_create();
+	obs_property_t *p;
 
 	obs_properties_add_int(props, "bitrate",
 			obs_module_text("Bitrate"), 32, 320, 32);
+
+	p = obs_properties_add_list(props, "application",
+			obs_module_text("Opus.Application"),
+			OBS_COMBO_TYPE_LIST, OBS_COMBO_FORMAT_STRING);
+	obs_property_list_add_string(p,
+			obs_module_text("Opus.Application.Audio"), "audio");
+	obs_property_list_add_string(p,
+			obs_module_text("Opus.Application.VoIP"), "voip");
+	obs_property_list_add_string(p,
+			obs_module_text("Opus.Application.LowDelay"),
+			"lowdelay");
+
+	p = obs_properties_add_list(props, "frame_duration",
+			obs_module_text("Opus.FrameDuration"),
+			OBS_COMBO_TYPE_LIST, OBS_COMBO_FORMAT_STRING);
+	obs_property_list_add_string(p, "2.5 ms", "2.5");
+	obs_property_list_add_string(p, "5 ms", "5");
+	obs_property_list_add_string(p, "10 ms", "10");
+	obs_property_list_add_string(p, "20 ms", "20");
+
+	obs_properties_add_bool(props, "fec", obs_module_text("Opus.FEC"));
+	obs_properties_add_int(props, "packet_loss",
+			obs_module_text("Opus.PacketLoss"), 0, 100, 1);
 	return props;
 }
 
@@ -284,6 +364,12 @@ static size_t opus_frame_size(void *data)
 	return enc->frame_size;
 }
 
+static int64_t opus_delay(void *data)
+{
+	struct opus_encoder *enc = data;
+	return enc->delay;
+}
+
 struct obs_encoder_info opus_encoder_info = {
 	.id             = "ffmpeg_opus",
 	.type           = OBS_ENCODER_AUDIO,
@@ -296,5 +382,6 @@ struct obs_encoder_info opus_encoder_info = {
 	.get_defaults   = opus_defaults,
 	.get_properties = opus_properties,
 	.get_extra_data = opus_extra_data,
-	.get_audio_info = opus_audio_info
+	.get_audio_info = opus_audio_info,
+	.get_delay      = opus_delay
 };
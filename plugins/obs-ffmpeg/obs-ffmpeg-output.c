@@ -16,7 +16,6 @@
 ******************************************************************************/
 
 #include <obs-module.h>
-#include <util/circlebuf.h>
 #include <util/threading.h>
 #include <util/dstr.h>
 #include <util/darray.h>
@@ -30,6 +29,7 @@
 #include "obs-ffmpeg-formats.h"
 #include "closest-pixel-format.h"
 #include "obs-ffmpeg-compat.h"
+#include "obs-ffmpeg-write-queue.h"
 
 struct ffmpeg_cfg {
 	const char         *url;
@@ -74,8 +74,8 @@ struct ffmpeg_data {
 	enum audio_format  audio_format;
 	size_t             audio_planes;
 	size_t             audio_size;
-	struct circlebuf   excess_frames[MAX_AV_PLANES];
 	uint8_t            *samples[MAX_AV_PLANES];
+	int                samples_filled;
 	AVFrame            *aframe;
 
 	struct ffmpeg_cfg  config;
@@ -97,12 +97,9 @@ struct ffmpeg_output {
 	volatile bool      stopping;
 
 	bool               write_thread_active;
-	pthread_mutex_t    write_mutex;
 	pthread_t          write_thread;
-	os_sem_t           *write_sem;
+	struct write_queue write_queue;
 	os_event_t         *stop_event;
-
-	DARRAY(AVPacket)   packets;
 };
 
 /* ------------------------------------------------------------------------- */
@@ -435,9 +432,6 @@ static void close_video(struct ffmpeg_data *data)
 
 static void close_audio(struct ffmpeg_data *data)
 {
-	for (size_t i = 0; i < MAX_AV_PLANES; i++)
-		circlebuf_free(&data->excess_frames[i]);
-
 	av_freep(&data->samples[0]);
 	avcodec_close(data->audio->codec);
 	av_frame_free(&data->aframe);
@@ -588,15 +582,12 @@ static void ffmpeg_log_callback(void *param, int level, const char *format,
 static void *ffmpeg_output_create(obs_data_t *settings, obs_output_t *output)
 {
 	struct ffmpeg_output *data = bzalloc(sizeof(struct ffmpeg_output));
-	pthread_mutex_init_value(&data->write_mutex);
 	data->output = output;
 
-	if (pthread_mutex_init(&data->write_mutex, NULL) != 0)
+	if (!write_queue_init(&data->write_queue))
 		goto fail;
 	if (os_event_init(&data->stop_event, OS_EVENT_TYPE_AUTO) != 0)
 		goto fail;
-	if (os_sem_init(&data->write_sem, 0) != 0)
-		goto fail;
 
 	av_log_set_callback(ffmpeg_log_callback);
 
@@ -604,7 +595,7 @@ static void *ffmpeg_output_create(obs_data_t *settings, obs_output_t *output)
 	return data;
 
 fail:
-	pthread_mutex_destroy(&data->write_mutex);
+	write_queue_free(&data->write_queue);
 	os_event_destroy(data->stop_event);
 	bfree(data);
 	return NULL;
@@ -623,13 +614,18 @@ static void ffmpeg_output_destroy(void *data)
 
 		ffmpeg_output_full_stop(output);
 
-		pthread_mutex_destroy(&output->write_mutex);
-		os_sem_destroy(output->write_sem);
+		write_queue_free(&output->write_queue);
 		os_event_destroy(output->stop_event);
 		bfree(data);
 	}
 }
 
+static inline void push_packet(struct ffmpeg_output *output,
+		AVPacket *packet)
+{
+	write_queue_push(&output->write_queue, packet);
+}
+
 static inline void copy_data(AVPicture *pic, const struct video_data *frame,
 		int height, enum AVPixelFormat format)
 {
@@ -690,10 +686,7 @@ static void receive_video(void *param, struct video_data *frame)
 		packet.data          = data->dst_picture.data[0];
 		packet.size          = sizeof(AVPicture);
 
-		pthread_mutex_lock(&output->write_mutex);
-		da_push_back(output->packets, &packet);
-		pthread_mutex_unlock(&output->write_mutex);
-		os_sem_post(output->write_sem);
+		push_packet(output, &packet);
 
 	} else {
 		data->vframe->pts = data->total_frames;
@@ -714,10 +707,7 @@ static void receive_video(void *param, struct video_data *frame)
 					context->time_base,
 					data->video->time_base);
 
-			pthread_mutex_lock(&output->write_mutex);
-			da_push_back(output->packets, &packet);
-			pthread_mutex_unlock(&output->write_mutex);
-			os_sem_post(output->write_sem);
+			push_packet(output, &packet);
 		} else {
 			ret = 0;
 		}
@@ -773,10 +763,7 @@ static void encode_audio(struct ffmpeg_output *output,
 			data->audio->time_base);
 	packet.stream_index = data->audio->index;
 
-	pthread_mutex_lock(&output->write_mutex);
-	da_push_back(output->packets, &packet);
-	pthread_mutex_unlock(&output->write_mutex);
-	os_sem_post(output->write_sem);
+	push_packet(output, &packet);
 }
 
 static bool prepare_audio(struct ffmpeg_data *data,
@@ -811,7 +798,6 @@ static void receive_audio(void *param, struct audio_data *frame)
 {
 	struct ffmpeg_output *output = param;
 	struct ffmpeg_data   *data   = &output->ff_data;
-	size_t frame_size_bytes;
 	struct audio_data in;
 
 	// codec doesn't support audio or none configured
@@ -828,18 +814,29 @@ static void receive_audio(void *param, struct audio_data *frame)
 	if (!output->audio_start_ts)
 		output->audio_start_ts = in.timestamp;
 
-	frame_size_bytes = (size_t)data->frame_size * data->audio_size;
+	/* copy straight into the encoder frame buffer, encoding each time
+	 * it fills up, rather than staging the audio in a separate buffer */
+	while (in.frames) {
+		uint32_t frames = (uint32_t)(data->frame_size -
+				data->samples_filled);
+		size_t offset = (size_t)data->samples_filled * data->audio_size;
 
-	for (size_t i = 0; i < data->audio_planes; i++)
-		circlebuf_push_back(&data->excess_frames[i], in.data[i],
-				in.frames * data->audio_size);
+		if (frames > in.frames)
+			frames = in.frames;
 
-	while (data->excess_frames[0].size >= frame_size_bytes) {
-		for (size_t i = 0; i < data->audio_planes; i++)
-			circlebuf_pop_front(&data->excess_frames[i],
-					data->samples[i], frame_size_bytes);
+		for (size_t i = 0; i < data->audio_planes; i++) {
+			memcpy(data->samples[i] + offset, in.data[i],
+					frames * data->audio_size);
+			in.data[i] += frames * data->audio_size;
+		}
+
+		in.frames -= frames;
+		data->samples_filled += (int)frames;
 
-		encode_audio(output, context, data->audio_size);
+		if (data->samples_filled == data->frame_size) {
+			encode_audio(output, context, data->audio_size);
+			data->samples_filled = 0;
+		}
 	}
 }
 
@@ -863,39 +860,26 @@ static uint64_t get_packet_sys_dts(struct ffmpeg_output *output,
 			time_base, (AVRational){1, 1000000000});
 }
 
-static int process_packet(struct ffmpeg_output *output)
+static int write_packet(struct ffmpeg_output *output, AVPacket *packet)
 {
-	AVPacket packet;
-	bool new_packet = false;
 	int ret;
 
-	pthread_mutex_lock(&output->write_mutex);
-	if (output->packets.num) {
-		packet = output->packets.array[0];
-		da_erase(output->packets, 0);
-		new_packet = true;
-	}
-	pthread_mutex_unlock(&output->write_mutex);
-
-	if (!new_packet)
-		return 0;
-
-	/*blog(LOG_DEBUG, "size = %d, flags = %lX, stream = %d, "
-			"packets queued: %lu",
-			packet.size, packet.flags,
-			packet.stream_index, output->packets.num);*/
+	/*blog(LOG_DEBUG, "size = %d, flags = %lX, stream = %d",
+			packet->size, packet->flags,
+			packet->stream_index);*/
 
 	if (stopping(output)) {
-		uint64_t sys_ts = get_packet_sys_dts(output, &packet);
+		uint64_t sys_ts = get_packet_sys_dts(output, packet);
 		if (sys_ts >= output->stop_ts) {
+			av_free_packet(packet);
 			ffmpeg_output_full_stop(output);
-			return 0;
+			return 1;
 		}
 	}
 
-	ret = av_interleaved_write_frame(output->ff_data.output, &packet);
+	ret = av_interleaved_write_frame(output->ff_data.output, packet);
 	if (ret < 0) {
-		av_free_packet(&packet);
+		av_free_packet(packet);
 		blog(LOG_WARNING, "receive_audio: Error writing packet: %s",
 				av_err2str(ret));
 		return ret;
@@ -904,16 +888,46 @@ static int process_packet(struct ffmpeg_output *output)
 	return 0;
 }
 
+static int process_packets(struct ffmpeg_output *output, bool *more)
+{
+	AVPacket packets[MAX_WRITE_BATCH];
+	size_t count;
+	size_t i = 0;
+	int ret = 0;
+
+	/* take everything currently queued in one go so the encoder threads
+	 * only contend for the lock once per batch */
+	count = write_queue_pop(&output->write_queue, packets, more);
+
+	for (; i < count; i++) {
+		ret = write_packet(output, &packets[i]);
+		if (ret != 0) {
+			i++;
+			break;
+		}
+	}
+
+	for (; i < count; i++)
+		av_free_packet(&packets[i]);
+
+	return ret < 0 ? ret : 0;
+}
+
 static void *write_thread(void *data)
 {
 	struct ffmpeg_output *output = data;
 
-	while (os_sem_wait(output->write_sem) == 0) {
+	while (write_queue_wait(&output->write_queue) == 0) {
 		/* check to see if shutting down */
 		if (os_event_try(output->stop_event) == 0)
 			break;
 
-		int ret = process_packet(output);
+		bool more = true;
+		int ret = 0;
+
+		while (more && ret == 0)
+			ret = process_packets(output, &more);
+
 		if (ret != 0) {
 			int code = OBS_OUTPUT_ERROR;
 
@@ -1084,18 +1098,12 @@ static void ffmpeg_deactivate(struct ffmpeg_output *output)
 {
 	if (output->write_thread_active) {
 		os_event_signal(output->stop_event);
-		os_sem_post(output->write_sem);
+		write_queue_wake(&output->write_queue);
 		pthread_join(output->write_thread, NULL);
 		output->write_thread_active = false;
 	}
 
-	pthread_mutex_lock(&output->write_mutex);
-
-	for (size_t i = 0; i < output->packets.num; i++)
-		av_free_packet(output->packets.array+i);
-	da_free(output->packets);
-
-	pthread_mutex_unlock(&output->write_mutex);
+	write_queue_clear(&output->write_queue);
 
 	ffmpeg_data_free(&output->ff_data);
 }
@@ -52,8 +52,13 @@ struct ffmpeg_source {
 	enum video_range_type range;
 	int audio_buffer_size;
 	int video_buffer_size;
+	int video_buffer_mb;
+	int decoder_threads;
+	bool is_frame_threading;
+	bool is_slice_threading;
 	bool is_advanced;
 	bool is_looping;
+	int preroll_ms;
 	bool is_forcing_scale;
 	bool is_hw_decoding;
 	bool is_clear_on_media_end;
@@ -302,10 +307,12 @@ static bool is_local_file_modified(obs_properties_t *props,
 			"input_format");
 	obs_property_t *local_file = obs_properties_get(props, "local_file");
 	obs_property_t *looping = obs_properties_get(props, "looping");
+	obs_property_t *preroll = obs_properties_get(props, "preroll_ms");
 	obs_property_set_visible(input, !enabled);
 	obs_property_set_visible(input_format, !enabled);
 	obs_property_set_visible(local_file, enabled);
 	obs_property_set_visible(looping, enabled);
+	obs_property_set_visible(preroll, enabled);
 
 	return true;
 }
@@ -319,11 +326,19 @@ static bool is_advanced_modified(obs_properties_t *props,
 	obs_property_t *fscale = obs_properties_get(props, "force_scale");
 	obs_property_t *abuf = obs_properties_get(props, "audio_buffer_size");
 	obs_property_t *vbuf = obs_properties_get(props, "video_buffer_size");
+	obs_property_t *vbuf_mb = obs_properties_get(props, "video_buffer_mb");
+	obs_property_t *threads = obs_properties_get(props, "decoder_threads");
+	obs_property_t *fthread = obs_properties_get(props, "frame_threading");
+	obs_property_t *sthread = obs_properties_get(props, "slice_threading");
 	obs_property_t *frame_drop = obs_properties_get(props, "frame_drop");
 	obs_property_t *color_range = obs_properties_get(props, "color_range");
 	obs_property_set_visible(fscale, enabled);
 	obs_property_set_visible(abuf, enabled);
 	obs_property_set_visible(vbuf, enabled);
+	obs_property_set_visible(vbuf_mb, enabled);
+	obs_property_set_visible(threads, enabled);
+	obs_property_set_visible(fthread, enabled);
+	obs_property_set_visible(sthread, enabled);
 	obs_property_set_visible(frame_drop, enabled);
 	obs_property_set_visible(color_range, enabled);
 
@@ -334,9 +349,14 @@ static void ffmpeg_source_defaults(obs_data_t *settings)
 {
 	obs_data_set_default_bool(settings, "is_local_file", true);
 	obs_data_set_default_bool(settings, "looping", false);
+	obs_data_set_default_int(settings, "preroll_ms", 0);
 	obs_data_set_default_bool(settings, "clear_on_media_end", true);
 	obs_data_set_default_bool(settings, "restart_on_activate", true);
 	obs_data_set_default_bool(settings, "force_scale", true);
+	obs_data_set_default_int(settings, "video_buffer_mb", 0);
+	obs_data_set_default_int(settings, "decoder_threads", 0);
+	obs_data_set_default_bool(settings, "frame_threading", true);
+	obs_data_set_default_bool(settings, "slice_threading", true);
 #if defined(_WIN32)
 	obs_data_set_default_bool(settings, "hw_decode", true);
 #endif
@@ -393,6 +413,8 @@ static obs_properties_t *ffmpeg_source_getproperties(void *data)
 	dstr_free(&path);
 
 	obs_properties_add_bool(props, "looping", obs_module_text("Looping"));
+	obs_properties_add_int(props, "preroll_ms",
+			obs_module_text("LoopPreroll"), 0, 10000, 100);
 
 	obs_properties_add_bool(props, "restart_on_activate",
 			obs_module_text("RestartWhenActivated"));
@@ -427,6 +449,26 @@ static obs_properties_t *ffmpeg_source_getproperties(void *data)
 
 	obs_property_set_visible(prop, false);
 
+	prop = obs_properties_add_int(props, "video_buffer_mb",
+			obs_module_text("VideoBufferMB"), 0, 4096, 16);
+
+	obs_property_set_visible(prop, false);
+
+	prop = obs_properties_add_int(props, "decoder_threads",
+			obs_module_text("DecoderThreads"), 0, 64, 1);
+
+	obs_property_set_visible(prop, false);
+
+	prop = obs_properties_add_bool(props, "frame_threading",
+			obs_module_text("FrameThreading"));
+
+	obs_property_set_visible(prop, false);
+
+	prop = obs_properties_add_bool(props, "slice_threading",
+			obs_module_text("SliceThreading"));
+
+	obs_property_set_visible(prop, false);
+
 	prop = obs_properties_add_list(props, "frame_drop",
 			obs_module_text("FrameDropping"), OBS_COMBO_TYPE_LIST,
 			OBS_COMBO_FORMAT_INT);
@@ -492,6 +534,7 @@ static void dump_source_info(struct ffmpeg_source *s, const char *input,
 			"\tinput:                   %s\n"
 			"\tinput_format:            %s\n"
 			"\tis_looping:              %s\n"
+			"\tpreroll_ms:              %d\n"
 			"\tis_forcing_scale:        %s\n"
 			"\tis_hw_decoding:          %s\n"
 			"\tis_clear_on_media_end:   %s\n"
@@ -499,6 +542,7 @@ static void dump_source_info(struct ffmpeg_source *s, const char *input,
 			input ? input : "(null)",
 			input_format ? input_format : "(null)",
 			s->is_looping ? "yes" : "no",
+			s->preroll_ms,
 			s->is_forcing_scale ? "yes" : "no",
 			s->is_hw_decoding ? "yes" : "no",
 			s->is_clear_on_media_end ? "yes" : "no",
@@ -511,9 +555,17 @@ static void dump_source_info(struct ffmpeg_source *s, const char *input,
 			"advanced settings:\n"
 			"\taudio_buffer_size:       %d\n"
 			"\tvideo_buffer_size:       %d\n"
+			"\tvideo_buffer_mb:         %d\n"
+			"\tdecoder_threads:         %d\n"
+			"\tis_frame_threading:      %s\n"
+			"\tis_slice_threading:      %s\n"
 			"\tframe_drop:              %s",
 			s->audio_buffer_size,
 			s->video_buffer_size,
+			s->video_buffer_mb,
+			s->decoder_threads,
+			s->is_frame_threading ? "yes" : "no",
+			s->is_slice_threading ? "yes" : "no",
 			frame_drop_to_str(s->frame_drop));
 }
 
@@ -525,6 +577,7 @@ static void ffmpeg_source_start(struct ffmpeg_source *s)
 	s->demuxer = ff_demuxer_init();
 	s->demuxer->options.is_hw_decoding = s->is_hw_decoding;
 	s->demuxer->options.is_looping = s->is_looping;
+	s->demuxer->options.preroll_ms = s->preroll_ms;
 
 	ff_demuxer_set_callbacks(&s->demuxer->video_callbacks,
 			video_frame, NULL,
@@ -539,6 +592,11 @@ static void ffmpeg_source_start(struct ffmpeg_source *s)
 			s->audio_buffer_size;
 		s->demuxer->options.video_frame_queue_size =
 			s->video_buffer_size;
+		s->demuxer->options.video_frame_queue_bytes =
+			(int64_t)s->video_buffer_mb * 1024 * 1024;
+		s->demuxer->options.video_thread_count = s->decoder_threads;
+		s->demuxer->options.is_frame_threading = s->is_frame_threading;
+		s->demuxer->options.is_slice_threading = s->is_slice_threading;
 		s->demuxer->options.frame_drop = s->frame_drop;
 	}
 
@@ -562,11 +620,13 @@ static void ffmpeg_source_update(void *data, obs_data_t *settings)
 		input = (char *)obs_data_get_string(settings, "local_file");
 		input_format = NULL;
 		s->is_looping = obs_data_get_bool(settings, "looping");
+		s->preroll_ms = (int)obs_data_get_int(settings, "preroll_ms");
 	} else {
 		input = (char *)obs_data_get_string(settings, "input");
 		input_format = (char *)obs_data_get_string(settings,
 				"input_format");
 		s->is_looping = false;
+		s->preroll_ms = 0;
 	}
 
 	s->input = input ? bstrdup(input) : NULL;
@@ -585,6 +645,14 @@ static void ffmpeg_source_update(void *data, obs_data_t *settings)
 				"audio_buffer_size");
 		s->video_buffer_size = (int)obs_data_get_int(settings,
 				"video_buffer_size");
+		s->video_buffer_mb = (int)obs_data_get_int(settings,
+				"video_buffer_mb");
+		s->decoder_threads = (int)obs_data_get_int(settings,
+				"decoder_threads");
+		s->is_frame_threading = obs_data_get_bool(settings,
+				"frame_threading");
+		s->is_slice_threading = obs_data_get_bool(settings,
+				"slice_threading");
 		s->frame_drop = (enum AVDiscard)obs_data_get_int(settings,
 					"frame_drop");
 		s->is_forcing_scale = obs_data_get_bool(settings,
@@ -603,6 +671,11 @@ static void ffmpeg_source_update(void *data, obs_data_t *settings)
 					s->audio_buffer_size);
 		}
 
+		if (s->video_buffer_mb < 0)
+			s->video_buffer_mb = 0;
+		if (s->decoder_threads < 0)
+			s->decoder_threads = 0;
+
 		if (s->frame_drop < AVDISCARD_NONE ||
 		    s->frame_drop > AVDISCARD_ALL) {
 			s->frame_drop = AVDISCARD_DEFAULT;
@@ -612,8 +685,13 @@ static void ffmpeg_source_update(void *data, obs_data_t *settings)
 	}
 
 	dump_source_info(s, input, input_format, is_advanced);
-	if (!s->restart_on_activate || obs_source_active(s->source))
+	if (!s->restart_on_activate || obs_source_active(s->source)) {
 		ffmpeg_source_start(s);
+	} else if (s->demuxer != NULL) {
+		/* a paused demuxer still has the old settings */
+		ff_demuxer_free(s->demuxer);
+		s->demuxer = NULL;
+	}
 }
 
 static const char *ffmpeg_source_getname(void *unused)
@@ -652,7 +730,12 @@ static void ffmpeg_source_activate(void *data)
 {
 	struct ffmpeg_source *s = data;
 
-	if (s->restart_on_activate)
+	if (!s->restart_on_activate)
+		return;
+
+	if (s->demuxer != NULL && !s->demuxer->abort)
+		ff_demuxer_restart(s->demuxer);
+	else
 		ffmpeg_source_start(s);
 }
 
@@ -662,8 +745,14 @@ static void ffmpeg_source_deactivate(void *data)
 
 	if (s->restart_on_activate) {
 		if (s->demuxer != NULL) {
-			ff_demuxer_free(s->demuxer);
-			s->demuxer = NULL;
+			/* with a pre-roll cache, keep the file open so that
+			 * it restarts from the cache on activation */
+			if (s->is_looping && s->preroll_ms > 0) {
+				ff_demuxer_pause(s->demuxer);
+			} else {
+				ff_demuxer_free(s->demuxer);
+				s->demuxer = NULL;
+			}
 
 			if (s->is_clear_on_media_end)
 				obs_source_output_video(s->source, NULL);
@@ -0,0 +1,44 @@
+#pragma once
+
+/*
+ * Timestamp rebasing for split recordings.
+ *
+ * Every file after a split starts at the keyframe it was cut at.  All tracks
+ * are rebased on that same point in time, converted to the timebase of each
+ * track, so audio and video stay in sync in every file.  The first file keeps
+ * the encoder timestamps.
+ */
+
+struct split_offsets {
+	bool    rebase;
+	int64_t start_usec;
+};
+
+static inline void split_offsets_reset(struct split_offsets *offsets,
+		bool rebase, int64_t start_usec)
+{
+	offsets->rebase = rebase;
+	offsets->start_usec = rebase ? start_usec : 0;
+}
+
+/* packet timestamps count in units of 1/timebase_den (dts_usec is derived
+ * the same way), rounded to the nearest unit so that the packet the file was
+ * cut at gets a timestamp of exactly zero */
+static inline int64_t split_offsets_get(const struct split_offsets *offsets,
+		const struct encoder_packet *packet)
+{
+	if (!offsets->rebase)
+		return 0;
+
+	return (offsets->start_usec * packet->timebase_den + 500000) /
+		1000000;
+}
+
+static inline void split_offsets_apply(const struct split_offsets *offsets,
+		struct encoder_packet *packet)
+{
+	int64_t offset = split_offsets_get(offsets, packet);
+
+	packet->pts -= offset;
+	packet->dts -= offset;
+}
@@ -0,0 +1,103 @@
+#pragma once
+
+/*
+ * Packet queue between the encoding threads and the write thread of the
+ * ffmpeg output.
+ *
+ * Packets are kept in a ring, and the write thread takes up to
+ * MAX_WRITE_BATCH of them per lock.  The write thread drains the queue
+ * completely on each wakeup, so it only needs to be woken when the queue
+ * goes from empty to non-empty.
+ */
+
+#include <util/circlebuf.h>
+#include <util/threading.h>
+
+#include "obs-ffmpeg-compat.h"
+
+/* maximum number of packets the write thread takes per lock */
+#define MAX_WRITE_BATCH 32
+
+struct write_queue {
+	pthread_mutex_t  mutex;
+	os_sem_t         *sem;
+	struct circlebuf packets;
+};
+
+static inline bool write_queue_init(struct write_queue *q)
+{
+	pthread_mutex_init_value(&q->mutex);
+	if (pthread_mutex_init(&q->mutex, NULL) != 0)
+		return false;
+	if (os_sem_init(&q->sem, 0) != 0)
+		return false;
+
+	return true;
+}
+
+/* drops all queued packets */
+static inline void write_queue_clear(struct write_queue *q)
+{
+	pthread_mutex_lock(&q->mutex);
+
+	while (q->packets.size) {
+		AVPacket packet;
+		circlebuf_pop_front(&q->packets, &packet, sizeof(packet));
+		av_free_packet(&packet);
+	}
+	circlebuf_free(&q->packets);
+
+	pthread_mutex_unlock(&q->mutex);
+}
+
+static inline void write_queue_free(struct write_queue *q)
+{
+	write_queue_clear(q);
+
+	pthread_mutex_destroy(&q->mutex);
+	os_sem_destroy(q->sem);
+}
+
+static inline void write_queue_push(struct write_queue *q, AVPacket *packet)
+{
+	bool was_empty;
+
+	pthread_mutex_lock(&q->mutex);
+	was_empty = q->packets.size == 0;
+	circlebuf_push_back(&q->packets, packet, sizeof(*packet));
+	pthread_mutex_unlock(&q->mutex);
+
+	if (was_empty)
+		os_sem_post(q->sem);
+}
+
+/* takes up to MAX_WRITE_BATCH packets, 'more' is set if any are left */
+static inline size_t write_queue_pop(struct write_queue *q, AVPacket *packets,
+		bool *more)
+{
+	size_t count;
+
+	pthread_mutex_lock(&q->mutex);
+	count = q->packets.size / sizeof(AVPacket);
+	if (count > MAX_WRITE_BATCH)
+		count = MAX_WRITE_BATCH;
+	if (count)
+		circlebuf_pop_front(&q->packets, packets,
+				count * sizeof(AVPacket));
+	*more = q->packets.size != 0;
+	pthread_mutex_unlock(&q->mutex);
+
+	return count;
+}
+
+/* waits until packets were queued, or the queue was woken with
+ * write_queue_wake */
+static inline int write_queue_wait(struct write_queue *q)
+{
+	return os_sem_wait(q->sem);
+}
+
+static inline void write_queue_wake(struct write_queue *q)
+{
+	os_sem_post(q->sem);
+}
@@ -42,22 +42,91 @@ static inline double encoder_bitrate(obs_encoder_t *encoder)
 
 #define FLV_INFO_SIZE_OFFSET 42
 
-void write_file_info(FILE *file, int64_t duration_ms, int64_t size)
+void write_file_info(struct serializer *s, int64_t duration_ms, int64_t size)
 {
 	char buf[64];
 	char *enc = buf;
 	char *end = enc + sizeof(buf);
 
-	fseek(file, FLV_INFO_SIZE_OFFSET, SEEK_SET);
+	serializer_seek(s, FLV_INFO_SIZE_OFFSET, SERIALIZE_SEEK_START);
 
 	enc_num_val(&enc, end, "duration", (double)duration_ms / 1000.0);
 	enc_num_val(&enc, end, "fileSize", (double)size);
 
-	fwrite(buf, 1, enc - buf, file);
+	s_write(s, buf, enc - buf);
+}
+
+/* The keyframe index is reserved at the end of onMetaData as a "keyframes"
+ * object holding "times" and "filepositions" strict arrays, followed by a
+ * "padding" long string that takes up whatever the arrays do not use. This
+ * keeps the size of the tag fixed so the index can be filled in on close. */
+#define KEYFRAME_ENTRY_SIZE 18
+
+static inline void s_amf_key(struct serializer *s, const char *name)
+{
+	size_t len = strlen(name);
+	s_wb16(s, (uint16_t)len);
+	s_write(s, name, len);
+}
+
+static inline void s_amf_num(struct serializer *s, double val)
+{
+	s_w8(s, AMF_NUMBER);
+	s_wbd(s, val);
+}
+
+static void write_keyframe_index_data(struct serializer *s, size_t slots,
+		const struct flv_keyframe *keyframes, size_t count)
+{
+	size_t padding;
+
+	if (count > slots)
+		count = slots;
+	padding = KEYFRAME_ENTRY_SIZE * (slots - count);
+
+	s_amf_key(s, "keyframes");
+	s_w8(s, AMF_OBJECT);
+
+	s_amf_key(s, "times");
+	s_w8(s, AMF_STRICT_ARRAY);
+	s_wb32(s, (uint32_t)count);
+	for (size_t i = 0; i < count; i++)
+		s_amf_num(s, (double)keyframes[i].time_ms / 1000.0);
+
+	s_amf_key(s, "filepositions");
+	s_w8(s, AMF_STRICT_ARRAY);
+	s_wb32(s, (uint32_t)count);
+	for (size_t i = 0; i < count; i++)
+		s_amf_num(s, (double)keyframes[i].pos);
+
+	s_wb16(s, 0);
+	s_w8(s, AMF_OBJECT_END);
+
+	s_amf_key(s, "padding");
+	s_w8(s, AMF_LONG_STRING);
+	s_wb32(s, (uint32_t)padding);
+	for (size_t i = 0; i < padding; i++)
+		s_w8(s, ' ');
+}
+
+void write_keyframe_index(struct serializer *s, int64_t offset, size_t slots,
+		const struct flv_keyframe *keyframes, size_t count)
+{
+	struct array_output_data data;
+	struct serializer index;
+
+	array_output_serializer_init(&index, &data);
+	write_keyframe_index_data(&index, slots, keyframes, count);
+
+	serializer_seek(s, offset, SERIALIZE_SEEK_START);
+	s_write(s, data.bytes.array, data.bytes.num);
+
+	array_output_serializer_free(&data);
 }
 
 static bool build_flv_meta_data(obs_output_t *context,
-		uint8_t **output, size_t *size, size_t a_idx)
+		uint8_t **output, size_t *size, size_t a_idx,
+		size_t keyframe_slots, size_t *index_offset)
 {
 	obs_encoder_t *vencoder = obs_output_get_video_encoder(context);
 	obs_encoder_t *aencoder = obs_output_get_audio_encoder(context, a_idx);
@@ -74,7 +143,8 @@ static bool build_flv_meta_data(obs_output_t *context,
 	enc_str(&enc, end, "onMetaData");
 
 	*enc++ = AMF_ECMA_ARRAY;
-	enc    = AMF_EncodeInt32(enc, end, a_idx == 0 ? 14 : 9);
+	enc    = AMF_EncodeInt32(enc, end, (a_idx == 0 ? 14 : 9) +
+			(keyframe_slots ? 2 : 0));
 
 	enc_num_val(&enc, end, "duration", 0.0);
 	enc_num_val(&enc, end, "fileSize", 0.0);
@@ -120,6 +190,24 @@ static bool build_flv_meta_data(obs_output_t *context,
 	enc_str_val(&enc, end, "encoder", encoder_name.array);
 	dstr_free(&encoder_name);
 
+	if (keyframe_slots) {
+		struct array_output_data data;
+		struct serializer s;
+
+		array_output_serializer_init(&s, &data);
+		s_write(&s, buf, enc - buf);
+
+		*index_offset = data.bytes.num;
+		write_keyframe_index_data(&s, keyframe_slots, NULL, 0);
+
+		s_wb16(&s, 0);
+		s_w8(&s, AMF_OBJECT_END);
+
+		*size   = data.bytes.num;
+		*output = data.bytes.array;
+		return true;
+	}
+
 	*enc++  = 0;
 	*enc++  = 0;
 	*enc++  = AMF_OBJECT_END;
@@ -129,23 +217,25 @@ static bool build_flv_meta_data(obs_output_t *context,
 	return true;
 }
 
-bool flv_meta_data(obs_output_t *context, uint8_t **output, size_t *size,
-		bool write_header, size_t audio_idx)
+static bool flv_meta_data_internal(obs_output_t *context, uint8_t **output,
+		size_t *size, bool write_header, size_t audio_idx,
+		size_t keyframe_slots, int64_t *index_offset)
 {
 	struct array_output_data data;
 	struct serializer s;
 	uint8_t *meta_data = NULL;
 	size_t  meta_data_size;
+	size_t  meta_index_offset = 0;
 	uint32_t start_pos;
 
-	array_output_serializer_init(&s, &data);
-
 	if (!build_flv_meta_data(context, &meta_data, &meta_data_size,
-				audio_idx)) {
+				audio_idx, keyframe_slots, &meta_index_offset)) {
 		bfree(meta_data);
 		return false;
 	}
 
+	array_output_serializer_init(&s, &data);
+
 	if (write_header) {
 		s_write(&s, "FLV", 3);
 		s_w8(&s, 1);
@@ -162,6 +252,10 @@ bool flv_meta_data(obs_output_t *context, uint8_t **output, size_t *size,
 	s_wb32(&s, 0);
 	s_wb24(&s, 0);
 
+	if (index_offset)
+		*index_offset = (int64_t)(serializer_get_pos(&s) +
+				meta_index_offset);
+
 	s_write(&s, meta_data, meta_data_size);
 
 	s_wb32(&s, (uint32_t)serializer_get_pos(&s) - start_pos + 4 - 1);
@@ -173,6 +267,20 @@ bool flv_meta_data(obs_output_t *context, uint8_t **output, size_t *size,
 	return true;
 }
 
+bool flv_meta_data(obs_output_t *context, uint8_t **output, size_t *size,
+		bool write_header, size_t audio_idx)
+{
+	return flv_meta_data_internal(context, output, size, write_header,
+			audio_idx, 0, NULL);
+}
+
+bool flv_meta_data_indexed(obs_output_t *context, uint8_t **output,
+		size_t *size, size_t keyframe_slots, int64_t *index_offset)
+{
+	return flv_meta_data_internal(context, output, size, true, 0,
+			keyframe_slots, index_offset);
+}
+
 #ifdef DEBUG_TIMESTAMPS
 static int32_t last_time = 0;
 #endif
@@ -18,6 +18,7 @@
 #pragma once
 
 #include <obs.h>
+#include <util/serializer.h>
 
 #define MILLISECOND_DEN   1000
 
@@ -26,9 +27,21 @@ static uint32_t get_ms_time(struct encoder_packet *packet, int64_t val)
 	return (uint32_t)(val * MILLISECOND_DEN / packet->timebase_den);
 }
 
-extern void write_file_info(FILE *file, int64_t duration_ms, int64_t size);
+extern void write_file_info(struct serializer *s, int64_t duration_ms,
+		int64_t size);
+
+struct flv_keyframe {
+	int64_t time_ms;
+	int64_t pos;
+};
+
+extern void write_keyframe_index(struct serializer *s, int64_t offset,
+		size_t slots, const struct flv_keyframe *keyframes,
+		size_t count);
 
 extern bool flv_meta_data(obs_output_t *context, uint8_t **output, size_t *size,
 		bool write_header, size_t audio_idx);
+extern bool flv_meta_data_indexed(obs_output_t *context, uint8_t **output,
+		size_t *size, size_t keyframe_slots, int64_t *index_offset);
 extern void flv_packet_mux(struct encoder_packet *packet,
 		uint8_t **output, size_t *size, bool is_header);
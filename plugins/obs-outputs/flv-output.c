@@ -21,6 +21,8 @@
 #include <util/platform.h>
 #include <util/dstr.h>
 #include <util/threading.h>
+#include <util/darray.h>
+#include <util/buffered-file-serializer.h>
 #include <inttypes.h>
 #include "flv-mux.h"
 
@@ -31,13 +33,23 @@
 #define warn(format, ...)  do_log(LOG_WARNING, format, ##__VA_ARGS__)
 #define info(format, ...)  do_log(LOG_INFO,    format, ##__VA_ARGS__)
 
+/* number of keyframe index entries reserved in onMetaData (about 150 KB).
+ * once they run out, every other entry is dropped, so long recordings keep
+ * an evenly spaced index rather than one that stops part way through */
+#define KEYFRAME_SLOTS 8192
+
 struct flv_output {
 	obs_output_t *output;
 	struct dstr  path;
-	FILE         *file;
+	struct serializer file;
 	bool         active;
 	bool         sent_headers;
 	int64_t      last_packet_ts;
+
+	int64_t      index_offset;
+	DARRAY(struct flv_keyframe) keyframes;
+	size_t       keyframe_count;
+	size_t       keyframe_stride;
 };
 
 static const char *flv_output_getname(void *unused)
@@ -56,6 +68,7 @@ static void flv_output_destroy(void *data)
 		flv_output_stop(data, 0);
 
 	dstr_free(&stream->path);
+	da_free(stream->keyframes);
 	bfree(stream);
 }
 
@@ -73,11 +86,30 @@ static void flv_output_stop(void *data, uint64_t ts)
 	struct flv_output *stream = data;
 
 	if (stream->active) {
-		if (stream->file) {
-			write_file_info(stream->file, stream->last_packet_ts,
-					os_ftelli64(stream->file));
-
-			fclose(stream->file);
+		if (stream->file.data) {
+			struct buffered_file_stats stats;
+
+			write_file_info(&stream->file, stream->last_packet_ts,
+					serializer_get_pos(&stream->file));
+			if (stream->index_offset)
+				write_keyframe_index(&stream->file,
+						stream->index_offset,
+						KEYFRAME_SLOTS,
+						stream->keyframes.array,
+						stream->keyframes.num);
+
+			buffered_file_serializer_get_stats(&stream->file,
+					&stats);
+			buffered_file_serializer_free(&stream->file);
+
+			info("Wrote %"PRIu64" bytes, write queue peaked at "
+			     "%"PRIu64" KB, %"PRIu64" stalls totalling "
+			     "%"PRIu64" ms, slowest write %"PRIu64" ms",
+			     stats.bytes_written,
+			     (uint64_t)stats.max_queue_size / 1024,
+			     stats.stalls,
+			     stats.stall_time_ns / 1000000,
+			     stats.max_write_time_ns / 1000000);
 		}
 		obs_output_end_data_capture(stream->output);
 		stream->active = false;
@@ -89,6 +121,31 @@ static void flv_output_stop(void *data, uint64_t ts)
 	UNUSED_PARAMETER(ts);
 }
 
+static void add_keyframe(struct flv_output *stream, int64_t time_ms)
+{
+	struct flv_keyframe keyframe = {
+		.time_ms = time_ms,
+		.pos     = serializer_get_pos(&stream->file)
+	};
+
+	if (stream->keyframe_count++ % stream->keyframe_stride != 0)
+		return;
+
+	if (stream->keyframes.num == KEYFRAME_SLOTS) {
+		for (size_t i = 1; i < KEYFRAME_SLOTS / 2; i++)
+			stream->keyframes.array[i] =
+				stream->keyframes.array[i * 2];
+
+		da_resize(stream->keyframes, KEYFRAME_SLOTS / 2);
+		stream->keyframe_stride *= 2;
+
+		if ((stream->keyframe_count - 1) % stream->keyframe_stride)
+			return;
+	}
+
+	da_push_back(stream->keyframes, &keyframe);
+}
+
 static int write_packet(struct flv_output *stream,
 		struct encoder_packet *packet, bool is_header)
 {
@@ -98,8 +155,12 @@ static int write_packet(struct flv_output *stream,
 
 	stream->last_packet_ts = get_ms_time(packet, packet->dts);
 
+	if (!is_header && packet->type == OBS_ENCODER_VIDEO &&
+	    packet->keyframe)
+		add_keyframe(stream, stream->last_packet_ts);
+
 	flv_packet_mux(packet, &data, &size, is_header);
-	fwrite(data, 1, size, stream->file);
+	s_write(&stream->file, data, size);
 	bfree(data);
 	obs_encoder_packet_release(packet);
 
@@ -111,8 +172,9 @@ static void write_meta_data(struct flv_output *stream)
 	uint8_t *meta_data;
 	size_t  meta_data_size;
 
-	flv_meta_data(stream->output, &meta_data, &meta_data_size, true, 0);
-	fwrite(meta_data, 1, meta_data_size, stream->file);
+	flv_meta_data_indexed(stream->output, &meta_data, &meta_data_size,
+			KEYFRAME_SLOTS, &stream->index_offset);
+	s_write(&stream->file, meta_data, meta_data_size);
 	bfree(meta_data);
 }
 
@@ -174,12 +236,17 @@ static bool flv_output_start(void *data)
 	dstr_copy(&stream->path, path);
 	obs_data_release(settings);
 
-	stream->file = os_fopen(stream->path.array, "wb");
-	if (!stream->file) {
+	if (!buffered_file_serializer_init(&stream->file, stream->path.array,
+				0, 0)) {
 		warn("Unable to open FLV file '%s'", stream->path.array);
 		return false;
 	}
 
+	stream->index_offset = 0;
+	stream->keyframe_count = 0;
+	stream->keyframe_stride = 1;
+	da_resize(stream->keyframes, 0);
+
 	/* write headers and start capture */
 	stream->active = true;
 	obs_output_begin_data_capture(stream->output, 0);
@@ -1,5 +1,4 @@
 #include <obs-module.h>
-#include <graphics/image-file.h>
 #include <util/dstr.h>
 
 #define S_LUMA_IMG              "luma_image"
@@ -21,7 +20,8 @@ struct luma_wipe_info {
 	gs_eparam_t *ep_invert;
 	gs_eparam_t *ep_softness;
 
-	gs_image_file_t luma_image;
+	obs_cached_image_t *luma_image;
+	gs_texture_t *luma_texture;
 	bool  invert_luma;
 	float softness;
 	obs_data_t *wipes_list;
@@ -48,16 +48,18 @@ static void luma_wipe_update(void *data, obs_data_t *settings)
 
 	char *file = obs_module_file(path.array);
 
-	obs_enter_graphics();
-	gs_image_file_free(&lwipe->luma_image);
-	obs_leave_graphics();
-
-	gs_image_file_init(&lwipe->luma_image, file);
+	/* luma images are shared by every luma wipe using the same file */
+	obs_cached_image_t *new_image = obs_image_cache_get(file);
+	obs_cached_image_t *old_image;
 
 	obs_enter_graphics();
-	gs_image_file_init_texture(&lwipe->luma_image);
+	old_image = lwipe->luma_image;
+	lwipe->luma_image = new_image;
+	lwipe->luma_texture = obs_cached_image_get_texture(new_image);
 	obs_leave_graphics();
 
+	obs_image_cache_release(old_image);
+
 	bfree(file);
 	dstr_free(&path);
 
@@ -114,9 +116,7 @@ static void luma_wipe_destroy(void *data)
 {
 	struct luma_wipe_info *lwipe = data;
 
-	obs_enter_graphics();
-	gs_image_file_free(&lwipe->luma_image);
-	obs_leave_graphics();
+	obs_image_cache_release(lwipe->luma_image);
 
 	obs_data_release(lwipe->wipes_list);
 
@@ -161,7 +161,7 @@ static void luma_wipe_callback(void *data, gs_texture_t *a, gs_texture_t *b,
 
 	gs_effect_set_texture(lwipe->ep_a_tex, a);
 	gs_effect_set_texture(lwipe->ep_b_tex, b);
-	gs_effect_set_texture(lwipe->ep_l_tex, lwipe->luma_image.texture);
+	gs_effect_set_texture(lwipe->ep_l_tex, lwipe->luma_texture);
 	gs_effect_set_float(lwipe->ep_progress, t);
 
 	gs_effect_set_bool(lwipe->ep_invert, lwipe->invert_luma);
@@ -35,19 +35,21 @@ void load_os_font_list(void)
 {
 }
 
-const char *get_font_path(const char *family, uint16_t size, const char *style,
+long get_os_font_list_generation(void)
+{
+	return 0;
+}
+
+char *get_font_path(const char *family, uint16_t size, const char *style,
 		uint32_t flags, FT_Long *idx)
 {
 	bool      bold     = !!(flags & OBS_FONT_BOLD);
 	bool      italic   = !!(flags & OBS_FONT_ITALIC);
 	FcPattern *pattern = FcPatternCreate();
 	FcPattern *match   = NULL;
-	bool      success  = false;
+	char      *result  = NULL;
 	FcResult  match_result;
 
-	/* somewhat of a cheap hack */
-	static __thread char result[512];
-
 	FcPatternAddString(pattern, FC_FAMILY, (const FcChar8*)family);
 	FcPatternAddString(pattern, FC_STYLE, (const FcChar8*)style);
 	FcPatternAddInteger(pattern, FC_WEIGHT,
@@ -63,7 +65,7 @@ const char *get_font_path(const char *family, uint16_t size, const char *style,
 	if (match) {
 		FcChar8 *path = FcPatternFormat(match,
 				(const FcChar8*)"%{file}");
-		strncpy(result, (char*)path, 511);
+		result = bstrdup((char*)path);
 		FcStrFree(path);
 
 		int fc_index = 0;
@@ -71,12 +73,11 @@ const char *get_font_path(const char *family, uint16_t size, const char *style,
 		*idx = (FT_Long)fc_index;
 
 		FcPatternDestroy(match);
-		success = true;
 	} else {
 		blog(LOG_WARNING, "no matching font for '%s' found",
 				family);
 	}
 
 	FcPatternDestroy(pattern);
-	return success ? &result[0] : NULL;
+	return result;
 }
@@ -1,10 +1,54 @@
 #include <util/file-serializer.h>
+#include <util/platform.h>
+#include <util/threading.h>
+#include <sys/stat.h>
 #include <ctype.h>
 #include <time.h>
 #include <obs-module.h>
 #include "find-font.h"
 
-DARRAY(struct font_path_info) font_list;
+/* The font list is kept per font directory and per font file, along with
+ * their modification times, so that only directories that changed since the
+ * cached list was written have to be parsed with FreeType again.  The list
+ * is refreshed on a background thread and swapped in as a whole; lookups go
+ * through an index of the family names sorted by hash instead of rating
+ * every known font. */
+
+struct font_file {
+	char     *path;
+	int64_t  mtime;
+	int64_t  size;
+
+	/* set while the file is shared between the live list and the one
+	 * being built by the scan */
+	bool     reused;
+
+	DARRAY(struct font_path_info) fonts;
+};
+
+struct font_dir {
+	char     *path;
+	int64_t  mtime;
+	DARRAY(struct font_file*) files;
+};
+
+struct font_index_entry {
+	uint32_t              hash;
+	struct font_path_info *info;
+};
+
+struct font_db {
+	DARRAY(struct font_dir)         dirs;
+	DARRAY(struct font_index_entry) index;
+};
+
+static pthread_mutex_t font_db_mutex = PTHREAD_MUTEX_INITIALIZER;
+static struct font_db  *font_db = NULL;
+static volatile long   font_db_generation = 0;
+
+static pthread_t       scan_thread;
+static bool            scan_thread_active = false;
+static volatile bool   stop_scan = false;
 
 static inline bool read_data(struct serializer *s, void *data, size_t size)
 {
@@ -50,64 +94,239 @@ static bool write_str(struct serializer *s, const char *str)
 	return true;
 }
 
-static bool load_cached_font_list(struct serializer *s)
+static bool read_font(struct serializer *s, struct font_path_info *info)
 {
-	bool success = true;
-	int count;
+	bool success;
+
+#define do_read(var) \
+	success = read_var(s, var); \
+	if (!success) return false
 
-	success = read_var(s, count);
+	success = read_str(s, &info->face_and_style);
 	if (!success) return false;
 
-	da_init(font_list);
-	da_resize(font_list, count);
+	do_read(info->full_len);
+	do_read(info->face_len);
+	do_read(info->is_bitmap);
+	do_read(info->num_sizes);
 
-#define do_read(var) \
-	success = read_var(s, var); \
-	if (!success) break
+	info->sizes = bmalloc(sizeof(int) * info->num_sizes);
+	success = read_data(s, info->sizes, sizeof(int) * info->num_sizes);
+	if (!success) return false;
 
-	for (int i = 0; i < count; i++) {
-		struct font_path_info *info = &font_list.array[i];
+	do_read(info->bold);
+	do_read(info->italic);
+	do_read(info->index);
 
-		success = read_str(s, &info->face_and_style);
-		if (!success) break;
+#undef do_read
 
-		do_read(info->full_len);
-		do_read(info->face_len);
-		do_read(info->is_bitmap);
-		do_read(info->num_sizes);
+	return true;
+}
 
-		info->sizes = bmalloc(sizeof(int) * info->num_sizes);
-		success = read_data(s, info->sizes,
-				sizeof(int) * info->num_sizes);
-		if (!success) break;
+static bool write_font(struct serializer *s, struct font_path_info *info)
+{
+	bool success;
 
-		do_read(info->bold);
+#define do_write(var) \
+	success = write_var(s, var); \
+	if (!success) return false
 
-		success = read_str(s, &info->path);
-		if (!success) break;
+	success = write_str(s, info->face_and_style);
+	if (!success) return false;
 
-		do_read(info->italic);
-		do_read(info->index);
+	do_write(info->full_len);
+	do_write(info->face_len);
+	do_write(info->is_bitmap);
+	do_write(info->num_sizes);
+
+	success = write_data(s, info->sizes, sizeof(int) * info->num_sizes);
+	if (!success) return false;
+
+	do_write(info->bold);
+	do_write(info->italic);
+	do_write(info->index);
+
+#undef do_write
+
+	return true;
+}
+
+static void font_file_free(struct font_file *file)
+{
+	for (size_t i = 0; i < file->fonts.num; i++)
+		font_path_info_free(file->fonts.array + i);
+	da_free(file->fonts);
+	bfree(file->path);
+	bfree(file);
+}
+
+/* files shared with another list are left alone */
+static void font_db_free(struct font_db *db)
+{
+	if (!db)
+		return;
+
+	for (size_t i = 0; i < db->dirs.num; i++) {
+		struct font_dir *dir = db->dirs.array + i;
+
+		for (size_t j = 0; j < dir->files.num; j++) {
+			struct font_file *file = dir->files.array[j];
+			if (!file->reused)
+				font_file_free(file);
+		}
+
+		da_free(dir->files);
+		bfree(dir->path);
 	}
 
-#undef do_read
+	da_free(db->dirs);
+	da_free(db->index);
+	bfree(db);
+}
 
-	if (!success) {
-		free_os_font_list();
+static void font_db_clear_reused(struct font_db *db)
+{
+	for (size_t i = 0; i < db->dirs.num; i++) {
+		struct font_dir *dir = db->dirs.array + i;
+
+		for (size_t j = 0; j < dir->files.num; j++)
+			dir->files.array[j]->reused = false;
+	}
+}
+
+static inline char upper(char ch)
+{
+	return (char)toupper((unsigned char)ch);
+}
+
+/* FNV-1a over the upper case characters, so that the hash of every prefix
+ * of a name can be computed incrementally */
+#define FAMILY_HASH_INIT 2166136261U
+
+static inline uint32_t family_hash_add(uint32_t hash, char ch)
+{
+	return (hash ^ (uint8_t)upper(ch)) * 16777619U;
+}
+
+static int cmp_index_entry(const void *a, const void *b)
+{
+	const struct font_index_entry *entry1 = a;
+	const struct font_index_entry *entry2 = b;
+
+	if (entry1->hash == entry2->hash)
+		return 0;
+	return entry1->hash < entry2->hash ? -1 : 1;
+}
+
+static void font_db_build_index(struct font_db *db)
+{
+	for (size_t i = 0; i < db->dirs.num; i++) {
+		struct font_dir *dir = db->dirs.array + i;
+
+		for (size_t j = 0; j < dir->files.num; j++) {
+			struct font_file *file = dir->files.array[j];
+
+			for (size_t k = 0; k < file->fonts.num; k++) {
+				struct font_index_entry entry;
+				struct font_path_info *info =
+					file->fonts.array + k;
+
+				entry.hash = FAMILY_HASH_INIT;
+				entry.info = info;
+
+				for (uint32_t c = 0; c < info->face_len; c++)
+					entry.hash = family_hash_add(entry.hash,
+						info->face_and_style[c]);
+
+				da_push_back(db->index, &entry);
+			}
+		}
+	}
+
+	if (db->index.num)
+		qsort(db->index.array, db->index.num,
+				sizeof(struct font_index_entry),
+				cmp_index_entry);
+}
+
+static size_t font_db_find_hash(struct font_db *db, uint32_t hash)
+{
+	size_t low = 0;
+	size_t high = db->index.num;
+
+	while (low < high) {
+		size_t mid = low + (high - low) / 2;
+
+		if (db->index.array[mid].hash < hash)
+			low = mid + 1;
+		else
+			high = mid;
+	}
+
+	return low;
+}
+
+static bool load_cached_font_file(struct serializer *s,
+		struct font_file *file)
+{
+	uint32_t count;
+
+	if (!read_str(s, &file->path))
+		return false;
+	if (!read_var(s, file->mtime) || !read_var(s, file->size))
+		return false;
+	if (!read_var(s, count))
 		return false;
+
+	for (uint32_t i = 0; i < count; i++) {
+		struct font_path_info *info = da_push_back_new(file->fonts);
+
+		if (!read_font(s, info))
+			return false;
+
+		info->path = bstrdup(file->path);
 	}
 
 	return true;
 }
 
-extern uint32_t get_font_checksum();
-static const uint32_t font_cache_ver = 1;
+static bool load_cached_font_list(struct serializer *s, struct font_db *db)
+{
+	uint32_t dir_count;
+
+	if (!read_var(s, dir_count))
+		return false;
+
+	for (uint32_t i = 0; i < dir_count; i++) {
+		struct font_dir *dir = da_push_back_new(db->dirs);
+		uint32_t file_count;
+
+		if (!read_str(s, &dir->path))
+			return false;
+		if (!read_var(s, dir->mtime) || !read_var(s, file_count))
+			return false;
+
+		for (uint32_t j = 0; j < file_count; j++) {
+			struct font_file *file = bzalloc(sizeof(*file));
+			bool success;
+
+			da_push_back(dir->files, &file);
+
+			success = load_cached_font_file(s, file);
+			if (!success)
+				return false;
+		}
+	}
+
+	return true;
+}
+
+static const uint32_t font_cache_ver = 2;
 
 bool load_cached_os_font_list(void)
 {
 	char *file_name = obs_module_config_path("font_data.bin");
-	uint32_t old_checksum;
-	uint32_t new_checksum;
+	struct font_db *db;
 	struct serializer s;
 	uint32_t ver;
 	bool success;
@@ -118,81 +337,85 @@ bool load_cached_os_font_list(void)
 	if (!success)
 		return false;
 
-	success = read_data(&s, &ver, sizeof(ver));
+	db = bzalloc(sizeof(*db));
 
-	if (!success || ver != font_cache_ver) {
+	success = read_data(&s, &ver, sizeof(ver));
+	if (success && ver == font_cache_ver)
+		success = load_cached_font_list(&s, db);
+	else
 		success = false;
-		goto finish;
-	}
 
-	success = s_read(&s, &old_checksum, sizeof(old_checksum));
-	new_checksum = get_font_checksum();
+	file_input_serializer_free(&s);
 
-	if (!success || old_checksum != new_checksum) {
-		success = false;
-		goto finish;
+	if (!success) {
+		font_db_free(db);
+		return false;
 	}
 
-	success = load_cached_font_list(&s);
+	font_db_build_index(db);
 
-finish:
-	file_input_serializer_free(&s);
-	return success;
+	pthread_mutex_lock(&font_db_mutex);
+	font_db_free(font_db);
+	font_db = db;
+	pthread_mutex_unlock(&font_db_mutex);
+
+	os_atomic_inc_long(&font_db_generation);
+	return true;
+}
+
+static bool save_font_file(struct serializer *s, struct font_file *file)
+{
+	uint32_t count = (uint32_t)file->fonts.num;
+
+	if (!write_str(s, file->path))
+		return false;
+	if (!write_var(s, file->mtime) || !write_var(s, file->size))
+		return false;
+	if (!write_var(s, count))
+		return false;
+
+	for (size_t i = 0; i < file->fonts.num; i++) {
+		if (!write_font(s, file->fonts.array + i))
+			return false;
+	}
+
+	return true;
 }
 
-void save_font_list(void)
+static void save_font_list(struct font_db *db)
 {
 	char *file_name = obs_module_config_path("font_data.bin");
-	uint32_t font_checksum = get_font_checksum();
-	int font_count = (int)font_list.num;
+	uint32_t dir_count = (uint32_t)db->dirs.num;
 	struct serializer s;
-	bool success = false;
+	bool success;
 
-	if (font_checksum)
-		success = file_output_serializer_init_safe(&s, file_name,
-				"tmp");
+	success = file_output_serializer_init_safe(&s, file_name, "tmp");
 	bfree(file_name);
 
 	if (!success)
 		return;
 
 	success = write_var(&s, font_cache_ver);
-	if (!success) return;
-	success = write_var(&s, font_checksum);
-	if (!success) return;
-	success = write_var(&s, font_count);
-	if (!success) return;
-
-#define do_write(var) \
-	success = write_var(&s, var); \
-	if (!success) break
-
-	for (size_t i = 0; i < font_list.num; i++) {
-		struct font_path_info *info = &font_list.array[i];
-
-		success = write_str(&s, info->face_and_style);
-		if (!success) break;
-
-		do_write(info->full_len);
-		do_write(info->face_len);
-		do_write(info->is_bitmap);
-		do_write(info->num_sizes);
-
-		success = write_data(&s, info->sizes,
-				sizeof(int) * info->num_sizes);
-		if (!success) break;
-
-		do_write(info->bold);
-
-		success = write_str(&s, info->path);
-		if (!success) break;
-
-		do_write(info->italic);
-		do_write(info->index);
+	if (!success) goto finish;
+	success = write_var(&s, dir_count);
+	if (!success) goto finish;
+
+	for (size_t i = 0; i < db->dirs.num; i++) {
+		struct font_dir *dir = db->dirs.array + i;
+		uint32_t file_count = (uint32_t)dir->files.num;
+
+		success = write_str(&s, dir->path) &&
+		          write_var(&s, dir->mtime) &&
+		          write_var(&s, file_count);
+		if (!success) goto finish;
+
+		for (size_t j = 0; j < dir->files.num; j++) {
+			success = save_font_file(&s, dir->files.array[j]);
+			if (!success) goto finish;
+		}
 	}
 
-#undef do_write
-
+finish:
 	file_output_serializer_free(&s);
 }
 
@@ -218,16 +441,16 @@ static void create_bitmap_sizes(struct font_path_info *info, FT_Face face)
 	info->num_sizes = (uint32_t)face->num_fixed_sizes;
 }
 
-static void add_font_path(FT_Face face,
+static void add_font_path(struct font_file *file,
+		FT_Face face,
 		FT_Long idx,
 		const char *family_in,
-		const char *style_in,
-		const char *path)
+		const char *style_in)
 {
 	struct dstr face_and_style = {0};
 	struct font_path_info info;
 
-	if (!family_in || !path)
+	if (!family_in)
 		return;
 
 	dstr_copy(&face_and_style, family_in);
@@ -257,18 +480,19 @@ static void add_font_path(FT_Face face,
 	info.italic         = !!(face->style_flags & FT_STYLE_FLAG_ITALIC);
 	info.index          = idx;
 
-	info.path           = bstrdup(path);
+	info.path           = bstrdup(file->path);
 
 	create_bitmap_sizes(&info, face);
-	da_push_back(font_list, &info);
+	da_push_back(file->fonts, &info);
 
 	/*blog(LOG_DEBUG, "name: %s\n\tstyle: %s\n\tpath: %s\n",
 			family_in,
 			style_in,
-			path);*/
+			file->path);*/
 }
 
-void build_font_path_info(FT_Face face, FT_Long idx, const char *path)
+static void build_font_path_info(struct font_file *file, FT_Face face,
+		FT_Long idx)
 {
 	FT_UInt num_names = FT_Get_Sfnt_Name_Count(face);
 	DARRAY(char*) family_names;
@@ -301,8 +525,8 @@ void build_font_path_info(FT_Face face, FT_Long idx, const char *path)
 	}
 
 	for (size_t i = 0; i < family_names.num; i++) {
-		add_font_path(face, idx, family_names.array[i],
-				face->style_name, path);
+		add_font_path(file, face, idx, family_names.array[i],
+				face->style_name);
 
 		/* first item isn't our allocation */
 		if (i > 0)
@@ -312,11 +536,218 @@ void build_font_path_info(FT_Face face, FT_Long idx, const char *path)
 	da_free(family_names);
 }
 
+/* files that can't be parsed are kept (without fonts) as well, so they
+ * aren't opened again on every scan */
+static struct font_file *load_font_file(FT_Library lib, const char *path,
+		const struct stat *stats)
+{
+	struct font_file *file = bzalloc(sizeof(*file));
+	FT_Face face;
+	FT_Long idx = 0;
+	FT_Long max_faces = 1;
+
+	file->path  = bstrdup(path);
+	file->mtime = (int64_t)stats->st_mtime;
+	file->size  = (int64_t)stats->st_size;
+
+	while (idx < max_faces) {
+		if (FT_New_Face(lib, path, idx, &face) != 0)
+			break;
+
+		build_font_path_info(file, face, idx++);
+		max_faces = face->num_faces;
+		FT_Done_Face(face);
+	}
+
+	return file;
+}
+
+static struct font_dir *find_font_dir(struct font_db *db, const char *path)
+{
+	if (!db)
+		return NULL;
+
+	for (size_t i = 0; i < db->dirs.num; i++) {
+		struct font_dir *dir = db->dirs.array + i;
+		if (strcmp(dir->path, path) == 0)
+			return dir;
+	}
+
+	return NULL;
+}
+
+static struct font_file *find_font_file(struct font_dir *dir,
+		const char *path)
+{
+	if (!dir)
+		return NULL;
+
+	for (size_t i = 0; i < dir->files.num; i++) {
+		struct font_file *file = dir->files.array[i];
+		if (strcmp(file->path, path) == 0)
+			return file;
+	}
+
+	return NULL;
+}
+
+/* returns false if the directory didn't change since the last scan, in which
+ * case all of its files are taken over from the current list */
+static bool scan_font_dir(FT_Library lib, struct font_db *old_db,
+		struct font_db *db, const char *path)
+{
+	struct font_dir  *old_dir = find_font_dir(old_db, path);
+	struct font_dir  *dir;
+	struct dstr      file_path = {0};
+	struct os_dirent *ent;
+	os_dir_t         *os_dir;
+	struct stat      stats;
+
+	if (os_stat(path, &stats) != 0)
+		return old_dir != NULL;
+
+	dir = da_push_back_new(db->dirs);
+	dir->path  = bstrdup(path);
+	dir->mtime = (int64_t)stats.st_mtime;
+
+	if (old_dir && old_dir->mtime == dir->mtime) {
+		for (size_t i = 0; i < old_dir->files.num; i++) {
+			struct font_file *file = old_dir->files.array[i];
+			file->reused = true;
+			da_push_back(dir->files, &file);
+		}
+
+		return false;
+	}
+
+	os_dir = os_opendir(path);
+	if (!os_dir)
+		return true;
+
+	while ((ent = os_readdir(os_dir)) != NULL) {
+		struct font_file *file;
+
+		if (os_atomic_load_bool(&stop_scan))
+			break;
+		if (ent->directory)
+			continue;
+
+		dstr_copy(&file_path, path);
+		dstr_cat_ch(&file_path, '/');
+		dstr_cat(&file_path, ent->d_name);
+
+		if (os_stat(file_path.array, &stats) != 0)
+			continue;
+
+		file = find_font_file(old_dir, file_path.array);
+		if (file && file->mtime == (int64_t)stats.st_mtime &&
+		    file->size == (int64_t)stats.st_size)
+			file->reused = true;
+		else
+			file = load_font_file(lib, file_path.array, &stats);
+
+		da_push_back(dir->files, &file);
+	}
+
+	os_closedir(os_dir);
+	dstr_free(&file_path);
+	return true;
+}
+
+static void *scan_thread_func(void *unused)
+{
+	struct font_db *old_db = font_db;
+	struct font_db *db;
+	FT_Library     lib = NULL;
+	char           **dirs;
+	bool           changed = false;
+	size_t         dirs_found = 0;
+	uint64_t       start_time = os_gettime_ns();
+
+	os_set_thread_name("text-ft2: font scan");
+
+	/* FT_Library objects can't be used from multiple threads */
+	if (FT_Init_FreeType(&lib) != 0)
+		return NULL;
+
+	db = bzalloc(sizeof(*db));
+	dirs = get_os_font_dirs();
+
+	for (char **dir = dirs; dir && *dir; dir++) {
+		if (os_atomic_load_bool(&stop_scan))
+			break;
+		if (find_font_dir(old_db, *dir))
+			dirs_found++;
+		if (scan_font_dir(lib, old_db, db, *dir))
+			changed = true;
+	}
+
+	/* a font directory was removed */
+	if (!old_db || dirs_found != old_db->dirs.num)
+		changed = true;
+
+	strlist_free(dirs);
+	FT_Done_FreeType(lib);
+
+	if (os_atomic_load_bool(&stop_scan) || !changed) {
+		font_db_free(db);
+		if (old_db)
+			font_db_clear_reused(old_db);
+		return NULL;
+	}
+
+	font_db_build_index(db);
+
+	pthread_mutex_lock(&font_db_mutex);
+	font_db = db;
+	pthread_mutex_unlock(&font_db_mutex);
+
+	os_atomic_inc_long(&font_db_generation);
+
+	font_db_free(old_db);
+	font_db_clear_reused(db);
+	save_font_list(db);
+
+	blog(LOG_INFO, "FT2-text: Updated font list (%d names) in %llu ms",
+			(int)db->index.num,
+			(unsigned long long)(os_gettime_ns() - start_time)
+				/ 1000000ULL);
+
+	UNUSED_PARAMETER(unused);
+	return NULL;
+}
+
+void load_os_font_list(void)
+{
+	if (scan_thread_active)
+		return;
+
+	os_atomic_set_bool(&stop_scan, false);
+	scan_thread_active = pthread_create(&scan_thread, NULL,
+			scan_thread_func, NULL) == 0;
+
+	if (!scan_thread_active)
+		blog(LOG_WARNING, "FT2-text: Failed to create font scan "
+		                  "thread");
+}
+
 void free_os_font_list(void)
 {
-	for (size_t i = 0; i < font_list.num; i++)
-		font_path_info_free(font_list.array + i);
-	da_free(font_list);
+	if (scan_thread_active) {
+		os_atomic_set_bool(&stop_scan, true);
+		pthread_join(scan_thread, NULL);
+		scan_thread_active = false;
+	}
+
+	pthread_mutex_lock(&font_db_mutex);
+	font_db_free(font_db);
+	font_db = NULL;
+	pthread_mutex_unlock(&font_db_mutex);
+}
+
+long get_os_font_list_generation(void)
+{
+	return os_atomic_load_long(&font_db_generation);
 }
 
 static inline size_t get_rating(struct font_path_info *info, struct dstr *cmp)
@@ -326,8 +757,8 @@ static inline size_t get_rating(struct font_path_info *info, struct dstr *cmp)
 	size_t num = 0;
 
 	do {
-		char ch1 = (char)toupper(*src);
-		char ch2 = (char)toupper(*dst);
+		char ch1 = upper(*src);
+		char ch2 = upper(*dst);
 
 		if (ch1 != ch2)
 			break;
@@ -338,15 +769,17 @@ static inline size_t get_rating(struct font_path_info *info, struct dstr *cmp)
 	return num;
 }
 
-const char *get_font_path(const char *family, uint16_t size, const char *style,
+char *get_font_path(const char *family, uint16_t size, const char *style,
 		uint32_t flags, FT_Long *idx)
 {
 	const char  *best_path     = NULL;
+	char        *path          = NULL;
 	double      best_rating    = 0.0;
 	struct dstr face_and_style = {0};
 	struct dstr style_str      = {0};
 	bool        bold           = !!(flags & OBS_FONT_BOLD);
 	bool        italic         = !!(flags & OBS_FONT_ITALIC);
+	uint32_t    hash           = FAMILY_HASH_INIT;
 
 	if (!family || !*family)
 		return NULL;
@@ -365,35 +798,61 @@ const char *get_font_path(const char *family, uint16_t size, const char *style,
 		dstr_cat_dstr(&face_and_style, &style_str);
 	}
 
-	for (size_t i = 0; i < font_list.num; i++) {
-		struct font_path_info *info = font_list.array + i;
+	pthread_mutex_lock(&font_db_mutex);
 
-		double rating = (double)get_rating(info, &face_and_style);
-		if (rating < info->face_len)
-			continue;
+	/* only fonts whose family name is a prefix of the requested face and
+	 * style can match, so look up every prefix in the index */
+	for (size_t len = 0; font_db && len <= face_and_style.len; len++) {
+		size_t i;
 
-		if (info->is_bitmap) {
-			int best_diff = 1000;
-			for (uint32_t j = 0; j < info->num_sizes; j++) {
-				int diff = abs(info->sizes[j] - size);
-				if (diff < best_diff)
-					best_diff = diff;
-			}
+		if (len)
+			hash = family_hash_add(hash,
+					face_and_style.array[len - 1]);
 
-			rating /= (double)(best_diff + 1.0);
-		}
+		i = font_db_find_hash(font_db, hash);
 
-		if (info->bold   == bold)   rating += 1.0;
-		if (info->italic == italic) rating += 1.0;
+		for (; i < font_db->index.num; i++) {
+			struct font_index_entry *entry = font_db->index.array + i;
+			struct font_path_info *info = entry->info;
+			double rating;
 
-		if (rating > best_rating) {
-			best_path   = info->path;
-			*idx        = info->index;
-			best_rating = rating;
+			if (entry->hash != hash)
+				break;
+			if (info->face_len != len)
+				continue;
+
+			rating = (double)get_rating(info, &face_and_style);
+			if (rating < info->face_len)
+				continue;
+
+			if (info->is_bitmap) {
+				int best_diff = 1000;
+				for (uint32_t j = 0; j < info->num_sizes; j++) {
+					int diff = abs(info->sizes[j] - size);
+					if (diff < best_diff)
+						best_diff = diff;
+				}
+
+				rating /= (double)(best_diff + 1.0);
+			}
+
+			if (info->bold   == bold)   rating += 1.0;
+			if (info->italic == italic) rating += 1.0;
+
+			if (rating > best_rating) {
+				best_path   = info->path;
+				*idx        = info->index;
+				best_rating = rating;
+			}
 		}
 	}
 
+	if (best_path)
+		path = bstrdup(best_path);
+
+	pthread_mutex_unlock(&font_db_mutex);
+
 	dstr_free(&style_str);
 	dstr_free(&face_and_style);
-	return best_path;
+	return path;
 }
@@ -31,11 +31,12 @@ static inline void font_path_info_free(struct font_path_info *info)
 	bfree(info->path);
 }
 
-extern void build_font_path_info(FT_Face face, FT_Long idx, const char *path);
 extern char *sfnt_name_to_utf8(FT_SfntName *sfnt_name);
+extern char **get_os_font_dirs(void);
 
 extern bool load_cached_os_font_list(void);
 extern void load_os_font_list(void);
 extern void free_os_font_list(void);
-extern const char *get_font_path(const char *family, uint16_t size,
+extern long get_os_font_list_generation(void);
+extern char *get_font_path(const char *family, uint16_t size,
 		const char *style, uint32_t flags, FT_Long *idx);
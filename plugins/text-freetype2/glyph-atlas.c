@@ -0,0 +1,267 @@
+/******************************************************************************
+Copyright (C) 2017 by OBS Studio contributors
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#include <obs-module.h>
+#include <util/threading.h>
+#include <ft2build.h>
+#include FT_FREETYPE_H
+#include "text-freetype2.h"
+
+/* Glyph atlases are shared by every source using the same font file, face
+ * and size, so the glyphs are only rasterized and uploaded once.  When an
+ * atlas runs out of space, the glyphs no source uses anymore are evicted and
+ * the rest are packed again.  A source whose text still doesn't fit in the
+ * shared atlas moves to a private one.  The list and the atlases themselves
+ * (including their FT_Face, which FreeType does not allow to be used from
+ * multiple threads) are protected by atlas_mutex.  The mutex is always taken
+ * before entering the graphics context. */
+
+extern uint32_t texbuf_w, texbuf_h;
+
+static pthread_mutex_t atlas_mutex = PTHREAD_MUTEX_INITIALIZER;
+static struct glyph_atlas *first_atlas = NULL;
+
+void glyph_atlas_lock(void)
+{
+	pthread_mutex_lock(&atlas_mutex);
+}
+
+void glyph_atlas_unlock(void)
+{
+	pthread_mutex_unlock(&atlas_mutex);
+}
+
+static void glyph_atlas_free_glyphs(struct glyph_atlas *atlas)
+{
+	for (uint32_t i = 0; i < num_cache_slots; i++) {
+		if (atlas->glyphs[i] != NULL) {
+			bfree(atlas->glyphs[i]);
+			atlas->glyphs[i] = NULL;
+		}
+	}
+}
+
+static void glyph_atlas_destroy(struct glyph_atlas *atlas)
+{
+	glyph_atlas_free_glyphs(atlas);
+
+	if (atlas->face)
+		FT_Done_Face(atlas->face);
+
+	obs_enter_graphics();
+	gs_texture_destroy(atlas->tex);
+	obs_leave_graphics();
+
+	bfree(atlas->texbuf);
+	bfree(atlas->path);
+	bfree(atlas);
+}
+
+static struct glyph_atlas *glyph_atlas_create(const char *path,
+		FT_Long index, uint16_t size)
+{
+	struct glyph_atlas *atlas = bzalloc(sizeof(struct glyph_atlas));
+
+	if (FT_New_Face(ft2_lib, path, index, &atlas->face) != 0) {
+		bfree(atlas);
+		return NULL;
+	}
+
+	FT_Set_Pixel_Sizes(atlas->face, 0, size);
+	FT_Select_Charmap(atlas->face, FT_ENCODING_UNICODE);
+
+	atlas->path = bstrdup(path);
+	atlas->index = index;
+	atlas->size = size;
+	atlas->refs = 1;
+	atlas->texbuf = bzalloc(texbuf_w * texbuf_h);
+	atlas->dirty_x = texbuf_w;
+	atlas->dirty_y = texbuf_h;
+
+	obs_enter_graphics();
+	atlas->tex = gs_texture_create(texbuf_w, texbuf_h, GS_A8, 1,
+			(const uint8_t **)&atlas->texbuf, GS_DYNAMIC);
+	obs_leave_graphics();
+
+	if (!atlas->tex) {
+		glyph_atlas_destroy(atlas);
+		return NULL;
+	}
+
+	cache_standard_glyphs(atlas);
+	return atlas;
+}
+
+struct glyph_atlas *glyph_atlas_get(const char *path, FT_Long index,
+		uint16_t size)
+{
+	struct glyph_atlas *atlas;
+
+	pthread_mutex_lock(&atlas_mutex);
+
+	atlas = first_atlas;
+	while (atlas) {
+		if (atlas->index == index && atlas->size == size &&
+		    strcmp(atlas->path, path) == 0) {
+			atlas->refs++;
+			break;
+		}
+
+		atlas = atlas->next;
+	}
+
+	if (!atlas) {
+		atlas = glyph_atlas_create(path, index, size);
+		if (atlas) {
+			atlas->shared = true;
+			atlas->next = first_atlas;
+			first_atlas = atlas;
+		}
+	}
+
+	pthread_mutex_unlock(&atlas_mutex);
+	return atlas;
+}
+
+void glyph_atlas_release(struct glyph_atlas *atlas)
+{
+	struct glyph_atlas **prev;
+
+	if (!atlas)
+		return;
+
+	pthread_mutex_lock(&atlas_mutex);
+
+	if (--atlas->refs == 0) {
+		if (atlas->shared) {
+			prev = &first_atlas;
+			while (*prev != atlas)
+				prev = &(*prev)->next;
+			*prev = atlas->next;
+		}
+
+		glyph_atlas_destroy(atlas);
+	}
+
+	pthread_mutex_unlock(&atlas_mutex);
+}
+
+/* Moves a source off a shared atlas that ran out of space and onto a new
+ * atlas of its own, which it can flush without affecting anyone else.
+ * Returns the atlas to use from now on, the given one if it isn't used by
+ * anyone else or no new atlas could be created.  Must be called with the
+ * atlas locked. */
+struct glyph_atlas *glyph_atlas_make_private(struct glyph_atlas *atlas)
+{
+	struct glyph_atlas *private_atlas;
+
+	if (atlas->refs == 1)
+		return atlas;
+
+	private_atlas = glyph_atlas_create(atlas->path, atlas->index,
+			atlas->size);
+	if (!private_atlas)
+		return atlas;
+
+	atlas->refs--;
+	return private_atlas;
+}
+
+/* Evicts the glyphs that no source uses and that aren't in keep, and packs
+ * the remaining ones again from the top of the atlas.  The glyphs that are
+ * kept move, so the generation is bumped for the sources using the atlas to
+ * rebuild their vertex buffers.  Must be called with the atlas locked. */
+struct kept_glyph {
+	FT_UInt index;
+	long    refs;
+};
+
+void glyph_atlas_evict(struct glyph_atlas *atlas, const wchar_t *keep)
+{
+	DARRAY(struct kept_glyph) kept;
+	uint8_t *keep_slot = bzalloc(num_cache_slots);
+	size_t evicted = 0;
+
+	da_init(kept);
+
+	for (const wchar_t *ch = keep; ch && *ch; ch++)
+		keep_slot[FT_Get_Char_Index(atlas->face, *ch)] = 1;
+
+	for (uint32_t i = 0; i < num_cache_slots; i++) {
+		struct glyph_info *glyph = atlas->glyphs[i];
+		if (!glyph)
+			continue;
+
+		if (glyph->refs > 0 || keep_slot[i]) {
+			struct kept_glyph *info = da_push_back_new(kept);
+			info->index = i;
+			info->refs = glyph->refs;
+		} else {
+			evicted++;
+		}
+
+		bfree(glyph);
+		atlas->glyphs[i] = NULL;
+	}
+
+	memset(atlas->texbuf, 0, texbuf_w * texbuf_h);
+	atlas->texbuf_x = 0;
+	atlas->texbuf_y = 0;
+
+	for (size_t i = 0; i < kept.num; i++) {
+		struct kept_glyph *info = kept.array + i;
+
+		if (rasterize_glyph(atlas, info->index))
+			atlas->glyphs[info->index]->refs = info->refs;
+	}
+
+	atlas->dirty_x = 0;
+	atlas->dirty_y = 0;
+	atlas->dirty_x2 = texbuf_w;
+	atlas->dirty_y2 = texbuf_h;
+	os_atomic_inc_long(&atlas->generation);
+
+	blog(LOG_DEBUG, "glyph atlas for %s: evicted %zu glyphs, kept %zu",
+			atlas->path, evicted, kept.num);
+
+	da_free(kept);
+	bfree(keep_slot);
+}
+
+/* Uploads the part of the atlas that changed.  Must be called with the atlas
+ * locked. */
+void glyph_atlas_upload(struct glyph_atlas *atlas)
+{
+	uint32_t x = atlas->dirty_x, y = atlas->dirty_y;
+	uint32_t w = atlas->dirty_x2 - x, h = atlas->dirty_y2 - y;
+
+	if (atlas->dirty_x2 <= x || atlas->dirty_y2 <= y)
+		return;
+
+	obs_enter_graphics();
+	if ((w == texbuf_w && h == texbuf_h) ||
+	    !gs_texture_set_image_rect(atlas->tex, x, y, w, h,
+			    atlas->texbuf + y * texbuf_w + x, texbuf_w))
+		gs_texture_set_image(atlas->tex, atlas->texbuf, texbuf_w,
+				false);
+	obs_leave_graphics();
+
+	atlas->dirty_x = texbuf_w;
+	atlas->dirty_y = texbuf_h;
+	atlas->dirty_x2 = 0;
+	atlas->dirty_y2 = 0;
+}
@@ -17,6 +17,7 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
 #include <obs-module.h>
 #include <util/platform.h>
+#include <util/threading.h>
 #include <ft2build.h>
 #include FT_FREETYPE_H
 #include <sys/stat.h>
@@ -64,8 +65,10 @@ static void init_plugin(void)
 		return;
 	}
 
-	if (!load_cached_os_font_list())
-		load_os_font_list();
+	/* the cached list is used right away, and refreshed in the
+	 * background; sources pick up the new list on their next tick */
+	load_cached_os_font_list();
+	load_os_font_list();
 
 	plugin_initialized = true;
 }
@@ -165,17 +168,10 @@ static void ft2_source_destroy(void *data)
 {
 	struct ft2_source *srcdata = data;
 
-	if (srcdata->font_face != NULL) {
-		FT_Done_Face(srcdata->font_face);
-		srcdata->font_face = NULL;
-	}
-	
-	for (uint32_t i = 0; i < num_cache_slots; i++) {
-		if (srcdata->cacheglyphs[i] != NULL) {
-			bfree(srcdata->cacheglyphs[i]);
-			srcdata->cacheglyphs[i] = NULL;
-		}
-	}
+	release_text_glyphs(srcdata);
+	da_free(srcdata->glyph_refs);
+	glyph_atlas_release(srcdata->atlas);
+	srcdata->atlas = NULL;
 
 	if (srcdata->font_name != NULL)
 		bfree(srcdata->font_name);
@@ -183,23 +179,19 @@ static void ft2_source_destroy(void *data)
 		bfree(srcdata->font_style);
 	if (srcdata->text != NULL)
 		bfree(srcdata->text);
-	if (srcdata->texbuf != NULL)
-		bfree(srcdata->texbuf);
-	if (srcdata->colorbuf != NULL)
-		bfree(srcdata->colorbuf);
 	if (srcdata->text_file != NULL)
 		bfree(srcdata->text_file);
 
 	obs_enter_graphics();
 
-	if (srcdata->tex != NULL) {
-		gs_texture_destroy(srcdata->tex);
-		srcdata->tex = NULL;
-	}
 	if (srcdata->vbuf != NULL) {
 		gs_vertexbuffer_destroy(srcdata->vbuf);
 		srcdata->vbuf = NULL;
 	}
+	if (srcdata->shadow_vbuf != NULL) {
+		gs_vertexbuffer_destroy(srcdata->shadow_vbuf);
+		srcdata->shadow_vbuf = NULL;
+	}
 	if (srcdata->draw_effect != NULL) {
 		gs_effect_destroy(srcdata->draw_effect);
 		srcdata->draw_effect = NULL;
@@ -215,23 +207,66 @@ static void ft2_source_render(void *data, gs_effect_t *effect)
 	struct ft2_source *srcdata = data;
 	if (srcdata == NULL) return;
 
-	if (srcdata->tex == NULL || srcdata->vbuf == NULL) return;
+	if (srcdata->atlas == NULL || srcdata->vbuf == NULL) return;
 	if (srcdata->text == NULL || *srcdata->text == 0) return;
+	if (srcdata->num_glyphs == 0) return;
 
 	gs_reset_blend_state();
 	if (srcdata->outline_text) draw_outlines(srcdata);
 	if (srcdata->drop_shadow) draw_drop_shadow(srcdata);
 
-	draw_uv_vbuffer(srcdata->vbuf, srcdata->tex,
-		srcdata->draw_effect, (uint32_t)wcslen(srcdata->text) * 6);
+	draw_text(srcdata);
 
 	UNUSED_PARAMETER(effect);
 }
 
+static bool init_font(struct ft2_source *srcdata)
+{
+	struct glyph_atlas *atlas;
+	FT_Long index;
+	char *path;
+
+	srcdata->font_list_generation = get_os_font_list_generation();
+
+	path = get_font_path(srcdata->font_name, srcdata->font_size,
+			srcdata->font_style, srcdata->font_flags, &index);
+	if (!path)
+		return false;
+
+	atlas = glyph_atlas_get(path, index, srcdata->font_size);
+	bfree(path);
+
+	if (atlas != srcdata->atlas)
+		release_text_glyphs(srcdata);
+	glyph_atlas_release(srcdata->atlas);
+	srcdata->atlas = atlas;
+
+	return atlas != NULL;
+}
+
+static void reload_font(struct ft2_source *srcdata)
+{
+	struct glyph_atlas *atlas = srcdata->atlas;
+
+	if (init_font(srcdata) && srcdata->atlas != atlas)
+		update_text_glyphs(srcdata);
+}
+
 static void ft2_video_tick(void *data, float seconds)
 {
 	struct ft2_source *srcdata = data;
 	if (srcdata == NULL) return;
+
+	// the font list was refreshed, the font may resolve differently now
+	if (srcdata->font_name &&
+	    srcdata->font_list_generation != get_os_font_list_generation())
+		reload_font(srcdata);
+
+	// another source sharing the atlas evicted glyphs, which moved ours
+	if (srcdata->atlas && srcdata->atlas_generation !=
+			os_atomic_load_long(&srcdata->atlas->generation))
+		update_text_glyphs(srcdata);
+
 	if (!srcdata->from_file || !srcdata->text_file) return;
 
 	if (os_gettime_ns() - srcdata->last_checked >= 1000000000) {
@@ -244,30 +279,13 @@ static void ft2_video_tick(void *data, float seconds)
 			else
 				load_text_from_file(srcdata,
 					srcdata->text_file);
-			cache_glyphs(srcdata, srcdata->text);
-			set_up_vertex_buffer(srcdata);
+			update_text_glyphs(srcdata);
 		}
 	}
 
 	UNUSED_PARAMETER(seconds);
 }
 
-static bool init_font(struct ft2_source *srcdata)
-{
-	FT_Long index;
-	const char *path = get_font_path(srcdata->font_name, srcdata->font_size,
-			srcdata->font_style, srcdata->font_flags, &index);
-	if (!path)
-		return false;
-
-	if (srcdata->font_face != NULL) {
-		FT_Done_Face(srcdata->font_face);
-		srcdata->font_face = NULL;
-	}
-
-	return FT_New_Face(ft2_lib, path, index, &srcdata->font_face) == 0;
-}
-
 static void ft2_source_update(void *data, obs_data_t *settings)
 {
 	struct ft2_source *srcdata = data;
@@ -360,7 +378,6 @@ static void ft2_source_update(void *data, obs_data_t *settings)
 		bfree(srcdata->font_style);
 		srcdata->font_name = NULL;
 		srcdata->font_style = NULL;
-		srcdata->max_h = 0;
 		vbuf_needs_update = true;
 	}
 
@@ -369,24 +386,11 @@ static void ft2_source_update(void *data, obs_data_t *settings)
 	srcdata->font_size  = font_size;
 	srcdata->font_flags = font_flags;
 
-	if (!init_font(srcdata) || srcdata->font_face == NULL) {
+	// the font list may still be being scanned; the font is loaded again
+	// once it has been updated
+	if (!init_font(srcdata))
 		blog(LOG_WARNING, "FT2-text: Failed to load font %s",
 			srcdata->font_name);
-		goto error;
-	}
-	else {
-		FT_Set_Pixel_Sizes(srcdata->font_face, 0, srcdata->font_size); 
-		FT_Select_Charmap(srcdata->font_face, FT_ENCODING_UNICODE);
-	}
-
-	if (srcdata->texbuf != NULL) {
-		bfree(srcdata->texbuf);
-		srcdata->texbuf = NULL;
-	}
-	srcdata->texbuf = bzalloc(texbuf_w * texbuf_h);
-
-	if (srcdata->font_face)
-		cache_standard_glyphs(srcdata);
 
 skip_font_load:
 	if (from_file) {
@@ -431,10 +435,8 @@ skip_font_load:
 		os_utf8_to_wcs_ptr(tmp, strlen(tmp), &srcdata->text);
 	}
 
-	if (srcdata->font_face) {
-		cache_glyphs(srcdata, srcdata->text);
-		set_up_vertex_buffer(srcdata);
-	}
+	if (srcdata->atlas)
+		update_text_glyphs(srcdata);
 
 error:
 	obs_data_release(font_obj);
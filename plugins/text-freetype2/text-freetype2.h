@@ -16,15 +16,49 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 ******************************************************************************/
 
 #include <obs-module.h>
+#include <util/darray.h>
 #include <ft2build.h>
+#include FT_FREETYPE_H
 
 #define num_cache_slots 65535
-#define src_glyph srcdata->cacheglyphs[glyph_index]
+#define src_glyph srcdata->atlas->glyphs[glyph_index]
 
 struct glyph_info {
 	float u, v, u2, v2;
 	int32_t w, h, xoff, yoff;
 	int32_t xadv;
+
+	/* number of sources whose text uses the glyph, only glyphs that no
+	 * source uses are evicted */
+	long     refs;
+	uint32_t ref_stamp;
+};
+
+/* shared by all sources using the same font file, face index and size,
+ * except for the private atlases of sources whose text did not fit */
+struct glyph_atlas {
+	char     *path;
+	FT_Long  index;
+	uint16_t size;
+	long     refs;
+	bool     shared;
+
+	FT_Face  face;
+	struct glyph_info *glyphs[num_cache_slots];
+	uint32_t max_h;
+
+	uint32_t texbuf_x, texbuf_y;
+	uint8_t  *texbuf;
+	gs_texture_t *tex;
+
+	/* area of texbuf that changed since the last upload */
+	uint32_t dirty_x, dirty_y, dirty_x2, dirty_y2;
+
+	/* bumped whenever glyphs are evicted and the rest are moved */
+	volatile long generation;
+	uint32_t ref_stamp;
+
+	struct glyph_atlas *next;
 };
 
 struct ft2_source {
@@ -40,21 +74,26 @@ struct ft2_source {
 	time_t m_timestamp;
 	uint64_t last_checked;
 
-	uint32_t cx, cy, max_h, custom_width;
-	uint32_t texbuf_x, texbuf_y;
+	uint32_t cx, cy, custom_width;
 	uint32_t color[2];
-	uint32_t *colorbuf;
 
 	int32_t cur_scroll, scroll_speed;
 
-	gs_texture_t *tex;
-
-	struct glyph_info *cacheglyphs[num_cache_slots];
-
-	FT_Face	font_face;
+	long font_list_generation;
+	struct glyph_atlas *atlas;
+	long atlas_generation;
+	DARRAY(FT_UInt) glyph_refs;
 
-	uint8_t *texbuf;
+	/* the vertex buffers are reused while the text fits, and only the
+	 * vertices in use are uploaded, once per change of the text.  Outlines
+	 * and drop shadows use a second buffer with the same vertices in
+	 * black. */
 	gs_vertbuffer_t *vbuf;
+	gs_vertbuffer_t *shadow_vbuf;
+	uint32_t vbuf_capacity;
+	uint32_t num_glyphs;
+	bool vbuf_dirty;
+	bool shadow_vbuf_dirty;
 
 	gs_effect_t *draw_effect;
 	bool outline_text, drop_shadow;
@@ -73,6 +112,7 @@ static void ft2_video_tick(void *data, float seconds);
 
 void draw_outlines(struct ft2_source *srcdata);
 void draw_drop_shadow(struct ft2_source *srcdata);
+void draw_text(struct ft2_source *srcdata);
 
 static uint32_t ft2_source_get_width(void *data);
 static uint32_t ft2_source_get_height(void *data);
@@ -87,8 +127,20 @@ time_t get_modified_timestamp(char *filename);
 void load_text_from_file(struct ft2_source *srcdata, const char *filename);
 void read_from_end(struct ft2_source *srcdata, const char *filename);
 
-void cache_standard_glyphs(struct ft2_source *srcdata);
-void cache_glyphs(struct ft2_source *srcdata, wchar_t *cache_glyphs);
+struct glyph_atlas *glyph_atlas_get(const char *path, FT_Long index,
+		uint16_t size);
+void glyph_atlas_release(struct glyph_atlas *atlas);
+struct glyph_atlas *glyph_atlas_make_private(struct glyph_atlas *atlas);
+void glyph_atlas_evict(struct glyph_atlas *atlas, const wchar_t *keep);
+void glyph_atlas_upload(struct glyph_atlas *atlas);
+void glyph_atlas_lock(void);
+void glyph_atlas_unlock(void);
+
+bool rasterize_glyph(struct glyph_atlas *atlas, FT_UInt glyph_index);
+void cache_standard_glyphs(struct glyph_atlas *atlas);
+bool cache_glyphs(struct glyph_atlas *atlas, const wchar_t *cache_glyphs);
+void update_text_glyphs(struct ft2_source *srcdata);
+void release_text_glyphs(struct ft2_source *srcdata);
 
 void set_up_vertex_buffer(struct ft2_source *srcdata);
 void fill_vertex_buffer(struct ft2_source *srcdata);
@@ -17,6 +17,7 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
 #include <obs-module.h>
 #include <util/platform.h>
+#include <util/threading.h>
 #include <ft2build.h>
 #include FT_FREETYPE_H
 #include <sys/stat.h>
@@ -28,54 +29,134 @@ float offsets[16] = { -2.0f, 0.0f, 0.0f, -2.0f, 2.0f, 0.0f, 2.0f, 0.0f,
 
 extern uint32_t texbuf_w, texbuf_h;
 
-void draw_outlines(struct ft2_source *srcdata)
+// The buffers are sized for the longest text so far, only the vertices that
+// are drawn are uploaded.  Must be called within the graphics context.
+static void flush_vertices(gs_vertbuffer_t *vbuf, uint32_t num_verts)
 {
-	// Horrible (hopefully temporary) solution for outlines.
-	uint32_t *tmp;
+	struct gs_vb_data *vdata = gs_vertexbuffer_get_data(vbuf);
+	size_t capacity = vdata->num;
 
-	struct gs_vb_data *vdata = gs_vertexbuffer_get_data(srcdata->vbuf);
+	vdata->num = num_verts;
+	gs_vertexbuffer_flush(vbuf);
+	vdata->num = capacity;
+}
+
+// Outlines and drop shadows draw the same vertices in black, from a buffer
+// of their own, so neither buffer is uploaded again until the text changes.
+static void load_shadow_vertices(struct ft2_source *srcdata)
+{
+	struct gs_vb_data *vdata, *sdata;
+	uint32_t num_verts = srcdata->num_glyphs * 6;
+
+	if (!srcdata->shadow_vbuf_dirty)
+		return;
+
+	vdata = gs_vertexbuffer_get_data(srcdata->vbuf);
+	sdata = gs_vertexbuffer_get_data(srcdata->shadow_vbuf);
+	memcpy(sdata->points, vdata->points, sizeof(struct vec3) * num_verts);
+	memcpy(sdata->tvarray[0].array, vdata->tvarray[0].array,
+			sizeof(struct vec2) * num_verts);
+	flush_vertices(srcdata->shadow_vbuf, num_verts);
+
+	srcdata->shadow_vbuf_dirty = false;
+}
+
+static void load_text_vertices(struct ft2_source *srcdata)
+{
+	if (!srcdata->vbuf_dirty)
+		return;
+
+	flush_vertices(srcdata->vbuf, srcdata->num_glyphs * 6);
+	srcdata->vbuf_dirty = false;
+}
 
+void draw_outlines(struct ft2_source *srcdata)
+{
+	// Horrible (hopefully temporary) solution for outlines.
 	if (!srcdata->text)
 		return;
 
-	tmp = vdata->colors;
-	vdata->colors = srcdata->colorbuf;
+	load_shadow_vertices(srcdata);
 
 	gs_matrix_push();
 	for (int32_t i = 0; i < 8; i++) {
 		gs_matrix_translate3f(offsets[i * 2], offsets[(i * 2) + 1],
 			0.0f);
-		draw_uv_vbuffer(srcdata->vbuf, srcdata->tex,
-			srcdata->draw_effect,
-			(uint32_t)wcslen(srcdata->text) * 6);
+		draw_uv_vbuffer(srcdata->shadow_vbuf, srcdata->atlas->tex,
+			srcdata->draw_effect, srcdata->num_glyphs * 6);
 	}
 	gs_matrix_identity();
 	gs_matrix_pop();
-
-	vdata->colors = tmp;
 }
 
 void draw_drop_shadow(struct ft2_source *srcdata)
 {
 	// Horrible (hopefully temporary) solution for drop shadow.
-	uint32_t *tmp;
-
-	struct gs_vb_data *vdata = gs_vertexbuffer_get_data(srcdata->vbuf);
-
 	if (!srcdata->text)
 		return;
 
-	tmp = vdata->colors;
-	vdata->colors = srcdata->colorbuf;
+	load_shadow_vertices(srcdata);
 
 	gs_matrix_push();
 	gs_matrix_translate3f(4.0f, 4.0f, 0.0f);
-	draw_uv_vbuffer(srcdata->vbuf, srcdata->tex,
-		srcdata->draw_effect, (uint32_t)wcslen(srcdata->text) * 6);
+	draw_uv_vbuffer(srcdata->shadow_vbuf, srcdata->atlas->tex,
+		srcdata->draw_effect, srcdata->num_glyphs * 6);
 	gs_matrix_identity();
 	gs_matrix_pop();
+}
 
-	vdata->colors = tmp;
+void draw_text(struct ft2_source *srcdata)
+{
+	load_text_vertices(srcdata);
+
+	draw_uv_vbuffer(srcdata->vbuf, srcdata->atlas->tex,
+		srcdata->draw_effect, srcdata->num_glyphs * 6);
+}
+
+static void destroy_vertex_buffers(struct ft2_source *srcdata)
+{
+	if (srcdata->vbuf != NULL) {
+		gs_vertbuffer_t *tmpvbuf = srcdata->vbuf;
+		srcdata->vbuf = NULL;
+		gs_vertexbuffer_destroy(tmpvbuf);
+	}
+	if (srcdata->shadow_vbuf != NULL) {
+		gs_vertbuffer_t *tmpvbuf = srcdata->shadow_vbuf;
+		srcdata->shadow_vbuf = NULL;
+		gs_vertexbuffer_destroy(tmpvbuf);
+	}
+}
+
+// Grows the vertex buffers to fit len glyphs.  Must be called within the
+// graphics context.
+static bool reserve_vertex_buffer(struct ft2_source *srcdata, uint32_t len)
+{
+	uint32_t capacity = srcdata->vbuf_capacity ?
+		srcdata->vbuf_capacity : 64;
+	struct gs_vb_data *sdata;
+
+	if (srcdata->vbuf != NULL && len <= srcdata->vbuf_capacity)
+		return true;
+
+	while (capacity < len)
+		capacity *= 2;
+
+	destroy_vertex_buffers(srcdata);
+
+	srcdata->vbuf_capacity = 0;
+	srcdata->vbuf = create_uv_vbuffer(capacity * 6, true);
+	srcdata->shadow_vbuf = create_uv_vbuffer(capacity * 6, true);
+	if (srcdata->vbuf == NULL || srcdata->shadow_vbuf == NULL) {
+		destroy_vertex_buffers(srcdata);
+		return false;
+	}
+
+	sdata = gs_vertexbuffer_get_data(srcdata->shadow_vbuf);
+	for (size_t i = 0; i < capacity * 6; i++)
+		sdata->colors[i] = 0xFF000000;
+
+	srcdata->vbuf_capacity = capacity;
+	return true;
 }
 
 void set_up_vertex_buffer(struct ft2_source *srcdata)
@@ -84,30 +165,25 @@ void set_up_vertex_buffer(struct ft2_source *srcdata)
 	uint32_t x = 0, space_pos = 0, word_width = 0;
 	size_t len;
 
-	if (!srcdata->text)
+	if (!srcdata->text || !srcdata->atlas)
 		return;
 
 	if (srcdata->custom_width >= 100)
 		srcdata->cx = srcdata->custom_width;
 	else
 		srcdata->cx = get_ft2_text_width(srcdata->text, srcdata);
-	srcdata->cy = srcdata->max_h;
+	srcdata->cy = srcdata->atlas->max_h;
 
 	obs_enter_graphics();
-	if (srcdata->vbuf != NULL) {
-		gs_vertbuffer_t *tmpvbuf = srcdata->vbuf;
-		srcdata->vbuf = NULL;
-		gs_vertexbuffer_destroy(tmpvbuf);
-	}
+	srcdata->num_glyphs = 0;
 
-	if (*srcdata->text == 0) {
+	if (*srcdata->text == 0 ||
+	    !reserve_vertex_buffer(srcdata,
+		    (uint32_t)wcslen(srcdata->text))) {
 		obs_leave_graphics();
 		return;
 	}
 
-	srcdata->vbuf = create_uv_vbuffer((uint32_t)wcslen(srcdata->text) * 6,
-			true);
-
 	if (srcdata->custom_width <= 100) goto skip_word_wrap;
 	if (!srcdata->word_wrap) goto skip_word_wrap;
 
@@ -134,9 +210,10 @@ void set_up_vertex_buffer(struct ft2_source *srcdata)
 		if (srcdata->text[i] == L' ')
 			space_pos = i;
 	next_char:;
-		glyph_index = FT_Get_Char_Index(srcdata->font_face,
+		glyph_index = FT_Get_Char_Index(srcdata->atlas->face,
 			srcdata->text[i]);
-		word_width += src_glyph->xadv;
+		if (src_glyph != NULL)
+			word_width += src_glyph->xadv;
 	eos_skip:;
 	}
 
@@ -155,31 +232,23 @@ void fill_vertex_buffer(struct ft2_source *srcdata)
 
 	FT_UInt glyph_index = 0;
 
-	uint32_t dx = 0, dy = srcdata->max_h, max_y = dy;
+	uint32_t max_h = srcdata->atlas->max_h;
+	uint32_t dx = 0, dy = max_h, max_y = dy;
 	uint32_t cur_glyph = 0;
 	size_t len = wcslen(srcdata->text);
 
-	if (srcdata->colorbuf != NULL) {
-		bfree(srcdata->colorbuf);
-		srcdata->colorbuf = NULL;
-	}
-	srcdata->colorbuf = bzalloc(sizeof(uint32_t)*wcslen(srcdata->text) * 6);
-	for (size_t i = 0; i < len * 6; i++) {
-		srcdata->colorbuf[i] = 0xFF000000;
-	}
-
 	for (size_t i = 0; i < len; i++) {
 	add_linebreak:;
 		if (srcdata->text[i] != L'\n') goto draw_glyph;
 		dx = 0; i++;
-		dy += srcdata->max_h + 4;
+		dy += max_h + 4;
 		if (i == wcslen(srcdata->text)) goto skip_glyph;
 		if (srcdata->text[i] == L'\n') goto add_linebreak;
 	draw_glyph:;
 		// Skip filthy dual byte Windows line breaks
 		if (srcdata->text[i] == L'\r') goto skip_glyph;
 
-		glyph_index = FT_Get_Char_Index(srcdata->font_face,
+		glyph_index = FT_Get_Char_Index(srcdata->atlas->face,
 			srcdata->text[i]);
 		if (src_glyph == NULL)
 			goto skip_glyph;
@@ -188,7 +257,7 @@ void fill_vertex_buffer(struct ft2_source *srcdata)
 
 		if (dx + src_glyph->xadv > srcdata->custom_width) {
 			dx = 0;
-			dy += srcdata->max_h + 4;
+			dy += max_h + 4;
 		}
 
 	skip_custom_width:;
@@ -213,115 +282,200 @@ void fill_vertex_buffer(struct ft2_source *srcdata)
 	skip_glyph:;
 	}
 
+	srcdata->num_glyphs = cur_glyph;
+	srcdata->vbuf_dirty = true;
+	srcdata->shadow_vbuf_dirty = true;
 	srcdata->cy = max_y;
 }
 
-void cache_standard_glyphs(struct ft2_source *srcdata)
-{
-	for (uint32_t i = 0; i < num_cache_slots; i++) {
-		if (srcdata->cacheglyphs[i] != NULL) {
-			bfree(srcdata->cacheglyphs[i]);
-			srcdata->cacheglyphs[i] = NULL;
-		}
-	}
-
-	srcdata->texbuf_x = 0;
-	srcdata->texbuf_y = 0;
-
-	cache_glyphs(srcdata, L"abcdefghijklmnopqrstuvwxyz" \
-		L"ABCDEFGHIJKLMNOPQRSTUVWXYZ1234567890" \
-		L"!@#$%^&*()-_=+,<.>/?\\|[]{}`~ \'\"\0");
-}
+static const wchar_t *standard_glyphs = L"abcdefghijklmnopqrstuvwxyz" \
+	L"ABCDEFGHIJKLMNOPQRSTUVWXYZ1234567890" \
+	L"!@#$%^&*()-_=+,<.>/?\\|[]{}`~ \'\"\0";
 
+#define atlas_glyph atlas->glyphs[glyph_index]
 #define glyph_pos x + (y*slot->bitmap.pitch)
 #define buf_pos (dx + x) + ((dy + y) * texbuf_w)
 
-void cache_glyphs(struct ft2_source *srcdata, wchar_t *cache_glyphs)
+// Rasterizes a glyph into the next free spot of the atlas.  Returns false if
+// the atlas ran out of space.
+bool rasterize_glyph(struct glyph_atlas *atlas, FT_UInt glyph_index)
 {
-	FT_GlyphSlot slot;
-	FT_UInt glyph_index = 0;
+	FT_GlyphSlot slot = atlas->face->glyph;
+	uint32_t dx = atlas->texbuf_x, dy = atlas->texbuf_y;
 
-	if (!srcdata->font_face || !cache_glyphs)
-		return;
+	FT_Load_Glyph(atlas->face, glyph_index, FT_LOAD_DEFAULT);
+	FT_Render_Glyph(slot, FT_RENDER_MODE_NORMAL);
 
-	slot = srcdata->font_face->glyph;
+	uint32_t g_w = slot->bitmap.width;
+	uint32_t g_h = slot->bitmap.rows;
 
-	uint32_t dx = srcdata->texbuf_x, dy = srcdata->texbuf_y;
+	if (atlas->max_h < g_h) atlas->max_h = g_h;
+
+	if (dx + g_w >= texbuf_w) {
+		dx = 0;
+		dy += atlas->max_h + 1;
+	}
+
+	if (dy + g_h >= texbuf_h)
+		return false;
+
+	atlas_glyph = bzalloc(sizeof(struct glyph_info));
+	atlas_glyph->u = (float)dx / (float)texbuf_w;
+	atlas_glyph->u2 = (float)(dx + g_w) / (float)texbuf_w;
+	atlas_glyph->v = (float)dy / (float)texbuf_h;
+	atlas_glyph->v2 = (float)(dy + g_h) / (float)texbuf_h;
+	atlas_glyph->w = g_w;
+	atlas_glyph->h = g_h;
+	atlas_glyph->yoff = slot->bitmap_top;
+	atlas_glyph->xoff = slot->bitmap_left;
+	atlas_glyph->xadv = slot->advance.x >> 6;
+
+	for (uint32_t y = 0; y < g_h; y++) {
+		for (uint32_t x = 0; x < g_w; x++)
+			atlas->texbuf[buf_pos] =
+				slot->bitmap.buffer[glyph_pos];
+	}
 
-	int32_t cached_glyphs = 0;
+	if (atlas->dirty_x > dx) atlas->dirty_x = dx;
+	if (atlas->dirty_y > dy) atlas->dirty_y = dy;
+	if (atlas->dirty_x2 < dx + g_w) atlas->dirty_x2 = dx + g_w;
+	if (atlas->dirty_y2 < dy + g_h) atlas->dirty_y2 = dy + g_h;
+
+	dx += (g_w + 1);
+	if (dx >= texbuf_w) {
+		dx = 0;
+		dy += atlas->max_h;
+	}
+
+	atlas->texbuf_x = dx;
+	atlas->texbuf_y = dy;
+	return true;
+}
+
+// Rasterizes the glyphs that aren't in the atlas yet.  Returns the number of
+// glyphs added, or -1 if the atlas ran out of space.
+static int add_glyphs(struct glyph_atlas *atlas, const wchar_t *cache_glyphs)
+{
+	FT_UInt glyph_index = 0;
+	int cached_glyphs = 0;
 	size_t len = wcslen(cache_glyphs);
 
 	for (size_t i = 0; i < len; i++) {
-		glyph_index = FT_Get_Char_Index(srcdata->font_face,
-			cache_glyphs[i]);
+		glyph_index = FT_Get_Char_Index(atlas->face, cache_glyphs[i]);
+		if (atlas_glyph != NULL)
+			continue;
 
-		if (src_glyph != NULL)
-			goto skip_glyph;
+		if (!rasterize_glyph(atlas, glyph_index))
+			return -1;
 
-		FT_Load_Glyph(srcdata->font_face, glyph_index, FT_LOAD_DEFAULT);
-		FT_Render_Glyph(slot, FT_RENDER_MODE_NORMAL);
+		cached_glyphs++;
+	}
 
-		uint32_t g_w = slot->bitmap.width;
-		uint32_t g_h = slot->bitmap.rows;
+	return cached_glyphs;
+}
 
-		if (srcdata->max_h < g_h) srcdata->max_h = g_h;
+// Must be called with the atlas locked.  Sources sharing the atlas may be
+// drawing with it at any time, so new glyphs are written into the existing
+// texture instead of replacing it, and only the area they were written to is
+// uploaded.  When the atlas is full, the glyphs no source uses are evicted.
+// Returns false if the glyphs still didn't fit into a shared atlas.
+bool cache_glyphs(struct glyph_atlas *atlas, const wchar_t *cache_glyphs)
+{
+	bool fits = true;
 
-		if (dx + g_w >= texbuf_w) {
-			dx = 0;
-			dy += srcdata->max_h + 1;
-		}
+	if (!atlas || !cache_glyphs)
+		return true;
 
-		if (dy + g_h >= texbuf_h) {
-			blog(LOG_WARNING, "Out of space trying to render glyphs");
-			break;
-		}
+	if (add_glyphs(atlas, cache_glyphs) < 0) {
+		glyph_atlas_evict(atlas, cache_glyphs);
 
-		src_glyph = bzalloc(sizeof(struct glyph_info));
-		src_glyph->u = (float)dx / (float)texbuf_w;
-		src_glyph->u2 = (float)(dx + g_w) / (float)texbuf_w;
-		src_glyph->v = (float)dy / (float)texbuf_h;
-		src_glyph->v2 = (float)(dy + g_h) / (float)texbuf_h;
-		src_glyph->w = g_w;
-		src_glyph->h = g_h;
-		src_glyph->yoff = slot->bitmap_top;
-		src_glyph->xoff = slot->bitmap_left;
-		src_glyph->xadv = slot->advance.x >> 6;
-
-		for (uint32_t y = 0; y < g_h; y++) {
-			for (uint32_t x = 0; x < g_w; x++)
-				srcdata->texbuf[buf_pos] =
-					slot->bitmap.buffer[glyph_pos];
+		if (add_glyphs(atlas, cache_glyphs) < 0) {
+			if (atlas->refs > 1)
+				fits = false;
+			else
+				blog(LOG_WARNING, "Out of space trying to "
+						"render glyphs");
 		}
+	}
 
-		dx += (g_w + 1);
-		if (dx >= texbuf_w) {
-			dx = 0;
-			dy += srcdata->max_h;
-		}
+	glyph_atlas_upload(atlas);
+	return fits;
+}
 
-		cached_glyphs++;
-	skip_glyph:;
+void cache_standard_glyphs(struct glyph_atlas *atlas)
+{
+	cache_glyphs(atlas, standard_glyphs);
+}
+
+// Every source counts as a user of the glyphs in its text, so they are not
+// evicted while it shows them.  Must be called with the atlas locked.
+static void ref_text_glyphs(struct ft2_source *srcdata)
+{
+	struct glyph_atlas *atlas = srcdata->atlas;
+	FT_UInt glyph_index;
+	uint32_t stamp = ++atlas->ref_stamp;
+
+	if (!srcdata->text)
+		return;
+
+	for (const wchar_t *ch = srcdata->text; *ch; ch++) {
+		glyph_index = FT_Get_Char_Index(atlas->face, *ch);
+		if (atlas_glyph == NULL || atlas_glyph->ref_stamp == stamp)
+			continue;
+
+		atlas_glyph->ref_stamp = stamp;
+		atlas_glyph->refs++;
+		da_push_back(srcdata->glyph_refs, &glyph_index);
 	}
+}
 
-	srcdata->texbuf_x = dx;
-	srcdata->texbuf_y = dy;
+static void unref_text_glyphs(struct ft2_source *srcdata)
+{
+	struct glyph_atlas *atlas = srcdata->atlas;
 
-	if (cached_glyphs > 0) {
+	for (size_t i = 0; i < srcdata->glyph_refs.num; i++) {
+		FT_UInt glyph_index = srcdata->glyph_refs.array[i];
+		if (atlas_glyph != NULL)
+			atlas_glyph->refs--;
+	}
 
-		obs_enter_graphics();
+	da_resize(srcdata->glyph_refs, 0);
+}
 
-		if (srcdata->tex != NULL) {
-			gs_texture_t *tmp_texture = NULL;
-			tmp_texture = srcdata->tex;
-			srcdata->tex = NULL;
-			gs_texture_destroy(tmp_texture);
-		}
+void release_text_glyphs(struct ft2_source *srcdata)
+{
+	if (!srcdata->atlas)
+		return;
 
-		srcdata->tex = gs_texture_create(texbuf_w, texbuf_h,
-			GS_A8, 1, (const uint8_t **)&srcdata->texbuf, 0);
+	glyph_atlas_lock();
+	unref_text_glyphs(srcdata);
+	glyph_atlas_unlock();
+}
 
-		obs_leave_graphics();
+// Also called when another source evicted glyphs from the atlas, which moves
+// the glyphs of this source's text.
+void update_text_glyphs(struct ft2_source *srcdata)
+{
+	struct glyph_atlas *atlas = srcdata->atlas;
+
+	if (!atlas)
+		return;
+
+	glyph_atlas_lock();
+	unref_text_glyphs(srcdata);
+
+	if (!cache_glyphs(atlas, srcdata->text)) {
+		atlas = glyph_atlas_make_private(atlas);
+		srcdata->atlas = atlas;
+
+		if (!cache_glyphs(atlas, srcdata->text))
+			blog(LOG_WARNING, "Out of space trying to render glyphs");
 	}
+
+	srcdata->atlas_generation = os_atomic_load_long(&atlas->generation);
+	ref_text_glyphs(srcdata);
+	set_up_vertex_buffer(srcdata);
+	glyph_atlas_unlock();
 }
 
 time_t get_modified_timestamp(char *filename)
@@ -491,7 +645,8 @@ void read_from_end(struct ft2_source *srcdata, const char *filename)
 
 uint32_t get_ft2_text_width(wchar_t *text, struct ft2_source *srcdata)
 {
-	FT_GlyphSlot slot = srcdata->font_face->glyph;
+	struct glyph_atlas *atlas = srcdata->atlas;
+	FT_GlyphSlot slot = atlas->face->glyph;
 	FT_UInt glyph_index = 0;
 	uint32_t w = 0, max_w = 0;
 	size_t len;
@@ -501,14 +656,21 @@ uint32_t get_ft2_text_width(wchar_t *text, struct ft2_source *srcdata)
 
 	len = wcslen(text);
 	for (size_t i = 0; i < len; i++) {
-		glyph_index = FT_Get_Char_Index(srcdata->font_face, text[i]);
-		FT_Load_Glyph(srcdata->font_face, glyph_index, FT_LOAD_DEFAULT);
+		if (text[i] == L'\n') {
+			w = 0;
+			continue;
+		}
 
-		if (text[i] == L'\n') w = 0;
-		else {
+		glyph_index = FT_Get_Char_Index(atlas->face, text[i]);
+		if (atlas_glyph != NULL) {
+			w += atlas_glyph->xadv;
+		} else {
+			FT_Load_Glyph(atlas->face, glyph_index,
+					FT_LOAD_DEFAULT);
 			w += slot->advance.x >> 6;
-			if (w > max_w) max_w = w;
 		}
+
+		if (w > max_w) max_w = w;
 	}
 
 	return max_w;
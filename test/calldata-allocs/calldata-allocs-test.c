@@ -0,0 +1,122 @@
+/*
+ * Checks that emitting a signal with stack calldata does not touch the heap.
+ *
+ * The allocations are counted by a base allocator installed before anything
+ * else runs, and with btotal_allocs when libobs is built with
+ * LIBOBS_COUNT_ALLOCATIONS.  Heap calldata is emitted as well, to make sure
+ * the counting actually sees allocations.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <util/bmem.h>
+#include <util/threading.h>
+#include <callback/signal.h>
+
+#define EMITS 10000
+
+static volatile long allocs;
+static double volume_sum;
+static void *last_source;
+
+static void *count_malloc(size_t size)
+{
+	os_atomic_inc_long(&allocs);
+	return malloc(size);
+}
+
+static void *count_realloc(void *ptr, size_t size)
+{
+	os_atomic_inc_long(&allocs);
+	return realloc(ptr, size);
+}
+
+static struct base_allocator counting_allocator = {
+	count_malloc, count_realloc, free
+};
+
+static void volume_changed(void *data, calldata_t *cd)
+{
+	last_source = calldata_ptr_fast(cd, "source");
+	volume_sum += calldata_float_fast(cd, "volume");
+
+	UNUSED_PARAMETER(data);
+}
+
+static void emit_stack(signal_handler_t *handler, signal_id_t id, int i)
+{
+	CALLDATA_FIXED_DECL(cd, CALLDATA_FIXED_SIZE);
+	calldata_set_ptr(&cd, "source", handler);
+	calldata_set_float(&cd, "volume", (float)(i % 2));
+
+	signal_handler_signal_id(handler, id, &cd);
+}
+
+static void emit_heap(signal_handler_t *handler, signal_id_t id, int i)
+{
+	calldata_t cd = {0};
+	calldata_set_ptr(&cd, "source", handler);
+	calldata_set_float(&cd, "volume", (float)(i % 2));
+
+	signal_handler_signal_id(handler, id, &cd);
+	calldata_free(&cd);
+}
+
+static long count_emits(signal_handler_t *handler, signal_id_t id,
+		void (*emit)(signal_handler_t*, signal_id_t, int),
+		long *total_allocs)
+{
+	long start = os_atomic_load_long(&allocs);
+	long start_total = btotal_allocs();
+
+	for (int i = 0; i < EMITS; i++)
+		emit(handler, id, i);
+
+	*total_allocs = btotal_allocs() - start_total;
+	return os_atomic_load_long(&allocs) - start;
+}
+
+int main(void)
+{
+	signal_handler_t *handler;
+	signal_id_t id;
+	long stack_allocs, heap_allocs;
+	long stack_total, heap_total;
+	bool success;
+
+	base_set_allocator(&counting_allocator);
+
+	handler = signal_handler_create();
+	signal_handler_add(handler, "void volume(ptr source, float volume)");
+	signal_handler_connect(handler, "volume", volume_changed, NULL);
+	id = signal_get_id("volume");
+
+	/* the first emit may set up per-thread state */
+	emit_stack(handler, id, 0);
+	volume_sum = 0.0;
+
+	stack_allocs = count_emits(handler, id, emit_stack, &stack_total);
+	success = last_source == handler && volume_sum == EMITS / 2;
+
+	heap_allocs = count_emits(handler, id, emit_heap, &heap_total);
+
+	printf("%d emits: %ld allocations with stack calldata, %ld with heap "
+			"calldata (btotal_allocs: %ld, %ld)\n", EMITS,
+			stack_allocs, heap_allocs, stack_total, heap_total);
+
+	if (!success)
+		printf("FAIL: the callback did not receive the parameters\n");
+	if (stack_allocs != 0 || stack_total != 0) {
+		printf("FAIL: stack calldata allocated\n");
+		success = false;
+	}
+	if (heap_allocs == 0) {
+		printf("FAIL: the allocator did not count heap calldata\n");
+		success = false;
+	}
+
+	signal_handler_disconnect(handler, "volume", volume_changed, NULL);
+	signal_handler_destroy(handler);
+
+	return success ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,247 @@
+/*
+ * Decode throughput of the threading modes the media source can use.
+ *
+ * A test stream is generated by encoding a moving pattern, then decoded with
+ * the same thread_count and thread_type settings libff applies for the
+ * media source's decoder threads and frame/slice threading options.  Reports
+ * frames per second for each mode and checks that every frame comes out once
+ * and in order.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <inttypes.h>
+
+#include <libavcodec/avcodec.h>
+#include <libavutil/opt.h>
+#include <libavutil/time.h>
+
+#define WIDTH   1920
+#define HEIGHT  1080
+#define FPS     60
+#define FRAMES  240
+
+struct stream {
+	AVPacket *packets;
+	int      count;
+};
+
+struct mode {
+	const char *name;
+	int        thread_count;
+	int        thread_type;
+};
+
+static void draw_frame(AVFrame *frame, int idx)
+{
+	for (int y = 0; y < frame->height; y++) {
+		uint8_t *row = frame->data[0] + y * frame->linesize[0];
+
+		for (int x = 0; x < frame->width; x++)
+			row[x] = (uint8_t)(x + y * 2 + idx * 4);
+	}
+
+	for (int plane = 1; plane < 3; plane++) {
+		for (int y = 0; y < frame->height / 2; y++) {
+			uint8_t *row = frame->data[plane] +
+				y * frame->linesize[plane];
+			memset(row, 128 + (plane == 1 ? idx : -idx) % 64,
+					frame->width / 2);
+		}
+	}
+}
+
+static void add_packet(struct stream *stream, AVPacket *packet)
+{
+	stream->packets = realloc(stream->packets,
+			(stream->count + 1) * sizeof(AVPacket));
+	stream->packets[stream->count++] = *packet;
+}
+
+static bool generate_stream(const char *encoder_name, struct stream *stream)
+{
+	AVCodec *codec = avcodec_find_encoder_by_name(encoder_name);
+	AVCodecContext *context;
+	AVFrame *frame;
+	bool success = false;
+
+	if (!codec)
+		return false;
+
+	context = avcodec_alloc_context3(codec);
+	context->width     = WIDTH;
+	context->height    = HEIGHT;
+	context->pix_fmt   = AV_PIX_FMT_YUV420P;
+	context->time_base = (AVRational){1, FPS};
+	context->gop_size  = FPS * 2;
+	context->bit_rate  = 20 * 1000 * 1000;
+	context->max_b_frames = 2;
+
+	if (strcmp(encoder_name, "libx264") == 0)
+		av_opt_set(context->priv_data, "preset", "veryfast", 0);
+
+	frame = av_frame_alloc();
+	frame->width  = WIDTH;
+	frame->height = HEIGHT;
+	frame->format = AV_PIX_FMT_YUV420P;
+
+	if (avcodec_open2(context, codec, NULL) < 0 ||
+	    av_frame_get_buffer(frame, 32) < 0)
+		goto fail;
+
+	for (int i = 0; i <= FRAMES; i++) {
+		AVFrame *in = i < FRAMES ? frame : NULL;
+		AVPacket packet;
+		int got_packet;
+
+		do {
+			av_init_packet(&packet);
+			packet.data = NULL;
+			packet.size = 0;
+			got_packet = 0;
+
+			if (in) {
+				av_frame_make_writable(frame);
+				draw_frame(frame, i);
+				frame->pts = i;
+			}
+
+			if (avcodec_encode_video2(context, &packet, in,
+						&got_packet) < 0)
+				goto fail;
+			if (got_packet)
+				add_packet(stream, &packet);
+
+		/* drain the delayed frames once all frames are in */
+		} while (!in && got_packet);
+	}
+
+	success = stream->count == FRAMES;
+
+fail:
+	av_frame_free(&frame);
+	avcodec_free_context(&context);
+	return success;
+}
+
+static void free_stream(struct stream *stream)
+{
+	for (int i = 0; i < stream->count; i++)
+		av_packet_unref(&stream->packets[i]);
+	free(stream->packets);
+	memset(stream, 0, sizeof(*stream));
+}
+
+static bool decode_stream(enum AVCodecID codec_id, const struct stream *stream,
+		const struct mode *mode)
+{
+	AVCodec *codec = avcodec_find_decoder(codec_id);
+	AVCodecContext *context = avcodec_alloc_context3(codec);
+	AVFrame *frame = av_frame_alloc();
+	int64_t start, elapsed;
+	int64_t next_pts = 0;
+	int decoded = 0;
+	bool in_order = true;
+
+	context->thread_count = mode->thread_count;
+	context->thread_type  = mode->thread_type;
+	context->refcounted_frames = 1;
+
+	if (avcodec_open2(context, codec, NULL) < 0) {
+		av_frame_free(&frame);
+		avcodec_free_context(&context);
+		return false;
+	}
+
+	start = av_gettime_relative();
+
+	for (int i = 0; i <= stream->count; i++) {
+		AVPacket packet;
+		int got_frame;
+
+		if (i < stream->count) {
+			packet = stream->packets[i];
+		} else {
+			av_init_packet(&packet);
+			packet.data = NULL;
+			packet.size = 0;
+		}
+
+		do {
+			got_frame = 0;
+			if (avcodec_decode_video2(context, frame, &got_frame,
+						&packet) < 0)
+				break;
+
+			if (got_frame) {
+				int64_t pts = av_frame_get_best_effort_timestamp(
+						frame);
+				if (pts != next_pts++)
+					in_order = false;
+
+				decoded++;
+				av_frame_unref(frame);
+			}
+
+		/* drain the frames the decoder threads still hold */
+		} while (i == stream->count && got_frame);
+	}
+
+	elapsed = av_gettime_relative() - start;
+	if (elapsed <= 0)
+		elapsed = 1;
+
+	printf("  %-22s %3d threads: %7.1f fps%s\n", mode->name,
+			context->thread_count,
+			(double)decoded * 1000000.0 / (double)elapsed,
+			decoded == stream->count && in_order ?
+			"" : "  (frames lost or out of order)");
+
+	av_frame_free(&frame);
+	avcodec_free_context(&context);
+	return decoded == stream->count && in_order;
+}
+
+int main(void)
+{
+	static const char *encoders[] = {"libx264", "mpeg4"};
+	static const struct mode modes[] = {
+		{"single thread",        1, 0},
+		{"slice threading",      0, FF_THREAD_SLICE},
+		{"frame threading",      0, FF_THREAD_FRAME},
+		{"frame+slice threading", 0, FF_THREAD_FRAME | FF_THREAD_SLICE},
+	};
+	bool success = true;
+
+	avcodec_register_all();
+	av_log_set_level(AV_LOG_ERROR);
+
+	for (size_t e = 0; e < sizeof(encoders) / sizeof(encoders[0]); e++) {
+		AVCodec *codec = avcodec_find_encoder_by_name(encoders[e]);
+		struct stream stream = {0};
+
+		if (!codec)
+			continue;
+
+		if (!generate_stream(encoders[e], &stream)) {
+			printf("%s: failed to generate the test stream\n",
+					encoders[e]);
+			free_stream(&stream);
+			success = false;
+			continue;
+		}
+
+		printf("%s, %dx%d, %d frames:\n", codec->name, WIDTH, HEIGHT,
+				stream.count);
+
+		for (size_t m = 0; m < sizeof(modes) / sizeof(modes[0]); m++)
+			success = decode_stream(codec->id, &stream,
+					&modes[m]) && success;
+
+		free_stream(&stream);
+	}
+
+	return success ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,156 @@
+/*
+ * Throughput of the ffmpeg output's write queue at high bitrates.
+ *
+ * An encoder thread queues video and audio packets as fast as it can while
+ * the write thread drains them in batches and writes them to a temporary
+ * file, the same way obs-ffmpeg-output does.  Reports how much faster than
+ * real time each bitrate can be written, and checks that every packet
+ * arrives once and in order.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <inttypes.h>
+#include <util/platform.h>
+#include <util/threading.h>
+#include <obs.h>
+#include "obs-ffmpeg-write-queue.h"
+
+#define FPS              60
+#define SECONDS          20
+#define AUDIO_BITRATE    320
+#define AUDIO_PER_SECOND (48000 / 1024)
+
+struct bench {
+	struct write_queue queue;
+	volatile bool      stop;
+	FILE               *file;
+
+	int                video_kbps;
+	int64_t            packets_in;
+	int64_t            packets_out;
+	int64_t            bytes_out;
+	int64_t            batches;
+	int64_t            next_pts;
+	bool               in_order;
+};
+
+static void *encode_thread(void *data)
+{
+	struct bench *b = data;
+	int video_size = b->video_kbps * 1000 / 8 / FPS;
+	int audio_size = AUDIO_BITRATE * 1000 / 8 / AUDIO_PER_SECOND;
+	int64_t pts = 0;
+
+	for (int sec = 0; sec < SECONDS; sec++) {
+		for (int i = 0; i < FPS + AUDIO_PER_SECOND; i++) {
+			bool video = i % 2 == 0 && i / 2 < FPS;
+			AVPacket packet;
+
+			av_init_packet(&packet);
+			if (av_new_packet(&packet,
+					video ? video_size : audio_size) < 0)
+				continue;
+
+			memset(packet.data, i, packet.size);
+			packet.stream_index = video ? 0 : 1;
+			packet.pts = packet.dts = pts++;
+
+			write_queue_push(&b->queue, &packet);
+			b->packets_in++;
+		}
+	}
+
+	os_atomic_set_bool(&b->stop, true);
+	write_queue_wake(&b->queue);
+	return NULL;
+}
+
+static void write_packets(struct bench *b)
+{
+	AVPacket packets[MAX_WRITE_BATCH];
+	bool more = true;
+
+	while (more) {
+		size_t count = write_queue_pop(&b->queue, packets, &more);
+		if (count)
+			b->batches++;
+
+		for (size_t i = 0; i < count; i++) {
+			AVPacket *packet = &packets[i];
+
+			if (packet->pts != b->next_pts++)
+				b->in_order = false;
+
+			fwrite(packet->data, 1, packet->size, b->file);
+			b->bytes_out += packet->size;
+			b->packets_out++;
+			av_free_packet(packet);
+		}
+	}
+}
+
+static void *write_thread(void *data)
+{
+	struct bench *b = data;
+
+	while (write_queue_wait(&b->queue) == 0) {
+		/* everything was queued before stop was set */
+		bool stop = os_atomic_load_bool(&b->stop);
+
+		write_packets(b);
+		if (stop)
+			break;
+	}
+
+	return NULL;
+}
+
+static bool run(int video_kbps)
+{
+	struct bench b = {0};
+	pthread_t encoder, writer;
+	uint64_t start, elapsed;
+	double seconds;
+	bool success;
+
+	b.video_kbps = video_kbps;
+	b.in_order = true;
+	b.file = tmpfile();
+	if (!b.file || !write_queue_init(&b.queue))
+		return false;
+
+	start = os_gettime_ns();
+	pthread_create(&writer, NULL, write_thread, &b);
+	pthread_create(&encoder, NULL, encode_thread, &b);
+	pthread_join(encoder, NULL);
+	pthread_join(writer, NULL);
+	elapsed = os_gettime_ns() - start;
+	seconds = (double)elapsed / 1000000000.0;
+
+	success = b.in_order && b.packets_in == b.packets_out;
+
+	printf("%4d Mbps: %8.1f MB/s, %8.0f packets/s, %5.1f packets per "
+			"batch, %6.1fx real time%s\n",
+			video_kbps / 1000,
+			(double)b.bytes_out / seconds / (1024.0 * 1024.0),
+			(double)b.packets_out / seconds,
+			b.batches ? (double)b.packets_out / b.batches : 0.0,
+			(double)SECONDS / seconds,
+			success ? "" : " (FAILED)");
+
+	write_queue_free(&b.queue);
+	fclose(b.file);
+	return success;
+}
+
+int main(void)
+{
+	static const int bitrates[] = {50000, 100000, 250000, 500000};
+	bool success = true;
+
+	for (size_t i = 0; i < sizeof(bitrates) / sizeof(bitrates[0]); i++)
+		success = run(bitrates[i]) && success;
+
+	return success ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,309 @@
+/*
+ * Measures how fast packets move from a demuxer thread to a decoder thread
+ * through ff_packet_queue, one packet at a time and in batches.
+ *
+ *   libff-throughput            synthetic packets, queue overhead only
+ *   libff-throughput <file>     demuxes and decodes <file> without pacing
+ *
+ * The demuxer side stops when the decoder's queue is over its byte or
+ * duration limit, the same way ff-demuxer does.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <pthread.h>
+
+#include <libavcodec/avcodec.h>
+#include <libavformat/avformat.h>
+#include <libavutil/time.h>
+
+#include <libff/ff-packet-queue.h>
+#include <libff/ff-compat.h>
+
+#define SYNTHETIC_PACKETS  (2 * 1000 * 1000)
+#define QUEUE_BYTES        (5 * 256 * 1024)
+#define QUEUE_MS           5000
+#define MAX_BATCH          32
+
+struct pipeline {
+	struct ff_packet_queue queue;
+	int                    batch;
+	bool                   done;
+
+	/* synthetic mode */
+	int64_t                packets;
+
+	/* file mode */
+	AVFormatContext        *format;
+	AVStream               *stream;
+	AVCodecContext         *codec;
+
+	int64_t                packets_in;
+	int64_t                packets_out;
+	int64_t                frames;
+	int64_t                bytes;
+	int64_t                full_waits;
+};
+
+static bool queue_full(struct pipeline *p)
+{
+	int64_t queued_ms;
+
+	if (p->queue.total_size > QUEUE_BYTES)
+		return true;
+	if (!p->stream)
+		return false;
+
+	queued_ms = av_rescale_q(p->queue.total_duration,
+			p->stream->time_base, (AVRational){1, 1000});
+	return queued_ms > QUEUE_MS;
+}
+
+/* ------------------------------------------------------------------------- */
+
+static void put_packets(struct pipeline *p, struct ff_packet *packets,
+		int count)
+{
+	while (queue_full(p)) {
+		p->full_waits++;
+		av_usleep(1000);
+	}
+
+	if (p->batch > 1)
+		packet_queue_put_batch(&p->queue, packets, count);
+	else
+		for (int i = 0; i < count; i++)
+			packet_queue_put(&p->queue, &packets[i]);
+
+	p->packets_in += count;
+}
+
+static void *synthetic_demux_thread(void *data)
+{
+	struct pipeline *p = data;
+	struct ff_packet packets[MAX_BATCH];
+	int count = 0;
+
+	memset(packets, 0, sizeof(packets));
+
+	for (int64_t i = 0; i < p->packets; i++) {
+		struct ff_packet *packet = &packets[count++];
+
+		av_init_packet(&packet->base);
+		packet->base.size = 1024;
+		packet->base.duration = 1;
+
+		if (count == p->batch) {
+			put_packets(p, packets, count);
+			count = 0;
+		}
+	}
+
+	if (count)
+		put_packets(p, packets, count);
+
+	packet_queue_put_flush_packet(&p->queue);
+	return NULL;
+}
+
+static void *file_demux_thread(void *data)
+{
+	struct pipeline *p = data;
+	struct ff_packet packets[MAX_BATCH];
+	int count = 0;
+
+	memset(packets, 0, sizeof(packets));
+
+	for (;;) {
+		struct ff_packet *packet = &packets[count];
+
+		av_init_packet(&packet->base);
+		if (av_read_frame(p->format, &packet->base) < 0)
+			break;
+
+		if (packet->base.stream_index != p->stream->index) {
+			av_free_packet(&packet->base);
+			continue;
+		}
+
+		p->bytes += packet->base.size;
+
+		if (++count == p->batch) {
+			put_packets(p, packets, count);
+			count = 0;
+		}
+	}
+
+	if (count)
+		put_packets(p, packets, count);
+
+	packet_queue_put_flush_packet(&p->queue);
+	return NULL;
+}
+
+static void decode_packet(struct pipeline *p, AVFrame *frame,
+		struct ff_packet *packet)
+{
+	AVPacket pkt = packet->base;
+	int complete = 0;
+
+	if (p->codec->codec_type == AVMEDIA_TYPE_VIDEO) {
+		avcodec_decode_video2(p->codec, frame, &complete, &pkt);
+		p->frames += complete != 0;
+		return;
+	}
+
+	while (pkt.size > 0) {
+		int ret = avcodec_decode_audio4(p->codec, frame, &complete,
+				&pkt);
+		if (ret < 0)
+			break;
+
+		pkt.data += ret;
+		pkt.size -= ret;
+		p->frames += complete != 0;
+	}
+}
+
+static void *decode_thread(void *data)
+{
+	struct pipeline *p = data;
+	struct ff_packet packets[MAX_BATCH];
+	AVFrame *frame = p->codec ? av_frame_alloc() : NULL;
+
+	while (!p->done) {
+		int count = packet_queue_get_batch(&p->queue, packets,
+				p->batch, true);
+		if (count <= 0)
+			break;
+
+		for (int i = 0; i < count; i++) {
+			struct ff_packet *packet = &packets[i];
+
+			if (packet->base.data ==
+					p->queue.flush_packet.base.data) {
+				p->done = true;
+				continue;
+			}
+
+			if (frame)
+				decode_packet(p, frame, packet);
+
+			av_free_packet(&packet->base);
+			p->packets_out++;
+		}
+	}
+
+	av_frame_free(&frame);
+	return NULL;
+}
+
+/* ------------------------------------------------------------------------- */
+
+static bool run(struct pipeline *p, void *(*demux)(void *), const char *name)
+{
+	pthread_t demux_thread, decoder_thread;
+	int64_t start, elapsed;
+
+	if (!packet_queue_init(&p->queue))
+		return false;
+
+	start = av_gettime_relative();
+
+	pthread_create(&decoder_thread, NULL, decode_thread, p);
+	pthread_create(&demux_thread, NULL, demux, p);
+	pthread_join(demux_thread, NULL);
+	pthread_join(decoder_thread, NULL);
+
+	elapsed = av_gettime_relative() - start;
+	if (elapsed <= 0)
+		elapsed = 1;
+
+	printf("%-10s batch %2d: %9"PRId64" packets, %8"PRId64" frames, "
+			"%10.0f packets/s, %8.1f frames/s, %6"PRId64
+			" full waits\n",
+			name, p->batch, p->packets_out, p->frames,
+			(double)p->packets_out * 1000000.0 / (double)elapsed,
+			(double)p->frames * 1000000.0 / (double)elapsed,
+			p->full_waits);
+
+	packet_queue_free(&p->queue);
+	return p->packets_in == p->packets_out;
+}
+
+static bool run_synthetic(int batch)
+{
+	struct pipeline p;
+
+	memset(&p, 0, sizeof(p));
+	p.batch = batch;
+	p.packets = SYNTHETIC_PACKETS;
+
+	return run(&p, synthetic_demux_thread, "synthetic");
+}
+
+static bool open_codec(struct pipeline *p, const char *file)
+{
+	AVCodec *codec;
+	int idx;
+
+	if (avformat_open_input(&p->format, file, NULL, NULL) < 0)
+		return false;
+	if (avformat_find_stream_info(p->format, NULL) < 0)
+		return false;
+
+	idx = av_find_best_stream(p->format, AVMEDIA_TYPE_VIDEO, -1, -1,
+			&codec, 0);
+	if (idx < 0)
+		idx = av_find_best_stream(p->format, AVMEDIA_TYPE_AUDIO, -1,
+				-1, &codec, 0);
+	if (idx < 0)
+		return false;
+
+	p->stream = p->format->streams[idx];
+	p->codec = p->stream->codec;
+	p->codec->thread_count = 0;
+
+	return avcodec_open2(p->codec, codec, NULL) == 0;
+}
+
+static bool run_file(const char *file, int batch)
+{
+	struct pipeline p;
+	bool success;
+
+	memset(&p, 0, sizeof(p));
+	p.batch = batch;
+
+	if (!open_codec(&p, file)) {
+		fprintf(stderr, "could not open '%s'\n", file);
+		avformat_close_input(&p.format);
+		return false;
+	}
+
+	success = run(&p, file_demux_thread, "file");
+
+	avcodec_close(p.codec);
+	avformat_close_input(&p.format);
+	return success;
+}
+
+int main(int argc, char *argv[])
+{
+	static const int batches[] = {1, 8, MAX_BATCH};
+	bool success = true;
+
+	av_register_all();
+	av_log_set_level(AV_LOG_ERROR);
+
+	for (size_t i = 0; i < sizeof(batches) / sizeof(batches[0]); i++) {
+		if (argc > 1)
+			success = run_file(argv[1], batches[i]) && success;
+		else
+			success = run_synthetic(batches[i]) && success;
+	}
+
+	return success ? EXIT_SUCCESS : EXIT_FAILURE;
+}
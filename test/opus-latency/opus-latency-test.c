@@ -0,0 +1,296 @@
+/*
+ * Measures the delay and latency of the Opus encoder settings offered by
+ * obs-ffmpeg-opus.
+ *
+ * For every application and frame duration, a burst of noise is encoded with
+ * libopus through libavcodec and decoded again without pre-skip.  The lag of
+ * the decoded signal is found by cross-correlation and compared with the
+ * codec's initial_padding, which is what the encoder reports to libobs as its
+ * delay.  The latency added by the encoder is that delay plus one frame of
+ * packetization.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <inttypes.h>
+
+#include <libavcodec/avcodec.h>
+#include <libavutil/channel_layout.h>
+#include <libavutil/opt.h>
+#include <libavutil/time.h>
+
+#define SAMPLE_RATE     48000
+#define BITRATE         128000
+#define SIGNAL_SAMPLES  SAMPLE_RATE
+#define SILENCE_SAMPLES (SAMPLE_RATE / 10)
+#define MAX_LAG         2400
+#define LAG_TOLERANCE   12
+
+struct result {
+	int     frame_size;
+	int64_t reported_delay;
+	int     measured_delay;
+	double  encode_us;
+};
+
+static float *input;
+static float *output;
+static int output_size;
+static int output_capacity;
+
+static void generate_input(void)
+{
+	uint32_t seed = 1;
+
+	input = calloc(SIGNAL_SAMPLES, sizeof(float));
+
+	/* silence, then a burst of noise */
+	for (int i = SILENCE_SAMPLES; i < SIGNAL_SAMPLES; i++) {
+		seed = seed * 1664525 + 1013904223;
+		input[i] = (float)((int32_t)seed >> 16) / 65536.0f;
+	}
+}
+
+static void append_output(const AVFrame *frame)
+{
+	if (output_size + frame->nb_samples > output_capacity) {
+		output_capacity = (output_size + frame->nb_samples) * 2;
+		output = realloc(output, output_capacity * sizeof(float));
+	}
+
+	for (int i = 0; i < frame->nb_samples; i++) {
+		float sample;
+
+		if (frame->format == AV_SAMPLE_FMT_S16 ||
+		    frame->format == AV_SAMPLE_FMT_S16P)
+			sample = ((const int16_t*)frame->data[0])[i] / 32768.0f;
+		else
+			sample = ((const float*)frame->data[0])[i];
+
+		output[output_size++] = sample;
+	}
+}
+
+static void decode_packet(AVCodecContext *decoder, AVPacket *packet,
+		AVFrame *frame)
+{
+	int got_frame = 0;
+
+	if (avcodec_decode_audio4(decoder, frame, &got_frame, packet) >= 0 &&
+	    got_frame)
+		append_output(frame);
+}
+
+/* lag of the output against the input with the highest correlation */
+static int find_lag(void)
+{
+	double best = 0.0;
+	int best_lag = -1;
+
+	for (int lag = 0; lag < MAX_LAG; lag++) {
+		double sum = 0.0;
+
+		for (int i = SILENCE_SAMPLES; i < SIGNAL_SAMPLES; i++) {
+			if (i + lag >= output_size)
+				break;
+			sum += input[i] * output[i + lag];
+		}
+
+		if (sum > best) {
+			best = sum;
+			best_lag = lag;
+		}
+	}
+
+	return best_lag;
+}
+
+static AVCodecContext *open_encoder(const char *application,
+		const char *duration)
+{
+	AVCodec *codec = avcodec_find_encoder_by_name("libopus");
+	AVCodecContext *context;
+	AVDictionary *opts = NULL;
+	int ret;
+
+	if (!codec)
+		return NULL;
+
+	context = avcodec_alloc_context3(codec);
+	context->bit_rate       = BITRATE;
+	context->sample_rate    = SAMPLE_RATE;
+	context->channels       = 1;
+	context->channel_layout = AV_CH_LAYOUT_MONO;
+	context->sample_fmt     = AV_SAMPLE_FMT_FLT;
+
+	/* the same options obs-ffmpeg-opus passes */
+	av_dict_set(&opts, "application", application, 0);
+	av_dict_set(&opts, "frame_duration", duration, 0);
+	av_dict_set_int(&opts, "packet_loss", 0, 0);
+
+	ret = avcodec_open2(context, codec, &opts);
+	av_dict_free(&opts);
+
+	if (ret < 0) {
+		avcodec_free_context(&context);
+		return NULL;
+	}
+
+	return context;
+}
+
+static AVCodecContext *open_decoder(void)
+{
+	AVCodec *codec = avcodec_find_decoder_by_name("libopus");
+	AVCodecContext *context;
+
+	if (!codec)
+		codec = avcodec_find_decoder(AV_CODEC_ID_OPUS);
+	if (!codec)
+		return NULL;
+
+	/* no extradata, so the decoder doesn't drop the pre-skip and the
+	 * full encoder delay shows up in the output */
+	context = avcodec_alloc_context3(codec);
+	context->sample_rate    = SAMPLE_RATE;
+	context->channels       = 1;
+	context->channel_layout = AV_CH_LAYOUT_MONO;
+
+	if (avcodec_open2(context, codec, NULL) < 0)
+		avcodec_free_context(&context);
+
+	return context;
+}
+
+static bool measure(const char *application, const char *duration,
+		struct result *result)
+{
+	AVCodecContext *encoder = open_encoder(application, duration);
+	AVCodecContext *decoder = open_decoder();
+	AVFrame *frame = av_frame_alloc();
+	AVFrame *decoded = av_frame_alloc();
+	int64_t encode_time = 0;
+	int frames = 0;
+	int pos = 0;
+	bool success = false;
+
+	output_size = 0;
+
+	if (!encoder || !decoder || !frame || !decoded)
+		goto fail;
+
+	frame->nb_samples     = encoder->frame_size;
+	frame->format         = encoder->sample_fmt;
+	frame->channel_layout = encoder->channel_layout;
+	if (av_frame_get_buffer(frame, 0) < 0)
+		goto fail;
+
+	for (;;) {
+		AVPacket packet;
+		int got_packet = 0;
+		int64_t start;
+		AVFrame *in = frame;
+
+		if (pos < SIGNAL_SAMPLES) {
+			float *samples = (float*)frame->data[0];
+
+			for (int i = 0; i < frame->nb_samples; i++, pos++)
+				samples[i] = pos < SIGNAL_SAMPLES ?
+					input[pos] : 0.0f;
+			frame->pts = pos - frame->nb_samples;
+		} else {
+			/* flush the frames still inside the encoder */
+			in = NULL;
+		}
+
+		av_init_packet(&packet);
+		packet.data = NULL;
+		packet.size = 0;
+
+		start = av_gettime_relative();
+		if (avcodec_encode_audio2(encoder, &packet, in,
+					&got_packet) < 0)
+			goto fail;
+		if (in) {
+			encode_time += av_gettime_relative() - start;
+			frames++;
+		}
+
+		if (!got_packet) {
+			if (!in)
+				break;
+			continue;
+		}
+
+		decode_packet(decoder, &packet, decoded);
+		av_packet_unref(&packet);
+	}
+
+	result->frame_size     = encoder->frame_size;
+	result->reported_delay = encoder->initial_padding;
+	result->measured_delay = find_lag();
+	result->encode_us      = (double)encode_time / frames;
+	success = true;
+
+fail:
+	av_frame_free(&decoded);
+	av_frame_free(&frame);
+	avcodec_free_context(&decoder);
+	avcodec_free_context(&encoder);
+	return success;
+}
+
+int main(void)
+{
+	static const char *applications[] = {"audio", "voip", "lowdelay"};
+	static const char *durations[] = {"2.5", "5", "10", "20"};
+	int failures = 0;
+
+	avcodec_register_all();
+	generate_input();
+
+	if (!avcodec_find_encoder_by_name("libopus")) {
+		printf("libavcodec was built without libopus, skipping\n");
+		free(input);
+		return EXIT_SUCCESS;
+	}
+
+	printf("%-9s %6s %8s %9s %9s %9s %9s\n", "app", "frame", "samples",
+			"reported", "measured", "latency", "encode");
+
+	for (size_t a = 0; a < 3; a++) {
+		for (size_t d = 0; d < 4; d++) {
+			struct result r = {0};
+			double frame_ms, reported_ms, measured_ms;
+			bool ok;
+
+			if (!measure(applications[a], durations[d], &r)) {
+				printf("%-9s %6s failed to encode\n",
+						applications[a], durations[d]);
+				failures++;
+				continue;
+			}
+
+			frame_ms    = r.frame_size * 1000.0 / SAMPLE_RATE;
+			reported_ms = r.reported_delay * 1000.0 / SAMPLE_RATE;
+			measured_ms = r.measured_delay * 1000.0 / SAMPLE_RATE;
+			ok = llabs(r.measured_delay - r.reported_delay) <=
+				LAG_TOLERANCE;
+
+			printf("%-9s %4sms %8d %7.2fms %7.2fms %7.2fms "
+					"%7.1fus%s\n",
+					applications[a], durations[d],
+					r.frame_size, reported_ms, measured_ms,
+					frame_ms + reported_ms, r.encode_us,
+					ok ? "" : "  (delay mismatch)");
+
+			if (!ok)
+				failures++;
+		}
+	}
+
+	free(output);
+	free(input);
+	return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
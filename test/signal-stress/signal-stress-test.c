@@ -0,0 +1,162 @@
+/*
+ * Connects and disconnects signal callbacks from several threads while other
+ * threads emit the signal as fast as they can.
+ *
+ * Once signal_handler_disconnect returns, the callback must not be called
+ * anymore, so the data of every disconnected callback is marked dead (and
+ * kept around) and any call that still reaches it is counted.  Some callbacks
+ * also disconnect themselves from inside the dispatch, which must not
+ * deadlock.  Reports how long disconnecting takes while the signal is busy.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <inttypes.h>
+#include <util/bmem.h>
+#include <util/platform.h>
+#include <util/threading.h>
+#include <callback/signal.h>
+
+#define DISPATCHERS 4
+#define WRITERS     2
+#define ITERATIONS  5000
+/* every fourth callback disconnects itself */
+#define DISCONNECTS (ITERATIONS - ITERATIONS / 4)
+
+#define ALIVE 0x600DF00D
+#define DEAD  0xDEADBEEF
+
+struct receiver {
+	volatile long magic;
+	volatile long calls;
+	bool          self_disconnect;
+};
+
+static signal_handler_t *handler;
+static signal_id_t signal_id;
+static volatile bool stop;
+
+static volatile long dead_calls;
+static volatile long dispatches;
+
+static struct receiver *receivers[WRITERS][ITERATIONS];
+static uint64_t disconnect_ns[WRITERS];
+
+static void callback(void *data, calldata_t *cd)
+{
+	struct receiver *r = data;
+
+	if (os_atomic_load_long(&r->magic) != ALIVE)
+		os_atomic_inc_long(&dead_calls);
+
+	if (os_atomic_inc_long(&r->calls) == 1 && r->self_disconnect)
+		signal_handler_disconnect(handler, "test", callback, r);
+
+	UNUSED_PARAMETER(cd);
+}
+
+static void *dispatch_thread(void *param)
+{
+	while (!os_atomic_load_bool(&stop)) {
+		signal_handler_signal_id(handler, signal_id, NULL);
+		os_atomic_inc_long(&dispatches);
+	}
+
+	UNUSED_PARAMETER(param);
+	return NULL;
+}
+
+static void *writer_thread(void *param)
+{
+	size_t idx = (size_t)param;
+	struct receiver *pending = NULL;
+
+	for (size_t i = 0; i < ITERATIONS; i++) {
+		struct receiver *r = bzalloc(sizeof(struct receiver));
+		uint64_t start;
+
+		r->magic = ALIVE;
+		r->self_disconnect = i % 4 == 0;
+		receivers[idx][i] = r;
+
+		signal_handler_connect(handler, "test", callback, r);
+
+		/* wait until it was called at least once */
+		while (!os_atomic_load_long(&r->calls))
+			os_sleep_ms(0);
+
+		/* a callback that disconnected itself can still be running
+		 * on other threads, until the next disconnect from outside a
+		 * dispatch has waited for them */
+		if (r->self_disconnect) {
+			pending = r;
+			continue;
+		}
+
+		start = os_gettime_ns();
+		signal_handler_disconnect(handler, "test", callback, r);
+		disconnect_ns[idx] += os_gettime_ns() - start;
+
+		os_atomic_set_long(&r->magic, DEAD);
+		if (pending) {
+			os_atomic_set_long(&pending->magic, DEAD);
+			pending = NULL;
+		}
+	}
+
+	return NULL;
+}
+
+int main(void)
+{
+	pthread_t dispatchers[DISPATCHERS];
+	pthread_t writers[WRITERS];
+	uint64_t total_ns = 0;
+	bool success = true;
+
+	handler = signal_handler_create();
+	signal_handler_add(handler, "void test()");
+	signal_id = signal_get_id("test");
+
+	for (size_t i = 0; i < DISPATCHERS; i++)
+		pthread_create(&dispatchers[i], NULL, dispatch_thread, NULL);
+	for (size_t i = 0; i < WRITERS; i++)
+		pthread_create(&writers[i], NULL, writer_thread, (void*)i);
+
+	for (size_t i = 0; i < WRITERS; i++)
+		pthread_join(writers[i], NULL);
+
+	os_atomic_set_bool(&stop, true);
+	for (size_t i = 0; i < DISPATCHERS; i++)
+		pthread_join(dispatchers[i], NULL);
+
+	for (size_t i = 0; i < WRITERS; i++)
+		total_ns += disconnect_ns[i];
+
+	if (dead_calls) {
+		printf("FAIL: %ld calls after disconnecting\n", dead_calls);
+		success = false;
+	}
+	if (signal_handler_has_callbacks(handler, signal_id)) {
+		printf("FAIL: callbacks left after disconnecting all\n");
+		success = false;
+	}
+
+	printf("%ld dispatches, %d disconnects, %.1f us per disconnect\n",
+			dispatches, WRITERS * DISCONNECTS,
+			(double)total_ns / (WRITERS * DISCONNECTS) / 1000.0);
+
+	signal_handler_destroy(handler);
+
+	for (size_t i = 0; i < WRITERS; i++) {
+		for (size_t j = 0; j < ITERATIONS; j++)
+			bfree(receivers[i][j]);
+	}
+
+	if (bnum_allocs() != 0) {
+		printf("FAIL: %ld allocations leaked\n", bnum_allocs());
+		success = false;
+	}
+
+	return success ? EXIT_SUCCESS : EXIT_FAILURE;
+}
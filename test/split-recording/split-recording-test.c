@@ -0,0 +1,228 @@
+/*
+ * Checks that the files of a split recording concatenate losslessly: every
+ * packet ends up in exactly one file, each file starts at zero with a
+ * keyframe, audio and video are rebased on the same point in time, and
+ * placing the files one after another restores the original timeline with no
+ * gap and no overlap.
+ *
+ * The packets are generated the way libobs hands them to an interleaved
+ * output, and split the same way obs-ffmpeg-mux does.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <inttypes.h>
+#include <util/darray.h>
+#include <obs.h>
+#include "obs-ffmpeg-split.h"
+
+#define FPS_NUM          30000
+#define FPS_DEN          1001
+#define KEYINT           60
+#define B_FRAME_DELAY    (2 * FPS_DEN)
+#define SAMPLE_RATE      48000
+#define AUDIO_FRAME_SIZE 1024
+#define NUM_FRAMES       3000
+#define SPLIT_USEC       (7 * 1000000LL)
+
+struct file_packet {
+	struct encoder_packet packet;
+	int64_t               orig_dts;
+	int64_t               orig_pts;
+	int64_t               orig_dts_usec;
+};
+
+struct split_file {
+	DARRAY(struct file_packet) packets;
+	struct split_offsets       offsets;
+	int64_t                    start_usec;
+};
+
+static DARRAY(struct split_file) files;
+static size_t packets_in;
+static int failures;
+
+#define check(cond, ...) \
+	do { \
+		if (!(cond)) { \
+			printf("FAIL: " __VA_ARGS__); \
+			printf("\n"); \
+			failures++; \
+		} \
+	} while (false)
+
+static inline int64_t dts_usec(const struct encoder_packet *packet)
+{
+	return packet->dts * 1000000 / packet->timebase_den;
+}
+
+static void make_video_packet(struct encoder_packet *packet, int64_t frame)
+{
+	memset(packet, 0, sizeof(*packet));
+	packet->type         = OBS_ENCODER_VIDEO;
+	packet->timebase_num = FPS_DEN;
+	packet->timebase_den = FPS_NUM;
+	packet->dts          = frame * FPS_DEN;
+	packet->pts          = packet->dts + B_FRAME_DELAY;
+	packet->keyframe     = (frame % KEYINT) == 0;
+	packet->dts_usec     = dts_usec(packet);
+}
+
+static void make_audio_packet(struct encoder_packet *packet, int64_t frame)
+{
+	memset(packet, 0, sizeof(*packet));
+	packet->type         = OBS_ENCODER_AUDIO;
+	packet->timebase_num = 1;
+	packet->timebase_den = SAMPLE_RATE;
+	packet->dts          = frame * AUDIO_FRAME_SIZE;
+	packet->pts          = packet->dts;
+	packet->keyframe     = true;
+	packet->dts_usec     = dts_usec(packet);
+}
+
+/* same rules as should_split/split_file in obs-ffmpeg-mux.c */
+static void mux_packet(struct encoder_packet *packet)
+{
+	struct split_file *file = files.num ? da_end(files) : NULL;
+	struct file_packet fp;
+
+	if (!file || (packet->type == OBS_ENCODER_VIDEO && packet->keyframe &&
+	    packet->dts_usec - file->start_usec >= SPLIT_USEC)) {
+		file = da_push_back_new(files);
+		file->start_usec = packet->dts_usec;
+		split_offsets_reset(&file->offsets, files.num > 1,
+				packet->dts_usec);
+	}
+
+	fp.packet        = *packet;
+	fp.orig_dts      = packet->dts;
+	fp.orig_pts      = packet->pts;
+	fp.orig_dts_usec = packet->dts_usec;
+	split_offsets_apply(&file->offsets, &fp.packet);
+	da_push_back(file->packets, &fp);
+
+	packets_in++;
+}
+
+static void check_file(size_t idx)
+{
+	struct split_file *file = files.array + idx;
+	bool found_video = false;
+	int64_t base_usec = idx ? file->start_usec : 0;
+
+	for (size_t i = 0; i < file->packets.num; i++) {
+		struct file_packet *fp = file->packets.array + i;
+		struct encoder_packet *pkt = &fp->packet;
+		int64_t tick_usec = 1000000 / pkt->timebase_den + 1;
+		int64_t rebased_usec = dts_usec(pkt);
+		int64_t expected_usec = fp->orig_dts_usec - base_usec;
+		int64_t offset = split_offsets_get(&file->offsets, pkt);
+
+		if (pkt->type == OBS_ENCODER_VIDEO && !found_video) {
+			check(pkt->keyframe, "file %zu does not start with a "
+					"keyframe", idx);
+			check(pkt->dts == 0, "file %zu starts video at %"PRId64,
+					idx, pkt->dts);
+			found_video = true;
+		}
+
+		/* both tracks are rebased on the same point in time */
+		check(llabs(rebased_usec - expected_usec) <= tick_usec,
+				"file %zu, packet %zu is out of sync by %"PRId64
+				" us", idx, i, rebased_usec - expected_usec);
+
+		/* placing the file at its start time restores the original
+		 * timestamps exactly */
+		check(pkt->dts + offset == fp->orig_dts &&
+		      pkt->pts + offset == fp->orig_pts,
+				"file %zu, packet %zu does not restore", idx, i);
+
+		/* nothing from before the cut leaks into the file */
+		check(pkt->dts_usec >= file->start_usec || idx == 0,
+				"file %zu, packet %zu is from before the cut",
+				idx, i);
+	}
+
+	check(found_video, "file %zu has no video", idx);
+}
+
+static void check_joins(void)
+{
+	for (size_t idx = 0; idx + 1 < files.num; idx++) {
+		struct split_file *file = files.array + idx;
+		struct split_file *next = files.array + idx + 1;
+		int64_t video_end = 0;
+		int64_t audio_end = 0;
+		int64_t next_audio_start = -1;
+
+		for (size_t i = 0; i < file->packets.num; i++) {
+			struct file_packet *fp = file->packets.array + i;
+
+			if (fp->packet.type == OBS_ENCODER_VIDEO)
+				video_end = fp->orig_dts + FPS_DEN;
+			else
+				audio_end = fp->orig_dts + AUDIO_FRAME_SIZE;
+		}
+
+		for (size_t i = 0; i < next->packets.num; i++) {
+			struct file_packet *fp = next->packets.array + i;
+
+			if (fp->packet.type == OBS_ENCODER_AUDIO) {
+				next_audio_start = fp->orig_dts;
+				break;
+			}
+		}
+
+		/* no gap and no overlap: each track continues in the next
+		 * file exactly where it stopped in the previous one */
+		check(video_end * 1000000 / FPS_NUM == next->start_usec,
+				"video gap at join %zu", idx);
+		check(audio_end == next_audio_start,
+				"audio gap or overlap at join %zu "
+				"(%"PRId64" -> %"PRId64")", idx,
+				audio_end, next_audio_start);
+	}
+}
+
+int main(void)
+{
+	int64_t video_frame = 0;
+	int64_t audio_frame = 0;
+	size_t packets_out = 0;
+
+	/* interleave the tracks by dts_usec, as obs_output does */
+	while (video_frame < NUM_FRAMES) {
+		struct encoder_packet video, audio;
+
+		make_video_packet(&video, video_frame);
+		make_audio_packet(&audio, audio_frame);
+
+		if (audio.dts_usec < video.dts_usec) {
+			mux_packet(&audio);
+			audio_frame++;
+		} else {
+			mux_packet(&video);
+			video_frame++;
+		}
+	}
+
+	check(files.num > 2, "expected several files, got %zu", files.num);
+
+	for (size_t i = 0; i < files.num; i++) {
+		check_file(i);
+		packets_out += files.array[i].packets.num;
+	}
+
+	check(packets_out == packets_in, "%zu packets in, %zu packets out",
+			packets_in, packets_out);
+	check_joins();
+
+	printf("%zu packets split into %zu files, %d failures\n",
+			packets_in, files.num, failures);
+
+	for (size_t i = 0; i < files.num; i++)
+		da_free(files.array[i].packets);
+	da_free(files);
+
+	return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
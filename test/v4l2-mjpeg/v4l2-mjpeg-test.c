@@ -0,0 +1,353 @@
+/*
+ * Feeds synthetic motion jpeg frames through the v4l2 decoder workers the
+ * way the capture thread does, with a small pool of capture buffers that are
+ * only reused once the decoder hands them back.  Every other frame is much
+ * more expensive to decode, so the workers finish out of order.  Checks that
+ * every frame comes out once, in capture order, with the image that belongs
+ * to its timestamp, and that every capture buffer is handed back.
+ *
+ * The decoder outputs through obs_source_output_video_ref, which is defined
+ * here to collect the frames instead of the one in libobs.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <time.h>
+
+#include <libavcodec/avcodec.h>
+
+#include <obs.h>
+#include <util/threading.h>
+#include "v4l2-mjpeg.h"
+
+#ifndef AV_INPUT_BUFFER_PADDING_SIZE
+#define AV_INPUT_BUFFER_PADDING_SIZE FF_INPUT_BUFFER_PADDING_SIZE
+#endif
+
+#define WIDTH        640
+#define HEIGHT       480
+#define FRAMES       120
+#define NUM_BUFFERS  4
+#define INTERVAL_NS  33333333ULL
+#define BAND_HEIGHT  64
+#define TIMEOUT_SEC  30
+
+struct capture_buffer {
+	uint8_t *data;
+	size_t  size;
+	bool    queued;
+};
+
+static AVPacket packets[FRAMES];
+static size_t max_packet_size;
+
+static struct capture_buffer buffers[NUM_BUFFERS];
+static pthread_mutex_t mutex;
+static pthread_cond_t cond;
+static int requeues;
+static int bad_requeues;
+
+static int outputs;
+static int out_of_order;
+static int wrong_image;
+static volatile long outputting;
+static int overlapping;
+
+/* the top band of each frame has a flat luma value that identifies it */
+static inline uint8_t frame_luma(int idx)
+{
+	return (uint8_t)(32 + (idx * 7) % 192);
+}
+
+/* ------------------------------------------------------------------------- */
+
+static void draw_frame(AVFrame *frame, int idx)
+{
+	uint32_t noise = 0x12345678 + idx;
+
+	for (int y = 0; y < frame->height; y++) {
+		uint8_t *row = frame->data[0] + y * frame->linesize[0];
+
+		for (int x = 0; x < frame->width; x++) {
+			if (y < BAND_HEIGHT || idx % 2 == 0) {
+				row[x] = frame_luma(idx);
+			} else {
+				noise = noise * 1103515245 + 12345;
+				row[x] = (uint8_t)(noise >> 16);
+			}
+		}
+	}
+
+	for (int plane = 1; plane < 3; plane++) {
+		for (int y = 0; y < frame->height / 2; y++)
+			memset(frame->data[plane] + y * frame->linesize[plane],
+					128, frame->width / 2);
+	}
+}
+
+static bool generate_frames(void)
+{
+	AVCodec *codec = avcodec_find_encoder(AV_CODEC_ID_MJPEG);
+	AVCodecContext *context;
+	AVFrame *frame;
+	bool success = false;
+	int i;
+
+	if (!codec)
+		return false;
+
+	context = avcodec_alloc_context3(codec);
+	context->width     = WIDTH;
+	context->height    = HEIGHT;
+	context->pix_fmt   = AV_PIX_FMT_YUVJ420P;
+	context->time_base = (AVRational){1, 30};
+
+	frame = av_frame_alloc();
+	frame->width  = WIDTH;
+	frame->height = HEIGHT;
+	frame->format = AV_PIX_FMT_YUVJ420P;
+
+	if (avcodec_open2(context, codec, NULL) < 0 ||
+	    av_frame_get_buffer(frame, 32) < 0)
+		goto fail;
+
+	for (i = 0; i < FRAMES; i++) {
+		int got_packet = 0;
+
+		av_init_packet(&packets[i]);
+		packets[i].data = NULL;
+		packets[i].size = 0;
+
+		av_frame_make_writable(frame);
+		draw_frame(frame, i);
+		frame->pts = i;
+
+		if (avcodec_encode_video2(context, &packets[i], frame,
+					&got_packet) < 0 || !got_packet)
+			goto fail;
+
+		if ((size_t)packets[i].size > max_packet_size)
+			max_packet_size = (size_t)packets[i].size;
+	}
+
+	success = true;
+
+fail:
+	av_frame_free(&frame);
+	avcodec_free_context(&context);
+	return success;
+}
+
+/* ------------------------------------------------------------------------- */
+
+void obs_source_output_video_ref(obs_source_t *source,
+		struct obs_source_frame *frame,
+		obs_source_frame_release_t release, void *param)
+{
+	int idx = (int)(frame->timestamp / INTERVAL_NS);
+	int luma = frame->data[0][(BAND_HEIGHT / 2) * frame->linesize[0] +
+		frame->width / 2];
+
+	UNUSED_PARAMETER(source);
+
+	if (os_atomic_inc_long(&outputting) != 1)
+		overlapping++;
+
+	pthread_mutex_lock(&mutex);
+
+	if (frame->timestamp != (uint64_t)outputs * INTERVAL_NS) {
+		printf("FAIL: frame %d output as frame %d\n", idx, outputs);
+		out_of_order++;
+	}
+	if (abs(luma - frame_luma(idx)) > 3) {
+		printf("FAIL: frame %d has the image of another frame\n", idx);
+		wrong_image++;
+	}
+	if (frame->width != WIDTH || frame->height != HEIGHT ||
+	    frame->format != VIDEO_FORMAT_I420) {
+		printf("FAIL: frame %d has the wrong format\n", idx);
+		wrong_image++;
+	}
+
+	outputs++;
+	pthread_cond_broadcast(&cond);
+	pthread_mutex_unlock(&mutex);
+
+	os_atomic_dec_long(&outputting);
+
+	/* libobs would hold the frame until it was drawn */
+	release(param, frame);
+}
+
+static void requeue(void *param, uint32_t index)
+{
+	UNUSED_PARAMETER(param);
+
+	pthread_mutex_lock(&mutex);
+
+	if (index >= NUM_BUFFERS || buffers[index].queued)
+		bad_requeues++;
+	else
+		buffers[index].queued = true;
+
+	requeues++;
+	pthread_cond_broadcast(&cond);
+	pthread_mutex_unlock(&mutex);
+}
+
+static void get_deadline(struct timespec *deadline)
+{
+	clock_gettime(CLOCK_REALTIME, deadline);
+	deadline->tv_sec += TIMEOUT_SEC;
+}
+
+/* the capture thread waits for the device to fill a queued buffer */
+static int dequeue(void)
+{
+	struct timespec deadline;
+	int index = -1;
+
+	get_deadline(&deadline);
+	pthread_mutex_lock(&mutex);
+
+	while (index < 0) {
+		for (int i = 0; i < NUM_BUFFERS && index < 0; i++) {
+			if (buffers[i].queued)
+				index = i;
+		}
+
+		if (index < 0 && pthread_cond_timedwait(&cond, &mutex,
+					&deadline) == ETIMEDOUT)
+			break;
+	}
+
+	if (index >= 0)
+		buffers[index].queued = false;
+
+	pthread_mutex_unlock(&mutex);
+	return index;
+}
+
+static bool wait_for_outputs(void)
+{
+	struct timespec deadline;
+	bool done;
+
+	get_deadline(&deadline);
+	pthread_mutex_lock(&mutex);
+
+	while (outputs < FRAMES) {
+		if (pthread_cond_timedwait(&cond, &mutex,
+					&deadline) == ETIMEDOUT)
+			break;
+	}
+
+	done = outputs == FRAMES;
+	pthread_mutex_unlock(&mutex);
+	return done;
+}
+
+/* ------------------------------------------------------------------------- */
+
+int main(void)
+{
+	v4l2_mjpeg_t *mjpeg;
+	int queued_after = 0;
+	int submitted = 0;
+	bool success = true;
+
+	pthread_mutex_init(&mutex, NULL);
+	pthread_cond_init(&cond, NULL);
+
+	avcodec_register_all();
+	av_log_set_level(AV_LOG_ERROR);
+
+	if (!generate_frames()) {
+		printf("failed to generate the test frames\n");
+		return EXIT_FAILURE;
+	}
+
+	for (int i = 0; i < NUM_BUFFERS; i++) {
+		buffers[i].size = max_packet_size +
+			AV_INPUT_BUFFER_PADDING_SIZE;
+		buffers[i].data = bmalloc(buffers[i].size);
+		buffers[i].queued = true;
+	}
+
+	mjpeg = v4l2_mjpeg_create(NULL, requeue, NULL);
+	if (!mjpeg) {
+		printf("failed to create the decoder\n");
+		return EXIT_FAILURE;
+	}
+
+	for (int i = 0; i < FRAMES; i++) {
+		int index = dequeue();
+		size_t buffer_size;
+
+		if (index < 0) {
+			printf("FAIL: no capture buffer was handed back\n");
+			success = false;
+			break;
+		}
+
+		memcpy(buffers[index].data, packets[i].data, packets[i].size);
+
+		/* every third frame leaves no room for the padding, which
+		 * makes the worker decode from a copy */
+		buffer_size = i % 3 == 0 ?
+			(size_t)packets[i].size : buffers[index].size;
+
+		if (!v4l2_mjpeg_decode(mjpeg, (uint32_t)index,
+				buffers[index].data, packets[i].size,
+				buffer_size, (uint64_t)i * INTERVAL_NS)) {
+			printf("FAIL: frame %d was not queued\n", i);
+			success = false;
+			break;
+		}
+
+		submitted++;
+	}
+
+	if (submitted == FRAMES && !wait_for_outputs()) {
+		printf("FAIL: only %d of %d frames were output\n", outputs,
+				FRAMES);
+		success = false;
+	}
+
+	v4l2_mjpeg_destroy(mjpeg);
+
+	for (int i = 0; i < NUM_BUFFERS; i++) {
+		if (buffers[i].queued)
+			queued_after++;
+	}
+
+	if (queued_after != NUM_BUFFERS || bad_requeues ||
+	    requeues != submitted) {
+		printf("FAIL: %d of %d buffers handed back, %d requeues for "
+				"%d frames, %d invalid\n", queued_after,
+				NUM_BUFFERS, requeues, submitted,
+				bad_requeues);
+		success = false;
+	}
+
+	if (out_of_order || wrong_image || overlapping)
+		success = false;
+
+	printf("%d frames, %d output, %d out of order, %d wrong images, "
+			"%d overlapping outputs\n", FRAMES, outputs,
+			out_of_order, wrong_image, overlapping);
+
+	for (int i = 0; i < NUM_BUFFERS; i++)
+		bfree(buffers[i].data);
+	for (int i = 0; i < FRAMES; i++)
+		av_packet_unref(&packets[i]);
+
+	pthread_cond_destroy(&cond);
+	pthread_mutex_destroy(&mutex);
+
+	return success ? EXIT_SUCCESS : EXIT_FAILURE;
+}